@@ -219,6 +219,17 @@ struct AsyncSocket {
       int fd;
    } passFd;
 
+   /*
+    * Optional read-ahead staging buffer; bytes [pos, len) of buf have been
+    * read from the socket but not yet handed to a recv request.
+    */
+   struct {
+      uint8 *buf;
+      int size;
+      int pos;
+      int len;
+   } readAhead;
+
    struct {
       char *origin;
       char *host;
@@ -320,7 +331,7 @@ void AsyncSocketUnlock(AsyncSocket *asock);
 Bool AsyncSocketIsLocked(AsyncSocket *asock);
 void AsyncSocketHandleError(AsyncSocket *asock, int asockErr);
 int AsyncSocketFillRecvBuffer(AsyncSocket *s);
-void AsyncSocketDispatchSentBuffer(AsyncSocket *s);
+void AsyncSocketDispatchSentBuffer(AsyncSocket *s, SendBufList **list);
 Bool AsyncSocketCheckAndDispatchRecv(AsyncSocket *s, int *error);
 int AsyncSocketSendInternal(AsyncSocket *asock, void *buf, int len,
                             AsyncSocketSendFn sendFn, void *clientData,
@@ -46,6 +46,10 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <stdarg.h>
+#if !defined(_WIN32) && defined(USE_SSL_DIRECT)
+#include <limits.h>
+#include <sys/uio.h>
+#endif
 
 #include "str.h"
 
@@ -106,6 +110,19 @@
  */
 #define ADDR_STRING_LEN (INET6_ADDRSTRLEN + 2 + PORT_STRING_LEN)
 
+/*
+ * Maximum number of queued send buffers handed to a single writev().
+ * Bounded by IOV_MAX, and kept small enough for the iovec array to live
+ * on the stack.
+ */
+#if !defined(_WIN32) && defined(USE_SSL_DIRECT)
+#if defined(IOV_MAX) && IOV_MAX < 64
+#define ASOCK_WRITEV_MAX IOV_MAX
+#else
+#define ASOCK_WRITEV_MAX 64
+#endif
+#endif
+
 /*
  * The slots each have a "unique" ID, which is just an incrementing integer.
  */
@@ -115,6 +132,7 @@ static Atomic_uint32 nextid = { 1 };
  * Local Functions
  */
 static Bool AsyncSocketHasDataPending(AsyncSocket *asock);
+static int AsyncSocketReadSocket(AsyncSocket *s, void *buf, int len);
 static int AsyncSocketMakeNonBlocking(int fd);
 static void AsyncSocketAcceptCallback(void *clientData);
 static void AsyncSocketConnectCallback(void *clientData);
@@ -2490,7 +2508,8 @@ AsyncSocketPoll(AsyncSocket *s,          // IN:
    }
 
    for (i = 0; i < numSock; i++) {
-      if (read && SSL_Pending(asock[i]->sslSock)) {
+      if (read && (SSL_Pending(asock[i]->sslSock) ||
+                   asock[i]->readAhead.pos < asock[i]->readAhead.len)) {
          *outAsock = asock[i];
          return ASOCKERR_SUCCESS;
       }
@@ -2730,7 +2749,7 @@ AsyncSocketBlockingWork(AsyncSocket *s,  // IN:
       }
 
       ASSERT(asock == s);
-      if ((numBytes = read ? SSL_Read(s->sslSock, buf, len)
+      if ((numBytes = read ? AsyncSocketReadSocket(s, buf, len)
                            : SSL_Write(s->sslSock, buf, len)) > 0) {
          if (completed) {
             *completed += numBytes;
@@ -3104,6 +3123,80 @@ AsyncSocketCheckAndDispatchRecv(AsyncSocket *s,  // IN
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * AsyncSocketReadSocket --
+ *
+ *      Reads up to len bytes from the socket into buf, going through the
+ *      read-ahead buffer if one is configured.
+ *
+ *      When the read-ahead buffer is empty and the request is smaller than
+ *      it, the buffer is refilled with one large read and the request is
+ *      served from memory; subsequent requests are served from the buffer
+ *      until it drains.  Larger requests bypass the buffer entirely.
+ *
+ *      Refills always use recvmsg so that a descriptor passed along with
+ *      the data is not lost; it is handed to the request that consumes the
+ *      first byte it arrived with, exactly as a direct read would have.
+ *
+ * Results:
+ *      Number of bytes read, 0 on EOF, -1 on error (as SSL_Read).
+ *
+ * Side effects:
+ *      May receive a passed fd into s->passFd.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static int
+AsyncSocketReadSocket(AsyncSocket *s,  // IN:
+                      void *buf,       // OUT:
+                      int len)         // IN:
+{
+   int fd = -1;
+   int recvd;
+
+   if (s->readAhead.pos == s->readAhead.len &&
+       (s->readAhead.size == 0 || len >= s->readAhead.size)) {
+      if (!s->passFd.expected) {
+         return SSL_Read(s->sslSock, buf, len);
+      }
+      recvd = SSL_RecvDataAndFd(s->sslSock, buf, len, &fd);
+      if (fd != -1) {
+         s->passFd.fd = fd;
+         s->passFd.expected = FALSE;
+      }
+      return recvd;
+   }
+
+   if (s->readAhead.pos == s->readAhead.len) {
+      recvd = SSL_RecvDataAndFd(s->sslSock, (char *) s->readAhead.buf,
+                                s->readAhead.size, &fd);
+      if (recvd <= 0) {
+         return recvd;
+      }
+      s->readAhead.pos = 0;
+      s->readAhead.len = recvd;
+   }
+
+   recvd = MIN(len, s->readAhead.len - s->readAhead.pos);
+   memcpy(buf, s->readAhead.buf + s->readAhead.pos, recvd);
+   s->readAhead.pos += recvd;
+
+   if (fd != -1) {
+      if (s->passFd.expected) {
+         s->passFd.fd = fd;
+         s->passFd.expected = FALSE;
+      } else {
+         SSLGeneric_close(fd);
+      }
+   }
+
+   return recvd;
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -3166,20 +3259,8 @@ AsyncSocketFillRecvBuffer(AsyncSocket *s)
        * Try to read the remaining bytes to complete the current recv request.
        */
 
-      if (s->passFd.expected) {
-         int fd;
-
-         recvd = SSL_RecvDataAndFd(s->sslSock,
-                                   (uint8 *) s->recvBuf + s->recvPos,
-                                   needed, &fd);
-         if (fd != -1) {
-            s->passFd.fd = fd;
-            s->passFd.expected = FALSE;
-         }
-      } else {
-         recvd = SSL_Read(s->sslSock, (uint8 *) s->recvBuf + s->recvPos,
-                          needed);
-      }
+      recvd = AsyncSocketReadSocket(s, (uint8 *) s->recvBuf + s->recvPos,
+                                    needed);
       ASOCKLOG(3, s, ("need\t%d\trecv\t%d\tremain\t%d\n", needed, recvd,
                       needed - recvd));
 
@@ -3211,20 +3292,20 @@ AsyncSocketFillRecvBuffer(AsyncSocket *s)
       /*
        * At this point, s->recvFoo have been updated to point to the
        * next chained Recv buffer. By default we're done at this
-       * point, but we may want to continue if the SSL socket has data
-       * buffered in userspace already (SSL_Pending).
+       * point, but we may want to continue if the SSL socket or the
+       * read-ahead buffer has data buffered in userspace already.
        */
 
       needed = s->recvLen - s->recvPos;
       ASSERT(needed > 0);
 
-      pending = SSL_Pending(s->sslSock);
+      pending = SSL_Pending(s->sslSock) + s->readAhead.len - s->readAhead.pos;
       needed = MIN(needed, pending);
 
    } while (needed);
 
    /*
-    * Reach this point only when previous SSL_Pending returns 0 or
+    * Reach this point only when nothing is pending in userspace or
     * error is ASOCK_EWOULDBLOCK
     */
 
@@ -3251,7 +3332,9 @@ exit:
  *
  * AsyncSocketDispatchSentBuffer --
  *
- *      Pop off the head of the send buffer list and call its callback.
+ *      Pop off the head of a list of sent buffers and call its callback.
+ *      The list is either the socket's send queue, or a list of buffers
+ *      already unlinked from it.
  *
  * Results:
  *      None.
@@ -3263,7 +3346,8 @@ exit:
  */
 
 void
-AsyncSocketDispatchSentBuffer(AsyncSocket *s)
+AsyncSocketDispatchSentBuffer(AsyncSocket *s,      // IN
+                              SendBufList **list)  // IN/OUT
 {
    /*
     * We're done with the current buffer, so pop it off and nuke it.
@@ -3271,14 +3355,16 @@ AsyncSocketDispatchSentBuffer(AsyncSocket *s)
     * consistent state.
     */
 
-   SendBufList *head = s->sendBufList;
+   SendBufList *head = *list;
    SendBufList tmp = *head;
 
-   s->sendBufList = head->next;
-   if (s->sendBufList == NULL) {
-      s->sendBufTail = &(s->sendBufList);
+   *list = head->next;
+   if (list == &(s->sendBufList)) {
+      if (s->sendBufList == NULL) {
+         s->sendBufTail = &(s->sendBufList);
+      }
+      s->sendPos = 0;
    }
-   s->sendPos = 0;
    free(tmp.base64Buf);
    free(head);
 
@@ -3320,6 +3406,10 @@ static int
 AsyncSocketWriteBuffers(AsyncSocket *s)
 {
    int result;
+#ifdef ASOCK_WRITEV_MAX
+   SendBufList *done = NULL;
+   SendBufList **doneTail = &done;
+#endif
 
    ASSERT(s->asockType != ASYNCSOCKET_TYPE_NAMEDPIPE);
    ASSERT(AsyncSocketIsLocked(s));
@@ -3336,6 +3426,94 @@ AsyncSocketWriteBuffers(AsyncSocket *s)
 
    AsyncSocketAddRef(s);
 
+#ifdef ASOCK_WRITEV_MAX
+   while (s->sendBufList && s->state == AsyncSocketConnected) {
+      struct iovec iov[ASOCK_WRITEV_MAX];
+      SendBufList *cur;
+      int iovcnt = 0;
+      int error = 0;
+      ssize_t sent;
+      ssize_t total = 0;
+
+      /*
+       * Gather as many queued buffers as fit into one writev(); the first
+       * one may already be partially written.
+       */
+
+      for (cur = s->sendBufList;
+           cur != NULL && iovcnt < ARRAYSIZE(iov);
+           cur = cur->next) {
+         uint8 *base = cur->base64Buf ? (uint8 *) cur->base64Buf
+                                      : (uint8 *) cur->buf;
+         int pos = iovcnt == 0 ? s->sendPos : 0;
+
+         iov[iovcnt].iov_base = base + pos;
+         iov[iovcnt].iov_len = cur->len - pos;
+         total += cur->len - pos;
+         iovcnt++;
+      }
+
+      sent = SSL_WriteV(s->sslSock, iov, iovcnt);
+      ASOCKLOG(3, s, ("bufs\t%d\tleft\t%"FMTSZ"d\tsent\t%"FMTSZ"d\n",
+                      iovcnt, total, sent));
+      if (sent > 0) {
+         s->sendBufFull = FALSE;
+         s->sslConnected = TRUE;
+
+         /*
+          * Unlink every buffer that went out completely and account for
+          * the partial one before firing any callback: a send callback
+          * can re-enter the send path (AsyncSocket_Flush, a low-latency
+          * AsyncSocket_Send), which must not see already written buffers
+          * still at the head of the queue.
+          */
+
+         while (sent > 0 && s->sendBufList != NULL) {
+            SendBufList *head = s->sendBufList;
+            int left = head->len - s->sendPos;
+
+            if (sent < left) {
+               s->sendPos += sent;
+               break;
+            }
+            sent -= left;
+            s->sendBufList = head->next;
+            if (s->sendBufList == NULL) {
+               s->sendBufTail = &(s->sendBufList);
+            }
+            s->sendPos = 0;
+            head->next = NULL;
+            *doneTail = head;
+            doneTail = &(head->next);
+         }
+
+         /*
+          * Now retire them in queue order. Their data is on the wire, so
+          * every callback fires even if an earlier one closes the socket.
+          */
+
+         while (done != NULL) {
+            AsyncSocketDispatchSentBuffer(s, &done);
+         }
+         doneTail = &done;
+      } else if (sent == 0) {
+         ASOCKLG0(s, ("socket write() should never return 0.\n"));
+         NOT_REACHED();
+      } else if ((error = ASOCK_LASTERROR()) != ASOCK_EWOULDBLOCK) {
+         ASOCKLG0(s, ("send error %d: %s\n", error, Err_Errno2String(error)));
+         s->genericErrno = error;
+         result = ASOCKERR_GENERIC;
+         goto exit;
+      } else {
+         /*
+          * Ran out of space to send; see below.
+          */
+
+         s->sendBufFull = TRUE;
+         break;
+      }
+   }
+#else
    while (s->sendBufList && s->state == AsyncSocketConnected) {
       SendBufList *head = s->sendBufList;
       int error = 0;
@@ -3356,7 +3534,7 @@ AsyncSocketWriteBuffers(AsyncSocket *s)
          s->sendBufFull = FALSE;
          s->sslConnected = TRUE;
          if ((s->sendPos += sent) == sizeToSend) {
-            AsyncSocketDispatchSentBuffer(s);
+            AsyncSocketDispatchSentBuffer(s, &(s->sendBufList));
          }
       } else if (sent == 0) {
          ASOCKLG0(s, ("socket write() should never return 0.\n"));
@@ -3379,6 +3557,7 @@ AsyncSocketWriteBuffers(AsyncSocket *s)
          break;
       }
    }
+#endif
 
    result = ASOCKERR_SUCCESS;
 
@@ -4592,7 +4771,8 @@ AsyncSocketDispatchConnect(AsyncSocket *asock,
 static Bool
 AsyncSocketHasDataPendingSocket(AsyncSocket *asock) // IN
 {
-   return SSL_Pending(asock->sslSock);
+   return SSL_Pending(asock->sslSock) ||
+          asock->readAhead.pos < asock->readAhead.len;
 }
 
 
@@ -5074,6 +5254,7 @@ AsyncSocketRelease(AsyncSocket *s,  // IN:
       if (s->vt && s->vt->release) {
          s->vt->release(s);
       }
+      free(s->readAhead.buf);
       free(s);
 
       return 0;
@@ -5744,3 +5925,58 @@ AsyncSocket_SetSendLowLatencyMode(AsyncSocket *asock,  // IN
 {
    asock->sendLowLatency = enable;
 }
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * AsyncSocket_SetReadAheadSize --
+ *
+ *    Stage receives on a stream socket through a read-ahead buffer of
+ *    'size' bytes.  Each refill is one large read from the socket and
+ *    successive AsyncSocket_Recv requests are satisfied from memory, so
+ *    length-prefixed protocols no longer need a read per header and per
+ *    payload.  A size of 0 turns read-ahead off again.
+ *
+ *    The buffer can only be resized or removed while it holds no unread
+ *    data, since that data has already been taken off the socket.
+ *
+ * Result
+ *    ASOCKERR_SUCCESS, or ASOCKERR_INVAL if the socket type does not
+ *    support read-ahead or buffered data would be discarded.
+ *
+ * Side-effects
+ *    Allocates or frees the staging buffer.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+AsyncSocket_SetReadAheadSize(AsyncSocket *asock,  // IN
+                             int size)            // IN
+{
+   int ret = ASOCKERR_SUCCESS;
+
+   if (asock == NULL || size < 0 ||
+       asock->asockType == ASYNCSOCKET_TYPE_NAMEDPIPE) {
+      return ASOCKERR_INVAL;
+   }
+
+   AsyncSocketLock(asock);
+
+   if (asock->readAhead.pos < asock->readAhead.len) {
+      ASOCKWARN(asock, ("cannot resize read-ahead buffer holding %d bytes\n",
+                        asock->readAhead.len - asock->readAhead.pos));
+      ret = ASOCKERR_INVAL;
+   } else if (size != asock->readAhead.size) {
+      free(asock->readAhead.buf);
+      asock->readAhead.buf = size > 0 ? Util_SafeMalloc(size) : NULL;
+      asock->readAhead.size = size;
+      asock->readAhead.pos = 0;
+      asock->readAhead.len = 0;
+   }
+
+   AsyncSocketUnlock(asock);
+
+   return ret;
+}
@@ -275,7 +275,7 @@ static void
 FreeStringList(char **strList,    // IN
                int32 *strLens)    // IN
 {
-   if (*strList != NULL) {
+   if (strList != NULL) {
       char **ptr;
       for (ptr = strList; *ptr != NULL; ptr++) {
          free(*ptr);
@@ -522,7 +522,7 @@ DecodeString(char **buf,         // IN/OUT
       return res;
    }
 
-   if (*left < *strLen) {
+   if (*strLen < 0 || *left < *strLen) {
       return DMERR_TRUNCATED_DATA;
    }
 
@@ -603,6 +603,12 @@ DecodeInt64List(char **buf,        // IN/OUT
 
    res = DecodeInt32(buf, left, &listLen);
 
+   /* do not allocate for more numbers than the buffer holds */
+   if (res == DMERR_SUCCESS &&
+       (listLen < 0 || *left / sizeof(int64) < listLen)) {
+      res = DMERR_TRUNCATED_DATA;
+   }
+
    if (res == DMERR_SUCCESS) {
       int32 i;
 
@@ -1434,6 +1440,11 @@ DecodeStringList(char **buf,           // IN
       return res;
    }
 
+   /* each string takes at least its length */
+   if (listSize < 0 || *left / sizeof(int32) < listSize) {
+      return DMERR_TRUNCATED_DATA;
+   }
+
    strList = (char **)calloc(listSize + 1, sizeof(char *));
    strLens = (int32 *)malloc(sizeof(int32) * listSize);
 
@@ -2488,3 +2499,840 @@ DataMap_ToString(const DataMap *that,               // IN
    }
 }
 
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMapWriter_Init --
+ *
+ *      Start encoding a DataMap into 'buf'.  Room for the payload length
+ *      is reserved at the start of the buffer; it is filled in by
+ *      DataMapWriter_Finish().
+ *
+ * Result:
+ *      0 on success
+ *      DMERR_BUFFER_TOO_SMALL if the buffer can not even hold the length.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMapWriter_Init(DataMapWriter *that,   // OUT
+                   char *buf,             // IN
+                   uint32 bufLen)         // IN
+{
+   if (that == NULL || buf == NULL) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   that->buf = buf;
+   that->cur = buf;
+   that->bufLen = bufLen;
+   that->result = DMERR_SUCCESS;
+
+   if (bufLen < sizeof(int32)) {
+      that->result = DMERR_BUFFER_TOO_SMALL;
+   } else {
+      that->cur += sizeof(int32);
+   }
+
+   return that->result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * WriterStartField --
+ *
+ *      - low level helper function to encode the type and field ID of an
+ *        entry, after checking that the buffer has room for them and
+ *        'valueLen' more bytes.
+ *
+ * Result:
+ *      0 on success
+ *      error code otherwise, which is also kept in the writer.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ErrorCode
+WriterStartField(DataMapWriter *that,   // IN/OUT
+                 DMFieldType type,      // IN
+                 DMKeyType fieldId,     // IN
+                 uint32 valueLen)       // IN
+{
+   uint32 left;
+
+   if (that == NULL) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   if (that->result != DMERR_SUCCESS) {
+      return that->result;
+   }
+
+   left = that->bufLen - (uint32)(that->cur - that->buf);
+   if (left < sizeof(int32) + sizeof(DMKeyType) ||
+       left - sizeof(int32) - sizeof(DMKeyType) < valueLen) {
+      that->result = DMERR_BUFFER_TOO_SMALL;
+      return that->result;
+   }
+
+   EncodeInt32(&that->cur, type);
+   EncodeInt32(&that->cur, fieldId);
+
+   return DMERR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMapWriter_PutInt64 --
+ *
+ *      Encode an integer field.
+ *
+ * Result:
+ *      0 on success
+ *      error code otherwise.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMapWriter_PutInt64(DataMapWriter *that,   // IN/OUT
+                       DMKeyType fieldId,     // IN
+                       int64 value)           // IN
+{
+   ErrorCode res;
+
+   res = WriterStartField(that, DMFIELDTYPE_INT64, fieldId, sizeof(int64));
+   if (res == DMERR_SUCCESS) {
+      EncodeInt64(&that->cur, value);
+   }
+
+   return res;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMapWriter_ReserveString --
+ *
+ *      Encode the header of a string field of 'strLen' bytes, and return
+ *      where the string goes in the buffer, so the caller can produce it
+ *      in place.
+ *
+ * Result:
+ *      0 on success
+ *      error code otherwise.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMapWriter_ReserveString(DataMapWriter *that,   // IN/OUT
+                            DMKeyType fieldId,     // IN
+                            int32 strLen,          // IN
+                            char **str)            // OUT
+{
+   ErrorCode res;
+
+   if (strLen < 0 || str == NULL) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   res = WriterStartField(that, DMFIELDTYPE_STRING, fieldId,
+                          sizeof(int32) + (uint32)strLen);
+   if (res == DMERR_SUCCESS) {
+      EncodeInt32(&that->cur, strLen);
+      *str = that->cur;
+      that->cur += strLen;
+   }
+
+   return res;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMapWriter_PutString --
+ *
+ *      Encode a string field.  The string is copied; if 'strLen' is -1,
+ *      'str' must be NUL terminated.
+ *
+ * Result:
+ *      0 on success
+ *      error code otherwise.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMapWriter_PutString(DataMapWriter *that,   // IN/OUT
+                        DMKeyType fieldId,     // IN
+                        const char *str,       // IN
+                        int32 strLen)          // IN
+{
+   ErrorCode res;
+   char *dst;
+
+   if (str == NULL) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   if (strLen < 0) {
+      strLen = (int32)strlen(str);
+   }
+
+   res = DataMapWriter_ReserveString(that, fieldId, strLen, &dst);
+   if (res == DMERR_SUCCESS) {
+      memcpy(dst, str, strLen);
+   }
+
+   return res;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMapWriter_PutInt64List --
+ *
+ *      Encode an integer list field.
+ *
+ * Result:
+ *      0 on success
+ *      error code otherwise.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMapWriter_PutInt64List(DataMapWriter *that,     // IN/OUT
+                           DMKeyType fieldId,       // IN
+                           const int64 *numList,    // IN
+                           int32 listLen)           // IN
+{
+   ErrorCode res;
+
+   if (listLen < 0 || (numList == NULL && listLen > 0)) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   if (listLen > (MAX_INT32 - sizeof(int32)) / sizeof(int64)) {
+      return DMERR_INTEGER_OVERFLOW;
+   }
+
+   res = WriterStartField(that, DMFIELDTYPE_INT64LIST, fieldId,
+                          sizeof(int32) + sizeof(int64) * listLen);
+   if (res == DMERR_SUCCESS) {
+      EncodeInt64List(&that->cur, (int64 *)numList, listLen);
+   }
+
+   return res;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMapWriter_PutStringList --
+ *
+ *      Encode a string list field, given as for DataMap_SetStringList():
+ *      a NULL terminated list of strings and their lengths.
+ *
+ * Result:
+ *      0 on success
+ *      error code otherwise.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMapWriter_PutStringList(DataMapWriter *that,    // IN/OUT
+                            DMKeyType fieldId,      // IN
+                            char **strList,         // IN
+                            int32 *strLens)         // IN
+{
+   ErrorCode res;
+   uint32 valueLen = sizeof(int32);
+   int32 listSize = 0;
+   int32 i;
+
+   if (strList == NULL || strLens == NULL) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   for (i = 0; strList[i] != NULL; i++) {
+      uint32 oldLen = valueLen;
+
+      if (strLens[i] < 0) {
+         return DMERR_INVALID_ARGS;
+      }
+      valueLen += sizeof(int32) + strLens[i];
+      if (valueLen < oldLen) {
+         return DMERR_INTEGER_OVERFLOW;
+      }
+      listSize++;
+   }
+
+   res = WriterStartField(that, DMFIELDTYPE_STRINGLIST, fieldId, valueLen);
+   if (res == DMERR_SUCCESS) {
+      EncodeInt32(&that->cur, listSize);
+      for (i = 0; i < listSize; i++) {
+         EncodeString(&that->cur, strList[i], strLens[i]);
+      }
+   }
+
+   return res;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMapWriter_Finish --
+ *
+ *      Complete the encoding by filling in the payload length.  The
+ *      buffer then holds what DataMap_Serialize() would produce for the
+ *      same fields, in the order they were put.
+ *
+ * Result:
+ *      0 on success, with the number of bytes used in *bufLen.
+ *      The first error hit by the writer otherwise.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMapWriter_Finish(DataMapWriter *that,   // IN/OUT
+                     uint32 *bufLen)        // OUT
+{
+   char *lenPtr;
+
+   if (that == NULL || bufLen == NULL) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   if (that->result != DMERR_SUCCESS) {
+      return that->result;
+   }
+
+   lenPtr = that->buf;
+   *bufLen = (uint32)(that->cur - that->buf);
+   EncodeInt32(&lenPtr, *bufLen - sizeof(int32));
+
+   return DMERR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ViewDecodeField --
+ *
+ *      - low level helper function to check one encoded entry and record
+ *        where its value is, without copying it.
+ *
+ * Result:
+ *      0 on success
+ *      error code otherwise.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ErrorCode
+ViewDecodeField(char **buf,                // IN/OUT
+                int32 *left,               // IN/OUT
+                DataMapViewField *field)   // OUT
+{
+   ErrorCode res;
+   int32 val;
+   int32 i;
+
+   res = DecodeInt32(buf, left, &val);     /* decode entry type */
+   if (res != DMERR_SUCCESS) {
+      return res;
+   }
+
+   if (val <= DMFIELDTYPE_EMPTY || val >= DMFIELDTYPE_MAX) {
+      return DMERR_UNKNOWN_TYPE;
+   }
+   field->type = (DMFieldType)val;
+
+   res = DecodeInt32(buf, left, &field->fieldId);   /* decode filedID */
+   if (res != DMERR_SUCCESS) {
+      return res;
+   }
+
+   if (field->type == DMFIELDTYPE_INT64) {
+      if (*left < sizeof(int64)) {
+         return DMERR_TRUNCATED_DATA;
+      }
+      field->count = 1;
+      field->value = *buf;
+      *buf += sizeof(int64);
+      *left -= sizeof(int64);
+      return DMERR_SUCCESS;
+   }
+
+   /* string length or list size */
+   res = DecodeInt32(buf, left, &field->count);
+   if (res != DMERR_SUCCESS) {
+      return res;
+   }
+   if (field->count < 0) {
+      return DMERR_TRUNCATED_DATA;
+   }
+   field->value = *buf;
+
+   switch (field->type) {
+      case DMFIELDTYPE_STRING:
+         if (*left < field->count) {
+            return DMERR_TRUNCATED_DATA;
+         }
+         *buf += field->count;
+         *left -= field->count;
+         break;
+      case DMFIELDTYPE_INT64LIST:
+         if (*left / sizeof(int64) < field->count) {
+            return DMERR_TRUNCATED_DATA;
+         }
+         *buf += field->count * sizeof(int64);
+         *left -= field->count * sizeof(int64);
+         break;
+      case DMFIELDTYPE_STRINGLIST:
+         for (i = 0; i < field->count; i++) {
+            int32 strLen;
+
+            res = DecodeInt32(buf, left, &strLen);
+            if (res != DMERR_SUCCESS) {
+               return res;
+            }
+            if (strLen < 0 || *left < strLen) {
+               return DMERR_TRUNCATED_DATA;
+            }
+            *buf += strLen;
+            *left -= strLen;
+         }
+         break;
+      default:
+         return DMERR_UNKNOWN_TYPE;
+   }
+
+   return DMERR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMapView_Init --
+ *
+ *      Initialize a view of a buffer produced by DataMap_Serialize() or
+ *      DataMapWriter_Finish().  Nothing is allocated and nothing needs to
+ *      be freed; the buffer must outlive the view.
+ *
+ * Result:
+ *      - 0 on success
+ *      - DMERR_BUFFER_TOO_SMALL if the map has more than
+ *        DATAMAP_VIEW_MAX_FIELDS fields; DataMap_Deserialize() still
+ *        handles those.
+ *      - other error codes as DataMap_Deserialize().
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMapView_Init(DataMapView *that,     // OUT
+                 const char *buf,       // IN
+                 int32 bufLen)          // IN
+{
+   ErrorCode res;
+   int32 left = bufLen;
+   int32 len;
+   char *p = (char *)buf;
+
+   if (that == NULL || buf == NULL || bufLen < 0) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   /* decode the encoded buffer length */
+   res = DecodeInt32(&p, &left, &len);
+   if (res != DMERR_SUCCESS) {
+      return res;
+   }
+
+   if (len < 0 || len > left) {
+      return DMERR_TRUNCATED_DATA;
+   }
+
+   return DataMapView_InitContent(that, p, len);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMapView_InitContent --
+ *
+ *      Initialize a view of the content of a serialized map, i.e. without
+ *      the leading payload length.  See DataMapView_Init().
+ *
+ * Result:
+ *      - 0 on success
+ *      - error code on failures.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMapView_InitContent(DataMapView *that,     // OUT
+                        const char *content,   // IN
+                        int32 contentLen)      // IN
+{
+   int32 left = contentLen;
+   char *buf = (char *)content;
+
+   if (that == NULL || content == NULL || contentLen < 0) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   that->numFields = 0;
+
+   while (left > 0) {
+      DataMapViewField *field;
+      ErrorCode res;
+      int32 i;
+
+      if (that->numFields == DATAMAP_VIEW_MAX_FIELDS) {
+         return DMERR_BUFFER_TOO_SMALL;
+      }
+
+      field = &that->fields[that->numFields];
+      res = ViewDecodeField(&buf, &left, field);
+      if (res != DMERR_SUCCESS) {
+         return res;
+      }
+
+      for (i = 0; i < that->numFields; i++) {
+         if (that->fields[i].fieldId == field->fieldId) {
+            return DMERR_DUPLICATED_FIELD_IDS;
+         }
+      }
+
+      that->numFields++;
+   }
+
+   return DMERR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * LookupViewField --
+ *
+ *      - low level helper function to find a field of a view.
+ *
+ * Result:
+ *      The field, or NULL if not found.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static const DataMapViewField *
+LookupViewField(const DataMapView *that,   // IN
+                DMKeyType fieldId)         // IN
+{
+   int32 i;
+
+   for (i = 0; i < that->numFields; i++) {
+      if (that->fields[i].fieldId == fieldId) {
+         return &that->fields[i];
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMapView_GetType --
+ *
+ *      Get the type of a field.
+ *
+ * Result:
+ *      The field type, DMFIELDTYPE_EMPTY if the field does not exist.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+DMFieldType
+DataMapView_GetType(const DataMapView *that,   // IN
+                    DMKeyType fieldId)         // IN
+{
+   const DataMapViewField *field;
+
+   if (that == NULL) {
+      return DMFIELDTYPE_EMPTY;
+   }
+
+   field = LookupViewField(that, fieldId);
+   return field == NULL ? DMFIELDTYPE_EMPTY : field->type;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMapView_GetInt64 --
+ *
+ *      Get an integer field.
+ *
+ * Result:
+ *      0 on success
+ *      error code otherwise.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMapView_GetInt64(const DataMapView *that,   // IN
+                     DMKeyType fieldId,         // IN
+                     int64 *value)              // OUT
+{
+   const DataMapViewField *field;
+   char *buf;
+   int32 left = sizeof(int64);
+
+   if (that == NULL || value == NULL) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   field = LookupViewField(that, fieldId);
+   if (field == NULL) {
+      return DMERR_NOT_FOUND;
+   }
+   if (field->type != DMFIELDTYPE_INT64) {
+      return DMERR_TYPE_MISMATCH;
+   }
+
+   buf = (char *)field->value;
+   return DecodeInt64(&buf, &left, value);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMapView_GetString --
+ *
+ *      Get a string field.  *str points into the viewed buffer and is not
+ *      NUL terminated.
+ *
+ * Result:
+ *      0 on success
+ *      error code otherwise.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMapView_GetString(const DataMapView *that,   // IN
+                      DMKeyType fieldId,         // IN
+                      const char **str,          // OUT
+                      int32 *strLen)             // OUT
+{
+   const DataMapViewField *field;
+
+   if (that == NULL || str == NULL || strLen == NULL) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   field = LookupViewField(that, fieldId);
+   if (field == NULL) {
+      return DMERR_NOT_FOUND;
+   }
+   if (field->type != DMFIELDTYPE_STRING) {
+      return DMERR_TYPE_MISMATCH;
+   }
+
+   *str = field->value;
+   *strLen = field->count;
+   return DMERR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMapView_GetInt64List --
+ *
+ *      Get an integer list field into a caller array.
+ *      - 'listLen': in, the size of 'numList'; out, the size of the list.
+ *
+ * Result:
+ *      0 on success
+ *      DMERR_BUFFER_TOO_SMALL if 'numList' can not hold the list.
+ *      error code otherwise.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMapView_GetInt64List(const DataMapView *that,   // IN
+                         DMKeyType fieldId,         // IN
+                         int64 *numList,            // OUT
+                         int32 *listLen)            // IN/OUT
+{
+   const DataMapViewField *field;
+   char *buf;
+   int32 left;
+   int32 size;
+   int32 i;
+
+   if (that == NULL || listLen == NULL) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   field = LookupViewField(that, fieldId);
+   if (field == NULL) {
+      return DMERR_NOT_FOUND;
+   }
+   if (field->type != DMFIELDTYPE_INT64LIST) {
+      return DMERR_TYPE_MISMATCH;
+   }
+
+   size = *listLen;
+   *listLen = field->count;
+   if (size < field->count || (numList == NULL && field->count > 0)) {
+      return DMERR_BUFFER_TOO_SMALL;
+   }
+
+   buf = (char *)field->value;
+   left = field->count * sizeof(int64);
+   for (i = 0; i < field->count; i++) {
+      DecodeInt64(&buf, &left, &numList[i]);
+   }
+
+   return DMERR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DataMapView_GetStringList --
+ *
+ *      Get a string list field: pointers into the viewed buffer and their
+ *      lengths are stored in caller arrays.
+ *      - 'listLen': in, the size of the arrays; out, the size of the list.
+ *
+ * Result:
+ *      0 on success
+ *      DMERR_BUFFER_TOO_SMALL if the arrays can not hold the list.
+ *      error code otherwise.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+ErrorCode
+DataMapView_GetStringList(const DataMapView *that,   // IN
+                          DMKeyType fieldId,         // IN
+                          const char **strList,      // OUT
+                          int32 *strLens,            // OUT
+                          int32 *listLen)            // IN/OUT
+{
+   const DataMapViewField *field;
+   char *buf;
+   int32 left = MAX_INT32;   /* lengths were checked by ViewDecodeField() */
+   int32 size;
+   int32 i;
+
+   if (that == NULL || listLen == NULL) {
+      return DMERR_INVALID_ARGS;
+   }
+
+   field = LookupViewField(that, fieldId);
+   if (field == NULL) {
+      return DMERR_NOT_FOUND;
+   }
+   if (field->type != DMFIELDTYPE_STRINGLIST) {
+      return DMERR_TYPE_MISMATCH;
+   }
+
+   size = *listLen;
+   *listLen = field->count;
+   if (size < field->count ||
+       ((strList == NULL || strLens == NULL) && field->count > 0)) {
+      return DMERR_BUFFER_TOO_SMALL;
+   }
+
+   buf = (char *)field->value;
+   for (i = 0; i < field->count; i++) {
+      DecodeInt32(&buf, &left, &strLens[i]);
+      strList[i] = buf;
+      buf += strLens[i];
+   }
+
+   return DMERR_SUCCESS;
+}
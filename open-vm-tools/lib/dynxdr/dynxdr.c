@@ -39,6 +39,7 @@
 typedef struct DynXdrData {
    DynBuf   data;
    Bool     freeMe;
+   Bool     inArena;
 } DynXdrData;
 
 /*
@@ -288,11 +289,10 @@ DynXdrInline(XDR *xdrs,                 // IN/OUT
 /*
  *-----------------------------------------------------------------------------
  *
- * DynXdr_Create --
+ * DynXdrCreateInt --
  *
- *    Creates a new XDR struct backed by a DynBuf. The XDR stream is created
- *    in XDR_ENCODE mode. The "in" argument is optional - if NULL, a new XDR
- *    structure will be allocated.
+ *    Common code for DynXdr_Create and DynXdr_CreateWithArena. If 'arena'
+ *    is not NULL, the stream state and buffer are allocated from it.
  *
  * Results:
  *    The XDR struct, or NULL on failure.
@@ -303,8 +303,9 @@ DynXdrInline(XDR *xdrs,                 // IN/OUT
  *-----------------------------------------------------------------------------
  */
 
-XDR *
-DynXdr_Create(XDR *in)  // IN
+static XDR *
+DynXdrCreateInt(XDR *in,              // IN
+                DynBufArena *arena)   // IN/OPT
 {
    static struct xdr_ops dynXdrOps = {
       /*
@@ -345,13 +346,22 @@ DynXdr_Create(XDR *in)  // IN
       ret = in;
    }
 
-   priv = malloc(sizeof *priv);
+   if (arena != NULL) {
+      priv = DynBufArena_Alloc(arena, sizeof *priv);
+   } else {
+      priv = malloc(sizeof *priv);
+   }
    if (priv == NULL) {
       goto error;
    }
 
    priv->freeMe = (in == NULL);
-   DynBuf_Init(&priv->data);
+   priv->inArena = (arena != NULL);
+   if (arena != NULL) {
+      DynBuf_InitWithArena(&priv->data, arena);
+   } else {
+      DynBuf_Init(&priv->data);
+   }
 
    ret->x_op = XDR_ENCODE;
    ret->x_public = NULL;
@@ -369,6 +379,60 @@ error:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynXdr_Create --
+ *
+ *    Creates a new XDR struct backed by a DynBuf. The XDR stream is created
+ *    in XDR_ENCODE mode. The "in" argument is optional - if NULL, a new XDR
+ *    structure will be allocated.
+ *
+ * Results:
+ *    The XDR struct, or NULL on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+XDR *
+DynXdr_Create(XDR *in)  // IN
+{
+   return DynXdrCreateInt(in, NULL);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynXdr_CreateWithArena --
+ *
+ *    Same as DynXdr_Create, but the stream's buffer is allocated from the
+ *    given arena, so short-lived streams need no heap allocation. The data
+ *    returned by DynXdr_Get belongs to the arena; use DynXdr_AllocGet to
+ *    get a heap copy that outlives it.
+ *
+ * Results:
+ *    The XDR struct, or NULL on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+XDR *
+DynXdr_CreateWithArena(XDR *in,              // IN
+                       DynBufArena *arena)   // IN
+{
+   ASSERT(arena != NULL);
+
+   return DynXdrCreateInt(in, arena);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -478,7 +542,9 @@ DynXdr_Destroy(XDR *xdrs,     // IN
       if (priv->freeMe) {
          free(xdrs);
       }
-      free(priv);
+      if (!priv->inArena) {
+         free(priv);
+      }
    }
 }
 
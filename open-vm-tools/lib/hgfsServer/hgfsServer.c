@@ -251,8 +251,11 @@ HgfsServerSessionCallbacks hgfsServerSessionCBTable = {
    HgfsServerSessionSendComplete,
 };
 
-/* Lock that protects shared folders list. */
-static MXUserExclLock *gHgfsSharedFoldersLock = NULL;
+/*
+ * Lock that protects shared folders list. Requests only look shares up;
+ * the list changes when the shares are reconfigured.
+ */
+static MXUserRWLock *gHgfsSharedFoldersLock = NULL;
 
 /* List of shared folders nodes. */
 static DblLnkLst_Links gHgfsSharedFoldersList;
@@ -1173,6 +1176,60 @@ exit:
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * HgfsHandleStartRead --
+ *
+ *    Look up the handle for a read of length bytes at offset. Get whether
+ *    the file was opened for sequential access, and whether the read
+ *    carries on from where the previous one on the handle stopped. The
+ *    read is recorded on the node in the same lookup, so a read takes the
+ *    node array lock once for both.
+ *
+ * Results:
+ *    TRUE on success, FALSE if the handle is invalid. A first read on the
+ *    handle is not sequential.
+ *
+ * Side effects:
+ *    Records the end of the read as where the next sequential one starts.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+HgfsHandleStartRead(HgfsHandle handle,         // IN: Hgfs file handle
+                    HgfsSessionInfo *session,  // IN: Session info
+                    uint64 offset,             // IN: offset of the read
+                    uint32 length,             // IN: bytes to read
+                    Bool *sequentialOpen,      // OUT: open was sequential
+                    Bool *sequentialRead)      // OUT: read is sequential
+{
+   HgfsFileNode *node;
+   Bool success = FALSE;
+
+   ASSERT(sequentialOpen);
+   ASSERT(sequentialRead);
+
+   MXUser_AcquireExclLock(session->nodeArrayLock);
+
+   node = HgfsHandle2FileNode(handle, session);
+   if (node == NULL) {
+      goto exit;
+   }
+
+   *sequentialOpen = (node->flags & HGFS_FILE_NODE_SEQUENTIAL_FL) != 0;
+   *sequentialRead = offset != 0 && offset == node->nextReadOffset;
+   node->nextReadOffset = offset + length;
+   success = TRUE;
+
+exit:
+   MXUser_ReleaseExclLock(session->nodeArrayLock);
+
+   return success;
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -1797,6 +1854,7 @@ HgfsAddNewFileNode(HgfsFileOpenInfo *openInfo,  // IN: open info struct
    newNode->shareAccess = (openInfo->mask & HGFS_OPEN_VALID_SHARE_ACCESS) ?
       openInfo->shareAccess : HGFS_DEFAULT_SHARE_ACCESS;
    newNode->flags = 0;
+   newNode->nextReadOffset = 0;
 
    if (append) {
       newNode->flags |= HGFS_FILE_NODE_APPEND_FL;
@@ -3512,7 +3570,7 @@ HgfsServerCleanupDeletedFolders(void)
 {
    DblLnkLst_Links *link, *nextElem;
 
-   MXUser_AcquireExclLock(gHgfsSharedFoldersLock);
+   MXUser_AcquireForWrite(gHgfsSharedFoldersLock);
    DblLnkLst_ForEachSafe(link, nextElem, &gHgfsSharedFoldersList) {
       HgfsSharedFolderProperties *folder =
          DblLnkLst_Container(link, HgfsSharedFolderProperties, links);
@@ -3527,7 +3585,7 @@ HgfsServerCleanupDeletedFolders(void)
          free(folder);
       }
    }
-   MXUser_ReleaseExclLock(gHgfsSharedFoldersLock);
+   MXUser_ReleaseRWLock(gHgfsSharedFoldersLock);
 }
 
 
@@ -3590,7 +3648,7 @@ HgfsServer_RegisterSharedFolder(const char *shareName,   // IN: shared folder na
       goto exit;
    }
 
-   MXUser_AcquireExclLock(gHgfsSharedFoldersLock);
+   MXUser_AcquireForWrite(gHgfsSharedFoldersLock);
 
    DblLnkLst_ForEachSafe(link, nextElem, &gHgfsSharedFoldersList) {
       HgfsSharedFolderProperties *folder =
@@ -3613,7 +3671,7 @@ HgfsServer_RegisterSharedFolder(const char *shareName,   // IN: shared folder na
          DblLnkLst_LinkLast(&gHgfsSharedFoldersList, &folder->links);
       }
    }
-   MXUser_ReleaseExclLock(gHgfsSharedFoldersLock);
+   MXUser_ReleaseRWLock(gHgfsSharedFoldersLock);
 
 exit:
    LOG(8, ("%s: %s, %s, %s exit %#x\n",__FUNCTION__,
@@ -3650,7 +3708,7 @@ HgfsServerGetShareHandle(const char *shareName)  // IN: name of the shared folde
       return HGFS_INVALID_FOLDER_HANDLE;
    }
 
-   MXUser_AcquireExclLock(gHgfsSharedFoldersLock);
+   MXUser_AcquireForRead(gHgfsSharedFoldersLock);
 
    DblLnkLst_ForEach(link, &gHgfsSharedFoldersList) {
       HgfsSharedFolderProperties *folder =
@@ -3660,7 +3718,7 @@ HgfsServerGetShareHandle(const char *shareName)  // IN: name of the shared folde
          break;
       }
    }
-   MXUser_ReleaseExclLock(gHgfsSharedFoldersLock);
+   MXUser_ReleaseRWLock(gHgfsSharedFoldersLock);
    return result;
 }
 
@@ -3695,7 +3753,7 @@ HgfsServerGetShareName(HgfsSharedFolderHandle sharedFolder, // IN: Notify handle
       return FALSE;
    }
 
-   MXUser_AcquireExclLock(gHgfsSharedFoldersLock);
+   MXUser_AcquireForRead(gHgfsSharedFoldersLock);
 
    DblLnkLst_ForEach(link, &gHgfsSharedFoldersList) {
       HgfsSharedFolderProperties *folder =
@@ -3707,7 +3765,7 @@ HgfsServerGetShareName(HgfsSharedFolderHandle sharedFolder, // IN: Notify handle
          break;
       }
    }
-   MXUser_ReleaseExclLock(gHgfsSharedFoldersLock);
+   MXUser_ReleaseRWLock(gHgfsSharedFoldersLock);
    return result;
 }
 
@@ -3753,8 +3811,8 @@ HgfsServer_InitState(HgfsServerSessionCallbacks **callbackTable,  // IN/OUT: our
    Atomic_Write(&gHgfsAsyncCounter, 0);
 
    DblLnkLst_Init(&gHgfsSharedFoldersList);
-   gHgfsSharedFoldersLock = MXUser_CreateExclLock("sharedFoldersLock",
-                                                  RANK_hgfsSharedFolders);
+   gHgfsSharedFoldersLock = MXUser_CreateReaderOptRWLock("sharedFoldersLock",
+                                                         RANK_hgfsSharedFolders);
    if (NULL != gHgfsSharedFoldersLock) {
       gHgfsAsyncLock = MXUser_CreateExclLock("asyncLock",
                                              RANK_hgfsSharedFolders);
@@ -3836,7 +3894,7 @@ HgfsServer_ExitState(void)
    }
 
    if (NULL != gHgfsSharedFoldersLock) {
-      MXUser_DestroyExclLock(gHgfsSharedFoldersLock);
+      MXUser_DestroyRWLock(gHgfsSharedFoldersLock);
       gHgfsSharedFoldersLock = NULL;
    }
 
@@ -163,6 +163,9 @@ typedef struct HgfsFileNode {
    /* File flags - see below. */
    uint32 flags;
 
+   /* Offset just past the last read, to recognize sequential reads. */
+   uint64 nextReadOffset;
+
    /*
     * Context as required by some file operations. Eg: BackupWrite on
     * Windows: BackupWrite requires the caller to hold on to a pointer
@@ -624,6 +627,14 @@ HgfsHandleIsSequentialOpen(HgfsHandle handle,        // IN:  Hgfs file handle
                            HgfsSessionInfo *session, // IN: session info
                            Bool *sequentialOpen);    // OUT: If open was sequential
 
+Bool
+HgfsHandleStartRead(HgfsHandle handle,         // IN: Hgfs file handle
+                    HgfsSessionInfo *session,  // IN: session info
+                    uint64 offset,             // IN: offset of the read
+                    uint32 length,             // IN: bytes to read
+                    Bool *sequentialOpen,      // OUT: open was sequential
+                    Bool *sequentialRead);     // OUT: read is sequential
+
 Bool
 HgfsHandleIsSharedFolderOpen(HgfsHandle handle,        // IN:  Hgfs file handle
                              HgfsSessionInfo *session, // IN: session info
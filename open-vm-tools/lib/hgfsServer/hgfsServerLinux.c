@@ -227,6 +227,17 @@ getdents_apple(DIR *fd,               // IN
 #endif
 
 
+#ifdef __linux__
+/*
+ * How far past a sequential positional read HgfsPlatformReadFile asks the
+ * kernel to start reading ahead. Clients such as the DnD/CP file transfer
+ * read whole files in order, one request at a time; this lets the disk fetch
+ * the next chunks while the current reply is still on its way to the client.
+ * Random reads are not hinted, so they don't pull in data nobody asked for.
+ */
+#define HGFS_READ_AHEAD_SIZE (1 << 20)
+#endif
+
 #if defined(sun) || defined(linux) || \
     (defined(__FreeBSD_version) && __FreeBSD_version < 490000)
 /*
@@ -4039,6 +4050,7 @@ HgfsPlatformReadFile(HgfsHandle file,             // IN: Hgfs file handle
    int error;
    HgfsInternalStatus status;
    Bool sequentialOpen;
+   Bool sequentialRead;
 
    ASSERT(session);
 
@@ -4054,7 +4066,8 @@ HgfsPlatformReadFile(HgfsHandle file,             // IN: Hgfs file handle
       return status;
    }
 
-   if (!HgfsHandleIsSequentialOpen(file, session, &sequentialOpen)) {
+   if (!HgfsHandleStartRead(file, session, offset, requiredSize,
+                            &sequentialOpen, &sequentialRead)) {
       LOG(4, ("%s: Could not get sequenial open status\n", __FUNCTION__));
       return EBADF;
    }
@@ -4065,6 +4078,13 @@ HgfsPlatformReadFile(HgfsHandle file,             // IN: Hgfs file handle
       error = read(fd, payload, requiredSize);
    } else {
       error = pread(fd, payload, requiredSize, offset);
+#ifdef __linux__
+      if (sequentialRead && error > 0 && (uint32)error == requiredSize) {
+         /* Only a hint: failure is harmless, so ignore it. */
+         (void)posix_fadvise(fd, offset + error, HGFS_READ_AHEAD_SIZE,
+                             POSIX_FADV_WILLNEED);
+      }
+#endif
    }
 #else
    /*
@@ -409,6 +409,11 @@ char *AsyncSocket_GetWebSocketCookie(AsyncSocket *asock);
  */
 void AsyncSocket_SetSendLowLatencyMode(AsyncSocket *asock, Bool enable);
 
+/*
+ * Stage receives through a read-ahead buffer of the given size (0 disables):
+ */
+int AsyncSocket_SetReadAheadSize(AsyncSocket *asock, int size);
+
 
 /*
  * Some logging macros for convenience
@@ -275,6 +275,9 @@ CodeSet_Init(const char *icuDataDir); // IN: ICU datafile directory in current p
 void
 CodeSet_DontUseIcu(void);
 
+void
+CodeSet_SetFastPath(Bool enable);  // IN
+
 Bool
 CodeSet_GenericToGenericDb(const char *codeIn,  // IN
                            const char *bufIn,   // IN
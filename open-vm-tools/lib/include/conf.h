@@ -54,6 +54,18 @@
 #define CONFNAME_DISABLETOOLSVERSION      "disable-tools-version"
 #define CONFNAME_DISABLEPMTIMERWARNING    "disable-pmtimerwarning"
 
+/**
+ * Time one in this many MXUser lock acquisitions to profile lock contention
+ * (0 disables). Results are returned by the "Lock_Contention" RPC.
+ */
+#define CONFNAME_LOCKCONTENTIONSAMPLERATE "lock-contention-sample-rate"
+
+/**
+ * Poll implementation for the service and its plugins: "gtk" (the default)
+ * or "epoll" (Linux only). Only read when the service starts.
+ */
+#define CONFNAME_POLLBACKEND              "poll-backend"
+
 
 /*
  ******************************************************************************
@@ -87,12 +99,50 @@
  */
 #define CONFNAME_GUESTINFO_POLLINTERVAL "poll-interval"
 
+/**
+ * Define the interval (in seconds) at which the guestlib stats are fetched
+ * from the host and published for libguestlib.
+ *
+ * @note Illegal values result in a @c g_warning and fallback to the default
+ * interval.
+ *
+ * @param int   User-defined interval.  0, the default, disables publishing;
+ *              each libguestlib consumer then queries the host itself.
+ */
+#define CONFNAME_GUESTINFO_GUESTLIBSTATSINTERVAL "guestlib-stats-interval"
+
 /*
  * END GuestInfo goodies.
  ******************************************************************************
  */
 
 
+/*
+ ******************************************************************************
+ * BEGIN TimeSync goodies.
+ */
+
+/**
+ * Defines the string used for the TimeSync config file group.
+ */
+#define CONFGROUPNAME_TIMESYNC "timeSync"
+
+/**
+ * Lets users have periodic time synchronization done by the servo, which
+ * estimates the guest's time error from several samples and corrects the
+ * guest clock's frequency, instead of slewing part of the error each
+ * period.
+ *
+ * @param bool  Set to TRUE to use the servo.
+ */
+#define CONFNAME_TIMESYNC_SERVO "servo"
+
+/*
+ * END TimeSync goodies.
+ ******************************************************************************
+ */
+
+
 /*
  ******************************************************************************
  * BEGIN Unity goodies.
@@ -80,6 +80,39 @@ typedef struct {
    const char *fieldName;
 } FieldIdNameEntry;
 
+/*
+ * DataMapWriter encodes fields straight into a caller supplied buffer, in
+ * the DataMap_Serialize() wire format, without building a DataMap first.
+ * Errors are sticky: once a Put fails, the following ones and
+ * DataMapWriter_Finish() return the same error.  The writer does not check
+ * for duplicated field IDs.
+ */
+typedef struct {
+   char *buf;            /* start of the caller's buffer */
+   char *cur;            /* where the next field goes */
+   uint32 bufLen;
+   ErrorCode result;
+} DataMapWriter;
+
+/*
+ * DataMapView decodes a serialized DataMap without copying: the getters
+ * return values that point into the serialized buffer, which must stay
+ * valid while the view is used.  Strings are not NUL terminated.
+ */
+#define DATAMAP_VIEW_MAX_FIELDS 32
+
+typedef struct {
+   DMKeyType fieldId;
+   DMFieldType type;
+   int32 count;          /* string length, or number of list elements */
+   const char *value;    /* encoded value, past the string/list length */
+} DataMapViewField;
+
+typedef struct {
+   DataMapViewField fields[DATAMAP_VIEW_MAX_FIELDS];
+   int32 numFields;
+} DataMapView;
+
 /*
  * Initializer
  */
@@ -169,6 +202,79 @@ DataMap_ToString(const DataMap *that,               // IN
                  int32 maxStrLen,                   // IN
                  char **buf);                       // OUT
 
+/*
+ * Writer
+ */
+
+ErrorCode
+DataMapWriter_Init(DataMapWriter *that,   // OUT
+                   char *buf,             // IN
+                   uint32 bufLen);        // IN
+ErrorCode
+DataMapWriter_PutInt64(DataMapWriter *that,   // IN/OUT
+                       DMKeyType fieldId,     // IN
+                       int64 value);          // IN
+ErrorCode
+DataMapWriter_PutString(DataMapWriter *that,   // IN/OUT
+                        DMKeyType fieldId,     // IN
+                        const char *str,       // IN
+                        int32 strLen);         // IN
+ErrorCode
+DataMapWriter_ReserveString(DataMapWriter *that,   // IN/OUT
+                            DMKeyType fieldId,     // IN
+                            int32 strLen,          // IN
+                            char **str);           // OUT
+ErrorCode
+DataMapWriter_PutInt64List(DataMapWriter *that,     // IN/OUT
+                           DMKeyType fieldId,       // IN
+                           const int64 *numList,    // IN
+                           int32 listLen);          // IN
+ErrorCode
+DataMapWriter_PutStringList(DataMapWriter *that,    // IN/OUT
+                            DMKeyType fieldId,      // IN
+                            char **strList,         // IN
+                            int32 *strLens);        // IN
+ErrorCode
+DataMapWriter_Finish(DataMapWriter *that,   // IN/OUT
+                     uint32 *bufLen);       // OUT
+
+/*
+ * View
+ */
+
+ErrorCode
+DataMapView_Init(DataMapView *that,     // OUT
+                 const char *buf,       // IN
+                 int32 bufLen);         // IN
+ErrorCode
+DataMapView_InitContent(DataMapView *that,     // OUT
+                        const char *content,   // IN
+                        int32 contentLen);     // IN
+
+DMFieldType
+DataMapView_GetType(const DataMapView *that,   // IN
+                    DMKeyType fieldId);        // IN
+ErrorCode
+DataMapView_GetInt64(const DataMapView *that,   // IN
+                     DMKeyType fieldId,         // IN
+                     int64 *value);             // OUT
+ErrorCode
+DataMapView_GetString(const DataMapView *that,   // IN
+                      DMKeyType fieldId,         // IN
+                      const char **str,          // OUT
+                      int32 *strLen);            // OUT
+ErrorCode
+DataMapView_GetInt64List(const DataMapView *that,   // IN
+                         DMKeyType fieldId,         // IN
+                         int64 *numList,            // OUT
+                         int32 *listLen);           // IN/OUT
+ErrorCode
+DataMapView_GetStringList(const DataMapView *that,   // IN
+                          DMKeyType fieldId,         // IN
+                          const char **strList,      // OUT
+                          int32 *strLens,            // OUT
+                          int32 *listLen);           // IN/OUT
+
 #ifdef __cplusplus
 }    /* end of extern "C"  */
 #endif
@@ -30,16 +30,56 @@
 #include "vm_assert.h"
 
 
+/*
+ * A DynBufArena hands out memory from caller-provided (typically stack)
+ * storage, spilling into heap chunks when that runs out. Everything is
+ * released at once by DynBufArena_Release. It is meant for short-lived
+ * request processing, where many small buffers share one lifetime.
+ */
+
+typedef struct DynBufArenaChunk DynBufArenaChunk;
+
+typedef struct DynBufArena {
+   char *cur;                  // Next free byte of the current chunk
+   char *end;                  // End of the current chunk
+   DynBufArenaChunk *chunks;   // Heap chunks, most recent first
+   char *storage;              // Caller-provided initial storage
+   size_t storageSize;
+} DynBufArena;
+
 typedef struct DynBuf {
    char *data;
    size_t size;
    size_t allocated;
+   Bool borrowed;        // data is caller storage or arena memory, not heap
+   DynBufArena *arena;   // Arena to grow into, or NULL for the heap
 } DynBuf;
 
 
 void
 DynBuf_Init(DynBuf *b); // IN
 
+void
+DynBuf_InitWithStorage(DynBuf *b,          // IN
+                       void *storage,      // IN
+                       size_t storageSize); // IN
+
+void
+DynBuf_InitWithArena(DynBuf *b,           // IN
+                     DynBufArena *arena); // IN
+
+void
+DynBufArena_Init(DynBufArena *arena,  // IN
+                 void *storage,       // IN/OPT
+                 size_t storageSize); // IN
+
+void *
+DynBufArena_Alloc(DynBufArena *arena,  // IN
+                  size_t size);        // IN
+
+void
+DynBufArena_Release(DynBufArena *arena); // IN
+
 void
 DynBuf_Destroy(DynBuf *b); // IN
 
@@ -88,6 +128,9 @@ DynBuf_SafeInternalAppend(DynBuf *b,            // IN
  *
  *      Retrieve a pointer to the data contained in a dynamic buffer --hpreg
  *
+ *      Buffers set up with DynBuf_InitWithStorage or DynBuf_InitWithArena
+ *      may not point to heap memory; use DynBuf_Detach to take ownership.
+ *
  * Results:
  *      The pointer to the data
  *
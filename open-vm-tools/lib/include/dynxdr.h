@@ -38,7 +38,10 @@
 #include <rpc/xdr.h>
 #include "vm_basic_types.h"
 
+struct DynBufArena;
+
 XDR *DynXdr_Create(XDR *in);
+XDR *DynXdr_CreateWithArena(XDR *in, struct DynBufArena *arena);
 Bool DynXdr_AppendRaw(XDR *xdrs, const void *buf, size_t len);
 void *DynXdr_AllocGet(XDR *xdrs);
 void *DynXdr_Get(XDR *xdrs);
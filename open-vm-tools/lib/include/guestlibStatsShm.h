@@ -0,0 +1,84 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * guestlibStatsShm.h --
+ *
+ *    Layout of the guestlib stats snapshot that vmtoolsd publishes for
+ *    libguestlib.
+ *
+ *    vmtoolsd fetches "guestlib.info.get" from the host once per interval
+ *    and copies the reply, as is, into a root-owned file that everybody
+ *    can map read-only.  libguestlib decodes the snapshot instead of going
+ *    to the host when the snapshot is present and fresh, so any number of
+ *    guestlib consumers cost one backdoor call per interval.
+ *
+ *    The file is updated in place under a sequence lock: the writer makes
+ *    'seq' odd, updates the rest of the segment, and makes 'seq' even
+ *    again.  A reader samples 'seq', copies what it needs, and retries if
+ *    'seq' was odd or has changed since.
+ */
+
+#ifndef _GUESTLIB_STATS_SHM_H_
+#define _GUESTLIB_STATS_SHM_H_
+
+#define INCLUDE_ALLOW_USERLEVEL
+#include "includeCheck.h"
+
+#include "vm_basic_types.h"
+#include "vm_basic_defs.h"
+#include "vm_basic_asm.h"
+#include "vm_atomic.h"
+
+#define GUESTLIB_STATS_SHM_PATH     "/var/run/vmware-guestlib-stats"
+#define GUESTLIB_STATS_SHM_MAGIC    0x53424c47  /* "GLBS" */
+#define GUESTLIB_STATS_SHM_VERSION  1
+#define GUESTLIB_STATS_SHM_SIZE     (64 * 1024)
+
+typedef struct GuestlibStatsShm {
+   uint32 magic;              /* GUESTLIB_STATS_SHM_MAGIC */
+   uint32 version;            /* GUESTLIB_STATS_SHM_VERSION */
+   Atomic_uint32 seq;         /* Odd while an update is in progress. */
+   uint32 interval;           /* Update interval, in seconds. */
+   uint64 updateTime;         /* Time of the last update, seconds (UTC). */
+   uint32 hostVersion;        /* Protocol version of 'reply'. */
+   uint32 replyLen;           /* 0: the host didn't provide stats. */
+   char reply[1];             /* The host's guestlib.info.get reply. */
+} GuestlibStatsShm;
+
+#define GUESTLIB_STATS_SHM_MAX_REPLY \
+   (GUESTLIB_STATS_SHM_SIZE - offsetof(GuestlibStatsShm, reply))
+
+/*
+ * The snapshot is considered stale, and readers go to the host, once it
+ * has missed this many updates.
+ */
+#define GUESTLIB_STATS_SHM_STALE_INTERVALS  3
+
+/*
+ * Orders the accesses to 'seq' and to the rest of the segment.  x86
+ * doesn't reorder loads with loads nor stores with stores, so keeping the
+ * compiler from doing it is enough there.
+ */
+#if defined(__i386__) || defined(__x86_64__)
+#define GUESTLIB_STATS_SHM_BARRIER()  COMPILER_MEM_BARRIER()
+#else
+#define GUESTLIB_STATS_SHM_BARRIER()  Atomic_MFence()
+#endif
+
+#endif /* _GUESTLIB_STATS_SHM_H_ */
@@ -75,6 +75,7 @@ typedef struct PollImpl {
 
 
 void Poll_InitWithImpl(const PollImpl *impl);
+Bool Poll_IsInitialized(void);
 
 /* Check if a PollClass is part of the set. */
 static INLINE Bool
@@ -31,6 +31,9 @@
 
 struct DynBuf;
 
+Bool StrUtil_GetNextTokenView(unsigned int *index, const char *str,
+                              const char *delimiters, const char **token,
+                              size_t *tokenLen);
 char *StrUtil_GetNextToken(unsigned int *index, const char *str,
                            const char *delimiters);
 Bool StrUtil_GetNextIntToken(int32 *out, unsigned int *index, const char *str,
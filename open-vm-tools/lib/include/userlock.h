@@ -120,6 +120,9 @@ void MXUser_DecRefRecLock(MXUserRecLock *lock);
 MXUserRWLock *MXUser_CreateRWLock(const char *name,
                                    MX_Rank rank);
 
+MXUserRWLock *MXUser_CreateReaderOptRWLock(const char *name,
+                                           MX_Rank rank);
+
 void MXUser_AcquireForRead(MXUserRWLock *lock);
 void MXUser_AcquireForWrite(MXUserRWLock *lock);
 void MXUser_ReleaseRWLock(MXUserRWLock *lock);
@@ -237,6 +240,27 @@ void MXUser_StatisticsControl(double contentionRatioFloor,
                               uint64 contentionDurationFloor);
 
 void MXUser_PerLockData(void);
+
+/*
+ * Sampled lock contention profiling. Unlike the statistics above this works
+ * in all builds and is cheap enough to leave enabled in production.
+ */
+
+#define MXUSER_CONTENTION_NAME_MAX 64
+
+typedef struct MXUserContentionInfo {
+   char    name[MXUSER_CONTENTION_NAME_MAX];  // Lock name (may be truncated)
+   uint64  sampled;                           // Sampled acquisitions
+   uint64  contended;                         // ... of which had to wait
+   uint64  waitTimeNS;                        // Time waited by those samples
+} MXUserContentionInfo;
+
+void MXUser_SetContentionSampling(uint32 sampleRate);
+uint32 MXUser_GetContentionSampling(void);
+uint32 MXUser_QueryContention(MXUserContentionInfo *topLocks,
+                              uint32 maxLocks,
+                              uint64 *totalAcquisitions);
+
 void MXUser_SetStatsFunc(void *context,
                          uint32 maxLineLength,
                          Bool trackHeldTime,
@@ -471,6 +471,45 @@ VMGuestLib_StatGet(const char *encoding,  // IN
                    size_t *replySize);    // OUT
 void VMGuestLib_StatFree(char *reply, size_t replySize);
 
+
+/*
+ * Batched semi-structured stats.
+ *
+ * VMGuestLib_StatGetBatch() fetches a list of stats, in one encoding,
+ * over a single channel to the hypervisor, and keeps the replies in a
+ * stat cache.  A stat fetched no more than 'maxStalenessMs' ago is
+ * answered from the cache without contacting the hypervisor; pass 0 to
+ * always fetch.
+ *
+ * results[i] is the result for stats[i].  The replies belong to the
+ * cache; they remain valid until the next VMGuestLib_StatGetBatch() on
+ * the same cache, or until the cache is closed.
+ *
+ * Concurrency/thread safety: as for handles, no locking is done
+ * internally; use one cache per thread, or lock around its use.
+ */
+
+struct _VMGuestLibStatCache;
+typedef struct _VMGuestLibStatCache* VMGuestLibStatCache;
+
+typedef struct VMGuestLibStatResult {
+   VMGuestLibError error;   // Result of fetching this stat
+   const char *reply;       // Reply, or error detail from the hypervisor
+   size_t replySize;        // Size of reply
+} VMGuestLibStatResult;
+
+VMGuestLibError
+VMGuestLib_StatCacheOpen(const char *encoding,        // IN
+                         VMGuestLibStatCache *cache); // OUT
+void VMGuestLib_StatCacheClose(VMGuestLibStatCache cache); // IN
+
+VMGuestLibError
+VMGuestLib_StatGetBatch(VMGuestLibStatCache cache,       // IN
+                        const char * const *stats,       // IN
+                        uint32 numStats,                 // IN
+                        uint32 maxStalenessMs,           // IN
+                        VMGuestLibStatResult *results);  // OUT
+
 #ifdef __cplusplus
 }
 #endif
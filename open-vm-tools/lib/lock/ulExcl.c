@@ -544,8 +544,7 @@ MXUser_AcquireExclLock(MXUserExclLock *lock)  // IN/OUT:
          }
       }
    } else {
-      MXRecLockAcquire(&lock->recursiveLock,
-                       NULL);  // non-stats
+      MXUserProfiledRecLockAcquire(&lock->header, &lock->recursiveLock);
    }
 
    if (vmx86_debug && (MXRecLockCount(&lock->recursiveLock) > 1)) {
@@ -454,14 +454,27 @@ typedef enum {
  * MXUser header - all MXUser objects start with this
  */
 
+/*
+ * Sampled contention profile of a lock. Only 1-in-N acquisitions (see
+ * MXUser_SetContentionSampling) update these, so they are cheap enough to
+ * be kept in every build.
+ */
+
+typedef struct MXUserProfileStats {
+   Atomic_uint64  sampled;     // Sampled acquisitions
+   Atomic_uint64  contended;   // Sampled acquisitions that had to wait
+   Atomic_uint64  waitTime;    // Time (ns) waited by the sampled acquisitions
+} MXUserProfileStats;
+
 typedef struct MXUserHeader {
-   uint32       signature;
-   char        *name;
-   MX_Rank      rank;
-   uint32       serialNumber;
-   void       (*dumpFunc)(struct MXUserHeader *);
-   void       (*statsFunc)(struct MXUserHeader *);
-   ListItem     item;
+   uint32              signature;
+   char               *name;
+   MX_Rank             rank;
+   uint32              serialNumber;
+   void              (*dumpFunc)(struct MXUserHeader *);
+   void              (*statsFunc)(struct MXUserHeader *);
+   ListItem            item;
+   MXUserProfileStats  profile;
 } MXUserHeader;
 
 
@@ -605,6 +618,80 @@ void MXUserForceHisto(Atomic_Ptr *histoPtr,
                       uint64 minValue,
                       uint32 decades);
 
+extern Atomic_uint32 mxUserProfileSampleRate;
+
+Bool MXUserProfileCountAcquisition(uint32 sampleRate);
+
+void MXUserProfileSample(MXUserHeader *header,
+                         Bool contended,
+                         VmTimeType waitTime);
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserProfileShouldSample --
+ *
+ *      Count an acquisition for contention profiling and decide whether to
+ *      time it. With profiling off this is a single load and branch.
+ *
+ * Results:
+ *      TRUE    Time this acquisition and report it via MXUserProfileSample
+ *      FALSE   Don't
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE Bool
+MXUserProfileShouldSample(void)
+{
+   uint32 sampleRate = Atomic_Read(&mxUserProfileSampleRate);
+
+   if (LIKELY(sampleRate == 0)) {
+      return FALSE;
+   }
+
+   return MXUserProfileCountAcquisition(sampleRate);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserProfiledRecLockAcquire --
+ *
+ *      Acquire the recursive lock behind an MXUser lock, timing the
+ *      acquisition if it is selected for contention profiling.
+ *
+ * Results:
+ *      The lock is acquired.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE void
+MXUserProfiledRecLockAcquire(MXUserHeader *header,  // IN/OUT:
+                             MXRecLock *lock)       // IN/OUT:
+{
+   if (LIKELY(!MXUserProfileShouldSample())) {
+      MXRecLockAcquire(lock,
+                       NULL);  // non-stats
+   } else if (MXRecLockTryAcquire(lock)) {
+      MXUserProfileSample(header, FALSE, 0);
+   } else {
+      VmTimeType waitTime;
+
+      MXRecLockAcquire(lock, &waitTime);
+      MXUserProfileSample(header, TRUE, waitTime);
+   }
+}
+
 extern void (*MXUserMX_LockRec)(struct MX_MutexRec *lock);
 extern void (*MXUserMX_UnlockRec)(struct MX_MutexRec *lock);
 extern Bool (*MXUserMX_TryLockRec)(struct MX_MutexRec *lock);
@@ -18,6 +18,8 @@
 
 #if defined(_WIN32)
 #include <windows.h>
+#else
+#include <unistd.h>
 #endif
 
 #include "vmware.h"
@@ -257,6 +259,25 @@ typedef struct
    Atomic_Ptr        histo;
 } MXUserHeldStats;
 
+/*
+ * Reader-optimized read-write locks.
+ *
+ * Readers announce themselves in one of a set of cache line sized counters
+ * picked by thread ID, so concurrent readers on different CPUs don't bounce
+ * a shared cache line. A writer takes writerLock, raises writerActive and
+ * then waits for every shard to drain; readers that see writerActive back
+ * out and queue behind writerLock. Writers are expensive - this flavor is
+ * for read-mostly data.
+ */
+
+#define MXUSER_RW_READER_SHARDS      32
+#define MXUSER_RW_WRITER_SPIN_LIMIT  1000
+
+typedef struct {
+   Atomic_uint32  readers;
+   uint8          pad[CACHELINE_SIZE - sizeof(Atomic_uint32)];
+} MXUserRWReaderShard;
+
 struct MXUserRWLock
 {
    MXUserHeader    header;
@@ -265,6 +286,14 @@ struct MXUserRWLock
    NativeRWLock    nativeLock;
    MXRecLock       recursiveLock;
 
+   Bool            readerOpt;     // Sharded reader counts
+   Bool            trackHolders;  // Maintain holderTable
+   MXRecLock       writerLock;    // readerOpt: serializes writers
+   Atomic_uint32   writerActive;  // readerOpt: readers must back off
+
+   MXUserRWReaderShard  *readerShards;     // readerOpt: aligned
+   void                 *readerShardsMem;  // readerOpt: allocated
+
    Atomic_uint32   holderCount;
    HashTable      *holderTable;
 
@@ -273,6 +302,262 @@ struct MXUserRWLock
 };
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserRWSharedReads --
+ *
+ *      Do readers of the specified lock hold it concurrently?
+ *
+ * Results:
+ *      TRUE   Yes
+ *      FALSE  No
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE Bool
+MXUserRWSharedReads(const MXUserRWLock *lock)  // IN:
+{
+   return lock->useNative || lock->readerOpt;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserRWReaderShardOf --
+ *
+ *      Return the reader shard of the calling thread. A thread always maps
+ *      to the same shard so a read release finds the count its acquire
+ *      made.
+ *
+ * Results:
+ *      As above.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE MXUserRWReaderShard *
+MXUserRWReaderShardOf(MXUserRWLock *lock)  // IN:
+{
+   uint32 shard = (uint32) VThread_CurID() % MXUSER_RW_READER_SHARDS;
+
+   return &lock->readerShards[shard];
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserRWReaderCount --
+ *
+ *      Return the number of readers of a reader-optimized lock. The value
+ *      is only a snapshot unless readers are held off by writerActive.
+ *
+ * Results:
+ *      As above.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint32
+MXUserRWReaderCount(MXUserRWLock *lock)  // IN:
+{
+   uint32 i;
+   uint32 count = 0;
+
+   for (i = 0; i < MXUSER_RW_READER_SHARDS; i++) {
+      count += Atomic_Read(&lock->readerShards[i].readers);
+   }
+
+   return count;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserReaderOptAcquire --
+ *
+ *      Acquire a reader-optimized lock in the specified mode.
+ *
+ *      A reader bumps its shard and, if no writer is active, is done. A
+ *      writer serializes on writerLock, raises writerActive and spins (then
+ *      sleeps) until all of the shards are empty.
+ *
+ * Results:
+ *      TRUE   The acquisition was contended
+ *      FALSE  The acquisition was not contended
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+MXUserReaderOptAcquire(MXUserRWLock *lock,  // IN/OUT:
+                       Bool forRead)        // IN:
+{
+   Bool contended = FALSE;
+
+   if (forRead) {
+      MXUserRWReaderShard *shard = MXUserRWReaderShardOf(lock);
+
+      while (TRUE) {
+         Atomic_Inc(&shard->readers);
+
+         if (LIKELY(Atomic_Read(&lock->writerActive) == 0)) {
+            break;
+         }
+
+         /*
+          * A writer is active or waiting for readers to drain. Get out of
+          * its way and queue behind it.
+          */
+
+         Atomic_Dec(&shard->readers);
+         contended = TRUE;
+
+         MXRecLockAcquire(&lock->writerLock,
+                          NULL);  // non-stats
+         MXRecLockRelease(&lock->writerLock);
+      }
+   } else {
+      uint32 i;
+
+      if (!MXRecLockTryAcquire(&lock->writerLock)) {
+         contended = TRUE;
+
+         MXRecLockAcquire(&lock->writerLock,
+                          NULL);  // non-stats
+      }
+
+      /* Full barrier: readers must see this before we look at the shards */
+      Atomic_ReadWrite(&lock->writerActive, 1);
+
+      for (i = 0; i < MXUSER_RW_READER_SHARDS; i++) {
+         uint32 spins = 0;
+
+         while (Atomic_Read(&lock->readerShards[i].readers) != 0) {
+            contended = TRUE;
+
+            if (spins++ < MXUSER_RW_WRITER_SPIN_LIMIT) {
+               PAUSE();
+            } else {
+#if defined(_WIN32)
+               Sleep(1);
+#else
+               usleep(10);
+#endif
+            }
+         }
+      }
+   }
+
+   return contended;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserReaderOptProfiledAcquire --
+ *
+ *      Acquire a reader-optimized lock in the specified mode, sampling the
+ *      acquisition for contention profiling when it is time to.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE void
+MXUserReaderOptProfiledAcquire(MXUserRWLock *lock,  // IN/OUT:
+                               Bool forRead)        // IN:
+{
+   if (LIKELY(!MXUserProfileShouldSample())) {
+      MXUserReaderOptAcquire(lock, forRead);
+   } else {
+      Bool contended;
+      VmTimeType begin = Hostinfo_SystemTimerNS();
+
+      contended = MXUserReaderOptAcquire(lock, forRead);
+
+      MXUserProfileSample(&lock->header, contended,
+                          contended ? Hostinfo_SystemTimerNS() - begin : 0);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserReaderOptRelease --
+ *
+ *      Release a reader-optimized lock held in the specified mode.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+MXUserReaderOptRelease(MXUserRWLock *lock,  // IN/OUT:
+                       Bool forRead)        // IN:
+{
+   if (forRead) {
+      Atomic_Dec(&MXUserRWReaderShardOf(lock)->readers);
+   } else {
+      Atomic_Write(&lock->writerActive, 0);
+      MXRecLockRelease(&lock->writerLock);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserReaderOptHoldsWrite --
+ *
+ *      Does the calling thread hold a reader-optimized lock for write?
+ *
+ * Results:
+ *      TRUE   Yes
+ *      FALSE  No
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+MXUserReaderOptHoldsWrite(const MXUserRWLock *lock)  // IN:
+{
+   return (MXRecLockCount(&lock->writerLock) > 0) &&
+          MXRecLockIsOwner(&lock->writerLock);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -524,6 +809,10 @@ MXUserDumpRWLock(MXUserHeader *header)  // IN:
 
    if (LIKELY(lock->useNative)) {
       Warning("\taddress of native lock 0x%p\n", &lock->nativeLock);
+   } else if (lock->readerOpt) {
+      Warning("\treaders %u\n", MXUserRWReaderCount(lock));
+      Warning("\twriter active %u\n", Atomic_Read(&lock->writerActive));
+      Warning("\twriter count %d\n", MXRecLockCount(&lock->writerLock));
    } else {
       Warning("\tcount %d\n", MXRecLockCount(&lock->recursiveLock));
    }
@@ -535,16 +824,12 @@ MXUserDumpRWLock(MXUserHeader *header)  // IN:
 /*
  *-----------------------------------------------------------------------------
  *
- * MXUser_CreateRWLock --
+ * MXUserCreateRWLock --
  *
- *      Create a read/write lock.
- *
- *      If native read-write locks are not available, a recursive lock will
- *      be used to provide one reader or one writer access... which is
- *      better than nothing.
+ *      Create a read/write lock of the specified flavor.
  *
  * Results:
- *      A pointer to a read/write lock.
+ *      A pointer to a read/write lock or NULL on failure.
  *
  * Side effects:
  *      None
@@ -552,21 +837,25 @@ MXUserDumpRWLock(MXUserHeader *header)  // IN:
  *-----------------------------------------------------------------------------
  */
 
-MXUserRWLock *
-MXUser_CreateRWLock(const char *userName,  // IN:
-                    MX_Rank rank)          // IN:
+static MXUserRWLock *
+MXUserCreateRWLock(const char *userName,  // IN:
+                   MX_Rank rank,          // IN:
+                   Bool readerOpt,        // IN:
+                   void *caller)          // IN:
 {
    Bool lockInited;
    char *properName;
-   Bool useNative = MXUserNativeRWSupported();
+   Bool useNative = !readerOpt && MXUserNativeRWSupported();
    MXUserRWLock *lock = Util_SafeCalloc(1, sizeof *lock);
 
    if (userName == NULL) {
-      if (LIKELY(useNative)) {
-         properName = Str_SafeAsprintf(NULL, "RW-%p", GetReturnAddress());
+      if (readerOpt) {
+         properName = Str_SafeAsprintf(NULL, "RWopt-%p", caller);
+      } else if (LIKELY(useNative)) {
+         properName = Str_SafeAsprintf(NULL, "RW-%p", caller);
       } else {
          /* emulated */
-         properName = Str_SafeAsprintf(NULL, "RWemul-%p", GetReturnAddress());
+         properName = Str_SafeAsprintf(NULL, "RWemul-%p", caller);
       }
    } else {
       properName = Util_SafeStrdup(userName);
@@ -588,12 +877,47 @@ MXUser_CreateRWLock(const char *userName,  // IN:
 
    lockInited = MXRecLockInit(&lock->recursiveLock);
 
+   if (LIKELY(lockInited) && readerOpt) {
+      lockInited = MXRecLockInit(&lock->writerLock);
+
+      if (LIKELY(lockInited)) {
+         uintptr_t addr;
+
+         lock->readerShardsMem = Util_SafeCalloc(1,
+                                     sizeof(MXUserRWReaderShard) *
+                                     MXUSER_RW_READER_SHARDS +
+                                     CACHELINE_SIZE);
+
+         addr = (uintptr_t) lock->readerShardsMem;
+         addr = (addr + CACHELINE_ALIGNMENT_MASK) & ~CACHELINE_ALIGNMENT_MASK;
+
+         lock->readerShards = (MXUserRWReaderShard *) addr;
+         lock->readerOpt = TRUE;
+      } else {
+         MXRecLockDestroy(&lock->recursiveLock);
+      }
+   }
+
    if (LIKELY(lockInited)) {
       uint32 statsMode;
 
-      lock->holderTable = HashTable_Alloc(256,
-                                          HASH_INT_KEY | HASH_FLAG_ATOMIC,
-                                          MXUserFreeHashEntry);
+      /*
+       * The holder table costs a hash lookup on every acquisition and
+       * release. Reader-optimized locks only keep it when something needs
+       * per-thread state: statistics or lock tracking.
+       */
+
+#if defined(MXUSER_DEBUG)
+      lock->trackHolders = TRUE;
+#else
+      lock->trackHolders = !readerOpt || vmx86_stats;
+#endif
+
+      if (lock->trackHolders) {
+         lock->holderTable = HashTable_Alloc(256,
+                                             HASH_INT_KEY | HASH_FLAG_ATOMIC,
+                                             MXUserFreeHashEntry);
+      }
 
       statsMode = MXUserStatsMode();
 
@@ -631,6 +955,71 @@ MXUser_CreateRWLock(const char *userName,  // IN:
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_CreateRWLock --
+ *
+ *      Create a read/write lock.
+ *
+ *      If native read-write locks are not available, a recursive lock will
+ *      be used to provide one reader or one writer access... which is
+ *      better than nothing.
+ *
+ * Results:
+ *      A pointer to a read/write lock.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+MXUserRWLock *
+MXUser_CreateRWLock(const char *userName,  // IN:
+                    MX_Rank rank)          // IN:
+{
+   return MXUserCreateRWLock(userName, rank, FALSE, GetReturnAddress());
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_CreateReaderOptRWLock --
+ *
+ *      Create a reader-optimized read/write lock.
+ *
+ *      Readers are tracked in per-thread-sharded counters rather than a
+ *      shared lock word, so read acquisitions scale with the number of
+ *      CPUs. When neither statistics nor lock tracking are enabled no
+ *      per-thread holder state is kept at all. Write acquisitions are
+ *      considerably more expensive than with MXUser_CreateRWLock; use this
+ *      for data that is read far more often than it is written.
+ *
+ *      The lock is used with the regular read-write lock routines. Without
+ *      holder tracking, MXUser_IsCurThreadHoldingRWLock can not tell the
+ *      calling thread's read hold from that of a thread sharing its reader
+ *      shard; it may return TRUE for MXUSER_RW_FOR_READ when the caller
+ *      holds nothing. That is fine for assertions that a lock is held.
+ *
+ * Results:
+ *      A pointer to a read/write lock.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+MXUserRWLock *
+MXUser_CreateReaderOptRWLock(const char *userName,  // IN:
+                             MX_Rank rank)          // IN:
+{
+   return MXUserCreateRWLock(userName, rank, TRUE, GetReturnAddress());
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -653,7 +1042,10 @@ MXUser_DestroyRWLock(MXUserRWLock *lock)  // IN:
    if (LIKELY(lock != NULL)) {
       MXUserValidateHeader(&lock->header, MXUSER_TYPE_RW);
 
-      if (Atomic_Read(&lock->holderCount) != 0) {
+      if ((Atomic_Read(&lock->holderCount) != 0) ||
+          (lock->readerOpt &&
+           ((MXUserRWReaderCount(lock) != 0) ||
+            (MXRecLockCount(&lock->writerLock) != 0)))) {
          MXUserDumpAndPanic(&lock->header,
                             "%s: Destroy on an acquired read-write lock\n",
                             __FUNCTION__);
@@ -672,6 +1064,11 @@ MXUser_DestroyRWLock(MXUserRWLock *lock)  // IN:
 
       MXRecLockDestroy(&lock->recursiveLock);
 
+      if (lock->readerOpt) {
+         MXRecLockDestroy(&lock->writerLock);
+         free(lock->readerShardsMem);
+      }
+
       MXUserRemoveFromList(&lock->header);
 
       if (vmx86_stats) {
@@ -697,7 +1094,10 @@ MXUser_DestroyRWLock(MXUserRWLock *lock)  // IN:
          }
       }
 
-      HashTable_FreeUnsafe(lock->holderTable);
+      if (lock->holderTable != NULL) {
+         HashTable_FreeUnsafe(lock->holderTable);
+      }
+
       free(lock->header.name);
       lock->header.name = NULL;
       free(lock);
@@ -775,6 +1175,14 @@ MXUserAcquisition(MXUserRWLock *lock,  // IN/OUT:
 
    MXUserAcquisitionTracking(&lock->header, TRUE);
 
+   if (UNLIKELY(!lock->trackHolders)) {
+      /* Reader-optimized lock with nothing to track: as fast as possible */
+      ASSERT(lock->readerOpt);
+      MXUserReaderOptProfiledAcquire(lock, forRead);
+
+      return;
+   }
+
    myContext = MXUserGetHolderContext(lock);
 
    if (UNLIKELY(myContext->state != RW_UNLOCKED)) {
@@ -792,7 +1200,12 @@ MXUserAcquisition(MXUserRWLock *lock,  // IN/OUT:
 
       acquireStats = Atomic_ReadPtr(&lock->acquireStatsMem);
 
-      if (lock->useNative) {
+      if (lock->readerOpt) {
+         VmTimeType begin = Hostinfo_SystemTimerNS();
+
+         value = MXUserReaderOptAcquire(lock, forRead) ?
+                 Hostinfo_SystemTimerNS() - begin : 0;
+      } else if (lock->useNative) {
          int err = 0;
          Bool contended;
          VmTimeType begin = Hostinfo_SystemTimerNS();
@@ -821,7 +1234,7 @@ MXUserAcquisition(MXUserRWLock *lock,  // IN/OUT:
           * necessary.
           */
 
-         if (forRead && lock->useNative) {
+         if (forRead && MXUserRWSharedReads(lock)) {
             MXRecLockAcquire(&lock->recursiveLock,
                              NULL);  // non-stats
          }
@@ -835,7 +1248,7 @@ MXUserAcquisition(MXUserRWLock *lock,  // IN/OUT:
             MXUserHistoSample(histo, value, GetReturnAddress());
          }
 
-         if (forRead && lock->useNative) {
+         if (forRead && MXUserRWSharedReads(lock)) {
             MXRecLockRelease(&lock->recursiveLock);
          }
 
@@ -846,22 +1259,35 @@ MXUserAcquisition(MXUserRWLock *lock,  // IN/OUT:
          }
       }
    } else {
-      if (LIKELY(lock->useNative)) {
+      if (lock->readerOpt) {
+         MXUserReaderOptProfiledAcquire(lock, forRead);
+      } else if (LIKELY(lock->useNative)) {
          int err = 0;
 
-         MXUserNativeRWAcquire(&lock->nativeLock, forRead, &err);
+         if (LIKELY(!MXUserProfileShouldSample())) {
+            MXUserNativeRWAcquire(&lock->nativeLock, forRead, &err);
+         } else {
+            Bool contended;
+            VmTimeType begin = Hostinfo_SystemTimerNS();
+
+            contended = MXUserNativeRWAcquire(&lock->nativeLock, forRead,
+                                              &err);
+
+            MXUserProfileSample(&lock->header, contended,
+                                contended ? Hostinfo_SystemTimerNS() - begin
+                                          : 0);
+         }
 
          if (UNLIKELY(err != 0)) {
             MXUserDumpAndPanic(&lock->header, "%s: Error %d\n",
                                __FUNCTION__, err);
          }
       } else {
-         MXRecLockAcquire(&lock->recursiveLock,
-                          NULL);  // non-stats
+         MXUserProfiledRecLockAcquire(&lock->header, &lock->recursiveLock);
       }
    }
 
-   if (!forRead || !lock->useNative) {
+   if (!forRead || !MXUserRWSharedReads(lock)) {
       ASSERT(Atomic_Read(&lock->holderCount) == 0);
    }
 
@@ -926,6 +1352,12 @@ MXUser_AcquireForWrite(MXUserRWLock *lock)  // IN/OUT:
  *
  *      Is the read-write lock held in the mode queried?
  *
+ *      For a lock from MXUser_CreateReaderOptRWLock without holder tracking
+ *      the answer for a read hold is approximate: it is TRUE whenever any
+ *      thread sharing the caller's reader shard holds the lock for read.
+ *      Use it only in ASSERTs that the lock is held, never in ASSERTs that
+ *      it is not, nor to decide what to do.
+ *
  * Results:
  *      TRUE   Yes
  *      FALSE  No
@@ -945,6 +1377,26 @@ MXUser_IsCurThreadHoldingRWLock(MXUserRWLock *lock,  // IN:
    ASSERT(lock);
    MXUserValidateHeader(&lock->header, MXUSER_TYPE_RW);
 
+   if (UNLIKELY(!lock->trackHolders)) {
+      Bool forWrite = MXUserReaderOptHoldsWrite(lock);
+      Bool forRead = !forWrite &&
+                     (Atomic_Read(&MXUserRWReaderShardOf(lock)->readers) != 0);
+
+      switch (queryType) {
+      case MXUSER_RW_FOR_READ:
+         return forRead;
+
+      case MXUSER_RW_FOR_WRITE:
+         return forWrite;
+
+      case MXUSER_RW_LOCKED:
+         return forRead || forWrite;
+
+      default:
+         Panic("%s: unknown query type %d\n", __FUNCTION__, queryType);
+      }
+   }
+
    myContext = MXUserGetHolderContext(lock);
 
    switch (queryType) {
@@ -987,6 +1439,19 @@ MXUser_ReleaseRWLock(MXUserRWLock *lock)  // IN/OUT:
    ASSERT(lock);
    MXUserValidateHeader(&lock->header, MXUSER_TYPE_RW);
 
+   if (UNLIKELY(!lock->trackHolders)) {
+      /*
+       * Readers never keep writerLock, so owning it means a write hold.
+       */
+
+      ASSERT(lock->readerOpt);
+
+      MXUserReleaseTracking(&lock->header);
+      MXUserReaderOptRelease(lock, !MXUserReaderOptHoldsWrite(lock));
+
+      return;
+   }
+
    myContext = MXUserGetHolderContext(lock);
 
    if (vmx86_stats) {
@@ -1001,7 +1466,8 @@ MXUser_ReleaseRWLock(MXUserRWLock *lock)  // IN/OUT:
           * when necessary
           */
 
-         if ((myContext->state == RW_LOCKED_FOR_READ) && lock->useNative) {
+         if ((myContext->state == RW_LOCKED_FOR_READ) &&
+             MXUserRWSharedReads(lock)) {
             MXRecLockAcquire(&lock->recursiveLock,
                              NULL);  // non-stats
          }
@@ -1014,7 +1480,8 @@ MXUser_ReleaseRWLock(MXUserRWLock *lock)  // IN/OUT:
             MXUserHistoSample(histo, duration, GetReturnAddress());
          }
 
-         if ((myContext->state == RW_LOCKED_FOR_READ) && lock->useNative) {
+         if ((myContext->state == RW_LOCKED_FOR_READ) &&
+             MXUserRWSharedReads(lock)) {
             MXRecLockRelease(&lock->recursiveLock);
          }
       }
@@ -1030,7 +1497,9 @@ MXUser_ReleaseRWLock(MXUserRWLock *lock)  // IN/OUT:
 
    Atomic_Dec(&lock->holderCount);
 
-   if (LIKELY(lock->useNative)) {
+   if (lock->readerOpt) {
+      MXUserReaderOptRelease(lock, myContext->state == RW_LOCKED_FOR_READ);
+   } else if (LIKELY(lock->useNative)) {
       int err = MXUserNativeRWRelease(&lock->nativeLock,
                                       myContext->state == RW_LOCKED_FOR_READ);
 
@@ -605,8 +605,7 @@ MXUser_AcquireRecLock(MXUserRecLock *lock)  // IN/OUT:
             }
          }
       } else {
-         MXRecLockAcquire(&lock->recursiveLock,
-                          NULL);  // non-stats
+         MXUserProfiledRecLockAcquire(&lock->header, &lock->recursiveLock);
       }
    }
 
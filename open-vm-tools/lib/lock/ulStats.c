@@ -1071,3 +1071,223 @@ MXUserAllocSerialNumber(void)
 
    return Atomic_ReadInc32(&firstFreeSerialNumber);
 }
+
+
+/*
+ * Contention profiling.
+ *
+ * Acquisitions are counted in sharded, cache line sized counters so that
+ * threads don't bounce a shared line on every lock operation. Shards are
+ * picked by thread ID, which spreads threads about as well as per-CPU
+ * counters would without needing to ask which CPU we are running on.
+ * Every sampleRate-th acquisition counted by a shard is timed and charged
+ * to its lock (see MXUserProfiledRecLockAcquire).
+ */
+
+#define MXUSER_PROFILE_SHARDS 32
+
+typedef struct {
+   Atomic_uint64  acquisitions;
+   uint8          pad[CACHELINE_SIZE - sizeof(Atomic_uint64)];
+} MXUserProfileShard;
+
+Atomic_uint32 mxUserProfileSampleRate;  // 0 is "off"
+static MXUserProfileShard mxUserProfileShards[MXUSER_PROFILE_SHARDS];
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserProfileCountAcquisition --
+ *
+ *      Count an acquisition in the calling thread's shard.
+ *
+ * Results:
+ *      TRUE if the acquisition should be sampled.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+MXUserProfileCountAcquisition(uint32 sampleRate)  // IN:
+{
+   uint32 shard = (uint32) VThread_CurID() % MXUSER_PROFILE_SHARDS;
+   uint64 count;
+
+   count = Atomic_ReadInc64(&mxUserProfileShards[shard].acquisitions);
+
+   return (count % sampleRate) == 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUserProfileSample --
+ *
+ *      Record a sampled acquisition of the specified lock.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+MXUserProfileSample(MXUserHeader *header,  // IN/OUT:
+                    Bool contended,        // IN:
+                    VmTimeType waitTime)   // IN:
+{
+   Atomic_Inc64(&header->profile.sampled);
+
+   if (contended) {
+      Atomic_Inc64(&header->profile.contended);
+      Atomic_Add64(&header->profile.waitTime, waitTime);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_SetContentionSampling --
+ *
+ *      Enable or disable sampled contention profiling. One in every
+ *      sampleRate acquisitions of exclusive, recursive and read-write locks
+ *      is timed; zero (0) disables profiling. Counts accumulated so far are
+ *      kept.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+MXUser_SetContentionSampling(uint32 sampleRate)  // IN:
+{
+   Atomic_Write(&mxUserProfileSampleRate, sampleRate);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_GetContentionSampling --
+ *
+ *      Return the contention profiling sample rate; zero (0) is "off".
+ *
+ * Results:
+ *      As above.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+uint32
+MXUser_GetContentionSampling(void)
+{
+   return Atomic_Read(&mxUserProfileSampleRate);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MXUser_QueryContention --
+ *
+ *      Report the most contended locks, ordered by the time spent waiting
+ *      for them in sampled acquisitions. Locks that were never seen
+ *      contended are not reported.
+ *
+ * Results:
+ *      The number of entries filled in topLocks (at most maxLocks).
+ *      The total number of acquisitions counted, if totalAcquisitions is
+ *      not NULL.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+uint32
+MXUser_QueryContention(MXUserContentionInfo *topLocks,    // OUT:
+                       uint32 maxLocks,                   // IN:
+                       uint64 *totalAcquisitions)         // OUT/OPT:
+{
+   uint32 i;
+   uint32 numLocks = 0;
+   MXRecLock *listLock = MXUserInternalSingleton(&mxLockMemPtr);
+
+   ASSERT(topLocks != NULL || maxLocks == 0);
+
+   if (totalAcquisitions != NULL) {
+      *totalAcquisitions = 0;
+
+      for (i = 0; i < MXUSER_PROFILE_SHARDS; i++) {
+         *totalAcquisitions +=
+                        Atomic_Read64(&mxUserProfileShards[i].acquisitions);
+      }
+   }
+
+   if (listLock == NULL || maxLocks == 0) {
+      return 0;
+   }
+
+   MXRecLockAcquire(listLock,
+                    NULL);  // non-stats
+
+   {
+      ListItem *entry;
+
+      LIST_SCAN(entry, mxUserLockList) {
+         MXUserHeader *header = LIST_CONTAINER(entry, MXUserHeader, item);
+         MXUserContentionInfo info;
+         uint32 pos;
+
+         info.contended = Atomic_Read64(&header->profile.contended);
+
+         if (info.contended == 0) {
+            continue;
+         }
+
+         info.sampled = Atomic_Read64(&header->profile.sampled);
+         info.waitTimeNS = Atomic_Read64(&header->profile.waitTime);
+
+         /* Insertion into the (short) sorted array of top locks. */
+         for (pos = numLocks;
+              pos > 0 && topLocks[pos - 1].waitTimeNS < info.waitTimeNS;
+              pos--) {
+            if (pos < maxLocks) {
+               topLocks[pos] = topLocks[pos - 1];
+            }
+         }
+
+         if (pos < maxLocks) {
+            /* Long names are truncated; that's fine for reporting. */
+            Str_Snprintf(info.name, sizeof info.name, "%s", header->name);
+            topLocks[pos] = info;
+
+            if (numLocks < maxLocks) {
+               numLocks++;
+            }
+         }
+      }
+   }
+
+   MXRecLockRelease(listLock);
+
+   return numLocks;
+}
@@ -62,6 +62,7 @@
 #   include <errno.h>
 #   include <su.h>
 #   include <sys/stat.h>
+#   include <pthread.h>
 #   include "hostinfo.h"
 #   include "hostType.h"
 #endif
@@ -71,6 +72,9 @@
 #endif
 
 #include <stdio.h>
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
 #include "vmware.h"
 #include "vm_product.h"
 #include "vm_atomic.h"
@@ -133,6 +137,7 @@
  */
 
 static Bool dontUseIcu = TRUE;
+static Bool useFastPath = TRUE;
 
 
 /*
@@ -365,6 +370,32 @@ CodeSet_DontUseIcu(void)
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSet_SetFastPath --
+ *
+ *    Enable or disable the native UTF-8/UTF-16LE/US-ASCII conversion and
+ *    validation paths (enabled by default). With them disabled, every
+ *    conversion goes through ICU or iconv, which is what benchmarks
+ *    compare the native paths against.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    See above
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+CodeSet_SetFastPath(Bool enable)  // IN
+{
+   useFastPath = enable;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -858,6 +889,729 @@ CodeSet_Utf8Normalize(const char *bufIn,     // IN
 #endif /* defined(__APPLE__) */
 
 
+/*
+ * The fast paths below handle the UTF-8, UTF-16LE and US-ASCII conversions
+ * that make up nearly all traffic (file names, DnD/copy-paste text, Unicode
+ * string allocations) without going through ICU or iconv. Anything they
+ * cannot handle strictly (invalid input, other encodings) is left to the
+ * generic code, which preserves the CSGTG_* error semantics.
+ */
+
+typedef enum {
+   CODESET_FAST_NONE,
+   CODESET_FAST_ASCII,
+   CODESET_FAST_UTF8,
+   CODESET_FAST_UTF16LE,
+} CodeSetFastEncoding;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetGetFastEncoding --
+ *
+ *    Map an encoding name onto one of the encodings with a native
+ *    conversion path.
+ *
+ * Results:
+ *    The fast encoding, or CODESET_FAST_NONE if there is none or the
+ *    native paths are disabled.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static CodeSetFastEncoding
+CodeSetGetFastEncoding(const char *code)  // IN
+{
+   if (!useFastPath) {
+      return CODESET_FAST_NONE;
+   }
+   if (Str_Strcasecmp(code, "UTF-8") == 0 ||
+       Str_Strcasecmp(code, "UTF8") == 0) {
+      return CODESET_FAST_UTF8;
+   }
+   if (Str_Strcasecmp(code, "UTF-16LE") == 0) {
+      return CODESET_FAST_UTF16LE;
+   }
+   if (Str_Strcasecmp(code, "US-ASCII") == 0 ||
+       Str_Strcasecmp(code, "ASCII") == 0 ||
+       Str_Strcasecmp(code, "ANSI_X3.4-1968") == 0) {
+      return CODESET_FAST_ASCII;
+   }
+
+   return CODESET_FAST_NONE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetAsciiSpan --
+ *
+ *    Count the leading 7-bit ASCII bytes in a buffer. Scans 16 bytes at a
+ *    time with SSE2 where available, and 8 bytes at a time otherwise.
+ *
+ * Results:
+ *    Number of leading bytes < 0x80.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static size_t
+CodeSetAsciiSpan(const uint8 *buf,  // IN
+                 size_t size)       // IN
+{
+   size_t i = 0;
+
+#if defined(__SSE2__)
+   while (i + 16 <= size) {
+      __m128i v = _mm_loadu_si128((const __m128i *) (buf + i));
+
+      if (_mm_movemask_epi8(v) != 0) {
+         break;
+      }
+      i += 16;
+   }
+#endif
+
+   while (i + 8 <= size) {
+      uint64 word;
+
+      memcpy(&word, buf + i, sizeof word);
+      if ((word & CONST64U(0x8080808080808080)) != 0) {
+         break;
+      }
+      i += 8;
+   }
+
+   while (i < size && buf[i] < 0x80) {
+      i++;
+   }
+
+   return i;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetFastValidateUtf8 --
+ *
+ *    Strictly validate UTF-8: no overlong forms, no surrogates, nothing
+ *    above U+10FFFF. ASCII runs are skipped with CodeSetAsciiSpan.
+ *
+ * Results:
+ *    TRUE if the buffer is valid UTF-8.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+CodeSetFastValidateUtf8(const uint8 *buf,  // IN
+                        size_t size)       // IN
+{
+   const uint8 *p = buf;
+   const uint8 *end = buf + size;
+
+   while (p < end) {
+      uint32 c;
+      int len;
+
+      p += CodeSetAsciiSpan(p, end - p);
+      if (p == end) {
+         break;
+      }
+
+      len = CodeSet_GetUtf8((const char *) p, (const char *) end, &c);
+      if (len == 0 || (c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF) {
+         return FALSE;
+      }
+      p += len;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetFastReserve --
+ *
+ *    Make sure 'db' has room for 'extra' more bytes past its current size.
+ *
+ * Results:
+ *    Pointer to the first free byte, or NULL on overflow/allocation failure.
+ *
+ * Side effects:
+ *    May reallocate the DynBuf.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static uint8 *
+CodeSetFastReserve(DynBuf *db,    // IN/OUT
+                   size_t extra)  // IN
+{
+   size_t size = DynBuf_GetSize(db);
+   size_t needed = size + extra;
+
+   if (needed < size) {  // Prevent integer overflow
+      return NULL;
+   }
+
+   if (needed > DynBuf_GetAllocatedSize(db) && !DynBuf_Enlarge(db, needed)) {
+      return NULL;
+   }
+
+   return (uint8 *) DynBuf_Get(db) + size;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetFastUtf8ToUtf16le --
+ *
+ *    Convert UTF-8 (or ASCII, when 'asciiOnly') to UTF-16LE. ASCII runs are
+ *    widened 16 bytes at a time with SSE2 where available.
+ *
+ * Results:
+ *    Number of bytes written, or -1 if the input is not strictly valid.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ssize_t
+CodeSetFastUtf8ToUtf16le(const uint8 *bufIn,  // IN
+                         size_t sizeIn,       // IN
+                         Bool asciiOnly,      // IN
+                         uint8 *bufOut)       // OUT: at least 2 * sizeIn
+{
+   const uint8 *p = bufIn;
+   const uint8 *end = bufIn + sizeIn;
+   uint8 *out = bufOut;
+
+   while (p < end) {
+      size_t ascii;
+      uint32 c;
+      int len;
+
+      /* Only look for an ASCII run where one starts. */
+      if (*p < 0x80) {
+#if defined(__SSE2__)
+         while (end - p >= 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *) p);
+            __m128i zero = _mm_setzero_si128();
+
+            if (_mm_movemask_epi8(v) != 0) {
+               break;
+            }
+            _mm_storeu_si128((__m128i *) out, _mm_unpacklo_epi8(v, zero));
+            _mm_storeu_si128((__m128i *) (out + 16),
+                             _mm_unpackhi_epi8(v, zero));
+            p += 16;
+            out += 32;
+         }
+#endif
+
+         ascii = CodeSetAsciiSpan(p, end - p);
+         while (ascii-- > 0) {
+            *out++ = *p++;
+            *out++ = 0;
+         }
+         if (p == end) {
+            break;
+         }
+      }
+
+      if (asciiOnly) {
+         return -1;
+      }
+
+      len = CodeSet_GetUtf8((const char *) p, (const char *) end, &c);
+      if (len == 0 || (c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF) {
+         return -1;
+      }
+      p += len;
+
+      if (c >= 0x10000) {
+         uint32 hi = 0xD800 + ((c - 0x10000) >> 10);
+         uint32 lo = 0xDC00 + ((c - 0x10000) & 0x3FF);
+
+         *out++ = hi & 0xFF;
+         *out++ = hi >> 8;
+         *out++ = lo & 0xFF;
+         *out++ = lo >> 8;
+      } else {
+         *out++ = c & 0xFF;
+         *out++ = c >> 8;
+      }
+   }
+
+   return out - bufOut;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetFastUtf16leToUtf8 --
+ *
+ *    Convert UTF-16LE to UTF-8 (or ASCII, when 'asciiOnly'). Unpaired
+ *    surrogates are rejected.
+ *
+ * Results:
+ *    Number of bytes written, or -1 if the input is not strictly valid.
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static ssize_t
+CodeSetFastUtf16leToUtf8(const uint8 *bufIn,  // IN
+                         size_t sizeIn,       // IN: even
+                         Bool asciiOnly,      // IN
+                         uint8 *bufOut)       // OUT: at least 3 * sizeIn / 2
+{
+   const uint8 *p = bufIn;
+   const uint8 *end = bufIn + sizeIn;
+   uint8 *out = bufOut;
+
+   ASSERT(sizeIn % 2 == 0);
+
+   while (p < end) {
+      uint32 c;
+
+#if defined(__SSE2__)
+      /* Only look for an ASCII run where one starts. */
+      while (p[1] == 0 && p[0] < 0x80 && end - p >= 16) {
+         __m128i v = _mm_loadu_si128((const __m128i *) p);
+
+         __m128i high = _mm_and_si128(v, _mm_set1_epi16((short) 0xFF80));
+
+         if (_mm_movemask_epi8(_mm_cmpeq_epi16(high,
+                                               _mm_setzero_si128())) != 0xFFFF) {
+            break;
+         }
+         _mm_storel_epi64((__m128i *) out, _mm_packus_epi16(v, v));
+         p += 16;
+         out += 8;
+      }
+      if (p == end) {
+         break;
+      }
+#endif
+
+      c = p[0] | (p[1] << 8);
+      p += 2;
+
+      if (c < 0x80) {
+         *out++ = c;
+         continue;
+      }
+      if (asciiOnly) {
+         return -1;
+      }
+
+      if (c >= 0xD800 && c <= 0xDFFF) {
+         uint32 lo;
+
+         if (c >= 0xDC00 || end - p < 2) {
+            return -1;
+         }
+         lo = p[0] | (p[1] << 8);
+         if (lo < 0xDC00 || lo > 0xDFFF) {
+            return -1;
+         }
+         p += 2;
+         c = 0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00);
+      }
+
+      if (c < 0x800) {
+         *out++ = 0xC0 | (c >> 6);
+         *out++ = 0x80 | (c & 0x3F);
+      } else if (c < 0x10000) {
+         *out++ = 0xE0 | (c >> 12);
+         *out++ = 0x80 | ((c >> 6) & 0x3F);
+         *out++ = 0x80 | (c & 0x3F);
+      } else {
+         *out++ = 0xF0 | (c >> 18);
+         *out++ = 0x80 | ((c >> 12) & 0x3F);
+         *out++ = 0x80 | ((c >> 6) & 0x3F);
+         *out++ = 0x80 | (c & 0x3F);
+      }
+   }
+
+   return out - bufOut;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetFastGenericToGenericDb --
+ *
+ *    Native conversion between UTF-8, UTF-16LE and US-ASCII.
+ *
+ * Results:
+ *    TRUE if the conversion was done and appended to 'db'.
+ *    FALSE if the caller must use the generic path; 'db' is unchanged
+ *    (apart from possibly having been enlarged).
+ *
+ * Side effects:
+ *    None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+CodeSetFastGenericToGenericDb(const char *codeIn,  // IN
+                              const char *bufIn,   // IN
+                              size_t sizeIn,       // IN
+                              const char *codeOut, // IN
+                              DynBuf *db)          // IN/OUT
+{
+   CodeSetFastEncoding in = CodeSetGetFastEncoding(codeIn);
+   CodeSetFastEncoding out;
+   const uint8 *src = (const uint8 *) bufIn;
+   uint8 *dst;
+   ssize_t written;
+
+   if (in == CODESET_FAST_NONE) {
+      return FALSE;
+   }
+   out = CodeSetGetFastEncoding(codeOut);
+   if (out == CODESET_FAST_NONE) {
+      return FALSE;
+   }
+
+   if (in == CODESET_FAST_UTF16LE && sizeIn % 2 != 0) {
+      return FALSE;
+   }
+
+   switch (in) {
+   case CODESET_FAST_ASCII:
+   case CODESET_FAST_UTF8:
+      if (out == CODESET_FAST_UTF16LE) {
+         if (sizeIn > ((size_t) -1) / 2 ||
+             (dst = CodeSetFastReserve(db, 2 * sizeIn)) == NULL) {
+            return FALSE;
+         }
+         written = CodeSetFastUtf8ToUtf16le(src, sizeIn,
+                                            in == CODESET_FAST_ASCII, dst);
+      } else {
+         /*
+          * UTF-8 is a superset of ASCII, so this is a validated copy.
+          */
+         if (in == CODESET_FAST_ASCII || out == CODESET_FAST_ASCII) {
+            if (CodeSetAsciiSpan(src, sizeIn) != sizeIn) {
+               return FALSE;
+            }
+         } else if (!CodeSetFastValidateUtf8(src, sizeIn)) {
+            return FALSE;
+         }
+         if ((dst = CodeSetFastReserve(db, sizeIn)) == NULL) {
+            return FALSE;
+         }
+         memcpy(dst, src, sizeIn);
+         written = sizeIn;
+      }
+      break;
+
+   case CODESET_FAST_UTF16LE:
+      if (out == CODESET_FAST_UTF16LE) {
+         /*
+          * Validated copy: convert into the scratch space past the end of
+          * 'db' to check the input, then overwrite it with the input.
+          */
+         if (sizeIn > ((size_t) -1) / 2 ||
+             (dst = CodeSetFastReserve(db, 2 * sizeIn)) == NULL ||
+             CodeSetFastUtf16leToUtf8(src, sizeIn, FALSE, dst) < 0 ||
+             (dst = CodeSetFastReserve(db, sizeIn)) == NULL) {
+            return FALSE;
+         }
+         memcpy(dst, src, sizeIn);
+         written = sizeIn;
+      } else {
+         if (sizeIn / 2 > ((size_t) -1) / 3 ||
+             (dst = CodeSetFastReserve(db, sizeIn / 2 * 3)) == NULL) {
+            return FALSE;
+         }
+         written = CodeSetFastUtf16leToUtf8(src, sizeIn,
+                                            out == CODESET_FAST_ASCII, dst);
+      }
+      break;
+
+   default:
+      NOT_REACHED();
+   }
+
+   if (written < 0) {
+      return FALSE;
+   }
+
+   DynBuf_SetSize(db, DynBuf_GetSize(db) + written);
+
+   return TRUE;
+}
+
+
+#if !defined(NO_ICU)
+
+/*
+ * Per-thread cache of open ICU converters, keyed by code set name.
+ *
+ * ucnv_open() looks the name up in the alias table and builds a fresh
+ * converter each time, which used to dominate short conversions. A
+ * converter is taken out of the cache while in use, so a thread that needs
+ * two converters for the same name (or re-enters through a callback) simply
+ * opens another one. Converters are reset before they are put back and
+ * closed when the thread exits.
+ *
+ * POSIX only: Windows thread-local destructors are unreliable in DLLs.
+ */
+
+#if !defined(_WIN32)
+#define CODESET_CACHE_CONVERTERS
+#endif
+
+#define CODESET_CONVERTER_CACHE_SIZE 4
+#define CODESET_CONVERTER_NAME_MAX   32
+
+#if defined(CODESET_CACHE_CONVERTERS)
+typedef struct CodeSetCachedConverter {
+   char name[CODESET_CONVERTER_NAME_MAX];
+   UConverter *cv;
+} CodeSetCachedConverter;
+
+typedef struct CodeSetConverterCache {
+   CodeSetCachedConverter entries[CODESET_CONVERTER_CACHE_SIZE];
+   unsigned int next;    // Next entry to evict
+} CodeSetConverterCache;
+
+static pthread_key_t converterCacheKey;
+static pthread_once_t converterCacheOnce = PTHREAD_ONCE_INIT;
+static Bool converterCacheKeyValid;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetConverterCacheFree --
+ *
+ *    Thread exit destructor for the converter cache.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Closes all cached converters.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CodeSetConverterCacheFree(void *data)  // IN
+{
+   CodeSetConverterCache *cache = data;
+   unsigned int i;
+
+   for (i = 0; i < ARRAYSIZE(cache->entries); i++) {
+      if (cache->entries[i].cv != NULL) {
+         ucnv_close(cache->entries[i].cv);
+      }
+   }
+   free(cache);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetConverterCacheKeyInit --
+ *
+ *    pthread_once() callback creating the cache TLS key.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Sets converterCacheKeyValid on success.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CodeSetConverterCacheKeyInit(void)
+{
+   converterCacheKeyValid =
+      pthread_key_create(&converterCacheKey, CodeSetConverterCacheFree) == 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetGetConverterCache --
+ *
+ *    Get (creating if needed) the calling thread's converter cache.
+ *
+ * Results:
+ *    The cache, or NULL if none could be set up.
+ *
+ * Side effects:
+ *    May allocate memory.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static CodeSetConverterCache *
+CodeSetGetConverterCache(void)
+{
+   CodeSetConverterCache *cache;
+
+   pthread_once(&converterCacheOnce, CodeSetConverterCacheKeyInit);
+   if (!converterCacheKeyValid) {
+      return NULL;
+   }
+
+   cache = pthread_getspecific(converterCacheKey);
+   if (cache == NULL) {
+      cache = calloc(1, sizeof *cache);
+      if (cache != NULL &&
+          pthread_setspecific(converterCacheKey, cache) != 0) {
+         free(cache);
+         cache = NULL;
+      }
+   }
+
+   return cache;
+}
+#endif // CODESET_CACHE_CONVERTERS
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetGetConverter --
+ *
+ *    Get a converter for 'code', from this thread's cache if possible.
+ *    Release it with CodeSetPutConverter.
+ *
+ * Results:
+ *    The converter, or NULL if ICU cannot open the code set.
+ *
+ * Side effects:
+ *    The returned converter is removed from the cache until it is put back.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static UConverter *
+CodeSetGetConverter(const char *code)  // IN
+{
+   UErrorCode uerr = U_ZERO_ERROR;
+
+#if defined(CODESET_CACHE_CONVERTERS)
+   CodeSetConverterCache *cache = CodeSetGetConverterCache();
+
+   if (cache != NULL) {
+      unsigned int i;
+
+      for (i = 0; i < ARRAYSIZE(cache->entries); i++) {
+         CodeSetCachedConverter *entry = &cache->entries[i];
+
+         if (entry->cv != NULL && strcmp(entry->name, code) == 0) {
+            UConverter *cv = entry->cv;
+
+            entry->cv = NULL;
+
+            return cv;
+         }
+      }
+   }
+#endif
+
+   return ucnv_open(code, &uerr);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CodeSetPutConverter --
+ *
+ *    Return a converter obtained from CodeSetGetConverter.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    The converter is reset and cached, or closed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CodeSetPutConverter(const char *code,  // IN
+                    UConverter *cv)    // IN
+{
+#if defined(CODESET_CACHE_CONVERTERS)
+   CodeSetConverterCache *cache;
+
+   if (cv == NULL) {
+      return;
+   }
+
+   cache = CodeSetGetConverterCache();
+   if (cache != NULL && strlen(code) < CODESET_CONVERTER_NAME_MAX) {
+      CodeSetCachedConverter *entry = NULL;
+      unsigned int i;
+
+      for (i = 0; i < ARRAYSIZE(cache->entries); i++) {
+         if (cache->entries[i].cv == NULL) {
+            entry = &cache->entries[i];
+            break;
+         }
+      }
+
+      if (entry == NULL) {
+         entry = &cache->entries[cache->next];
+         cache->next = (cache->next + 1) % ARRAYSIZE(cache->entries);
+         ucnv_close(entry->cv);
+      }
+
+      ucnv_reset(cv);
+      Str_Strcpy(entry->name, code, sizeof entry->name);
+      entry->cv = cv;
+
+      return;
+   }
+#endif
+
+   if (cv != NULL) {
+      ucnv_close(cv);
+   }
+}
+
+#endif // !NO_ICU
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -884,10 +1638,7 @@ CodeSet_GenericToGenericDb(const char *codeIn,  // IN
                            unsigned int flags,  // IN
                            DynBuf *db)          // IN/OUT
 {
-#if defined(NO_ICU)
-   return CodeSetOld_GenericToGenericDb(codeIn, bufIn, sizeIn, codeOut,
-                                        flags, db);
-#else
+#if !defined(NO_ICU)
    Bool result = FALSE;
    UErrorCode uerr;
    const char *bufInCur;
@@ -906,6 +1657,7 @@ CodeSet_GenericToGenericDb(const char *codeIn,  // IN
    UConverter *cvout = NULL;
    UConverterToUCallback toUCb;
    UConverterFromUCallback fromUCb;
+#endif
 
    ASSERT(codeIn);
    ASSERT(sizeIn == 0 || bufIn);
@@ -914,6 +1666,20 @@ CodeSet_GenericToGenericDb(const char *codeIn,  // IN
    ASSERT((CSGTG_NORMAL == flags) || (CSGTG_TRANSLIT == flags) ||
           (CSGTG_IGNORE == flags));
 
+   /*
+    * Strictly valid UTF-8/UTF-16LE/ASCII input converts the same way
+    * whatever the flags, so try the native path first.
+    */
+
+   if (sizeIn != 0 &&
+       CodeSetFastGenericToGenericDb(codeIn, bufIn, sizeIn, codeOut, db)) {
+      return TRUE;
+   }
+
+#if defined(NO_ICU)
+   return CodeSetOld_GenericToGenericDb(codeIn, bufIn, sizeIn, codeOut,
+                                        flags, db);
+#else
    if (dontUseIcu) {
       // fall back
       return CodeSetOld_GenericToGenericDb(codeIn, bufIn, sizeIn, codeOut,
@@ -933,14 +1699,12 @@ CodeSet_GenericToGenericDb(const char *codeIn,  // IN
     * Open converters.
     */
 
-   uerr = U_ZERO_ERROR;
-   cvin = ucnv_open(codeIn, &uerr);
+   cvin = CodeSetGetConverter(codeIn);
    if (!cvin) {
       goto exit;
    }
 
-   uerr = U_ZERO_ERROR;
-   cvout = ucnv_open(codeOut, &uerr);
+   cvout = CodeSetGetConverter(codeOut);
    if (!cvout) {
       goto exit;
    }
@@ -1061,13 +1825,8 @@ CodeSet_GenericToGenericDb(const char *codeIn,  // IN
    result = TRUE;
 
   exit:
-   if (cvin) {
-      ucnv_close(cvin);
-   }
-
-   if (cvout) {
-      ucnv_close(cvout);
-   }
+   CodeSetPutConverter(codeIn, cvin);
+   CodeSetPutConverter(codeOut, cvout);
 
    return result;
 #endif
@@ -1671,19 +2430,30 @@ CodeSet_Validate(const char *buf,   // IN: the string
                  size_t size,	    // IN: length of string
                  const char *code)  // IN: encoding
 {
-#if defined(NO_ICU)
-   return CodeSetOld_Validate(buf, size, code);
-#else
+#if !defined(NO_ICU)
    UConverter *cv;
    UErrorCode uerr;
-
-   // ucnv_toUChars takes 32-bit int size
-   VERIFY(size <= (size_t) MAX_INT32);
+#endif
 
    if (size == 0) {
       return TRUE;
    }
 
+   switch (CodeSetGetFastEncoding(code)) {
+   case CODESET_FAST_UTF8:
+      return CodeSetFastValidateUtf8((const uint8 *) buf, size);
+   case CODESET_FAST_ASCII:
+      return CodeSetAsciiSpan((const uint8 *) buf, size) == size;
+   default:
+      break;
+   }
+
+#if defined(NO_ICU)
+   return CodeSetOld_Validate(buf, size, code);
+#else
+   // ucnv_toUChars takes 32-bit int size
+   VERIFY(size <= (size_t) MAX_INT32);
+
    /*
     * Fallback if necessary.
     */
@@ -1699,13 +2469,13 @@ CodeSet_Validate(const char *buf,   // IN: the string
     * is bad.
     */
 
+   cv = CodeSetGetConverter(code);
+   VERIFY(cv != NULL);
    uerr = U_ZERO_ERROR;
-   cv = ucnv_open(code, &uerr);
-   VERIFY(uerr == U_ZERO_ERROR);
    ucnv_setToUCallBack(cv, UCNV_TO_U_CALLBACK_STOP, NULL, NULL, NULL, &uerr);
    VERIFY(uerr == U_ZERO_ERROR);
    ucnv_toUChars(cv, NULL, 0, buf, size, &uerr);
-   ucnv_close(cv);
+   CodeSetPutConverter(code, cv);
 
    return uerr == U_BUFFER_OVERFLOW_ERROR;
 #endif
@@ -30,6 +30,12 @@
 #include "vmware.h"
 #include "dynbuf.h"
 
+/*
+ * Arena memory is handed out in multiples of this, which keeps every
+ * allocation suitably aligned for any structure.
+ */
+#define DYNBUF_ARENA_ALIGN       16
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -55,6 +61,75 @@ DynBuf_Init(DynBuf *b)  // OUT:
    b->data = NULL;
    b->size = 0;
    b->allocated = 0;
+   b->borrowed = FALSE;
+   b->arena = NULL;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynBuf_InitWithStorage --
+ *
+ *      Dynamic buffer constructor using caller-provided storage. The buffer
+ *      starts out in 'storage' and only moves to the heap if it outgrows it,
+ *      so small results cost no allocation at all. 'storage' must outlive
+ *      the buffer and is never freed by it.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+DynBuf_InitWithStorage(DynBuf *b,           // OUT:
+                       void *storage,       // IN:
+                       size_t storageSize)  // IN:
+{
+   ASSERT(b);
+   ASSERT(storage != NULL || storageSize == 0);
+
+   DynBuf_Init(b);
+   if (storageSize > 0) {
+      b->data = storage;
+      b->allocated = storageSize;
+      b->borrowed = TRUE;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynBuf_InitWithArena --
+ *
+ *      Dynamic buffer constructor allocating from an arena. The buffer's
+ *      memory belongs to the arena and goes away with DynBufArena_Release;
+ *      DynBuf_Destroy is optional.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+DynBuf_InitWithArena(DynBuf *b,            // OUT:
+                     DynBufArena *arena)   // IN:
+{
+   ASSERT(b);
+   ASSERT(arena);
+
+   DynBuf_Init(b);
+   b->borrowed = TRUE;
+   b->arena = arena;
 }
 
 
@@ -79,7 +154,9 @@ DynBuf_Destroy(DynBuf *b)  // IN/OUT:
 {
    ASSERT(b);
 
-   free(b->data);
+   if (!b->borrowed) {
+      free(b->data);
+   }
    DynBuf_Init(b);
 }
 
@@ -141,9 +218,13 @@ DynBuf_Attach(DynBuf *b,    // IN
    ASSERT(b);
    ASSERT((size == 0) == (data == NULL));
 
-   free(b->data);
+   if (!b->borrowed) {
+      free(b->data);
+   }
    b->data = data;
    b->size = b->allocated = size;
+   b->borrowed = FALSE;
+   b->arena = NULL;
 }
 
 
@@ -155,8 +236,11 @@ DynBuf_Attach(DynBuf *b,    // IN
  *      Releases ownership of the buffer stored in the DynBuf object,
  *      and returns a pointer to it.
  *
+ *      If the data lives in caller storage or an arena, a heap copy of it
+ *      is returned instead.
+ *
  * Results:
- *      The pointer to the data.
+ *      The pointer to the data. NULL if a heap copy could not be allocated.
  *
  * Side effects:
  *      None
@@ -171,7 +255,13 @@ DynBuf_Detach(DynBuf *b) // IN
 
    ASSERT(b);
 
-   data = b->data;
+   if (b->borrowed) {
+      data = b->size > 0 ? DynBuf_AllocGet(b) : NULL;
+      b->borrowed = FALSE;
+      b->arena = NULL;
+   } else {
+      data = b->data;
+   }
    b->data = NULL;
    b->allocated = 0;
 
@@ -204,6 +294,54 @@ DynBufRealloc(DynBuf *b,            // IN:
 
    ASSERT(b);
 
+   if (b->borrowed) {
+      ASSERT(newAllocated >= b->size);
+
+      if (b->arena != NULL) {
+         DynBufArena *arena = b->arena;
+         size_t rounded = ROUNDUP(newAllocated, DYNBUF_ARENA_ALIGN);
+
+         if (rounded < newAllocated) {  // Prevent integer overflow
+            return FALSE;
+         }
+
+         /*
+          * Arena buffers are sized in multiples of DYNBUF_ARENA_ALIGN, the
+          * unit DynBufArena_Alloc hands out, so that growing in place
+          * leaves the next allocation aligned.
+          */
+
+         newAllocated = rounded;
+
+         /* The most recent arena allocation can grow in place. */
+         if (b->data != NULL && b->data + b->allocated == arena->cur &&
+             newAllocated - b->allocated <= (size_t) (arena->end - arena->cur)) {
+            arena->cur += newAllocated - b->allocated;
+            b->allocated = newAllocated;
+
+            return TRUE;
+         }
+
+         new_data = DynBufArena_Alloc(arena, newAllocated);
+      } else {
+         new_data = malloc(newAllocated);
+      }
+
+      if (new_data == NULL) {
+         /* Not enough memory */
+         return FALSE;
+      }
+
+      if (b->size > 0) {
+         memcpy(new_data, b->data, b->size);
+      }
+      b->data = new_data;
+      b->allocated = newAllocated;
+      b->borrowed = (b->arena != NULL);
+
+      return TRUE;
+   }
+
    new_data = realloc(b->data, newAllocated);
    if (new_data == NULL && newAllocated) {
       /* Not enough memory */
@@ -251,10 +389,14 @@ DynBuf_Enlarge(DynBuf *b,       // IN:
 #else
                         /*
                          * Double the previously allocated size if it is less
-                         * than 256KB; otherwise grow it linearly by 256KB
+                         * than 256KB; otherwise grow it by half. Growth must
+                         * stay geometric for appends to remain amortized
+                         * O(1): a fixed increment makes building a large
+                         * buffer quadratic in realloc copies.
                          */
                         (b->allocated < 256 * 1024 ? b->allocated * 2
-                                                   : b->allocated + 256 * 1024)
+                                                   : b->allocated +
+                                                     b->allocated / 2)
 #endif
                       :
 #if defined(DYNBUF_DEBUG)
@@ -378,6 +520,8 @@ DynBuf_SafeInternalAppend(DynBuf *b,            // IN
  *
  *      Reallocate a dynamic buffer to the exact size it occupies --hpreg
  *
+ *      No-op for buffers in caller storage or an arena.
+ *
  * Results:
  *      TRUE on success
  *      FALSE on failure (not enough memory)
@@ -393,6 +537,10 @@ DynBuf_Trim(DynBuf *b) // IN
 {
    ASSERT(b);
 
+   if (b->borrowed) {
+      return TRUE;
+   }
+
    return DynBufRealloc(b, b->size);
 }
 
@@ -432,8 +580,168 @@ DynBuf_Copy(DynBuf *src,   // IN
 
    dest->size = src->size;
    dest->allocated = src->allocated;
+   dest->borrowed = FALSE;
+   dest->arena = NULL;
 
    memcpy(dest->data, src->data, src->size);
 
    return TRUE;
 }
+
+
+/* Minimum size of a heap chunk, once the caller's storage is used up. */
+#define DYNBUF_ARENA_CHUNK_SIZE  (4 * 1024)
+
+struct DynBufArenaChunk {
+   DynBufArenaChunk *next;
+   /* Pads the header so that data starts aligned. */
+   char pad[DYNBUF_ARENA_ALIGN - sizeof(void *) % DYNBUF_ARENA_ALIGN];
+};
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynBufArenaAlign --
+ *
+ *      Round a pointer up to DYNBUF_ARENA_ALIGN, without going past 'end'.
+ *
+ * Results:
+ *      The aligned pointer.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+DynBufArenaAlign(char *p,    // IN:
+                 char *end)  // IN:
+{
+   uintptr_t aligned = ROUNDUP((uintptr_t) p, DYNBUF_ARENA_ALIGN);
+
+   return aligned > (uintptr_t) end ? end : (char *) aligned;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynBufArena_Init --
+ *
+ *      Arena constructor. Allocations are served from 'storage' (which may
+ *      be NULL) until it is exhausted, and from heap chunks after that.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+DynBufArena_Init(DynBufArena *arena,  // OUT:
+                 void *storage,       // IN/OPT:
+                 size_t storageSize)  // IN:
+{
+   ASSERT(arena);
+   ASSERT(storage != NULL || storageSize == 0);
+
+   arena->storage = storage;
+   arena->storageSize = storageSize;
+   arena->chunks = NULL;
+   arena->end = arena->storage + storageSize;
+   arena->cur = DynBufArenaAlign(arena->storage, arena->end);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynBufArena_Alloc --
+ *
+ *      Allocate memory from an arena. The memory is aligned for any type and
+ *      stays valid until DynBufArena_Release.
+ *
+ * Results:
+ *      Pointer to the memory, or NULL on failure (not enough memory).
+ *
+ * Side effects:
+ *      May allocate a new heap chunk.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void *
+DynBufArena_Alloc(DynBufArena *arena,  // IN/OUT:
+                  size_t size)         // IN:
+{
+   size_t rounded = ROUNDUP(size, DYNBUF_ARENA_ALIGN);
+   DynBufArenaChunk *chunk;
+   size_t chunkSize;
+   char *p;
+
+   ASSERT(arena);
+
+   if (rounded < size) {  // Prevent integer overflow
+      return NULL;
+   }
+
+   if (rounded > (size_t) (arena->end - arena->cur)) {
+      chunkSize = MAX(rounded, DYNBUF_ARENA_CHUNK_SIZE);
+      if (chunkSize + sizeof *chunk < chunkSize) {
+         return NULL;
+      }
+
+      chunk = malloc(sizeof *chunk + chunkSize);
+      if (chunk == NULL) {
+         return NULL;
+      }
+      chunk->next = arena->chunks;
+      arena->chunks = chunk;
+      arena->cur = (char *) (chunk + 1);
+      arena->end = arena->cur + chunkSize;
+   }
+
+   p = arena->cur;
+   arena->cur += rounded;
+
+   return p;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DynBufArena_Release --
+ *
+ *      Release all memory handed out by an arena, including the data of all
+ *      DynBufs created with DynBuf_InitWithArena on it. The arena can be
+ *      reused afterwards.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+DynBufArena_Release(DynBufArena *arena)  // IN/OUT:
+{
+   ASSERT(arena);
+
+   while (arena->chunks != NULL) {
+      DynBufArenaChunk *next = arena->chunks->next;
+
+      free(arena->chunks);
+      arena->chunks = next;
+   }
+
+   DynBufArena_Init(arena, arena->storage, arena->storageSize);
+}
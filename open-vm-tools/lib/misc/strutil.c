@@ -29,7 +29,11 @@
 #if !defined(_WIN32)
 #include <strings.h> /* For strncasecmp */
 #endif
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
 #include "vmware.h"
+#include "vm_basic_asm.h"
 #include "strutil.h"
 #include "str.h"
 #include "dynbuf.h"
@@ -37,6 +41,152 @@
 #include "util.h"
 
 
+/*
+ * Numeric tokens are parsed out of a stack buffer of this size; only longer
+ * ones (which are valid numbers only with lots of leading zeroes) fall back
+ * to a heap copy.
+ */
+#define STRUTIL_NUMERIC_TOKEN_SIZE 64
+
+#if defined(__SSE2__)
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * StrUtilSpanChar --
+ *
+ *      Count the leading bytes of 'str' that are 'delimiter' ('inSet' TRUE,
+ *      like strspn) or that are neither it nor the NUL ('inSet' FALSE, like
+ *      strcspn).
+ *
+ *      Bytes up to the first 16-byte boundary are checked one at a time,
+ *      which is where most tokens (RPC command names, numbers) end; the rest
+ *      16 at a time. The loads are aligned, so they never cross into a page
+ *      the string does not occupy.
+ *
+ * Results:
+ *      Length of the span; it never includes the terminating NUL.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static INLINE size_t
+StrUtilSpanChar(const char *str,  // IN: String to scan
+                char delimiter,   // IN: Char separating tokens
+                Bool inSet)       // IN: Count delimiters or non-delimiters
+{
+   const __m128i zero = _mm_setzero_si128();
+   __m128i delim;
+   const char *p = str;
+
+   while (((uintptr_t) p & 15) != 0) {
+      if (*p == '\0' || (*p == delimiter) != inSet) {
+         return p - str;
+      }
+      p++;
+   }
+
+   delim = _mm_set1_epi8(delimiter);
+   for (;;) {
+      __m128i v = _mm_load_si128((const __m128i *) p);
+      uint32 delimMask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, delim));
+      uint32 stop;
+
+      /* The NUL is never the delimiter, so ~delimMask covers it. */
+      if (inSet) {
+         stop = ~delimMask & 0xffff;
+      } else {
+         stop = delimMask | _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+      }
+      if (stop != 0) {
+         return p + lssb32_0(stop) - str;
+      }
+      p += 16;
+   }
+}
+#endif
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * StrUtil_GetNextTokenView --
+ *
+ *      Find the next token in a string after a given index w/o modifying or
+ *      copying the original string.
+ *
+ *      Almost every caller splits on a single delimiter (RPC dispatch and
+ *      its handlers split on spaces); with SSE2 that case is scanned inline
+ *      by StrUtilSpanChar, which saves the library call and set setup of
+ *      strspn/strcspn on short tokens. Other delimiter sets use those.
+ *
+ * Results:
+ *      TRUE if a token was found: 'token' points into 'str', 'tokenLen' is
+ *         its length (the token is NOT NUL-terminated) and 'index' is updated
+ *         to point after it.
+ *      FALSE if no tokens are left.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+Bool
+StrUtil_GetNextTokenView(unsigned int *index,     // IN/OUT: Index to start at
+                         const char *str,         // IN    : String to parse
+                         const char *delimiters,  // IN    : Chars separating tokens
+                         const char **token,      // OUT   : Start of token
+                         size_t *tokenLen)        // OUT   : Length of token
+{
+   const char *start;
+   size_t length;
+
+   ASSERT(index);
+   ASSERT(str);
+   ASSERT(delimiters);
+   ASSERT(token);
+   ASSERT(tokenLen);
+   ASSERT(*index <= strlen(str));
+
+   start = str + *index;
+
+#if defined(__SSE2__)
+   if (delimiters[0] != '\0' && delimiters[1] == '\0') {
+      start += StrUtilSpanChar(start, delimiters[0], TRUE);
+      if (*start == '\0') {
+         *index = start - str;
+         return FALSE;
+      }
+      length = StrUtilSpanChar(start, delimiters[0], FALSE);
+   } else
+#endif
+   {
+      /* Skip leading delimiters. */
+      start += strspn(start, delimiters);
+      if (*start == '\0') {
+         *index = start - str;
+         return FALSE;
+      }
+
+      /*
+       * Walk the string until we reach the end of it, or we find a
+       * delimiter.
+       */
+      length = strcspn(start, delimiters);
+   }
+   ASSERT(length);
+
+   *token = start;
+   *tokenLen = length;
+   *index = (start - str) + length;
+
+   return TRUE;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -61,43 +211,60 @@ StrUtil_GetNextToken(unsigned int *index,    // IN/OUT: Index to start at
                      const char *str,        // IN    : String to parse
                      const char *delimiters) // IN    : Chars separating tokens
 {
-   unsigned int startIndex;
-   unsigned int length;
+   const char *start;
+   size_t length;
    char *token;
 
-   ASSERT(index);
-   ASSERT(str);
-   ASSERT(delimiters);
-   ASSERT(*index <= strlen(str));
+   if (!StrUtil_GetNextTokenView(index, str, delimiters, &start, &length)) {
+      return NULL;
+   }
 
-#define NOT_DELIMITER (Str_Strchr(delimiters, str[*index]) == NULL)
+   token = (char *)malloc(length + 1 /* NUL */);
+   VERIFY(token);
+   memcpy(token, start, length);
+   token[length] = '\0';
 
-   /* Skip leading delimiters. */
-   for (; ; (*index)++) {
-      if (str[*index] == '\0') {
-         return NULL;
-      }
+   return token;
+}
 
-      if (NOT_DELIMITER) {
-         break;
-      }
-   }
-   startIndex = *index;
 
-   /*
-    * Walk the string until we reach the end of it, or we find a
-    * delimiter.
-    */
-   for ((*index)++; str[*index] != '\0' && NOT_DELIMITER; (*index)++) {
-   }
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * StrUtilGetNextNumericToken --
+ *
+ *      Get the next token as a NUL-terminated string for numeric parsing.
+ *      The token is copied into 'buf' when it fits, so the common case does
+ *      not allocate.
+ *
+ * Results:
+ *      'buf', or an allocated string the caller must free, holding the
+ *         token. 'index' is updated to point after the token.
+ *      NULL if no tokens are left.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
 
-#undef NOT_DELIMITER
+static char *
+StrUtilGetNextNumericToken(unsigned int *index,    // IN/OUT: Index to start at
+                           const char *str,        // IN    : String to parse
+                           const char *delimiters, // IN    : Chars separating tokens
+                           char *buf,              // OUT   : Token storage
+                           size_t bufSize)         // IN    : Size of buf
+{
+   const char *start;
+   size_t length;
+   char *token;
 
-   length = *index - startIndex;
-   ASSERT(length);
-   token = (char *)malloc(length + 1 /* NUL */);
-   VERIFY(token);
-   memcpy(token, str + startIndex, length);
+   if (!StrUtil_GetNextTokenView(index, str, delimiters, &start, &length)) {
+      return NULL;
+   }
+
+   token = length < bufSize ? buf : Util_SafeMalloc(length + 1 /* NUL */);
+   memcpy(token, start, length);
    token[length] = '\0';
 
    return token;
@@ -127,6 +294,7 @@ StrUtil_GetNextIntToken(int32 *out,             // OUT   : parsed int
                         const char *str,        // IN    : String to parse
                         const char *delimiters) // IN    : Chars separating tokens
 {
+   char buf[STRUTIL_NUMERIC_TOKEN_SIZE];
    char *resultStr;
    Bool valid = FALSE;
 
@@ -135,13 +303,16 @@ StrUtil_GetNextIntToken(int32 *out,             // OUT   : parsed int
    ASSERT(str);
    ASSERT(delimiters);
 
-   resultStr = StrUtil_GetNextToken(index, str, delimiters);
+   resultStr = StrUtilGetNextNumericToken(index, str, delimiters,
+                                          buf, sizeof buf);
    if (resultStr == NULL) {
       return FALSE;
    }
 
    valid = StrUtil_StrToInt(out, resultStr);
-   free(resultStr);
+   if (resultStr != buf) {
+      free(resultStr);
+   }
 
    return valid;
 }
@@ -170,6 +341,7 @@ StrUtil_GetNextUintToken(uint32 *out,            // OUT   : parsed int
                          const char *str,        // IN    : String to parse
                          const char *delimiters) // IN    : Chars separating tokens
 {
+   char buf[STRUTIL_NUMERIC_TOKEN_SIZE];
    char *resultStr;
    Bool valid = FALSE;
 
@@ -178,13 +350,16 @@ StrUtil_GetNextUintToken(uint32 *out,            // OUT   : parsed int
    ASSERT(str);
    ASSERT(delimiters);
 
-   resultStr = StrUtil_GetNextToken(index, str, delimiters);
+   resultStr = StrUtilGetNextNumericToken(index, str, delimiters,
+                                          buf, sizeof buf);
    if (resultStr == NULL) {
       return FALSE;
    }
 
    valid = StrUtil_StrToUint(out, resultStr);
-   free(resultStr);
+   if (resultStr != buf) {
+      free(resultStr);
+   }
 
    return valid;
 }
@@ -213,6 +388,7 @@ StrUtil_GetNextInt64Token(int64 *out,             // OUT: The output value
                           const char *str,        // IN    : String to parse
                           const char *delimiters) // IN    : Chars separating tokens
 {
+   char buf[STRUTIL_NUMERIC_TOKEN_SIZE];
    char *resultStr;
    Bool result;
 
@@ -221,9 +397,12 @@ StrUtil_GetNextInt64Token(int64 *out,             // OUT: The output value
    ASSERT(str);
    ASSERT(delimiters);
 
-   resultStr = StrUtil_GetNextToken(index, str, delimiters);
+   resultStr = StrUtilGetNextNumericToken(index, str, delimiters,
+                                          buf, sizeof buf);
    result = resultStr ? StrUtil_StrToInt64(out, resultStr) : FALSE;
-   free(resultStr);
+   if (resultStr != buf) {
+      free(resultStr);
+   }
 
    return result;
 }
@@ -112,6 +112,28 @@ Poll_InitWithImpl(const PollImpl *impl)
    pollImpl->Init();
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Poll_IsInitialized --
+ *
+ *      Find out whether an implementation of Poll was started.
+ *
+ * Results: TRUE if Poll_InitWithImpl was called, FALSE otherwise.
+ *
+ * Side effects: None
+ *
+ *----------------------------------------------------------------------
+ */
+
+Bool
+Poll_IsInitialized(void)
+{
+   return pollImpl != NULL;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
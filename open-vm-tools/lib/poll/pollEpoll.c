@@ -0,0 +1,1499 @@
+/*********************************************************
+ * Copyright (C) 2015 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * pollEpoll.c -- a native Poll implementation built on top of epoll.
+ *
+ * Unlike pollGtk, device callbacks are not turned into one GIOChannel
+ * watch per descriptor. All descriptors live in a single epoll set which
+ * is looked at through one GPollFD, so the GLib main loop polls one fd no
+ * matter how many sockets are registered. Device callbacks are found by
+ * indexing a table with the descriptor; real-time and main-loop callbacks
+ * live in a deadline-ordered heap. Callbacks are removed through a hash
+ * table keyed by client data, so registering and removing callbacks stays
+ * cheap with thousands of sockets.
+ *
+ * The implementation can be driven either by the GLib main loop (the
+ * source is attached to the default main context at init time, like the
+ * pollGtk timers and watches) or directly with Poll_LoopTimeout() by
+ * daemons that have no main loop of their own. Only one thread should
+ * dispatch at a time.
+ *
+ * Like pollGtk, any thread may register or remove callbacks; the poll
+ * lock is dropped while a callback runs.
+ */
+
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "pollImpl.h"
+#include "mutexRankLib.h"
+#include "dbllnklst.h"
+#include "hashTable.h"
+#include "hostinfo.h"
+#include "util.h"
+#include "err.h"
+
+#define LOGLEVEL_MODULE poll
+#include "loglevel_user.h"
+
+
+/*
+ * Number of epoll events harvested per pass.
+ */
+
+#define POLL_EPOLL_MAX_EVENTS   256
+
+/*
+ * Epoll user data of the wakeup eventfd. Device events carry the
+ * descriptor in the low 32 bits and its slot generation in the high 32.
+ */
+
+#define POLL_EPOLL_WAKEUP_DATA  ((uint64) -1)
+
+/*
+ * This describes a single callback waiting for an event or a timeout.
+ */
+
+typedef struct PollEpollCb {
+   int                  flags;
+   PollerFunction       cb;
+   void                *clientData;
+   PollClassSet         classSet;
+   MXUserRecLock       *cbLock;
+   PollEventType        type;
+   PollDevHandle        info;        // POLL_DEVICE fd or delay in us.
+
+   VmTimeType           deadline;    // Timers: when to fire, in us.
+   int                  heapIndex;   // Timers: -1 when not in the heap.
+   DblLnkLst_Links      deferLinks;  // Timers: on the deferred list.
+
+   struct PollEpollCb  *nextSameData;  // clientData hash chain.
+} PollEpollCb;
+
+
+/*
+ * The callbacks registered for one descriptor.
+ */
+
+typedef struct {
+   PollEpollCb  *read;
+   PollEpollCb  *write;
+   uint32        generation;   // Bumped each time the slot is (re)used.
+   uint32        events;       // EPOLL* events registered with the kernel.
+} PollEpollDevice;
+
+
+/*
+ * The GLib main loop source.
+ */
+
+typedef struct {
+   GSource  source;
+   GPollFD  pollFd;
+} PollEpollSource;
+
+
+/*
+ * The global Poll state.
+ */
+
+typedef struct Poll {
+   MXUserExclLock   *lock;
+
+   int               epollFd;
+   int               wakeupFd;
+
+   PollEpollDevice  *devices;      // Indexed by descriptor.
+   uint32            numDevices;
+
+   PollEpollCb     **timers;       // Binary min-heap on deadline.
+   uint32            numTimers;
+   uint32            timersSize;
+   DblLnkLst_Links   deferred;     // Expired timers of another class.
+
+   HashTable        *cbTable;      // clientData -> PollEpollCb chain.
+
+   Bool              inDispatch;   // Firing; timeouts are recomputed after.
+   PollEpollSource  *source;
+} Poll;
+
+static Poll *pollState;
+
+
+#define ASSERT_POLL_LOCKED()                                    \
+   ASSERT(!pollState || !pollState->lock ||                     \
+          MXUser_IsCurThreadHoldingExclLock(pollState->lock))
+
+#define LOG_CB(_l, _str, _c)                                                  \
+   LOG(_l, ("POLL: cb %p (f %p, data %p, flags %x, type %x)" _str,            \
+            (_c), (_c)->cb, (_c)->clientData, (_c)->flags, (_c)->type))
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * PollEpollLock --
+ * PollEpollUnlock --
+ *
+ *      Locking of the internal poll state.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static INLINE void
+PollEpollLock(void)
+{
+   MXUser_AcquireExclLock(pollState->lock);
+}
+
+
+static INLINE void
+PollEpollUnlock(void)
+{
+   MXUser_ReleaseExclLock(pollState->lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollWakeup --
+ *
+ *      Kick the dispatching thread out of epoll_wait so it recomputes its
+ *      timeout.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollWakeup(void)
+{
+   uint64 one = 1;
+
+   if (write(pollState->wakeupFd, &one, sizeof one) < 0 && errno != EAGAIN) {
+      LOG(1, ("POLL: wakeup failed: %s\n", Err_Errno2String(errno)));
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollHeapSwap --
+ * PollEpollHeapUp --
+ * PollEpollHeapDown --
+ *
+ *      Timer heap maintenance.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static INLINE void
+PollEpollHeapSwap(Poll *poll,  // IN/OUT
+                  uint32 i,    // IN
+                  uint32 j)    // IN
+{
+   PollEpollCb *tmp = poll->timers[i];
+
+   poll->timers[i] = poll->timers[j];
+   poll->timers[j] = tmp;
+   poll->timers[i]->heapIndex = i;
+   poll->timers[j]->heapIndex = j;
+}
+
+
+static void
+PollEpollHeapUp(Poll *poll,  // IN/OUT
+                uint32 i)    // IN
+{
+   while (i > 0) {
+      uint32 parent = (i - 1) / 2;
+
+      if (poll->timers[parent]->deadline <= poll->timers[i]->deadline) {
+         break;
+      }
+      PollEpollHeapSwap(poll, i, parent);
+      i = parent;
+   }
+}
+
+
+static void
+PollEpollHeapDown(Poll *poll,  // IN/OUT
+                  uint32 i)    // IN
+{
+   while (TRUE) {
+      uint32 smallest = i;
+      uint32 left = 2 * i + 1;
+      uint32 right = left + 1;
+
+      if (left < poll->numTimers &&
+          poll->timers[left]->deadline < poll->timers[smallest]->deadline) {
+         smallest = left;
+      }
+      if (right < poll->numTimers &&
+          poll->timers[right]->deadline < poll->timers[smallest]->deadline) {
+         smallest = right;
+      }
+      if (smallest == i) {
+         break;
+      }
+      PollEpollHeapSwap(poll, i, smallest);
+      i = smallest;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollTimerQueue --
+ *
+ *      Queue a timer callback to fire at the specified time.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The dispatching thread is woken if this is now the first timer.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollTimerQueue(PollEpollCb *cb,       // IN/OUT
+                    VmTimeType deadline)   // IN
+{
+   Poll *poll = pollState;
+
+   ASSERT_POLL_LOCKED();
+   ASSERT(cb->heapIndex == -1 && !DblLnkLst_IsLinked(&cb->deferLinks));
+
+   if (poll->numTimers == poll->timersSize) {
+      poll->timersSize = MAX(16, 2 * poll->timersSize);
+      poll->timers = Util_SafeRealloc(poll->timers,
+                                      poll->timersSize * sizeof *poll->timers);
+   }
+
+   cb->deadline = deadline;
+   cb->heapIndex = poll->numTimers;
+   poll->timers[poll->numTimers++] = cb;
+   PollEpollHeapUp(poll, cb->heapIndex);
+
+   if (cb->heapIndex == 0 && !poll->inDispatch) {
+      PollEpollWakeup();
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollTimerDequeue --
+ *
+ *      Take a timer callback out of the heap (or the deferred list).
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollTimerDequeue(PollEpollCb *cb)  // IN/OUT
+{
+   Poll *poll = pollState;
+
+   ASSERT_POLL_LOCKED();
+
+   if (DblLnkLst_IsLinked(&cb->deferLinks)) {
+      DblLnkLst_Unlink1(&cb->deferLinks);
+   } else if (cb->heapIndex != -1) {
+      uint32 i = cb->heapIndex;
+      uint32 last = --poll->numTimers;
+
+      if (i != last) {
+         PollEpollHeapSwap(poll, i, last);
+         PollEpollHeapDown(poll, i);
+         PollEpollHeapUp(poll, i);
+      }
+      cb->heapIndex = -1;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollDeviceUpdate --
+ *
+ *      Bring the kernel's view of a descriptor in line with the callbacks
+ *      registered for it.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollDeviceUpdate(int fd)  // IN
+{
+   Poll *poll = pollState;
+   PollEpollDevice *dev = &poll->devices[fd];
+   struct epoll_event ev;
+   uint32 events = 0;
+   int op;
+
+   ASSERT_POLL_LOCKED();
+
+   if (dev->read != NULL) {
+      events |= EPOLLIN | EPOLLPRI;
+   }
+   if (dev->write != NULL) {
+      events |= EPOLLOUT;
+   }
+
+   if (events == dev->events) {
+      return;
+   }
+
+   if (events == 0) {
+      op = EPOLL_CTL_DEL;
+   } else if (dev->events == 0) {
+      op = EPOLL_CTL_ADD;
+   } else {
+      op = EPOLL_CTL_MOD;
+   }
+
+   memset(&ev, 0, sizeof ev);
+   ev.events = events;
+   ev.data.u64 = ((uint64) dev->generation << 32) | (uint32) fd;
+
+   if (epoll_ctl(poll->epollFd, op, fd, &ev) < 0) {
+      /*
+       * The descriptor may already have been closed, in which case the
+       * kernel has forgotten it by itself.
+       */
+
+      if (op != EPOLL_CTL_DEL || (errno != EBADF && errno != ENOENT)) {
+         Warning("POLL: epoll_ctl(%d, %d) failed: %s\n", op, fd,
+                 Err_Errno2String(errno));
+      }
+   }
+
+   dev->events = events;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollHashAdd --
+ * PollEpollHashRemove --
+ *
+ *      Maintain the client data -> callback chains used for removal.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollHashAdd(PollEpollCb *cb)  // IN
+{
+   Poll *poll = pollState;
+   PollEpollCb *head;
+
+   ASSERT_POLL_LOCKED();
+
+   if (HashTable_Lookup(poll->cbTable, cb->clientData, (void **) &head)) {
+      cb->nextSameData = head;
+   } else {
+      cb->nextSameData = NULL;
+   }
+   HashTable_ReplaceOrInsert(poll->cbTable, cb->clientData, cb);
+}
+
+
+static void
+PollEpollHashRemove(PollEpollCb *cb)  // IN
+{
+   Poll *poll = pollState;
+   PollEpollCb *head;
+   PollEpollCb **link;
+
+   ASSERT_POLL_LOCKED();
+
+   if (!HashTable_Lookup(poll->cbTable, cb->clientData, (void **) &head)) {
+      NOT_REACHED();
+   }
+
+   if (head == cb) {
+      if (cb->nextSameData == NULL) {
+         HashTable_Delete(poll->cbTable, cb->clientData);
+      } else {
+         HashTable_ReplaceOrInsert(poll->cbTable, cb->clientData,
+                                   cb->nextSameData);
+      }
+      return;
+   }
+
+   for (link = &head->nextSameData; *link != cb; link = &(*link)->nextSameData) {
+      ASSERT(*link != NULL);
+   }
+   *link = cb->nextSameData;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollRemoveCb --
+ *
+ *      Unregister and free a callback.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollRemoveCb(PollEpollCb *cb)  // IN
+{
+   Poll *poll = pollState;
+
+   ASSERT_POLL_LOCKED();
+   LOG_CB(2, " to be removed\n", cb);
+
+   PollEpollHashRemove(cb);
+
+   if (cb->type == POLL_DEVICE) {
+      PollEpollDevice *dev = &poll->devices[cb->info];
+
+      if (dev->read == cb) {
+         dev->read = NULL;
+      } else {
+         ASSERT(dev->write == cb);
+         dev->write = NULL;
+      }
+      PollEpollDeviceUpdate(cb->info);
+   } else {
+      PollEpollTimerDequeue(cb);
+   }
+
+   free(cb);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollCbMatches --
+ *
+ *      Test whether a callback matches a removal request.
+ *
+ * Results:
+ *      TRUE if it does.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static INLINE Bool
+PollEpollCbMatches(const PollEpollCb *cb,    // IN
+                   PollClassSet classSet,    // IN
+                   int flags,                // IN
+                   PollerFunction f,         // IN
+                   PollEventType type)       // IN
+{
+   return cb->cb == f && cb->flags == flags && cb->type == type &&
+          PollClassSet_Equals(cb->classSet, classSet);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollFindAnyData --
+ *
+ *      HashTable_ForEach callback looking for a matching callback with any
+ *      client data.
+ *
+ * Results:
+ *      Non-zero (stop) when found.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+typedef struct {
+   PollClassSet    classSet;
+   int             flags;
+   PollerFunction  f;
+   PollEventType   type;
+   PollEpollCb    *found;
+} PollEpollFindData;
+
+static int
+PollEpollFindAnyData(const char *key,   // IN: unused
+                     void *value,       // IN: PollEpollCb chain
+                     void *clientData)  // IN/OUT: PollEpollFindData
+{
+   PollEpollFindData *search = clientData;
+   PollEpollCb *cb;
+
+   for (cb = value; cb != NULL; cb = cb->nextSameData) {
+      if (PollEpollCbMatches(cb, search->classSet, search->flags, search->f,
+                             search->type)) {
+         search->found = cb;
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollInit --
+ *
+ *      Module initialization.
+ *
+ * Results:
+ *       None
+ *
+ * Side effects:
+ *       Initializes the module-wide state and sets pollState.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void PollEpollSourceAttach(void);
+
+static void
+PollEpollInit(void)
+{
+   struct epoll_event ev;
+
+   ASSERT(pollState == NULL);
+   pollState = Util_SafeCalloc(1, sizeof *pollState);
+
+   pollState->lock = MXUser_CreateExclLock("pollEpollLock",
+                                           RANK_pollDefaultLock);
+   VERIFY(pollState->lock);
+
+   pollState->epollFd = epoll_create1(EPOLL_CLOEXEC);
+   pollState->wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if (pollState->epollFd < 0 || pollState->wakeupFd < 0) {
+      Panic("POLL: cannot create epoll descriptors: %s\n",
+            Err_Errno2String(errno));
+   }
+
+   memset(&ev, 0, sizeof ev);
+   ev.events = EPOLLIN;
+   ev.data.u64 = POLL_EPOLL_WAKEUP_DATA;
+   VERIFY(epoll_ctl(pollState->epollFd, EPOLL_CTL_ADD, pollState->wakeupFd,
+                    &ev) == 0);
+
+   DblLnkLst_Init(&pollState->deferred);
+   pollState->cbTable = HashTable_Alloc(4096, HASH_INT_KEY, NULL);
+
+   PollEpollSourceAttach();
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollFreeChain --
+ *
+ *      HashTable_ForEach callback freeing a callback chain at exit.
+ *
+ * Results:
+ *      0 (continue).
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+PollEpollFreeChain(const char *key,   // IN: unused
+                   void *value,       // IN: PollEpollCb chain
+                   void *clientData)  // IN: unused
+{
+   PollEpollCb *cb = value;
+
+   while (cb != NULL) {
+      PollEpollCb *next = cb->nextSameData;
+
+      free(cb);
+      cb = next;
+   }
+
+   return 0;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollExit --
+ *
+ *      Module exit.
+ *
+ * Results:
+ *       None
+ *
+ * Side effects:
+ *       Discards the module-wide state and clears pollState.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollExit(void)
+{
+   Poll *poll = pollState;
+
+   ASSERT(poll != NULL);
+
+   if (poll->source != NULL) {
+      g_source_destroy(&poll->source->source);
+      g_source_unref(&poll->source->source);
+      poll->source = NULL;
+   }
+
+   PollEpollLock();
+   HashTable_ForEach(poll->cbTable, PollEpollFreeChain, NULL);
+   HashTable_Free(poll->cbTable);
+   poll->cbTable = NULL;
+   free(poll->timers);
+   poll->timers = NULL;
+   free(poll->devices);
+   poll->devices = NULL;
+   close(poll->epollFd);
+   close(poll->wakeupFd);
+   PollEpollUnlock();
+
+   MXUser_DestroyExclLock(poll->lock);
+
+   free(poll);
+   pollState = NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollFire --
+ *
+ *      Fire a callback. Non-periodic callbacks are unregistered before
+ *      they run in case they re-register themselves; periodic timers are
+ *      re-queued.
+ *
+ *      Called and returns with the poll lock held; the lock is dropped
+ *      while the callback runs, so cb must not be used afterwards.
+ *
+ * Results:
+ *      TRUE if the callback fired, FALSE if its lock was busy.
+ *
+ * Side effects:
+ *      Depends on the invoked callback.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+PollEpollFire(PollEpollCb *cb,     // IN
+              VmTimeType now)      // IN: timers only
+{
+   PollerFunction f = cb->cb;
+   void *clientData = cb->clientData;
+   MXUserRecLock *cbLock = cb->cbLock;
+
+   ASSERT_POLL_LOCKED();
+
+   if (cbLock != NULL && !MXUser_TryAcquireRecLock(cbLock)) {
+      /*
+       * We cannot fire at this time. Devices are level triggered and will
+       * be reported again by the next pass; timers retry on the next pass.
+       */
+
+      LOG_CB(3, " did not fire\n", cb);
+      if (cb->type != POLL_DEVICE && cb->heapIndex == -1) {
+         PollEpollTimerQueue(cb, now + 1);
+      }
+      return FALSE;
+   }
+
+   LOG_CB(3, " about to fire\n", cb);
+
+   if ((cb->flags & POLL_FLAG_PERIODIC) == 0) {
+      PollEpollRemoveCb(cb);
+   } else if (cb->type != POLL_DEVICE) {
+      /* A zero delay must still wait for the next pass. */
+      PollEpollTimerQueue(cb, now + MAX(cb->info, 1));
+   }
+
+   PollEpollUnlock();
+   f(clientData);
+   if (cbLock != NULL) {
+      MXUser_ReleaseRecLock(cbLock);
+   }
+   PollEpollLock();
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollFireDevice --
+ *
+ *      Fire the callbacks of a descriptor reported by epoll.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Depends on the invoked callbacks.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollFireDevice(PollClass class,     // IN
+                    uint64 data,         // IN: epoll user data
+                    uint32 events)       // IN: epoll events
+{
+   Poll *poll = pollState;
+   int fd = (int) (uint32) data;
+   uint32 generation = (uint32) (data >> 32);
+   PollEpollDevice *dev;
+   uint32 writeEvents;
+
+   ASSERT_POLL_LOCKED();
+
+   /*
+    * The callbacks of this descriptor may have been removed, and the
+    * descriptor reused, since epoll_wait returned.
+    */
+
+   if (fd >= poll->numDevices || poll->devices[fd].generation != generation) {
+      return;
+   }
+   dev = &poll->devices[fd];
+
+   /* Errors go to the read callback when there is one. */
+   writeEvents = dev->read != NULL ? EPOLLOUT
+                                   : EPOLLOUT | EPOLLERR | EPOLLHUP;
+
+   if (dev->read != NULL &&
+       (events & (EPOLLIN | EPOLLPRI | EPOLLERR | EPOLLHUP)) != 0 &&
+       PollClassSet_IsMember(dev->read->classSet, class)) {
+      PollEpollFire(dev->read, 0);
+
+      /* The read callback may have changed everything. */
+      if (poll->devices[fd].generation != generation) {
+         return;
+      }
+      dev = &poll->devices[fd];
+   }
+
+   if (dev->write != NULL && (events & writeEvents) != 0 &&
+       PollClassSet_IsMember(dev->write->classSet, class)) {
+      PollEpollFire(dev->write, 0);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollFireTimers --
+ *
+ *      Fire the expired timer and main loop callbacks of a class.
+ *      Expired callbacks of other classes are set aside until the next
+ *      pass.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Depends on the invoked callbacks.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollFireTimers(PollClass class)  // IN
+{
+   Poll *poll = pollState;
+   VmTimeType now = Hostinfo_SystemTimerUS();
+   DblLnkLst_Links *curr;
+   DblLnkLst_Links *next;
+
+   ASSERT_POLL_LOCKED();
+
+   /*
+    * Callbacks set aside by earlier passes get another chance first.
+    */
+
+   DblLnkLst_ForEachSafe(curr, next, &poll->deferred) {
+      PollEpollCb *cb = DblLnkLst_Container(curr, PollEpollCb, deferLinks);
+
+      DblLnkLst_Unlink1(&cb->deferLinks);
+      PollEpollTimerQueue(cb, cb->deadline);
+   }
+
+   /*
+    * Re-queued timers always get a deadline after now, so this
+    * terminates even with zero delay periodic callbacks.
+    */
+
+   while (poll->numTimers > 0 && poll->timers[0]->deadline <= now) {
+      PollEpollCb *cb = poll->timers[0];
+
+      PollEpollTimerDequeue(cb);
+
+      if (PollClassSet_IsMember(cb->classSet, class)) {
+         PollEpollFire(cb, now);
+      } else {
+         DblLnkLst_LinkLast(&poll->deferred, &cb->deferLinks);
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollTimeoutUS --
+ *
+ *      How long may the dispatcher sleep before a timer is due?
+ *
+ *      Callbacks set aside for another class don't count.
+ *
+ * Results:
+ *      Microseconds, capped at maxTimeout.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static VmTimeType
+PollEpollTimeoutUS(PollClass class,        // IN
+                   VmTimeType maxTimeout)  // IN
+{
+   Poll *poll = pollState;
+   DblLnkLst_Links *curr;
+   VmTimeType now;
+
+   ASSERT_POLL_LOCKED();
+
+   DblLnkLst_ForEach(curr, &poll->deferred) {
+      PollEpollCb *cb = DblLnkLst_Container(curr, PollEpollCb, deferLinks);
+
+      if (PollClassSet_IsMember(cb->classSet, class)) {
+         return 0;
+      }
+   }
+
+   if (poll->numTimers == 0) {
+      return maxTimeout;
+   }
+
+   now = Hostinfo_SystemTimerUS();
+   if (poll->timers[0]->deadline <= now) {
+      return 0;
+   }
+
+   return MIN(poll->timers[0]->deadline - now, maxTimeout);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollDispatch --
+ *
+ *      One pass of the poll loop: wait up to timeout microseconds for
+ *      events, then fire the ready device callbacks and expired timers of
+ *      the class.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Depends on the invoked callbacks.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollDispatch(PollClass class,       // IN
+                  VmTimeType timeout)    // IN: microseconds
+{
+   Poll *poll = pollState;
+   struct epoll_event events[POLL_EPOLL_MAX_EVENTS];
+   int timeoutMS;
+   int n;
+   int i;
+
+   PollEpollLock();
+   timeout = PollEpollTimeoutUS(class, timeout);
+   PollEpollUnlock();
+
+   /* Round up so that we don't wake up just before the deadline. */
+   timeoutMS = (int) MIN(CEILING(timeout, 1000), MAX_INT32);
+
+   n = epoll_wait(poll->epollFd, events, ARRAYSIZE(events), timeoutMS);
+   if (n < 0) {
+      if (errno != EINTR) {
+         Warning("POLL: epoll_wait failed: %s\n", Err_Errno2String(errno));
+      }
+      n = 0;
+   }
+
+   PollEpollLock();
+   poll->inDispatch = TRUE;
+
+   for (i = 0; i < n; i++) {
+      if (events[i].data.u64 == POLL_EPOLL_WAKEUP_DATA) {
+         uint64 count;
+
+         if (read(poll->wakeupFd, &count, sizeof count) < 0) {
+            ASSERT(errno == EAGAIN);
+         }
+         continue;
+      }
+
+      PollEpollFireDevice(class, events[i].data.u64, events[i].events);
+   }
+
+   PollEpollFireTimers(class);
+
+   poll->inDispatch = FALSE;
+   PollEpollUnlock();
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollLoopTimeout --
+ *
+ *       The poll loop, for programs that don't run a GLib main loop.
+ *
+ * Result:
+ *       Void.
+ *
+ * Side effects:
+ *       Depends on the invoked callbacks.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollLoopTimeout(Bool loop,          // IN: loop forever if TRUE, else do one pass.
+                     Bool *exit,         // IN: NULL or set to TRUE to end loop.
+                     PollClass class,    // IN: class of events (POLL_CLASS_*)
+                     int timeout)        // IN: maximum time to sleep
+{
+   ASSERT(pollState != NULL);
+
+   do {
+      PollEpollDispatch(class, timeout);
+   } while (loop && (exit == NULL || !*exit));
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollCallbackRemoveInt --
+ *
+ *      Remove a callback.
+ *
+ * Results:
+ *      TRUE if entry found and removed, FALSE otherwise
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+PollEpollCallbackRemoveInt(PollClassSet classSet,           // IN
+                           int flags,                       // IN
+                           PollerFunction f,                // IN
+                           void *clientData,                // IN
+                           Bool matchAnyClientData,         // IN
+                           PollEventType type,              // IN
+                           void **foundClientData)          // OUT
+{
+   Poll *poll = pollState;
+   PollEpollCb *found = NULL;
+
+   ASSERT(poll);
+   ASSERT(!clientData || !matchAnyClientData);
+   ASSERT(type >= 0 && type < POLL_NUM_QUEUES);
+   ASSERT(foundClientData);
+
+   PollEpollLock();
+
+   if (matchAnyClientData) {
+      PollEpollFindData search;
+
+      search.classSet = classSet;
+      search.flags = flags;
+      search.f = f;
+      search.type = type;
+      search.found = NULL;
+
+      HashTable_ForEach(poll->cbTable, PollEpollFindAnyData, &search);
+      found = search.found;
+   } else {
+      PollEpollCb *cb;
+
+      if (HashTable_Lookup(poll->cbTable, clientData, (void **) &cb)) {
+         for (; cb != NULL; cb = cb->nextSameData) {
+            if (PollEpollCbMatches(cb, classSet, flags, f, type)) {
+               found = cb;
+               break;
+            }
+         }
+      }
+   }
+
+   if (found != NULL) {
+      *foundClientData = found->clientData;
+      PollEpollRemoveCb(found);
+   } else {
+      LOG(1, ("POLL: no matching entry for cb %p, data %p, flags %x, type %x\n",
+              f, clientData, flags, type));
+   }
+
+   PollEpollUnlock();
+
+   return found != NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollCallbackRemove --
+ *
+ *      Remove a callback.
+ *
+ * Results:
+ *      TRUE if entry found and removed, FALSE otherwise
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+PollEpollCallbackRemove(PollClassSet classSet,   // IN
+                        int flags,               // IN
+                        PollerFunction f,        // IN
+                        void *clientData,        // IN
+                        PollEventType type)      // IN
+{
+   void *foundClientData;
+
+   return PollEpollCallbackRemoveInt(classSet, flags, f, clientData, FALSE,
+                                     type, &foundClientData);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollCallbackRemoveOneByCB --
+ *
+ *      Remove a callback.
+ *
+ * Results:
+ *      TRUE if entry found and removed (*clientData updated), FALSE otherwise
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Bool
+PollEpollCallbackRemoveOneByCB(PollClassSet classSet,   // IN
+                               int flags,               // IN
+                               PollerFunction f,        // IN
+                               PollEventType type,      // IN
+                               void **clientData)       // OUT
+{
+   return PollEpollCallbackRemoveInt(classSet, flags, f, NULL, TRUE, type,
+                                     clientData);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollCallback --
+ *
+ *      For the POLL_REALTIME or POLL_DEVICE queues, entries can be
+ *      inserted for good, to fire on a periodic basis (by setting the
+ *      POLL_FLAG_PERIODIC flag).
+ *
+ *      Otherwise, the callback fires only once.
+ *
+ *      For POLL_REALTIME callbacks, "info" is the time in microseconds
+ *      until (and between) execution of the callback. POLL_MAIN_LOOP
+ *      callbacks fire on every pass of the loop. For POLL_DEVICE
+ *      callbacks, info is a file descriptor.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static VMwareStatus
+PollEpollCallback(PollClassSet classSet,   // IN
+                  int flags,               // IN
+                  PollerFunction f,        // IN
+                  void *clientData,        // IN
+                  PollEventType type,      // IN
+                  PollDevHandle info,      // IN
+                  MXUserRecLock *lock)     // IN
+{
+   Poll *poll = pollState;
+   PollEpollCb *cb;
+
+   ASSERT(f);
+   ASSERT(poll != NULL);
+
+   /*
+    * Every callback must be in POLL_CLASS_MAIN (plus possibly others)
+    */
+   ASSERT(PollClassSet_IsMember(classSet, POLL_CLASS_MAIN) != 0);
+   ASSERT(type >= 0 && type < POLL_NUM_QUEUES);
+
+   cb = Util_SafeCalloc(1, sizeof *cb);
+   cb->flags = flags;
+   cb->cb = f;
+   cb->clientData = clientData;
+   cb->classSet = classSet;
+   cb->cbLock = lock;
+   cb->type = type;
+   cb->info = info;
+   cb->heapIndex = -1;
+   DblLnkLst_Init(&cb->deferLinks);
+   LOG_CB(2, " is being added\n", cb);
+
+   PollEpollLock();
+
+   switch (type) {
+   case POLL_MAIN_LOOP:
+      ASSERT(info == 0);
+      /* Fall-through */
+   case POLL_REALTIME:
+      ASSERT(info >= 0);
+      PollEpollTimerQueue(cb, Hostinfo_SystemTimerUS() + info);
+      break;
+
+   case POLL_DEVICE: {
+      PollEpollDevice *dev;
+
+      if (info < 0) {
+         PollEpollUnlock();
+         free(cb);
+
+         return VMWARE_STATUS_ERROR;
+      }
+
+      if (info >= poll->numDevices) {
+         uint32 newSize = MAX(info + 1, MAX(64, 2 * poll->numDevices));
+
+         poll->devices = Util_SafeRealloc(poll->devices,
+                                          newSize * sizeof *poll->devices);
+         memset(poll->devices + poll->numDevices, 0,
+                (newSize - poll->numDevices) * sizeof *poll->devices);
+         poll->numDevices = newSize;
+      }
+
+      dev = &poll->devices[info];
+
+      if (dev->read == NULL && dev->write == NULL) {
+         dev->generation++;
+      }
+
+      /*
+       * Only one callback per direction per descriptor.
+       */
+
+      if (flags & POLL_FLAG_WRITE) {
+         ASSERT(dev->write == NULL);
+         dev->write = cb;
+      } else {
+         ASSERT(dev->read == NULL);
+         dev->read = cb;
+      }
+
+      PollEpollDeviceUpdate(info);
+      break;
+   }
+
+   case POLL_VIRTUALREALTIME:
+   case POLL_VTIME:
+   default:
+      NOT_IMPLEMENTED();
+   }
+
+   PollEpollHashAdd(cb);
+
+   PollEpollUnlock();
+
+   return VMWARE_STATUS_SUCCESS;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * PollEpollNotifyChange --
+ *
+ *      Wake up the dispatching thread so that it notices a change.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+PollEpollNotifyChange(PollClassSet classSet)  // IN: unused
+{
+   PollEpollWakeup();
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollSourcePrepare --
+ * PollEpollSourceCheck --
+ * PollEpollSourceDispatch --
+ *
+ *      GSource functions. The main loop only ever polls the epoll
+ *      descriptor; timers are folded into the poll timeout.
+ *
+ * Results:
+ *      TRUE if the source is ready to dispatch.
+ *
+ * Side effects:
+ *      Dispatch fires callbacks.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static gboolean
+PollEpollSourcePrepare(GSource *source,  // IN: unused
+                       gint *timeout)    // OUT
+{
+   VmTimeType us;
+
+   PollEpollLock();
+   us = PollEpollTimeoutUS(POLL_CLASS_MAIN, MAX_INT32 * CONST64U(1000));
+   PollEpollUnlock();
+
+   if (us >= MAX_INT32 * CONST64U(1000)) {
+      *timeout = -1;
+   } else {
+      *timeout = (gint) CEILING(us, 1000);
+   }
+
+   return *timeout == 0;
+}
+
+
+static gboolean
+PollEpollSourceCheck(GSource *source)  // IN
+{
+   PollEpollSource *src = (PollEpollSource *) source;
+   VmTimeType us;
+
+   if (src->pollFd.revents != 0) {
+      return TRUE;
+   }
+
+   PollEpollLock();
+   us = PollEpollTimeoutUS(POLL_CLASS_MAIN, 1);
+   PollEpollUnlock();
+
+   return us == 0;
+}
+
+
+static gboolean
+PollEpollSourceDispatch(GSource *source,       // IN: unused
+                        GSourceFunc callback,  // IN: unused
+                        gpointer data)         // IN: unused
+{
+   PollEpollDispatch(POLL_CLASS_MAIN, 0);
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PollEpollSourceAttach --
+ *
+ *      Hook the epoll descriptor into the default GLib main context.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PollEpollSourceAttach(void)
+{
+   static GSourceFuncs funcs = {
+      PollEpollSourcePrepare,
+      PollEpollSourceCheck,
+      PollEpollSourceDispatch,
+      NULL,
+   };
+   PollEpollSource *src;
+
+   src = (PollEpollSource *) g_source_new(&funcs, sizeof *src);
+   src->pollFd.fd = pollState->epollFd;
+   src->pollFd.events = G_IO_IN;
+   g_source_add_poll(&src->source, &src->pollFd);
+   g_source_attach(&src->source, NULL);
+
+   pollState->source = src;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Poll_InitEpoll --
+ *
+ *      Public init function for this Poll implementation. Poll callbacks
+ *      are dispatched by the default GLib main context or by Poll_Loop*.
+ *      Does nothing if another Poll implementation was started first.
+ *
+ *      Must be called before anything calls Poll_InitGtk, which is then a
+ *      no-op: vmtoolsd does so at startup when "poll-backend" is "epoll".
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+Poll_InitEpoll(void)
+{
+   static GStaticMutex mx = G_STATIC_MUTEX_INIT;
+   static volatile int inited = 0;
+
+   static const PollImpl epollImpl =
+   {
+      PollEpollInit,
+      PollEpollExit,
+      PollEpollLoopTimeout,
+      PollEpollCallback,
+      PollEpollCallbackRemove,
+      PollEpollCallbackRemoveOneByCB,
+      PollLockingAlwaysEnabled,
+      PollEpollNotifyChange,
+   };
+
+   g_static_mutex_lock(&mx);
+   if (!inited && !Poll_IsInitialized()) {
+      Poll_InitWithImpl(&epollImpl);
+      inited = 1;
+   }
+   g_static_mutex_unlock(&mx);
+}
@@ -1459,7 +1459,8 @@ PollGtkBasicCallback(gpointer data) // IN: The eventEntry
  * Poll_InitGtk --
  *
  *      Public init function for this Poll implementation. Poll loop will be
- *      up and running after this is called.
+ *      up and running after this is called. Does nothing if another Poll
+ *      implementation was started first, e.g. by Poll_InitEpoll.
  *
  * Results:
  *      None
@@ -1488,7 +1489,7 @@ Poll_InitGtk(void)
    };
 
    g_static_mutex_lock(&mx);
-   if (!inited) {
+   if (!inited && !Poll_IsInitialized()) {
       Poll_InitWithImpl(&gtkImpl);
       inited = 1;
    }
@@ -24,6 +24,7 @@
 
 #include <string.h>
 #include "vm_assert.h"
+#include "dynbuf.h"
 #include "dynxdr.h"
 #include "rpcChannelInt.h"
 #include "str.h"
@@ -51,6 +52,13 @@ typedef struct RpcChannelInt {
 /** Max number of times to attempt a channel restart. */
 #define RPCIN_MAX_RESTARTS 60
 
+/**
+ * Size of the on-stack arena used while dispatching an RPC. Command names,
+ * decoded XDR arguments and the XDR encoding of most replies fit in it, so
+ * dispatching a typical RPC allocates nothing beyond the final reply.
+ */
+#define RPCCHANNEL_DISPATCH_ARENA_SIZE 2048
+
 #define LGPFX "RpcChannel: "
 
 static gboolean
@@ -189,20 +197,22 @@ RpcChannelReset(RpcInData *data)
  *
  * @param[in]  data     RpcIn data.
  * @param[in]  rpc      The RPC registration data.
+ * @param[in]  arena    Arena for temporary allocations.
  *
  * @return Whether the RPC was handled successfully.
  */
 
 static Bool
 RpcChannelXdrWrapper(RpcInData *data,
-                     RpcChannelCallback *rpc)
+                     RpcChannelCallback *rpc,
+                     DynBufArena *arena)
 {
    Bool ret;
    RpcInData copy;
    void *xdrData = NULL;
 
    if (rpc->xdrIn != NULL) {
-      xdrData = malloc(rpc->xdrInSize);
+      xdrData = DynBufArena_Alloc(arena, rpc->xdrInSize);
       if (xdrData == NULL) {
          ret = RPCIN_SETRETVALS(data, "Out of memory.", FALSE);
          goto exit;
@@ -212,7 +222,6 @@ RpcChannelXdrWrapper(RpcInData *data,
       if (!XdrUtil_Deserialize(data->args + 1, data->argsSize - 1,
                                rpc->xdrIn, xdrData)) {
          ret = RPCIN_SETRETVALS(data, "XDR deserialization failed.", FALSE);
-         free(xdrData);
          goto exit;
       }
 
@@ -232,7 +241,6 @@ RpcChannelXdrWrapper(RpcInData *data,
 
    if (rpc->xdrIn != NULL) {
       VMX_XDR_FREE(rpc->xdrIn, xdrData);
-      free(xdrData);
       copy.args = NULL;
       data->result = copy.result;
       data->resultLen = copy.resultLen;
@@ -242,8 +250,9 @@ RpcChannelXdrWrapper(RpcInData *data,
    if (rpc->xdrOut != NULL && copy.result != NULL) {
       XDR xdrs;
       xdrproc_t xdrProc = rpc->xdrOut;
+      char *result;
 
-      if (DynXdr_Create(&xdrs) == NULL) {
+      if (DynXdr_CreateWithArena(&xdrs, arena) == NULL) {
          ret = RPCIN_SETRETVALS(data, "Out of memory.", FALSE);
          goto exit;
       }
@@ -254,13 +263,24 @@ RpcChannelXdrWrapper(RpcInData *data,
          goto exit;
       }
 
+      /*
+       * The encoded reply lives in the dispatch arena; the caller needs a
+       * heap copy it can free. This is the only allocation for the reply.
+       */
+      result = DynXdr_AllocGet(&xdrs);
+      if (result == NULL && XDR_GETPOS(&xdrs) > 0) {
+         ret = RPCIN_SETRETVALS(data, "Out of memory.", FALSE);
+         DynXdr_Destroy(&xdrs, TRUE);
+         goto exit;
+      }
+
       if (copy.freeResult) {
          VMX_XDR_FREE(rpc->xdrOut, copy.result);
       }
-      data->result = DynXdr_Get(&xdrs);
+      data->result = result;
       data->resultLen = XDR_GETPOS(&xdrs);
       data->freeResult = TRUE;
-      DynXdr_Destroy(&xdrs, FALSE);
+      DynXdr_Destroy(&xdrs, TRUE);
    }
 
 exit:
@@ -355,18 +375,31 @@ gboolean
 RpcChannel_Dispatch(RpcInData *data)
 {
    char *name = NULL;
-   unsigned int index = 0;
+   const char *token;
    size_t nameLen;
+   unsigned int index = 0;
    Bool status;
    RpcChannelCallback *rpc = NULL;
    RpcChannelInt *chan = data->clientData;
+   char arenaStorage[RPCCHANNEL_DISPATCH_ARENA_SIZE];
+   DynBufArena arena;
 
-   name = StrUtil_GetNextToken(&index, data->args, " ");
+   DynBufArena_Init(&arena, arenaStorage, sizeof arenaStorage);
+
+   /*
+    * Tokenize in place; only the name itself is copied, into the dispatch
+    * arena, since the handler table needs it NUL-terminated.
+    */
+   if (StrUtil_GetNextTokenView(&index, data->args, " ", &token, &nameLen)) {
+      name = DynBufArena_Alloc(&arena, nameLen + 1);
+   }
    if (name == NULL) {
       Debug(LGPFX "Bad command (null) received.\n");
       status = RPCIN_SETRETVALS(data, "Bad command", FALSE);
       goto exit;
    }
+   memcpy(name, token, nameLen);
+   name[nameLen] = '\0';
 
    if (chan->rpcs != NULL) {
       rpc = g_hash_table_lookup(chan->rpcs, name);
@@ -379,15 +412,14 @@ RpcChannel_Dispatch(RpcInData *data)
    }
 
    /* Adjust the RPC arguments. */
-   nameLen = strlen(name);
    data->name = name;
-   data->args = data->args + nameLen;
-   data->argsSize -= nameLen;
+   data->args = data->args + index;
+   data->argsSize -= index;
    data->appCtx = chan->appCtx;
    data->clientData = rpc->clientData;
 
    if (rpc->xdrIn != NULL || rpc->xdrOut != NULL) {
-      status = RpcChannelXdrWrapper(data, rpc);
+      status = RpcChannelXdrWrapper(data, rpc, &arena);
    } else {
       status = rpc->callback(data);
    }
@@ -396,7 +428,7 @@ RpcChannel_Dispatch(RpcInData *data)
 
 exit:
    data->name = NULL;
-   free(name);
+   DynBufArena_Release(&arena);
    return status;
 }
 
@@ -104,6 +104,7 @@ typedef struct RpcInCallbackList {
 #define RPCIN_HEARTBEAT_INTERVAL              1000             /* 1 second */
 #define RPCIN_MIN_SEND_BUF_SIZE               (64 * 1024)
 #define RPCIN_MIN_RECV_BUF_SIZE               (64 * 1024)
+#define RPCIN_READ_AHEAD_SIZE                 (4 * 1024)
 
 struct RpcIn;
 
@@ -1111,6 +1112,14 @@ RpcInConnectDone(AsyncSocket *asock,   // IN
       goto exit;
    }
 
+   /*
+    * Header and body of small packets can then come from a single read.
+    */
+   if (AsyncSocket_SetReadAheadSize(asock, RPCIN_READ_AHEAD_SIZE) !=
+       ASOCKERR_SUCCESS) {
+      Debug("RpcIn: could not enable read-ahead on vsocket.\n");
+   }
+
    conn->connected = TRUE;
    RpcInConnRecvHeader(conn);
    return;
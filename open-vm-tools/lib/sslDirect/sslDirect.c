@@ -33,6 +33,7 @@
 #include <winsock2.h>
 #else
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
 #endif
@@ -589,6 +590,43 @@ SSL_Write(SSLSock ssl,   // IN
 }
 
 
+#ifndef _WIN32
+/*
+ *----------------------------------------------------------------------
+ *
+ * SSL_WriteV()
+ *
+ *    Functional equivalent of the writev() syscall.
+ *
+ *    SSL records are written one buffer at a time, so an encrypted
+ *    connection only writes (some of) the first buffer; callers must be
+ *    prepared for short writes anyway.
+ *
+ * Results:
+ *    Returns the number of bytes written, or -1 on error.
+ *
+ * Side effects:
+ *
+ *----------------------------------------------------------------------
+ */
+
+ssize_t
+SSL_WriteV(SSLSock ssl,               // IN
+           const struct iovec *iov,   // IN
+           int iovcnt)                // IN
+{
+   ASSERT(ssl);
+   ASSERT(iovcnt > 0);
+
+   if (ssl->connectionFailed || ssl->encrypted) {
+      return SSL_Write(ssl, iov[0].iov_base, iov[0].iov_len);
+   }
+
+   return writev(ssl->fd, iov, iovcnt);
+}
+#endif
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -33,6 +33,7 @@
 #include <winsock2.h>
 #else
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
 #endif
@@ -80,6 +81,37 @@ SSL_Write(SSLSock sslSock,   // IN
 }
 
 
+#ifndef _WIN32
+/*
+ *----------------------------------------------------------------------
+ *
+ * SSL_WriteV()
+ *
+ *    Functional equivalent of the writev() syscall.
+ *
+ * Results:
+ *    Returns the number of bytes written, or -1 on error.
+ *
+ * Side effects:
+ *
+ *----------------------------------------------------------------------
+ */
+
+ssize_t
+SSL_WriteV(SSLSock sslSock,           // IN
+           const struct iovec *iov,   // IN
+           int iovcnt)                // IN
+{
+   struct msghdr msg = { 0 };
+
+   msg.msg_iov = (struct iovec *) iov;
+   msg.msg_iovlen = iovcnt;
+
+   return sendmsg(sslSock->fd, &msg, 0);
+}
+#endif
+
+
 /*
  *----------------------------------------------------------------------
  *
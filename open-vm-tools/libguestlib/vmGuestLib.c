@@ -23,6 +23,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "vmware.h"
 #include "vmGuestLib.h"
 #include "vmGuestLibInt.h"
@@ -37,6 +42,9 @@
 #include "dynxdr.h"
 #include "xdrutil.h"
 #include "ctype.h"
+#include "guestlibStatsShm.h"
+#include "hashTable.h"
+#include "hostinfo.h"
 
 #define GUESTLIB_NAME "VMware Guest API"
 
@@ -67,12 +75,51 @@ typedef struct {
     */
    size_t dataSize;
    void *data;
+
+   /*
+    * Stats snapshot published by vmtoolsd, mapped read-only, the sequence
+    * number of the snapshot that 'data' was decoded from (0 if 'data' came
+    * from the backdoor), and when the snapshot was last (re)mapped.
+    */
+   const GuestlibStatsShm *shm;
+   uint32 shmSeq;
+   time_t shmMapTime;
 } VMGuestLibHandleType;
 
+/* Result of looking at the stats snapshot. */
+typedef enum {
+   VMGUESTLIB_SNAPSHOT_NONE,        // No fresh snapshot, ask the host.
+   VMGUESTLIB_SNAPSHOT_UNCHANGED,   // The handle already holds the snapshot.
+   VMGUESTLIB_SNAPSHOT_NEW,         // A copy of a newer snapshot.
+} VMGuestLibSnapshotResult;
+
+/* Attempts at a consistent snapshot copy before giving up on it. */
+#define VMGUESTLIB_SNAPSHOT_TRIES 1000
+
+/* A stat held by a VMGuestLibStatCache. */
+typedef struct {
+   VMGuestLibError error;
+   char *reply;
+   size_t replySize;
+   VmTimeType fetchTime;    // Hostinfo_SystemTimerUS() when fetched.
+   uint32 batch;            // Batch that last fetched it.
+} VMGuestLibCachedStat;
+
+struct _VMGuestLibStatCache {
+   char *encoding;
+   HashTable *stats;        // Stat name -> VMGuestLibCachedStat
+   uint32 batch;            // Number of VMGuestLib_StatGetBatch() calls.
+};
+
+#define VMGUESTLIB_STATCACHE_BUCKETS 64
+
 #define HANDLE_VERSION(h)     (((VMGuestLibHandleType *)(h))->version)
 #define HANDLE_SESSIONID(h)   (((VMGuestLibHandleType *)(h))->sessionId)
 #define HANDLE_DATA(h)        (((VMGuestLibHandleType *)(h))->data)
 #define HANDLE_DATASIZE(h)    (((VMGuestLibHandleType *)(h))->dataSize)
+#define HANDLE_SHM(h)         (((VMGuestLibHandleType *)(h))->shm)
+#define HANDLE_SHMSEQ(h)      (((VMGuestLibHandleType *)(h))->shmSeq)
+#define HANDLE_SHMMAPTIME(h)  (((VMGuestLibHandleType *)(h))->shmMapTime)
 
 #define VMGUESTLIB_GETSTAT_V2(HANDLE, ERROR, OUTPTR, FIELDNAME)      \
    do {                                                              \
@@ -236,6 +283,235 @@ VMGuestLibCheckArgs(VMGuestLibHandle handle, // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMGuestLibUnmapSnapshot --
+ *
+ *      Unmap the stats snapshot from the handle, if it's mapped.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMGuestLibUnmapSnapshot(VMGuestLibHandle handle) // IN
+{
+   if (HANDLE_SHM(handle) != NULL) {
+      munmap((void *)HANDLE_SHM(handle), GUESTLIB_STATS_SHM_SIZE);
+      HANDLE_SHM(handle) = NULL;
+   }
+   HANDLE_SHMSEQ(handle) = 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMGuestLibMapSnapshot --
+ *
+ *      (Re)map the stats snapshot published by vmtoolsd.  The segment is
+ *      only trusted if nobody but root can have written it.
+ *
+ * Results:
+ *      TRUE if the snapshot is mapped.
+ *
+ * Side effects:
+ *      Any previous mapping is dropped.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+VMGuestLibMapSnapshot(VMGuestLibHandle handle) // IN
+{
+   const GuestlibStatsShm *shm;
+   struct stat st;
+   void *addr;
+   int fd;
+
+   VMGuestLibUnmapSnapshot(handle);
+
+   fd = open(GUESTLIB_STATS_SHM_PATH, O_RDONLY | O_NOFOLLOW);
+   if (fd < 0) {
+      return FALSE;
+   }
+
+   if (fstat(fd, &st) != 0 ||
+       !S_ISREG(st.st_mode) ||
+       st.st_uid != 0 ||
+       (st.st_mode & (S_IWGRP | S_IWOTH)) != 0 ||
+       st.st_size < GUESTLIB_STATS_SHM_SIZE) {
+      Debug("Ignoring stats snapshot %s\n", GUESTLIB_STATS_SHM_PATH);
+      close(fd);
+      return FALSE;
+   }
+
+   addr = mmap(NULL, GUESTLIB_STATS_SHM_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (addr == MAP_FAILED) {
+      return FALSE;
+   }
+
+   shm = addr;
+   if (shm->magic != GUESTLIB_STATS_SHM_MAGIC ||
+       shm->version != GUESTLIB_STATS_SHM_VERSION) {
+      munmap(addr, GUESTLIB_STATS_SHM_SIZE);
+      return FALSE;
+   }
+
+   HANDLE_SHM(handle) = shm;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMGuestLibCopySnapshot --
+ *
+ *      Copy the mapped stats snapshot out of the segment, under its
+ *      sequence lock.  Nothing is copied if the handle already holds the
+ *      snapshot.
+ *
+ * Results:
+ *      VMGuestLibSnapshotResult.  For VMGUESTLIB_SNAPSHOT_NEW, the malloc'ed
+ *      reply, the protocol version it uses and the snapshot's sequence
+ *      number.
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VMGuestLibSnapshotResult
+VMGuestLibCopySnapshot(VMGuestLibHandle handle, // IN
+                       char **reply,            // OUT
+                       size_t *replyLen,        // OUT
+                       uint32 *hostVersion,     // OUT
+                       uint32 *seq)             // OUT
+{
+   const GuestlibStatsShm *shm = HANDLE_SHM(handle);
+   unsigned int tries;
+
+   for (tries = 0; tries < VMGUESTLIB_SNAPSHOT_TRIES; tries++) {
+      VMGuestLibSnapshotResult result;
+      uint32 startSeq = Atomic_Read(&shm->seq);
+      uint64 now = time(NULL);
+      uint64 updateTime;
+      uint32 interval;
+      uint32 version;
+      uint32 len;
+      char *buf = NULL;
+
+      if (startSeq & 1) {
+         /* Update in progress. */
+         continue;
+      }
+      GUESTLIB_STATS_SHM_BARRIER();
+
+      updateTime = shm->updateTime;
+      interval = shm->interval;
+      version = shm->hostVersion;
+      len = shm->replyLen;
+
+      if (interval == 0 ||
+          updateTime > now + interval ||
+          updateTime + (uint64)interval * GUESTLIB_STATS_SHM_STALE_INTERVALS <
+             now ||
+          len == 0 ||
+          len > GUESTLIB_STATS_SHM_MAX_REPLY) {
+         result = VMGUESTLIB_SNAPSHOT_NONE;
+      } else if (startSeq == HANDLE_SHMSEQ(handle) &&
+                 HANDLE_SESSIONID(handle) != 0) {
+         result = VMGUESTLIB_SNAPSHOT_UNCHANGED;
+      } else {
+         buf = Util_SafeMalloc(len);
+         memcpy(buf, shm->reply, len);
+         result = VMGUESTLIB_SNAPSHOT_NEW;
+      }
+
+      GUESTLIB_STATS_SHM_BARRIER();
+      if (Atomic_Read(&shm->seq) != startSeq) {
+         /* Raced with an update; what we read may be torn. */
+         free(buf);
+         continue;
+      }
+
+      if (result == VMGUESTLIB_SNAPSHOT_NEW) {
+         *reply = buf;
+         *replyLen = len;
+         *hostVersion = version;
+         *seq = startSeq;
+      }
+      return result;
+   }
+
+   Debug("Stats snapshot keeps changing, using the backdoor\n");
+   return VMGUESTLIB_SNAPSHOT_NONE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMGuestLibReadSnapshot --
+ *
+ *      Look for a fresh stats snapshot from vmtoolsd.  If the mapped one is
+ *      stale, vmtoolsd may have been restarted and replaced the segment,
+ *      so map it again before giving up.  That is attempted at most once
+ *      a second.
+ *
+ * Results:
+ *      See VMGuestLibCopySnapshot().
+ *
+ * Side effects:
+ *      The snapshot may be (re)mapped into the handle.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VMGuestLibSnapshotResult
+VMGuestLibReadSnapshot(VMGuestLibHandle handle, // IN
+                       char **reply,            // OUT
+                       size_t *replyLen,        // OUT
+                       uint32 *hostVersion,     // OUT
+                       uint32 *seq)             // OUT
+{
+   VMGuestLibSnapshotResult result;
+   time_t now;
+
+   if (HANDLE_SHM(handle) != NULL) {
+      result = VMGuestLibCopySnapshot(handle, reply, replyLen, hostVersion,
+                                      seq);
+      if (result != VMGUESTLIB_SNAPSHOT_NONE) {
+         return result;
+      }
+   }
+
+   /*
+    * Mapping is much more expensive than reading the snapshot, so don't
+    * retry it more than once a second while there's no usable snapshot.
+    */
+   now = time(NULL);
+   if (now == HANDLE_SHMMAPTIME(handle)) {
+      return VMGUESTLIB_SNAPSHOT_NONE;
+   }
+   HANDLE_SHMMAPTIME(handle) = now;
+
+   if (!VMGuestLibMapSnapshot(handle)) {
+      return VMGUESTLIB_SNAPSHOT_NONE;
+   }
+   return VMGuestLibCopySnapshot(handle, reply, replyLen, hostVersion, seq);
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -318,6 +594,7 @@ VMGuestLib_CloseHandle(VMGuestLibHandle handle) // IN
       }
    }
    free(data);
+   VMGuestLibUnmapSnapshot(handle);
 
    /* Be paranoid. */
    HANDLE_DATA(handle) = NULL;
@@ -330,14 +607,14 @@ VMGuestLib_CloseHandle(VMGuestLibHandle handle) // IN
 /*
  *-----------------------------------------------------------------------------
  *
- * VMGuestLibUpdateInfo --
+ * VMGuestLibGetInfoFromHost --
  *
- *      Retrieve the bundle of stats over the backdoor and update the pointer to
- *      the Guestlib info in the handle.
+ *      Retrieve the bundle of stats over the backdoor, negotiating the
+ *      protocol version with the host.
  *
  * Results:
- *      TRUE on success
- *      FALSE on failure
+ *      VMGuestLibError.  On success, the malloc'ed reply and the
+ *      protocol version it uses.
  *
  * Side effects:
  *      None
@@ -346,7 +623,10 @@ VMGuestLib_CloseHandle(VMGuestLibHandle handle) // IN
  */
 
 static VMGuestLibError
-VMGuestLibUpdateInfo(VMGuestLibHandle handle) // IN
+VMGuestLibGetInfoFromHost(VMGuestLibHandle handle, // IN
+                          char **replyOut,         // OUT
+                          size_t *replyLenOut,     // OUT
+                          uint32 *hostVersionOut)  // OUT
 {
    char *reply = NULL;
    size_t replyLen;
@@ -435,7 +715,59 @@ VMGuestLibUpdateInfo(VMGuestLibHandle handle) // IN
    } while (ret != VMGUESTLIB_ERROR_SUCCESS);
 
    if (ret != VMGUESTLIB_ERROR_SUCCESS) {
-      goto done;
+      free(reply);
+      return ret;
+   }
+
+   *replyOut = reply;
+   *replyLenOut = replyLen;
+   *hostVersionOut = hostVersion;
+   return VMGUESTLIB_ERROR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMGuestLibUpdateInfo --
+ *
+ *      Retrieve the bundle of stats, from the snapshot vmtoolsd publishes if
+ *      there's a fresh one and over the backdoor otherwise, and update the
+ *      pointer to the Guestlib info in the handle.
+ *
+ * Results:
+ *      TRUE on success
+ *      FALSE on failure
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VMGuestLibError
+VMGuestLibUpdateInfo(VMGuestLibHandle handle) // IN
+{
+   char *reply = NULL;
+   size_t replyLen;
+   VMGuestLibError ret;
+   uint32 hostVersion;
+   uint32 snapshotSeq = 0;
+
+   switch (VMGuestLibReadSnapshot(handle, &reply, &replyLen, &hostVersion,
+                                  &snapshotSeq)) {
+   case VMGUESTLIB_SNAPSHOT_UNCHANGED:
+      /* The handle already holds this snapshot. */
+      return VMGUESTLIB_ERROR_SUCCESS;
+   case VMGUESTLIB_SNAPSHOT_NEW:
+      ret = VMGUESTLIB_ERROR_SUCCESS;
+      break;
+   default:
+      ret = VMGuestLibGetInfoFromHost(handle, &reply, &replyLen, &hostVersion);
+      if (ret != VMGUESTLIB_ERROR_SUCCESS) {
+         goto done;
+      }
+      break;
    }
 
    /* Sanity check the results. */
@@ -495,6 +827,18 @@ VMGuestLibUpdateInfo(VMGuestLibHandle handle) // IN
          goto done;
       }
 
+      /*
+       * Deep-free the statistics of the previous update: XDR decodes
+       * strings into whatever buffer the pointer already refers to, which
+       * may be too small for the new value.
+       */
+      if (HANDLE_VERSION(handle) == 3 && HANDLE_DATA(handle) != NULL) {
+         v3stats = HANDLE_DATA(handle);
+         for (count = 0; count < v3stats->numStats; count++) {
+            VMX_XDR_FREE(xdr_GuestLibV3Stat, &v3stats->stats[count]);
+         }
+      }
+
       /* 0. Copy the reply version and sessionId to the handle. */
       HANDLE_VERSION(handle) = v3reply->hdr.version;
       HANDLE_SESSIONID(handle) = v3reply->hdr.sessionId;
@@ -507,6 +851,7 @@ VMGuestLibUpdateInfo(VMGuestLibHandle handle) // IN
 
       if (!xdr_GuestLibV3StatCount(&xdrs, &count)) {
          xdr_destroy(&xdrs);
+         ret = VMGUESTLIB_ERROR_OTHER;
          goto done;
       }
       if (count >= GUESTLIB_MAX_STATISTIC_ID) {
@@ -566,6 +911,9 @@ VMGuestLibUpdateInfo(VMGuestLibHandle handle) // IN
    }
 
 done:
+   /* Only remember the snapshot once it has been decoded successfully. */
+   HANDLE_SHMSEQ(handle) = ret == VMGUESTLIB_ERROR_SUCCESS &&
+                           HANDLE_SESSIONID(handle) != 0 ? snapshotSeq : 0;
    free(reply);
    return ret;
 }
@@ -1919,3 +2267,213 @@ VMGuestLib_StatFree(char *reply,       // IN
 {
    free(reply);
 }
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMGuestLibFreeCachedStat --
+ *
+ *      Free a stat held by a stat cache.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMGuestLibFreeCachedStat(void *clientData) // IN
+{
+   VMGuestLibCachedStat *cached = clientData;
+
+   free(cached->reply);
+   free(cached);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMGuestLib_StatCacheOpen --
+ *
+ *      Create a stat cache for VMGuestLib_StatGetBatch(), for stats in the
+ *      given encoding (see VMGuestLib_StatGet()).  Release it with
+ *      VMGuestLib_StatCacheClose().
+ *
+ * Results:
+ *      VMGuestLibError
+ *
+ * Side effects:
+ *      Resources are allocated.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+VMGuestLibError
+VMGuestLib_StatCacheOpen(const char *encoding,        // IN
+                         VMGuestLibStatCache *cache)  // OUT
+{
+   struct _VMGuestLibStatCache *c;
+
+   if (encoding == NULL || cache == NULL) {
+      return VMGUESTLIB_ERROR_INVALID_ARG;
+   }
+
+   c = Util_SafeCalloc(1, sizeof *c);
+   c->encoding = Util_SafeStrdup(encoding);
+   c->stats = HashTable_Alloc(VMGUESTLIB_STATCACHE_BUCKETS,
+                              HASH_STRING_KEY | HASH_FLAG_COPYKEY,
+                              VMGuestLibFreeCachedStat);
+
+   *cache = c;
+   return VMGUESTLIB_ERROR_SUCCESS;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMGuestLib_StatCacheClose --
+ *
+ *      Release a stat cache and all the replies it holds.
+ *
+ * Results:
+ *      None
+ *
+ * Side effects:
+ *      Replies returned by VMGuestLib_StatGetBatch() become invalid.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+VMGuestLib_StatCacheClose(VMGuestLibStatCache cache) // IN
+{
+   if (cache == NULL) {
+      return;
+   }
+
+   HashTable_Free(cache->stats);
+   free(cache->encoding);
+   free(cache);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMGuestLib_StatGetBatch --
+ *
+ *      Fetch several semi-structured stats (see VMGuestLib_StatGet()).
+ *      Stats that are in the cache and no older than 'maxStalenessMs' are
+ *      answered from it; all the others are requested over one channel
+ *      to the hypervisor, instead of one channel per stat, and cached.
+ *
+ * Results:
+ *      VMGUESTLIB_ERROR_SUCCESS if every stat was answered; results[i]
+ *      then holds the error, reply and reply size for stats[i].
+ *      VMGUESTLIB_ERROR_NOT_AVAILABLE if the hypervisor couldn't be
+ *      reached; results for stats that weren't in the cache then hold
+ *      that error and no reply.
+ *
+ * Side effects:
+ *      Replies returned by the previous call on this cache may become
+ *      invalid.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+VMGuestLibError
+VMGuestLib_StatGetBatch(VMGuestLibStatCache cache,       // IN
+                        const char * const *stats,       // IN
+                        uint32 numStats,                 // IN
+                        uint32 maxStalenessMs,           // IN
+                        VMGuestLibStatResult *results)   // OUT
+{
+   VMGuestLibError ret = VMGUESTLIB_ERROR_SUCCESS;
+   VmTimeType now = Hostinfo_SystemTimerUS();
+   RpcChannel *chan = NULL;
+   Bool chanFailed = FALSE;
+   uint32 i;
+
+   if (cache == NULL) {
+      return VMGUESTLIB_ERROR_INVALID_HANDLE;
+   }
+   if (numStats > 0 && (stats == NULL || results == NULL)) {
+      return VMGUESTLIB_ERROR_INVALID_ARG;
+   }
+
+   cache->batch++;
+
+   for (i = 0; i < numStats; i++) {
+      const char *stat = stats[i] != NULL ? stats[i] : "";
+      VMGuestLibCachedStat *cached = NULL;
+      char *command;
+      char *reply = NULL;
+      size_t replySize = 0;
+      Bool ok;
+
+      /*
+       * A stat listed twice is fetched once, so that the first result
+       * stays valid.
+       */
+      if (HashTable_Lookup(cache->stats, stat, (void **)&cached) &&
+          (cached->batch == cache->batch ||
+           (maxStalenessMs > 0 &&
+            now - cached->fetchTime <= (VmTimeType)maxStalenessMs * 1000))) {
+         goto answer;
+      }
+
+      if (chan == NULL && !chanFailed) {
+         chan = RpcChannel_New();
+         if (chan != NULL && !RpcChannel_Start(chan)) {
+            RpcChannel_Destroy(chan);
+            chan = NULL;
+         }
+         chanFailed = chan == NULL;
+      }
+      if (chanFailed) {
+         Debug("%s: unable to open the channel\n", __FUNCTION__);
+         results[i].error = VMGUESTLIB_ERROR_NOT_AVAILABLE;
+         results[i].reply = NULL;
+         results[i].replySize = 0;
+         ret = VMGUESTLIB_ERROR_NOT_AVAILABLE;
+         continue;
+      }
+
+      command = Str_SafeAsprintf(NULL, "%s %s %s",
+                                 VMGUESTLIB_STATDATA_COMMAND_STRING,
+                                 cache->encoding, stat);
+      ok = RpcChannel_Send(chan, command, strlen(command), &reply, &replySize);
+      free(command);
+
+      if (cached == NULL) {
+         cached = Util_SafeCalloc(1, sizeof *cached);
+         HashTable_Insert(cache->stats, stat, cached);
+      } else {
+         free(cached->reply);
+      }
+      cached->error = ok ? VMGUESTLIB_ERROR_SUCCESS
+                         : VMGUESTLIB_ERROR_NOT_AVAILABLE;
+      cached->reply = reply;
+      cached->replySize = replySize;
+      cached->fetchTime = now;
+      cached->batch = cache->batch;
+
+answer:
+      results[i].error = cached->error;
+      results[i].reply = cached->reply;
+      results[i].replySize = cached->replySize;
+   }
+
+   if (chan != NULL) {
+      RpcChannel_Stop(chan);
+      RpcChannel_Destroy(chan);
+   }
+
+   return ret;
+}
@@ -84,8 +84,15 @@ typedef struct BlockInfo {
 } BlockInfo;
 
 
-/* XXX: Is it worth turning this into a hash table? */
-static DblLnkLst_Links blockedFiles;
+/*
+ * Blocked files are hashed by filename into a fixed number of chains so that
+ * lookups, which happen on every access through the vmblock namespace, do
+ * not have to walk every block of an in-progress DnD operation.  All chains
+ * are protected by blockedFilesLock; lookups only take it for reading.
+ */
+#define BLOCK_HASH_BUCKETS 256
+
+static DblLnkLst_Links blockedFiles[BLOCK_HASH_BUCKETS];
 static os_rwlock_t blockedFilesLock;
 static os_kmem_cache_t *blockInfoCache;
 
@@ -109,6 +116,8 @@ static os_kmem_cache_t *blockInfoCache;
 int
 BlockInit(void)
 {
+   unsigned int i;
+
    ASSERT(!blockInfoCache);
 
    blockInfoCache = os_kmem_cache_create("blockInfoCache",
@@ -119,7 +128,9 @@ BlockInit(void)
       return OS_ENOMEM;
    }
 
-   DblLnkLst_Init(&blockedFiles);
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      DblLnkLst_Init(&blockedFiles[i]);
+   }
    os_rwlock_init(&blockedFilesLock);
 
    return 0;
@@ -145,14 +156,50 @@ BlockInit(void)
 void
 BlockCleanup(void)
 {
+   unsigned int i;
+
    ASSERT(blockInfoCache);
-   ASSERT(!DblLnkLst_IsLinked(&blockedFiles));
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      ASSERT(!DblLnkLst_IsLinked(&blockedFiles[i]));
+   }
 
    os_rwlock_destroy(&blockedFilesLock);
    os_kmem_cache_destroy(blockInfoCache);
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BlockBucket --
+ *
+ *    Returns the hash chain a block on the provided filename belongs to.
+ *    The hash is 32-bit FNV-1a over the filename.
+ *
+ * Results:
+ *    Pointer to the head of the chain.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static DblLnkLst_Links *
+BlockBucket(const char *filename)  // IN: file to hash
+{
+   const unsigned char *p = (const unsigned char *)filename;
+   unsigned int hash = 2166136261U;
+
+   while (*p != '\0') {
+      hash ^= *p++;
+      hash *= 16777619U;
+   }
+
+   return &blockedFiles[hash % BLOCK_HASH_BUCKETS];
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -311,6 +358,7 @@ static BlockInfo *
 GetBlock(const char *filename,          // IN: file to find block for
          const os_blocker_id_t blocker) // IN: blocker associated with this block
 {
+   struct DblLnkLst_Links *bucket = BlockBucket(filename);
    struct DblLnkLst_Links *curr;
 
    /*
@@ -325,7 +373,7 @@ GetBlock(const char *filename,          // IN: file to find block for
    ASSERT(os_rwlock_held(&blockedFilesLock));
 #endif
 
-   DblLnkLst_ForEach(curr, &blockedFiles) {
+   DblLnkLst_ForEach(curr, bucket) {
       BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
       if ((blocker == OS_UNKNOWN_BLOCKER || currBlock->blocker == blocker) &&
           strcmp(currBlock->filename, filename) == 0) {
@@ -418,7 +466,7 @@ BlockAddFileBlock(const char *filename,           // IN: name of file to block
       goto out;
    }
 
-   DblLnkLst_LinkLast(&blockedFiles, &block->links);
+   DblLnkLst_LinkLast(BlockBucket(filename), &block->links);
    LOG(4, "added block for [%s]\n", filename);
    retval = 0;
 
@@ -494,20 +542,23 @@ BlockRemoveAllBlocks(const os_blocker_id_t blocker)  // IN: blocker to remove bl
    struct DblLnkLst_Links *curr;
    struct DblLnkLst_Links *tmp;
    unsigned int removed = 0;
+   unsigned int i;
 
    os_write_lock(&blockedFilesLock);
 
-   DblLnkLst_ForEachSafe(curr, tmp, &blockedFiles) {
-      BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      if (currBlock->blocker == blocker || blocker == OS_UNKNOWN_BLOCKER) {
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      DblLnkLst_ForEachSafe(curr, tmp, &blockedFiles[i]) {
+         BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
+         if (currBlock->blocker == blocker || blocker == OS_UNKNOWN_BLOCKER) {
 
-         BlockDoRemoveBlock(currBlock);
+            BlockDoRemoveBlock(currBlock);
 
-         /*
-          * We count only entries removed from the -list-, regardless of whether
-          * or not other waiters exist.
-          */
-         ++removed;
+            /*
+             * We count only entries removed from the -list-, regardless of
+             * whether or not other waiters exist.
+             */
+            ++removed;
+         }
       }
    }
 
@@ -641,13 +692,16 @@ BlockListFileBlocks(void)
 {
    DblLnkLst_Links *curr;
    int count = 0;
+   unsigned int i;
 
    os_read_lock(&blockedFilesLock);
 
-   DblLnkLst_ForEach(curr, &blockedFiles) {
-      BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
-      LOG(1, "BlockListFileBlocks: (%d) Filename: [%s], Blocker: [%p]\n",
-          count++, currBlock->filename, currBlock->blocker);
+   for (i = 0; i < BLOCK_HASH_BUCKETS; i++) {
+      DblLnkLst_ForEach(curr, &blockedFiles[i]) {
+         BlockInfo *currBlock = DblLnkLst_Container(curr, BlockInfo, links);
+         LOG(1, "BlockListFileBlocks: (%d) Filename: [%s], Blocker: [%p]\n",
+             count++, currBlock->filename, currBlock->blocker);
+      }
    }
 
    os_read_unlock(&blockedFilesLock);
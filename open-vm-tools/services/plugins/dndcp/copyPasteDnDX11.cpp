@@ -497,10 +497,20 @@ CopyPasteDnDX11::PointerInit()
 uint32
 CopyPasteDnDX11::GetCaps()
 {
-   return DND_CP_CAP_VALID |
-          DND_CP_CAP_DND |
-          DND_CP_CAP_CP |
-          DND_CP_CAP_FORMATS_ALL |
-          DND_CP_CAP_ACTIVE_CP |
-          DND_CP_CAP_BIG_BUFFER;
+   uint32 caps = DND_CP_CAP_VALID |
+                 DND_CP_CAP_DND |
+                 DND_CP_CAP_CP |
+                 DND_CP_CAP_FORMATS_ALL |
+                 DND_CP_CAP_ACTIVE_CP |
+                 DND_CP_CAP_BIG_BUFFER |
+                 DND_CP_CAP_WINDOWED_BIG_BUFFER |
+                 DND_CP_CAP_CLIPBOARD_HASH |
+                 DND_CP_CAP_LARGE_CLIPBOARD |
+                 DND_CP_CAP_FILE_STREAM;
+
+#ifdef HAVE_ZLIB
+   /* Only a tools build with zlib can inflate what the host sends. */
+   caps |= DND_CP_CAP_CLIPBOARD_COMPRESS;
+#endif
+   return caps;
 }
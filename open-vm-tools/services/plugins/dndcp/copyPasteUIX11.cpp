@@ -739,7 +739,7 @@ again:
 
       img->save_to_buffer(buf, bufSize, Glib::ustring("png"));
       if (bufSize > 0  &&
-          bufSize <= (int)CPCLIPITEM_MAX_SIZE_V3 &&
+          bufSize <= (int)CPCLIPITEM_MAX_SIZE_LARGE &&
           CPClipboard_SetItem(&mClipboard, CPFORMAT_IMG_PNG,
                               buf, bufSize)) {
          validDataInClip = true;
@@ -774,14 +774,14 @@ again:
       Gtk::SelectionData sdata = refClipboard->wait_for_contents(format);
       bufSize = sdata.get_length();
       if (bufSize > 0  &&
-          bufSize <= (int)CPCLIPITEM_MAX_SIZE_V3 &&
+          bufSize <= (int)CPCLIPITEM_MAX_SIZE_LARGE &&
           CPClipboard_SetItem(&mClipboard, CPFORMAT_RTF,
                               (const void *)sdata.get_data(), bufSize + 1)) {
          validDataInClip = true;
          g_debug("%s: Got RTF\n", __FUNCTION__);
       } else {
          g_debug("%s: Failed to get RTF size %d max %d\n",
-               __FUNCTION__, (int) bufSize, (int)CPCLIPITEM_MAX_SIZE_V3);
+               __FUNCTION__, (int) bufSize, (int)CPCLIPITEM_MAX_SIZE_LARGE);
       }
    }
 
@@ -792,7 +792,7 @@ again:
       Glib::ustring str = refClipboard->wait_for_text();
       bufSize = str.bytes();
       if (bufSize > 0  &&
-          bufSize <= (int)CPCLIPITEM_MAX_SIZE_V3 &&
+          bufSize <= (int)CPCLIPITEM_MAX_SIZE_LARGE &&
           CPClipboard_SetItem(&mClipboard, CPFORMAT_TEXT,
                               (const void *)str.data(), bufSize + 1)) {
          validDataInClip = true;
@@ -1164,12 +1164,7 @@ CopyPasteUIX11::GetNextPath(utf::utf8string& str, // IN: NUL-delimited path list
 void
 CopyPasteUIX11::GetRemoteClipboardCB(const CPClipboard *clip) // IN
 {
-   Glib::RefPtr<Gtk::Clipboard> refClipboard =
-      Gtk::Clipboard::get(GDK_SELECTION_CLIPBOARD);
-   Glib::RefPtr<Gtk::Clipboard> refPrimary =
-      Gtk::Clipboard::get(GDK_SELECTION_PRIMARY);
-   void *buf;
-   size_t sz;
+   CPClipboard localClip;
 
    TRACE_CALL();
    if (!clip) {
@@ -1177,6 +1172,46 @@ CopyPasteUIX11::GetRemoteClipboardCB(const CPClipboard *clip) // IN
       return;
    }
 
+   /*
+    * Items the rpc kept in spool files are read in with CPClipboard_LoadItem,
+    * which needs a clipboard of our own. The copy shares the spool files.
+    */
+   CPClipboard_Init(&localClip);
+   if (CPClipboard_Copy(&localClip, clip)) {
+      SetLocalClipboard(&localClip);
+   } else {
+      g_debug("%s: CPClipboard_Copy failed\n", __FUNCTION__);
+   }
+   CPClipboard_Destroy(&localClip);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CopyPasteUIX11::SetLocalClipboard --
+ *
+ *    Put the data of a clipboard from the host on the local clipboard.
+ *
+ * Results:
+ *    None
+ *
+ * Side effects:
+ *    Items of clip kept in spool files are read into memory.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+CopyPasteUIX11::SetLocalClipboard(CPClipboard *clip) // IN/OUT
+{
+   Glib::RefPtr<Gtk::Clipboard> refClipboard =
+      Gtk::Clipboard::get(GDK_SELECTION_CLIPBOARD);
+   Glib::RefPtr<Gtk::Clipboard> refPrimary =
+      Gtk::Clipboard::get(GDK_SELECTION_PRIMARY);
+   void *buf;
+   size_t sz;
+
    /* Clear the clipboard contents if we are the owner. */
    if (mIsClipboardOwner) {
       refClipboard->clear();
@@ -1197,7 +1232,7 @@ CopyPasteUIX11::GetRemoteClipboardCB(const CPClipboard *clip) // IN
        * rtf should be first in the target list otherwise OpenOffice may not
        * accept paste.
        */
-      if (CPClipboard_GetItem(clip, CPFORMAT_RTF, &buf, &sz)) {
+      if (CPClipboard_LoadItem(clip, CPFORMAT_RTF, &buf, &sz)) {
          g_debug("%s: RTF data, size %"FMTSZ"u.\n", __FUNCTION__, sz);
          Gtk::TargetEntry appRtf(TARGET_NAME_APPLICATION_RTF);
          Gtk::TargetEntry textRtf(TARGET_NAME_TEXT_RICHTEXT);
@@ -1208,7 +1243,7 @@ CopyPasteUIX11::GetRemoteClipboardCB(const CPClipboard *clip) // IN
          mIsClipboardOwner = true;
       }
 
-      if (CPClipboard_GetItem(clip, CPFORMAT_TEXT, &buf, &sz)) {
+      if (CPClipboard_LoadItem(clip, CPFORMAT_TEXT, &buf, &sz)) {
          Gtk::TargetEntry stringText(TARGET_NAME_STRING);
          Gtk::TargetEntry plainText(TARGET_NAME_TEXT_PLAIN);
          Gtk::TargetEntry utf8Text(TARGET_NAME_UTF8_STRING);
@@ -1233,7 +1268,7 @@ CopyPasteUIX11::GetRemoteClipboardCB(const CPClipboard *clip) // IN
       return;
    }
 
-   if (CPClipboard_GetItem(clip, CPFORMAT_IMG_PNG, &buf, &sz)) {
+   if (CPClipboard_LoadItem(clip, CPFORMAT_IMG_PNG, &buf, &sz)) {
       g_debug("%s: PNG data, size %"FMTSZ"u.\n", __FUNCTION__, sz);
       /* Try to load buf into pixbuf, and write to local clipboard. */
       try {
@@ -1266,7 +1301,7 @@ CopyPasteUIX11::GetRemoteClipboardCB(const CPClipboard *clip) // IN
       return;
    }
 
-   if (CPClipboard_GetItem(clip, CPFORMAT_FILELIST, &buf, &sz)) {
+   if (CPClipboard_LoadItem(clip, CPFORMAT_FILELIST, &buf, &sz)) {
       g_debug("%s: File data.\n", __FUNCTION__);
       DnDFileList flist;
       flist.FromCPClipboard(buf, sz);
@@ -1319,7 +1354,7 @@ CopyPasteUIX11::GetRemoteClipboardCB(const CPClipboard *clip) // IN
  */
 
 bool
-CopyPasteUIX11::LocalPrepareFileContents(const CPClipboard *clip) // IN
+CopyPasteUIX11::LocalPrepareFileContents(CPClipboard *clip) // IN/OUT
 {
    void *buf = NULL;
    size_t sz = 0;
@@ -1332,8 +1367,8 @@ CopyPasteUIX11::LocalPrepareFileContents(const CPClipboard *clip) // IN
    size_t i = 0;
    bool ret = false;
 
-   if (!CPClipboard_GetItem(clip, CPFORMAT_FILECONTENTS, &buf, &sz)) {
-      g_debug("%s: CPClipboard_GetItem failed\n", __FUNCTION__);
+   if (!CPClipboard_LoadItem(clip, CPFORMAT_FILECONTENTS, &buf, &sz)) {
+      g_debug("%s: CPClipboard_LoadItem failed\n", __FUNCTION__);
       return false;
    }
 
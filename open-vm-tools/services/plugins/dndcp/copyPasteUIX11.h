@@ -84,6 +84,7 @@ private:
 
    /* hg */
    void GetRemoteClipboardCB(const CPClipboard *clip);
+   void SetLocalClipboard(CPClipboard *clip);
    void RemoteGetFilesDone(void);
    void LocalGetFileRequestCB(Gtk::SelectionData& selection_data, guint info);
    void LocalGetTextOrRTFRequestCB(Gtk::SelectionData& sd, guint info);
@@ -102,7 +103,7 @@ private:
    /* Conversion methods. */
    utf::utf8string GetNextPath(utf::utf8string &str, size_t& index);
    utf::string GetLastDirName(const utf::string &str);
-   bool LocalPrepareFileContents(const CPClipboard *clip);
+   bool LocalPrepareFileContents(CPClipboard *clip);
 
    VmTimeType GetCurrentTime(void);
 
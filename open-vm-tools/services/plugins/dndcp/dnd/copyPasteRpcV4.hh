@@ -42,6 +42,7 @@ class LIB_EXPORT CopyPasteRpcV4
 {
 public:
    CopyPasteRpcV4(DnDCPTransport *transport);
+   virtual ~CopyPasteRpcV4(void);
    virtual void Init(void);
    virtual void SendPing(uint32 caps);
 
@@ -63,6 +64,14 @@ public:
    virtual void HandleMsg(RpcParams *params,
                           const uint8 *binary,
                           uint32 binarySize);
+   virtual bool HandleMsgOwned(RpcParams *params,
+                               uint8 *binary,
+                               uint32 binarySize);
+#ifndef _WIN32
+   virtual bool HandleMsgFile(RpcParams *params,
+                              int fd,
+                              uint32 binarySize);
+#endif
    virtual bool SendPacket(uint32 destId,
                            const uint8 *packet,
                            size_t length);
@@ -71,9 +80,22 @@ public:
                              size_t packetSize);
 
 private:
+   void HandleRecvClip(RpcParams *params);
+   void HandleRecvClipUnchanged(RpcParams *params);
+   void ResetClipHashes(void);
+   uint32 GetCompressedFormats(const RpcParams *params);
+
    DnDCPTransport *mTransport;
    TransportInterfaceType mTransportInterface;
    RpcV4Util mUtil;
+   /* Last clipboard received from the peer, replayed on *_UNCHANGED. */
+   CPClipboard mLastRecvClip;
+   bool mHaveLastRecvClip;
+   uint64 mLastRecvHash;
+   /* Hash of the last clipboard sent to the peer. */
+   bool mHaveLastSentHash;
+   uint64 mLastSentHash;
+   bool mLastSentIsActive;
 };
 
 #endif // COPY_PASTE_RPC_V4_HH
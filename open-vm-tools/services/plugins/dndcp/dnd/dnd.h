@@ -124,6 +124,9 @@ typedef struct CPClipItem {
    void *buf;
    uint32 size;
    Bool exists;
+   Bool borrowed; /* buf points into the clipboard's serialized buffer. */
+   int fd;        /* Spool file holding the data at offset, or -1. */
+   uint32 offset;
 } CPClipItem;
 
 /*
@@ -133,6 +136,7 @@ typedef struct CPClipItem {
 typedef struct {
    Bool changed;
    CPClipItem items[CPFORMAT_MAX - 1];
+   void *serialized; /* From CPClipboard_UnserializeTake, or NULL. */
 } CPClipboard;
 
 #if !defined(SWIG)
@@ -180,6 +184,8 @@ typedef struct DnDTransportBuffer {
    size_t totalSize;
    size_t offset;
    VmTimeType lastUpdateTime;
+   uint32 allocs;             // heap allocations made for this message
+   size_t bytesCopied;        // payload bytes memcpy'd for this message
 } DnDTransportBuffer;
 
 #define DND_TRANSPORT_PACKET_HEADER_SIZE      (5 * sizeof(uint32))
@@ -249,6 +255,7 @@ char *DnD_UriListGetNextFile(char const *uriList,
                              size_t *index,
                              size_t *length);
 Bool DnD_UriIsNonFileSchemes(char const *uri);
+int DnD_CreateSpoolFile(void);
 #endif
 
 /*
@@ -286,6 +293,10 @@ void DnD_TransportBufInit(DnDTransportBuffer *buf,
                           uint8 *msg,
                           size_t msgSize,
                           uint32 seqNum);
+void DnD_TransportBufInitOwned(DnDTransportBuffer *buf,
+                               uint8 *msg,
+                               size_t msgSize,
+                               uint32 seqNum);
 void DnD_TransportBufReset(DnDTransportBuffer *buf);
 size_t DnD_TransportBufGetPacket(DnDTransportBuffer *buf,
                                  DnDTransportPacketHeader **packet);
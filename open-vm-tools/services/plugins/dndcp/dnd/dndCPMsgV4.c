@@ -26,8 +26,12 @@
 #include "dnd.h"
 #include "dndClipboard.h"
 #include "dndCPMsgV4.h"
+#include "dndInt.h"
 #include "util.h"
 
+/* A big message is being received into msg, in memory or in a spool file. */
+#define DnDCPMsgV4HasBinary(msg) ((msg)->binary || (msg)->binaryFd >= 0)
+
 
 /**
  * Check if received packet is valid or not.
@@ -56,8 +60,11 @@ DnDCPMsgV4IsPacketValid(const uint8 *packet,
       return FALSE;
    }
 
-   /* Binary size is not valid. */
-   if (msgHdr->binarySize > DND_CP_MSG_MAX_BINARY_SIZE_V4) {
+   /*
+    * Binary size is not valid. Whether the peer may send more than
+    * DND_CP_MSG_MAX_BINARY_SIZE_V4 is up to the RPC layer.
+    */
+   if (msgHdr->binarySize > DND_CP_MSG_MAX_LARGE_BINARY_SIZE_V4) {
       return FALSE;
    }
 
@@ -81,6 +88,7 @@ DnDCPMsgV4_Init(DnDCPMsgV4 *msg)
 {
    ASSERT(msg);
    memset(msg, 0, sizeof(DnDCPMsgV4));
+   msg->binaryFd = -1;
 }
 
 /**
@@ -94,6 +102,11 @@ DnDCPMsgV4_Destroy(DnDCPMsgV4 *msg)
 {
    if (msg) {
       free(msg->binary);
+#ifndef _WIN32
+      if (msg->binaryFd >= 0) {
+         DnDCloseFile(msg->binaryFd);
+      }
+#endif
       DnDCPMsgV4_Init(msg);
    }
 }
@@ -136,7 +149,8 @@ DnDCPMsgPacketType DnDCPMsgV4_GetPacketType(const uint8 *packet,
 
 
 /**
- * Serialize the msg to packet.
+ * Serialize the msg to packet. The payload comes from msg->binary, or from
+ * msg->readBinary if there is no binary in memory.
  *
  * @param[in/out] msg DnDCPMsgV4 to be serialized from.
  * @param[out] packet DnDCPMsgV4 to be serialized to.
@@ -176,10 +190,19 @@ DnDCPMsgV4_Serialize(DnDCPMsgV4 *msg,
    *packetSize = DND_CP_MSG_HEADERSIZE_V4 + payloadSize;
    *packet = Util_SafeMalloc(*packetSize);
    memcpy(*packet, msg, DND_CP_MSG_HEADERSIZE_V4);
-   if (payloadSize > 0) {
+   if (payloadSize > 0 && msg->binary) {
       memcpy(*packet + DND_CP_MSG_HEADERSIZE_V4,
              msg->binary + msg->hdr.payloadOffset,
              payloadSize);
+   } else if (payloadSize > 0 &&
+              (NULL == msg->readBinary ||
+               !msg->readBinary(msg->readData,
+                                msg->hdr.payloadOffset,
+                                *packet + DND_CP_MSG_HEADERSIZE_V4,
+                                payloadSize))) {
+      free(*packet);
+      *packet = NULL;
+      return FALSE;
    }
    ((DnDCPMsgHdrV4 *)(*packet))->payloadSize = payloadSize;
    /* Next DnDCPMsgV4_Serialize will use this payloadOffset to get unsent binary. */
@@ -233,7 +256,9 @@ DnDCPMsgV4_UnserializeSingle(DnDCPMsgV4 *msg,
 
 
 /**
- * Unserialize the packet to DnDCPMsgV4 for big messsage.
+ * Unserialize the packet to DnDCPMsgV4 for big messsage. A binary bigger
+ * than DND_CP_MSG_MAX_BINARY_SIZE_V4 is received into msg->binaryFd instead
+ * of memory.
  *
  * @param[in/out] msg DnDCPMsgV4 to be unserialized to.
  * @param[in] packet DnDCPMsgV4 to be unserialized from.
@@ -262,32 +287,51 @@ DnDCPMsgV4_UnserializeMultiple(DnDCPMsgV4 *msg,
     * sessionId is different with buffered one, the received packet is for
     * another another new message. Destroy old buffered message.
     */
-   if (msg->binary &&
+   if (DnDCPMsgV4HasBinary(msg) &&
        msg->hdr.sessionId != msgHdr->sessionId) {
       DnDCPMsgV4_Destroy(msg);
    }
 
    /* Offset should be 0 for new message. */
-   if (NULL == msg->binary && msgHdr->payloadOffset != 0) {
+   if (!DnDCPMsgV4HasBinary(msg) && msgHdr->payloadOffset != 0) {
       return FALSE;
    }
 
    /* For existing buffered message, the payload offset should match. */
-   if (msg->binary &&
+   if (DnDCPMsgV4HasBinary(msg) &&
        msg->hdr.sessionId == msgHdr->sessionId &&
        msg->hdr.payloadOffset != msgHdr->payloadOffset) {
       return FALSE;
    }
 
-   if (NULL == msg->binary) {
+   if (!DnDCPMsgV4HasBinary(msg)) {
       memcpy(msg, msgHdr, DND_CP_MSG_HEADERSIZE_V4);
-      msg->binary = Util_SafeMalloc(msg->hdr.binarySize);
+      if (msg->hdr.binarySize > DND_CP_MSG_MAX_BINARY_SIZE_V4) {
+#ifndef _WIN32
+         msg->binaryFd = DnD_CreateSpoolFile();
+#endif
+         if (msg->binaryFd < 0) {
+            return FALSE;
+         }
+      } else {
+         msg->binary = Util_SafeMalloc(msg->hdr.binarySize);
+      }
    }
 
    /* msg->hdr.payloadOffset is used as received binary size. */
-   memcpy(msg->binary + msg->hdr.payloadOffset,
-          packet + DND_CP_MSG_HEADERSIZE_V4,
-          msgHdr->payloadSize);
+   if (msg->binary) {
+      memcpy(msg->binary + msg->hdr.payloadOffset,
+             packet + DND_CP_MSG_HEADERSIZE_V4,
+             msgHdr->payloadSize);
+   }
+#ifndef _WIN32
+   else if (!DnDWriteFile(msg->binaryFd,
+                          msg->hdr.payloadOffset,
+                          packet + DND_CP_MSG_HEADERSIZE_V4,
+                          msgHdr->payloadSize)) {
+      return FALSE;
+   }
+#endif
    msg->hdr.payloadOffset += msgHdr->payloadSize;
    return TRUE;
 }
@@ -344,11 +388,18 @@ DnDCPMsgV4_LookupCmd(uint32 cmd)
       { CP_CMD_SEND_CLIPBOARD,         "CP_CMD_SEND_CLIPBOARD" },
       { CP_CMD_GET_FILES_DONE,         "CP_CMD_GET_FILES_DONE" },
       { CP_CMD_SEND_FILES_DONE,        "CP_CMD_SEND_FILES_DONE" },
+      { CP_CMD_RECV_CLIPBOARD_UNCHANGED, "CP_CMD_RECV_CLIPBOARD_UNCHANGED" },
+      { CP_CMD_SEND_CLIPBOARD_UNCHANGED, "CP_CMD_SEND_CLIPBOARD_UNCHANGED" },
 
       { FT_CMD_HGFS_REQUEST,           "FT_CMD_HGFS_REQUEST" },
       { FT_CMD_HGFS_REPLY,             "FT_CMD_HGFS_REPLY" },
       { FT_CMD_UPDATE_PROGRESS,        "FT_CMD_UPDATE_PROGRESS" },
       { FT_CMD_PROGRESS_REPLY,         "FT_CMD_PROGRESS_REPLY" },
+      { FT_CMD_STREAM_FILE,            "FT_CMD_STREAM_FILE" },
+      { FT_CMD_STREAM_DATA,            "FT_CMD_STREAM_DATA" },
+      { FT_CMD_STREAM_ACK,             "FT_CMD_STREAM_ACK" },
+      { FT_CMD_STREAM_CANCEL,          "FT_CMD_STREAM_CANCEL" },
+      { FT_CMD_STREAM_PROGRESS,        "FT_CMD_STREAM_PROGRESS" },
    };
    size_t i;
 
@@ -103,9 +103,23 @@ typedef enum {
    CP_CMD_REQUEST_CLIPBOARD = 2000,
    CP_CMD_REQUEST_FILES,
    CP_CMD_RECV_CLIPBOARD,
+   /*
+    * With DND_CP_CAP_CLIPBOARD_COMPRESS, param5 of CP_CMD_RECV_CLIPBOARD and
+    * CP_CMD_SEND_CLIPBOARD has bit (1 << DND_CPFORMAT) set for every item
+    * of the binary that is a zlib stream rather than the raw item.
+    */
    CP_CMD_SEND_CLIPBOARD,
    CP_CMD_GET_FILES_DONE,
    CP_CMD_SEND_FILES_DONE,
+   /*
+    * Same as CP_CMD_RECV_CLIPBOARD/CP_CMD_SEND_CLIPBOARD, but without the
+    * clipboard binary: the peer should reuse the clipboard it last received,
+    * whose CPClipboard_GetHash is in the message. If it does not have it, the
+    * peer answers with DNDCP_CMP_REPLY and an error status. Only used with
+    * DND_CP_CAP_CLIPBOARD_HASH.
+    */
+   CP_CMD_RECV_CLIPBOARD_UNCHANGED,
+   CP_CMD_SEND_CLIPBOARD_UNCHANGED,
 } CopyPasteCmdV4;
 
 /* File transfer commands. */
@@ -113,7 +127,26 @@ typedef enum {
    FT_CMD_HGFS_REQUEST = 3000,
    FT_CMD_HGFS_REPLY,
    FT_CMD_UPDATE_PROGRESS,
-   FT_CMD_PROGRESS_REPLY
+   FT_CMD_PROGRESS_REPLY,
+   /*
+    * Streamed file contents, only sent to a guest that advertised
+    * DND_CP_CAP_FILE_STREAM. The controller asks for a file with
+    * FT_CMD_STREAM_FILE, binary is the NUL terminated UTF-8 path, param1 a
+    * stream id and param2/param3 the start offset. The guest answers with
+    * FT_CMD_STREAM_DATA messages of at most one packet each, param2/param3
+    * being the file offset of the data, and ends the stream with an empty
+    * one whose status tells whether the whole file was sent. It keeps no more
+    * than DND_CP_FILE_STREAM_WINDOW bytes unacknowledged; the controller
+    * acknowledges with FT_CMD_STREAM_ACK, param2/param3 being the offset it
+    * has received up to. FT_CMD_STREAM_CANCEL stops a stream, and
+    * FT_CMD_STREAM_PROGRESS reports the bytes sent in param2/param3 and the
+    * throughput of the stream in param4, in bytes per second.
+    */
+   FT_CMD_STREAM_FILE,
+   FT_CMD_STREAM_DATA,
+   FT_CMD_STREAM_ACK,
+   FT_CMD_STREAM_CANCEL,
+   FT_CMD_STREAM_PROGRESS
 } FileTransferCmdV4;
 
 /* Message types. */
@@ -173,6 +206,11 @@ typedef enum DnDCPMsgPacketType {
 #define DND_CP_CAP_ACTIVE_CP        (1 << 13)
 #define DND_CP_CAP_GUEST_PROGRESS   (1 << 14)
 #define DND_CP_CAP_BIG_BUFFER       (1 << 15)
+#define DND_CP_CAP_WINDOWED_BIG_BUFFER (1 << 16)
+#define DND_CP_CAP_CLIPBOARD_HASH   (1 << 17)
+#define DND_CP_CAP_LARGE_CLIPBOARD  (1 << 18)
+#define DND_CP_CAP_CLIPBOARD_COMPRESS (1 << 19)
+#define DND_CP_CAP_FILE_STREAM      (1 << 20)
 
 #define DND_CP_CAP_FORMATS_CP       (DND_CP_CAP_PLAIN_TEXT_CP   | \
                                      DND_CP_CAP_RTF_CP          | \
@@ -220,11 +258,40 @@ DnDCPMsgHdrV4;
                                            DND_CP_MSG_HEADERSIZE_V4)
 #define DND_CP_MSG_MAX_BINARY_SIZE_V4 (1 << 22)
 
+/*
+ * Limit for peers that negotiated DND_CP_CAP_LARGE_CLIPBOARD. Binaries bigger
+ * than DND_CP_MSG_MAX_BINARY_SIZE_V4 are never held in memory whole: they are
+ * sent through readBinary and received into binaryFd.
+ */
+#define DND_CP_MSG_MAX_LARGE_BINARY_SIZE_V4 (1 << 30)
+
+/*
+ * Windowed big buffer transfer. If both sides advertise
+ * DND_CP_CAP_WINDOWED_BIG_BUFFER, the sender keeps up to
+ * DND_CP_MSG_WINDOW_SIZE_V4 packets of a big message in flight, and the
+ * receiver only sends DNDCP_CMD_REQUEST_NEXT, carrying the cumulative received
+ * offset, once every DND_CP_MSG_WINDOW_ACK_INTERVAL_V4 packets.
+ */
+#define DND_CP_MSG_WINDOW_SIZE_V4 8
+#define DND_CP_MSG_WINDOW_ACK_INTERVAL_V4 (DND_CP_MSG_WINDOW_SIZE_V4 / 2)
+
+/* Unacknowledged FT_CMD_STREAM_DATA bytes a guest may have in flight. */
+#define DND_CP_FILE_STREAM_WINDOW (4 << 20)
+
+/* Reads size bytes of an outgoing binary, starting at offset, into buf. */
+typedef Bool (*DnDCPMsgV4ReadFunc)(void *clientData,
+                                   uint32 offset,
+                                   uint8 *buf,
+                                   uint32 size);
+
 /* DnD version 4 message. */
 typedef struct DnDCPMsgV4 {
    DnDCPMsgHdrV4 hdr;
    uint32 addrId;
    uint8 *binary;
+   DnDCPMsgV4ReadFunc readBinary;  /* Used when binary is NULL. */
+   void *readData;
+   int binaryFd;                   /* Received binary if spooled, or -1. */
 } DnDCPMsgV4;
 
 #if !defined(SWIG)
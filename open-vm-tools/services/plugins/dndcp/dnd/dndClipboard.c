@@ -25,6 +25,9 @@
 
 #include <stdlib.h>
 #include <string.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include "vm_assert.h"
 
@@ -35,6 +38,56 @@
 
 #define CPFormatToIndex(x) ((unsigned int)(x) - 1)
 
+#define CPCLIP_HASH_INIT  CONST64U(0xcbf29ce484222325)
+#define CPCLIP_HASH_PRIME CONST64U(0x100000001b3)
+
+/* Spooled items are read in chunks of this size. */
+#define CPCLIP_FILE_CHUNK_SIZE (1 << 16)
+
+/* Items smaller than this fit in a packet or two, not worth compressing. */
+#define CPCLIP_COMPRESS_THRESHOLD (1 << 16)
+
+/*
+ * Image, rtf and text may be put into a clipboard at same time, and total
+ * size may be more than limit. Image data will be first dropped, then
+ * rtf data.
+ */
+static const DND_CPFORMAT cpClipFilterList[] = {
+   CPFORMAT_IMG_PNG, CPFORMAT_RTF, CPFORMAT_TEXT
+};
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipHashBuffer --
+ *
+ *      Fold buf into a running 64-bit FNV-1a hash.
+ *
+ * Results:
+ *      The updated hash.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static uint64
+CPClipHashBuffer(uint64 hash,           // IN: hash so far
+                 const void *buf,       // IN: data to add
+                 size_t size)           // IN: size of buf
+{
+   const uint8 *p = buf;
+   const uint8 *end = p + size;
+
+   while (p < end) {
+      hash ^= *p++;
+      hash *= CPCLIP_HASH_PRIME;
+   }
+   return hash;
+}
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -59,6 +112,9 @@ CPClipItemInit(CPClipItem *item)        // IN/OUT: the clipboard item
    item->buf = NULL;
    item->size = 0;
    item->exists = FALSE;
+   item->borrowed = FALSE;
+   item->fd = -1;
+   item->offset = 0;
 }
 
 
@@ -83,11 +139,132 @@ CPClipItemDestroy(CPClipItem *item)     // IN/OUT: the clipboard item
 {
    ASSERT(item);
 
-   free(item->buf);
-   item->buf = NULL;
-   item->size = 0;
-   item->exists = FALSE;
+   if (!item->borrowed) {
+      free(item->buf);
+   }
+#ifndef _WIN32
+   if (item->fd >= 0) {
+      DnDCloseFile(item->fd);
+   }
+#endif
+   CPClipItemInit(item);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipItemRead --
+ *
+ *      Read size bytes of the item data, starting at offset, from memory or
+ *      from the spool file.
+ *
+ * Results:
+ *      TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+CPClipItemRead(const CPClipItem *item,  // IN: the clipboard item
+               uint32 offset,           // IN: offset in the item data
+               void *buf,               // OUT
+               size_t size)             // IN
+{
+   ASSERT(offset <= item->size && size <= item->size - offset);
+
+   if (item->buf) {
+      memcpy(buf, (const uint8 *)item->buf + offset, size);
+      return TRUE;
+   }
+#ifndef _WIN32
+   return item->fd >= 0 &&
+          DnDReadFile(item->fd, (uint64)item->offset + offset, buf, size);
+#else
+   return FALSE;
+#endif
+}
+
+
+#ifndef _WIN32
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipItemSetFile --
+ *
+ *      Make item refer to size bytes at offset in fd instead of copying them
+ *      to memory. Text is read once, in chunks, to check that it is valid
+ *      UTF-8; other formats are not read at all.
+ *
+ * Results:
+ *      TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *      fd is dup'ed, the caller keeps its own descriptor.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+CPClipItemSetFile(CPClipItem *item,     // IN/OUT: the clipboard item
+                  DND_CPFORMAT fmt,     // IN: the item format
+                  int fd,               // IN: file with the data
+                  uint32 offset,        // IN: offset of the data in fd
+                  uint32 size)          // IN: the item size
+{
+   uint8 *chunk = NULL;
+   uint32 done = 0;
+   Bool ret = FALSE;
+
+   if (CPFORMAT_TEXT == fmt) {
+      chunk = malloc(CPCLIP_FILE_CHUNK_SIZE);
+      if (!chunk) {
+         return FALSE;
+      }
+
+      while (done < size) {
+         uint32 len = MIN(size - done, CPCLIP_FILE_CHUNK_SIZE);
+         uint32 valid = len;
+
+         if (!DnDReadFile(fd, (uint64)offset + done, chunk, len)) {
+            goto exit;
+         }
+
+         /*
+          * Leave a character that starts in this chunk but may end in the
+          * next one to the next chunk.
+          */
+         if (done + len < size) {
+            while (valid > len - 3 && (chunk[valid - 1] & 0xc0) == 0x80) {
+               valid--;
+            }
+            valid--;
+         }
+         if (!Unicode_IsBufferValid((const char *)chunk, valid,
+                                    STRING_ENCODING_UTF8)) {
+            goto exit;
+         }
+         done += valid;
+      }
+   }
+
+   item->fd = DnDDupFile(fd);
+   if (item->fd < 0) {
+      goto exit;
+   }
+   item->offset = offset;
+   item->size = size;
+   item->exists = TRUE;
+   ret = TRUE;
+
+exit:
+   free(chunk);
+   return ret;
 }
+#endif
 
 
 /*
@@ -113,8 +290,27 @@ CPClipItemCopy(CPClipItem *dest,        // IN: dest clipboard item
    ASSERT(dest);
    ASSERT(src);
 
+#ifndef _WIN32
+   if (src->fd >= 0) {
+      /* Share the spool file instead of reading it into memory. */
+      int fd = DnDDupFile(src->fd);
+
+      if (fd < 0) {
+         return FALSE;
+      }
+      CPClipItemDestroy(dest);
+      dest->fd = fd;
+      dest->offset = src->offset;
+   } else
+#endif
    if (src->buf) {
-      void *tmp = dest->buf;
+      void *tmp;
+
+      if (dest->borrowed) {
+         dest->buf = NULL;
+         dest->borrowed = FALSE;
+      }
+      tmp = dest->buf;
       dest->buf = realloc(dest->buf, src->size + 1);
       if (!dest->buf) {
          dest->buf = tmp;
@@ -131,6 +327,290 @@ CPClipItemCopy(CPClipItem *dest,        // IN: dest clipboard item
 }
 
 
+#ifdef HAVE_ZLIB
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipItemDeflate --
+ *
+ *      Compress the data of item into out as a zlib stream. A spooled item
+ *      is read and compressed a chunk at a time. Gives up as soon as the
+ *      output is no smaller than the input.
+ *
+ * Results:
+ *      TRUE if item compressed to fewer bytes, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+CPClipItemDeflate(const CPClipItem *item,       // IN: the clipboard item
+                  DynBuf *out)                  // OUT: the zlib stream
+{
+   uint8 *chunk = NULL;
+   uint32 done = 0;
+   z_stream zs;
+   int zret = Z_OK;
+   Bool ret = FALSE;
+
+   memset(&zs, 0, sizeof zs);
+   if (deflateInit(&zs, Z_BEST_SPEED) != Z_OK) {
+      return FALSE;
+   }
+   if (!item->buf && !(chunk = malloc(CPCLIP_FILE_CHUNK_SIZE))) {
+      goto exit;
+   }
+
+   while (zret != Z_STREAM_END) {
+      if (zs.avail_in == 0 && done < item->size) {
+         uint32 len = MIN(item->size - done, CPCLIP_FILE_CHUNK_SIZE);
+
+         if (item->buf) {
+            zs.next_in = (uint8 *)item->buf + done;
+         } else if (CPClipItemRead(item, done, chunk, len)) {
+            zs.next_in = chunk;
+         } else {
+            goto exit;
+         }
+         zs.avail_in = len;
+         done += len;
+      }
+      if (DynBuf_GetSize(out) >= item->size ||
+          (DynBuf_GetAllocatedSize(out) == DynBuf_GetSize(out) &&
+           !DynBuf_Enlarge(out, DynBuf_GetSize(out) +
+                                CPCLIP_FILE_CHUNK_SIZE))) {
+         goto exit;
+      }
+      zs.next_out = (uint8 *)DynBuf_Get(out) + DynBuf_GetSize(out);
+      zs.avail_out = DynBuf_GetAllocatedSize(out) - DynBuf_GetSize(out);
+      zret = deflate(&zs, done < item->size ? Z_NO_FLUSH : Z_FINISH);
+      if (zret != Z_OK && zret != Z_STREAM_END && zret != Z_BUF_ERROR) {
+         goto exit;
+      }
+      DynBuf_SetSize(out, (uint8 *)zs.next_out - (uint8 *)DynBuf_Get(out));
+   }
+   ret = DynBuf_GetSize(out) < item->size;
+
+exit:
+   deflateEnd(&zs);
+   free(chunk);
+   return ret;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipItemInflate --
+ *
+ *      Uncompress the zlib stream in item into out, a chunk at a time for a
+ *      spooled item. The stream has to end exactly at the end of the item,
+ *      and may not uncompress to more than CPCLIPITEM_MAX_SIZE_LARGE bytes.
+ *
+ * Results:
+ *      TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+CPClipItemInflate(const CPClipItem *item,       // IN: the zlib stream
+                  DynBuf *out)                  // OUT: the data
+{
+   uint8 *chunk = NULL;
+   uint32 done = 0;
+   z_stream zs;
+   int zret = Z_OK;
+   Bool ret = FALSE;
+
+   memset(&zs, 0, sizeof zs);
+   if (inflateInit(&zs) != Z_OK) {
+      return FALSE;
+   }
+   if (!item->buf && !(chunk = malloc(CPCLIP_FILE_CHUNK_SIZE))) {
+      goto exit;
+   }
+
+   while (zret != Z_STREAM_END) {
+      if (zs.avail_in == 0 && done < item->size) {
+         uint32 len = MIN(item->size - done, CPCLIP_FILE_CHUNK_SIZE);
+
+         if (item->buf) {
+            zs.next_in = (uint8 *)item->buf + done;
+         } else if (CPClipItemRead(item, done, chunk, len)) {
+            zs.next_in = chunk;
+         } else {
+            goto exit;
+         }
+         zs.avail_in = len;
+         done += len;
+      }
+      if (DynBuf_GetAllocatedSize(out) == DynBuf_GetSize(out)) {
+         if (DynBuf_GetSize(out) >= CPCLIPITEM_MAX_SIZE_LARGE ||
+             !DynBuf_Enlarge(out, DynBuf_GetSize(out) +
+                                  CPCLIP_FILE_CHUNK_SIZE)) {
+            goto exit;
+         }
+      }
+      zs.next_out = (uint8 *)DynBuf_Get(out) + DynBuf_GetSize(out);
+      zs.avail_out = DynBuf_GetAllocatedSize(out) - DynBuf_GetSize(out);
+      /*
+       * There is always room for output, so Z_BUF_ERROR means that all of
+       * the input is used up before the end of the stream.
+       */
+      zret = inflate(&zs, Z_NO_FLUSH);
+      if (zret != Z_OK && zret != Z_STREAM_END) {
+         goto exit;
+      }
+      DynBuf_SetSize(out, (uint8 *)zs.next_out - (uint8 *)DynBuf_Get(out));
+   }
+   ret = zs.avail_in == 0 && done == item->size &&
+         DynBuf_GetSize(out) < CPCLIPITEM_MAX_SIZE_LARGE;
+
+exit:
+   inflateEnd(&zs);
+   free(chunk);
+   return ret;
+}
+#endif
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboardSetSerializedItem --
+ *
+ *      Helper for the unserialize functions. Set the fmt item of clip from
+ *      src, which refers to the item data in the serialized clipboard. If
+ *      the format is in compressed, src is a zlib stream and is uncompressed
+ *      first.
+ *
+ * Results:
+ *      TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+CPClipboardSetSerializedItem(CPClipboard *clip,         // IN/OUT
+                             DND_CPFORMAT fmt,          // IN: the format
+                             const CPClipItem *src,     // IN: the item data
+                             uint32 compressed)         // IN: format mask
+{
+   Bool ret = FALSE;
+
+   if (compressed & (1 << fmt)) {
+#ifdef HAVE_ZLIB
+      DynBuf out;
+
+      DynBuf_Init(&out);
+      ret = CPClipItemInflate(src, &out) &&
+            CPClipboard_SetItem(clip, fmt, DynBuf_Get(&out),
+                                DynBuf_GetSize(&out));
+      DynBuf_Destroy(&out);
+#endif
+      return ret;
+   }
+
+#ifndef _WIN32
+   if (src->fd >= 0) {
+      return CPClipItemSetFile(&clip->items[CPFormatToIndex(fmt)], fmt,
+                               src->fd, src->offset, src->size);
+   }
+#endif
+   return CPClipboard_SetItem(clip, fmt, src->buf, src->size);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboardDropOverLimit --
+ *
+ *      Drop some data if the total size of clip is more than the limit,
+ *      following cpClipFilterList.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+CPClipboardDropOverLimit(CPClipboard *clip)     // IN/OUT: the clipboard
+{
+   int filterIndex = 0;
+
+   while (CPClipboard_GetTotalSize(clip) >= CPCLIPITEM_MAX_SIZE_LARGE &&
+          filterIndex < ARRAYSIZE(cpClipFilterList)) {
+      CPClipboard_ClearItem(clip, cpClipFilterList[filterIndex]);
+      filterIndex++;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboardBorrowItem --
+ *
+ *      Helper for CPClipboard_UnserializeTake. Same as CPClipboard_SetItem,
+ *      but the item refers to buf in the serialized clipboard instead of a
+ *      copy of it, and is never spooled to a file.
+ *
+ * Results:
+ *      TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *      The item is not NUL terminated yet.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+CPClipboardBorrowItem(CPClipboard *clip,        // IN/OUT: the clipboard
+                      DND_CPFORMAT fmt,         // IN: the item format
+                      void *buf,                // IN: the item
+                      uint32 size)              // IN: the item size
+{
+   CPClipItem *item = &clip->items[CPFormatToIndex(fmt)];
+
+   ASSERT(clip->serialized);
+
+   if (size >= CPCLIPITEM_MAX_SIZE_LARGE) {
+      return FALSE;
+   }
+
+   /* It has to be valid utf8 for plain text format. */
+   if (CPFORMAT_TEXT == fmt &&
+       !Unicode_IsBufferValid(buf, size, STRING_ENCODING_UTF8)) {
+      return FALSE;
+   }
+
+   CPClipItemDestroy(item);
+   item->buf = buf;
+   item->size = size;
+   item->exists = TRUE;
+   item->borrowed = TRUE;
+
+   CPClipboardDropOverLimit(clip);
+
+   return TRUE;
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -158,6 +638,7 @@ CPClipboard_Init(CPClipboard *clip)     // IN/OUT: the clipboard
    for (i = CPFORMAT_MIN; i < CPFORMAT_MAX; ++i) {
       CPClipItemInit(&clip->items[CPFormatToIndex(i)]);
    }
+   clip->serialized = NULL;
 }
 
 
@@ -187,6 +668,8 @@ CPClipboard_Destroy(CPClipboard *clip)  // IN/OUT: the clipboard
    for (i = CPFORMAT_MIN; i < CPFORMAT_MAX; ++i) {
       CPClipItemDestroy(&clip->items[CPFormatToIndex(i)]);
    }
+   free(clip->serialized);
+   clip->serialized = NULL;
 }
 
 
@@ -217,6 +700,8 @@ CPClipboard_Clear(CPClipboard *clip)    // IN/OUT: the clipboard
    for (i = CPFORMAT_MIN; i < CPFORMAT_MAX; ++i) {
       CPClipboard_ClearItem(clip, i);
    }
+   free(clip->serialized);
+   clip->serialized = NULL;
 }
 
 
@@ -227,7 +712,9 @@ CPClipboard_Clear(CPClipboard *clip)    // IN/OUT: the clipboard
  *
  *      Makes a copy of the item adds it to the clipboard. If something
  *      already exists for the format it is overwritten. To set a promised
- *      type, pass in NULL for buffer and 0 for the size.
+ *      type, pass in NULL for buffer and 0 for the size. Items of
+ *      CPCLIPITEM_FILE_THRESHOLD bytes or more are copied to a spool file,
+ *      or to memory if no spool file can be created.
  *
  * Results:
  *      TRUE on success, FALSE on failure.
@@ -246,13 +733,7 @@ CPClipboard_SetItem(CPClipboard *clip,          // IN/OUT: the clipboard
 {
    CPClipItem *item;
    uint8 *newBuf = NULL;
-   /*
-    * Image, rtf and text may be put into a clipboard at same time, and total
-    * size may be more than limit. Image data will be first dropped, then
-    * rtf data.
-    */
-   DND_CPFORMAT filterList[] = {CPFORMAT_IMG_PNG, CPFORMAT_RTF, CPFORMAT_TEXT};
-   int filterIndex = 0;
+   int fd = -1;
 
    ASSERT(clip);
 
@@ -264,7 +745,7 @@ CPClipboard_SetItem(CPClipboard *clip,          // IN/OUT: the clipboard
       return FALSE;
    }
 
-   if (size >= CPCLIPITEM_MAX_SIZE_V3) {
+   if (size >= CPCLIPITEM_MAX_SIZE_LARGE) {
       return FALSE;
    }
 
@@ -281,26 +762,31 @@ CPClipboard_SetItem(CPClipboard *clip,          // IN/OUT: the clipboard
          }
       }
 
-      newBuf = malloc(size + 1);
-      if (!newBuf) {
-         return FALSE;
+#ifndef _WIN32
+      if (size >= CPCLIPITEM_FILE_THRESHOLD &&
+          (fd = DnD_CreateSpoolFile()) >= 0 &&
+          !DnDWriteFile(fd, 0, clipitem, size)) {
+         DnDCloseFile(fd);
+         fd = -1;
+      }
+#endif
+
+      if (fd < 0) {
+         newBuf = malloc(size + 1);
+         if (!newBuf) {
+            return FALSE;
+         }
+         memcpy(newBuf, clipitem, size);
+         newBuf[size] = 0;
       }
-      memcpy(newBuf, clipitem, size);
-      newBuf[size] = 0;
    }
 
    item->buf = newBuf;
+   item->fd = fd;
    item->size = size;
    item->exists = TRUE;
 
-   /* Drop some data if total size is more than limit. */
-   while (CPClipboard_GetTotalSize(clip) >= CPCLIPITEM_MAX_SIZE_V3 &&
-          filterIndex < ARRAYSIZE(filterList)) {
-      if (!CPClipboard_ClearItem(clip, filterList[filterIndex])) {
-         return FALSE;
-      }
-      filterIndex++;
-   }
+   CPClipboardDropOverLimit(clip);
 
    return TRUE;
 }
@@ -326,20 +812,13 @@ Bool
 CPClipboard_ClearItem(CPClipboard *clip,        // IN: the clipboard
                       DND_CPFORMAT fmt)         // IN: item to be cleared
 {
-   CPClipItem *item;
-
    ASSERT(clip);
 
    if (!(CPFORMAT_UNKNOWN < fmt && fmt < CPFORMAT_MAX)) {
       return FALSE;
    }
 
-   item = &clip->items[CPFormatToIndex(fmt)];
-
-   free(item->buf);
-   item->buf = NULL;
-   item->size = 0;
-   item->exists = FALSE;
+   CPClipItemDestroy(&clip->items[CPFormatToIndex(fmt)]);
 
    return TRUE;
 }
@@ -352,10 +831,11 @@ CPClipboard_ClearItem(CPClipboard *clip,        // IN: the clipboard
  *
  *      Get the clipboard item of format fmt from the clipboard. The clipboard
  *      maintains ownership of the data. If the item is promised, the buffer
- *      will contain NULL and the size will be 0.
+ *      will contain NULL and the size will be 0. An item kept in a spool
+ *      file is only returned once CPClipboard_LoadItem has read it in.
  *
  * Results:
- *      TRUE if item exists, FALSE otherwise.
+ *      TRUE if item exists in memory, FALSE otherwise.
  *
  * Side effects:
  *      None.
@@ -378,10 +858,14 @@ CPClipboard_GetItem(const CPClipboard *clip,    // IN: the clipboard
    }
 
    if (clip->items[CPFormatToIndex(fmt)].exists) {
+      if (!clip->items[CPFormatToIndex(fmt)].buf) {
+         ASSERT(clip->items[CPFormatToIndex(fmt)].fd >= 0);
+         return FALSE;
+      }
       *buf = clip->items[CPFormatToIndex(fmt)].buf;
       *size = clip->items[CPFormatToIndex(fmt)].size;
       ASSERT(*buf);
-      ASSERT((*size > 0) && (*size < CPCLIPITEM_MAX_SIZE_V3));
+      ASSERT((*size > 0) && (*size < CPCLIPITEM_MAX_SIZE_LARGE));
       return TRUE;
    } else {
       ASSERT(!clip->items[CPFormatToIndex(fmt)].size);
@@ -393,32 +877,79 @@ CPClipboard_GetItem(const CPClipboard *clip,    // IN: the clipboard
 /*
  *----------------------------------------------------------------------------
  *
- * CPClipboard_ItemExists  --
+ * CPClipboard_LoadItem  --
  *
- *      Check if the clipboard item of format fmt exists or not.
+ *      Same as CPClipboard_GetItem, but an item kept in a spool file is read
+ *      into memory first.
  *
  * Results:
  *      TRUE if item exists, FALSE otherwise.
  *
  * Side effects:
- *      None.
+ *      A spooled item stays in memory until it is cleared.
  *
  *----------------------------------------------------------------------------
  */
 
 Bool
-CPClipboard_ItemExists(const CPClipboard *clip,    // IN: the clipboard
-                       DND_CPFORMAT fmt)           // IN: the format
+CPClipboard_LoadItem(CPClipboard *clip,         // IN/OUT: the clipboard
+                     DND_CPFORMAT fmt,          // IN: the format
+                     void **buf,                // OUT
+                     size_t *size)              // OUT
 {
+   CPClipItem *item;
+
    ASSERT(clip);
 
    if(!(CPFORMAT_UNKNOWN < fmt && fmt < CPFORMAT_MAX)) {
       return FALSE;
    }
 
-   return (clip->items[CPFormatToIndex(fmt)].exists &&
-           clip->items[CPFormatToIndex(fmt)].size > 0);
-}
+   item = &clip->items[CPFormatToIndex(fmt)];
+   if (item->exists && !item->buf && item->fd >= 0) {
+      uint8 *newBuf = malloc(item->size + 1);
+
+      if (!newBuf || !CPClipItemRead(item, 0, newBuf, item->size)) {
+         free(newBuf);
+         return FALSE;
+      }
+      newBuf[item->size] = 0;
+      item->buf = newBuf;
+   }
+
+   return CPClipboard_GetItem(clip, fmt, buf, size);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboard_ItemExists  --
+ *
+ *      Check if the clipboard item of format fmt exists or not.
+ *
+ * Results:
+ *      TRUE if item exists, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+CPClipboard_ItemExists(const CPClipboard *clip,    // IN: the clipboard
+                       DND_CPFORMAT fmt)           // IN: the format
+{
+   ASSERT(clip);
+
+   if(!(CPFORMAT_UNKNOWN < fmt && fmt < CPFORMAT_MAX)) {
+      return FALSE;
+   }
+
+   return (clip->items[CPFormatToIndex(fmt)].exists &&
+           clip->items[CPFormatToIndex(fmt)].size > 0);
+}
 
 
 /*
@@ -574,12 +1105,50 @@ CPClipboard_Copy(CPClipboard *dest,             // IN: the desination clipboard
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboard_GetSerializedSize --
+ *
+ *      Get the size of the clipboard once serialized.
+ *
+ * Results:
+ *      Serialized size of the clipboard.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+size_t
+CPClipboard_GetSerializedSize(const CPClipboard *clip) // IN: the clipboard
+{
+   DND_CPFORMAT fmt;
+   size_t size = sizeof (uint32) + sizeof clip->changed;
+
+   ASSERT(clip);
+
+   for (fmt = CPFORMAT_MIN; fmt < CPFORMAT_MAX; ++fmt) {
+      const CPClipItem *item = &clip->items[CPFormatToIndex(fmt)];
+
+      size += sizeof item->exists + sizeof item->size;
+      if (item->exists) {
+         size += item->size;
+      }
+   }
+   return size;
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
  * CPClipboard_Serialize --
  *
  *      Serialize the contents of the CPClipboard out to the provided dynbuf.
+ *      The dynbuf is grown to its final size up front, so a big clipboard is
+ *      copied exactly once.
  *
  * Results:
  *      TRUE on success.
@@ -597,10 +1166,17 @@ CPClipboard_Serialize(const CPClipboard *clip, // IN
 {
    DND_CPFORMAT fmt;
    uint32 maxFmt = CPFORMAT_MAX;
+   size_t needed;
 
    ASSERT(clip);
    ASSERT(buf);
 
+   needed = CPClipboard_GetSerializedSize(clip) + DynBuf_GetSize(buf);
+   if (DynBuf_GetAllocatedSize(buf) < needed &&
+       !DynBuf_Enlarge(buf, needed)) {
+      return FALSE;
+   }
+
    /* First append number of formats in clip. */
    if (!DynBuf_Append(buf, &maxFmt, sizeof maxFmt)) {
       return FALSE;
@@ -613,9 +1189,14 @@ CPClipboard_Serialize(const CPClipboard *clip, // IN
           !DynBuf_Append(buf, &item->size, sizeof item->size)) {
          return FALSE;
       }
-      if (item->exists && (item->size > 0) &&
-          !DynBuf_Append(buf, item->buf, item->size)) {
-         return FALSE;
+      if (item->exists && (item->size > 0)) {
+         size_t pos = DynBuf_GetSize(buf);
+
+         if (!CPClipItemRead(item, 0, (uint8 *)DynBuf_Get(buf) + pos,
+                             item->size)) {
+            return FALSE;
+         }
+         DynBuf_SetSize(buf, pos + item->size);
       }
    }
 
@@ -630,25 +1211,162 @@ CPClipboard_Serialize(const CPClipboard *clip, // IN
 /*
  *----------------------------------------------------------------------------
  *
- * CPClipboard_Unserialize --
+ * CPClipboardReadField --
  *
- *      Unserialize the arguments of the CPClipboard provided by the buffer.
- *      On failure the clip will be destroyed.
+ *      Helper for CPClipboard_ReadSerialized. Copy the part of a serialized
+ *      field, at *pos in the serialized clipboard, that falls into the range
+ *      being read. The field is either item data or a plain value.
  *
  * Results:
- *      TRUE if success, FALSE otherwise
+ *      TRUE on success, FALSE on failure.
  *
  * Side effects:
- *      The clip passed in should be empty, otherwise will cause memory leakage.
- *      On success, arguments found in buf are unserialized into clip.
+ *      *pos is advanced past the field.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+CPClipboardReadField(const CPClipItem *item,    // IN: item data, or NULL
+                     const void *field,         // IN: value if item is NULL
+                     size_t fieldSize,          // IN
+                     size_t *pos,               // IN/OUT: offset of the field
+                     size_t offset,             // IN: offset of out
+                     uint8 *out,                // OUT
+                     size_t size)               // IN: size of out
+{
+   size_t start = MAX(*pos, offset);
+   size_t end = MIN(*pos + fieldSize, offset + size);
+   Bool ret = TRUE;
+
+   if (start < end) {
+      if (item) {
+         ret = CPClipItemRead(item, start - *pos, out + (start - offset),
+                              end - start);
+      } else {
+         memcpy(out + (start - offset), (const uint8 *)field + (start - *pos),
+                end - start);
+      }
+   }
+   *pos += fieldSize;
+   return ret;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboard_ReadSerialized --
+ *
+ *      Read size bytes of the serialized clipboard, starting at offset,
+ *      without serializing the whole clipboard. This is what streams a big
+ *      clipboard out packet by packet.
+ *
+ * Results:
+ *      TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *      None.
  *
  *----------------------------------------------------------------------------
  */
 
 Bool
-CPClipboard_Unserialize(CPClipboard *clip, // OUT: the clipboard
-                        const void *buf,   // IN: input buffer
-                        size_t len)        // IN: buffer length
+CPClipboard_ReadSerialized(const CPClipboard *clip,     // IN: the clipboard
+                           size_t offset,               // IN
+                           void *buf,                   // OUT
+                           size_t size)                 // IN
+{
+   DND_CPFORMAT fmt;
+   uint32 maxFmt = CPFORMAT_MAX;
+   size_t total = CPClipboard_GetSerializedSize(clip);
+   size_t pos = 0;
+
+   ASSERT(buf);
+
+   if (offset > total || size > total - offset) {
+      return FALSE;
+   }
+
+   /* Same layout as CPClipboard_Serialize. */
+   CPClipboardReadField(NULL, &maxFmt, sizeof maxFmt, &pos, offset, buf, size);
+   for (fmt = CPFORMAT_MIN; fmt < CPFORMAT_MAX && pos < offset + size;
+        ++fmt) {
+      const CPClipItem *item = &clip->items[CPFormatToIndex(fmt)];
+
+      CPClipboardReadField(NULL, &item->exists, sizeof item->exists, &pos,
+                           offset, buf, size);
+      CPClipboardReadField(NULL, &item->size, sizeof item->size, &pos,
+                           offset, buf, size);
+      if (item->exists && item->size > 0 &&
+          !CPClipboardReadField(item, NULL, item->size, &pos, offset, buf,
+                                size)) {
+         return FALSE;
+      }
+   }
+   CPClipboardReadField(NULL, &clip->changed, sizeof clip->changed, &pos,
+                        offset, buf, size);
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboard_FitSerializedSize --
+ *
+ *      Drop image, then rtf, then text data until the serialized clipboard
+ *      is at most maxSize bytes, for a peer that cannot take a bigger one.
+ *
+ * Results:
+ *      TRUE if the clipboard fits, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+CPClipboard_FitSerializedSize(CPClipboard *clip,        // IN/OUT: the clipboard
+                              size_t maxSize)           // IN
+{
+   int filterIndex = 0;
+
+   ASSERT(clip);
+
+   while (CPClipboard_GetSerializedSize(clip) > maxSize &&
+          filterIndex < ARRAYSIZE(cpClipFilterList)) {
+      CPClipboard_ClearItem(clip, cpClipFilterList[filterIndex]);
+      filterIndex++;
+   }
+   return CPClipboard_GetSerializedSize(clip) <= maxSize;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboardUnserialize --
+ *
+ *      Helper for the in-memory unserialize functions. Items borrow their
+ *      bytes from buf if clip owns it, and are copied otherwise.
+ *
+ * Results:
+ *      TRUE if success, FALSE otherwise. On failure the clip is destroyed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+CPClipboardUnserialize(CPClipboard *clip,       // IN/OUT: initialized clip
+                       const void *buf,         // IN: input buffer
+                       size_t len,              // IN: buffer length
+                       uint32 compressed)       // IN: format mask
 {
    DND_CPFORMAT fmt;
    BufRead r;
@@ -657,8 +1375,6 @@ CPClipboard_Unserialize(CPClipboard *clip, // OUT: the clipboard
    ASSERT(clip);
    ASSERT(buf);
 
-   CPClipboard_Init(clip);
-
    r.pos = buf;
    r.unreadLen = len;
 
@@ -680,11 +1396,21 @@ CPClipboard_Unserialize(CPClipboard *clip, // OUT: the clipboard
       }
 
       if (exists && size) {
+         CPClipItem src;
+
          if (size > r.unreadLen) {
             goto error;
          }
 
-         if (!CPClipboard_SetItem(clip, fmt, r.pos, size)) {
+         CPClipItemInit(&src);
+         src.buf = (void *)r.pos;
+         src.size = size;
+         if (clip->serialized && !(compressed & (1 << fmt))) {
+            if (!CPClipboardBorrowItem(clip, fmt, src.buf, size)) {
+               goto error;
+            }
+         } else if (!CPClipboardSetSerializedItem(clip, fmt, &src,
+                                                  compressed)) {
             goto error;
          }
          if (!DnDSlideBuffer(&r, size)) {
@@ -707,6 +1433,258 @@ error:
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboard_Unserialize --
+ *
+ *      Unserialize the arguments of the CPClipboard provided by the buffer.
+ *      On failure the clip will be destroyed.
+ *
+ * Results:
+ *      TRUE if success, FALSE otherwise
+ *
+ * Side effects:
+ *      The clip passed in should be empty, otherwise will cause memory leakage.
+ *      On success, arguments found in buf are unserialized into clip.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+CPClipboard_Unserialize(CPClipboard *clip, // OUT: the clipboard
+                        const void *buf,   // IN: input buffer
+                        size_t len)        // IN: buffer length
+{
+   return CPClipboard_UnserializeCompressed(clip, buf, len, 0);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboard_UnserializeCompressed --
+ *
+ *      Same as CPClipboard_Unserialize, for a clipboard serialized after
+ *      CPClipboard_Compress. The items of the formats in compressed, a mask
+ *      of (1 << format), are zlib streams and are uncompressed.
+ *
+ * Results:
+ *      TRUE if success, FALSE otherwise. Always FALSE for a compressed
+ *      clipboard if zlib support is not compiled in.
+ *
+ * Side effects:
+ *      Same as CPClipboard_Unserialize.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+CPClipboard_UnserializeCompressed(CPClipboard *clip,    // OUT: the clipboard
+                                  const void *buf,      // IN: input buffer
+                                  size_t len,           // IN: buffer length
+                                  uint32 compressed)    // IN: format mask
+{
+   ASSERT(buf);
+
+   CPClipboard_Init(clip);
+   return CPClipboardUnserialize(clip, buf, len, compressed);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboard_UnserializeTake --
+ *
+ *      Same as CPClipboard_UnserializeCompressed, but takes ownership of
+ *      buf, which must have been allocated with malloc. Items that are not
+ *      compressed refer to their bytes in buf instead of copies of them, so
+ *      buf is kept until the clipboard is cleared or destroyed. Their
+ *      trailing NUL is written over the field that follows them in buf.
+ *
+ * Results:
+ *      TRUE if success, FALSE otherwise.
+ *
+ * Side effects:
+ *      buf is freed, right away on failure or if no item refers to it.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+CPClipboard_UnserializeTake(CPClipboard *clip,  // OUT: the clipboard
+                            void *buf,          // IN: input buffer, taken
+                            size_t len,         // IN: buffer length
+                            uint32 compressed)  // IN: format mask
+{
+   const uint8 *end = (const uint8 *)buf + len;
+   DND_CPFORMAT fmt;
+
+   ASSERT(buf);
+
+   CPClipboard_Init(clip);
+   clip->serialized = buf;
+   if (!CPClipboardUnserialize(clip, buf, len, compressed)) {
+      return FALSE;
+   }
+
+   for (fmt = CPFORMAT_MIN; fmt < CPFORMAT_MAX; ++fmt) {
+      CPClipItem *item = &clip->items[CPFormatToIndex(fmt)];
+
+      if (!item->borrowed) {
+         continue;
+      }
+
+      /*
+       * The field after the item was read already. The last item of a
+       * clipboard without 'changed' has nothing after it, so gets a copy.
+       */
+      if ((uint8 *)item->buf + item->size < end) {
+         ((uint8 *)item->buf)[item->size] = 0;
+      } else if (!CPClipboard_SetItem(clip, fmt, item->buf, item->size)) {
+         CPClipboard_Destroy(clip);
+         return FALSE;
+      }
+   }
+
+   for (fmt = CPFORMAT_MIN; fmt < CPFORMAT_MAX; ++fmt) {
+      if (clip->items[CPFormatToIndex(fmt)].borrowed) {
+         return TRUE;
+      }
+   }
+   free(clip->serialized);
+   clip->serialized = NULL;
+   return TRUE;
+}
+
+
+#ifndef _WIN32
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboard_UnserializeFile --
+ *
+ *      Same as CPClipboard_Unserialize, for a serialized clipboard in the
+ *      first len bytes of fd. Items of CPCLIPITEM_FILE_THRESHOLD bytes or
+ *      more are left in the file instead of being read into memory.
+ *
+ * Results:
+ *      TRUE if success, FALSE otherwise
+ *
+ * Side effects:
+ *      The clip passed in should be empty, otherwise will cause memory leakage.
+ *      The clip keeps its own descriptor for fd, the caller may close fd.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+CPClipboard_UnserializeFile(CPClipboard *clip,  // OUT: the clipboard
+                            int fd,             // IN: input file
+                            size_t len)         // IN: serialized size
+{
+   return CPClipboard_UnserializeFileCompressed(clip, fd, len, 0);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboard_UnserializeFileCompressed --
+ *
+ *      Same as CPClipboard_UnserializeFile, for a clipboard serialized after
+ *      CPClipboard_Compress. See CPClipboard_UnserializeCompressed.
+ *
+ * Results:
+ *      TRUE if success, FALSE otherwise
+ *
+ * Side effects:
+ *      Same as CPClipboard_UnserializeFile.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+CPClipboard_UnserializeFileCompressed(CPClipboard *clip,        // OUT
+                                      int fd,                   // IN
+                                      size_t len,               // IN
+                                      uint32 compressed)        // IN
+{
+   DND_CPFORMAT fmt;
+   uint32 maxFmt;
+   size_t pos = 0;
+
+   ASSERT(clip);
+   ASSERT(fd >= 0);
+
+   CPClipboard_Init(clip);
+
+   /* First get number of formats in the file. */
+   if (len < sizeof maxFmt || !DnDReadFile(fd, pos, &maxFmt, sizeof maxFmt)) {
+      goto error;
+   }
+   pos += sizeof maxFmt;
+
+   /* This version only supports number of formats up to CPFORMAT_MAX. */
+   maxFmt = MIN(CPFORMAT_MAX, maxFmt);
+
+   for (fmt = CPFORMAT_MIN; fmt < maxFmt; ++fmt) {
+      Bool exists;
+      uint32 size;
+
+      if (len - pos < sizeof exists + sizeof size ||
+          !DnDReadFile(fd, pos, &exists, sizeof exists) ||
+          !DnDReadFile(fd, pos + sizeof exists, &size, sizeof size)) {
+         goto error;
+      }
+      pos += sizeof exists + sizeof size;
+
+      if (exists && size) {
+         if (size > len - pos || size >= CPCLIPITEM_MAX_SIZE_LARGE) {
+            goto error;
+         }
+
+         if (size >= CPCLIPITEM_FILE_THRESHOLD || (compressed & (1 << fmt))) {
+            CPClipItem src;
+
+            CPClipItemInit(&src);
+            src.fd = fd;
+            src.offset = pos;
+            src.size = size;
+            if (!CPClipboardSetSerializedItem(clip, fmt, &src, compressed)) {
+               goto error;
+            }
+         } else {
+            uint8 *buf = malloc(size);
+            Bool ok = buf &&
+                      DnDReadFile(fd, pos, buf, size) &&
+                      CPClipboard_SetItem(clip, fmt, buf, size);
+
+            free(buf);
+            if (!ok) {
+               goto error;
+            }
+         }
+         pos += size;
+      }
+   }
+
+   /* It is possible that clip->changed is missing in some beta products. */
+   if (len - pos == sizeof clip->changed &&
+       !DnDReadFile(fd, pos, &clip->changed, sizeof clip->changed)) {
+      goto error;
+   }
+
+   return TRUE;
+
+error:
+   CPClipboard_Destroy(clip);
+   return FALSE;
+}
+#endif
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -753,3 +1731,166 @@ CPClipboard_Strip(CPClipboard *clip,    // IN/OUT: the clipboard
    }
    return CPClipboard_IsEmpty(clip);
 }
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipItemHash --
+ *
+ *      Fold the data of item into a running hash. A spooled item is read
+ *      back from its file in chunks.
+ *
+ * Results:
+ *      TRUE on success, FALSE if the spool file could not be read.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+CPClipItemHash(const CPClipItem *item,  // IN: the clipboard item
+               uint64 *hash)            // IN/OUT: hash so far
+{
+#ifndef _WIN32
+   if (item->fd >= 0) {
+      uint8 *chunk = malloc(CPCLIP_FILE_CHUNK_SIZE);
+      uint32 done = 0;
+
+      if (!chunk) {
+         return FALSE;
+      }
+      while (done < item->size) {
+         uint32 len = MIN(item->size - done, CPCLIP_FILE_CHUNK_SIZE);
+
+         if (!DnDReadFile(item->fd, (uint64)item->offset + done, chunk, len)) {
+            free(chunk);
+            return FALSE;
+         }
+         *hash = CPClipHashBuffer(*hash, chunk, len);
+         done += len;
+      }
+      free(chunk);
+      return TRUE;
+   }
+#endif
+   if (item->buf) {
+      *hash = CPClipHashBuffer(*hash, item->buf, item->size);
+   }
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboard_GetHash --
+ *
+ *      Compute a hash over the clipboard contents. Nothing is hashed when an
+ *      item is set, this makes one pass over every item, so only call it
+ *      when the hash is going to be used, i.e. when the peer advertised
+ *      DND_CP_CAP_CLIPBOARD_HASH. Two clipboards that serialize to the same
+ *      bytes get the same hash.
+ *
+ * Results:
+ *      64-bit hash of the clipboard, or 0 if a spooled item could not be
+ *      read.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+uint64
+CPClipboard_GetHash(const CPClipboard *clip)    // IN: the clipboard
+{
+   DND_CPFORMAT fmt;
+   uint64 hash = CPCLIP_HASH_INIT;
+
+   ASSERT(clip);
+
+   for (fmt = CPFORMAT_MIN; fmt < CPFORMAT_MAX; ++fmt) {
+      const CPClipItem *item = &clip->items[CPFormatToIndex(fmt)];
+
+      if (!item->exists) {
+         continue;
+      }
+      hash = CPClipHashBuffer(hash, &fmt, sizeof fmt);
+      hash = CPClipHashBuffer(hash, &item->size, sizeof item->size);
+      if (!CPClipItemHash(item, &hash)) {
+         return 0;
+      }
+   }
+   return CPClipHashBuffer(hash, &clip->changed, sizeof clip->changed);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CPClipboard_Compress --
+ *
+ *      Make dest a copy of src in which the text and RTF items of
+ *      CPCLIP_COMPRESS_THRESHOLD bytes or more are replaced by zlib streams,
+ *      when that makes them smaller. Spooled items are compressed a chunk at
+ *      a time. dest must only be serialized and sent, with formats, to a
+ *      peer that negotiated DND_CP_CAP_CLIPBOARD_COMPRESS, which unserializes
+ *      it with CPClipboard_UnserializeCompressed.
+ *
+ * Results:
+ *      TRUE on success, FALSE on failure. *formats is the mask of
+ *      (1 << format) of the items that were compressed, it may be 0.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+CPClipboard_Compress(CPClipboard *dest,         // OUT: compressed clipboard
+                     const CPClipboard *src,    // IN: the clipboard
+                     uint32 *formats)           // OUT: compressed formats
+{
+#ifdef HAVE_ZLIB
+   static const DND_CPFORMAT compressible[] = { CPFORMAT_TEXT, CPFORMAT_RTF };
+   unsigned int i;
+
+   ASSERT(dest);
+   ASSERT(src);
+   ASSERT(formats);
+
+   *formats = 0;
+   if (!CPClipboard_Copy(dest, src)) {
+      return FALSE;
+   }
+
+   for (i = 0; i < ARRAYSIZE(compressible); i++) {
+      CPClipItem *item = &dest->items[CPFormatToIndex(compressible[i])];
+      DynBuf out;
+
+      if (!item->exists || item->size < CPCLIP_COMPRESS_THRESHOLD) {
+         continue;
+      }
+
+      DynBuf_Init(&out);
+      if (CPClipItemDeflate(item, &out) && DynBuf_Append(&out, "", 1)) {
+         /* Keep the trailing NUL every item buffer has. */
+         uint32 size = DynBuf_GetSize(&out) - 1;
+
+         CPClipItemDestroy(item);
+         item->buf = DynBuf_Detach(&out);
+         item->size = size;
+         item->exists = TRUE;
+         *formats |= 1 << compressible[i];
+      }
+      DynBuf_Destroy(&out);
+   }
+   return TRUE;
+#else
+   return FALSE;
+#endif
+}
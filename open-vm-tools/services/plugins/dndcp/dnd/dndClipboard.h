@@ -37,6 +37,7 @@
 #include "vm_basic_types.h"
 
 #include "dnd.h"
+#include "dndCPMsgV4.h"
 #include "dynbuf.h"
 
 /*
@@ -47,6 +48,14 @@
 #define CPCLIPITEM_MAX_SIZE_V2 ((1 << 16) - 100)
 #define CPCLIPITEM_MAX_SIZE_V3 (DNDMSG_MAX_ARGSZ - 100)
 
+/*
+ * Bigger clipboards can only go to peers that negotiated
+ * DND_CP_CAP_LARGE_CLIPBOARD. Items of CPCLIPITEM_FILE_THRESHOLD bytes or more
+ * are kept in a spool file instead of memory.
+ */
+#define CPCLIPITEM_MAX_SIZE_LARGE (DND_CP_MSG_MAX_LARGE_BINARY_SIZE_V4 - 100)
+#define CPCLIPITEM_FILE_THRESHOLD (1 << 20)
+
 /* Cross platform formats */
 typedef
 #include "vmware_pack_begin.h"
@@ -125,14 +134,32 @@ Bool CPClipboard_Changed(const CPClipboard *clip);
 Bool CPClipboard_ClearItem(CPClipboard *clip, DND_CPFORMAT fmt);
 Bool CPClipboard_GetItem(const CPClipboard *clip, DND_CPFORMAT fmt,
                          void **buf, size_t *size);
+Bool CPClipboard_LoadItem(CPClipboard *clip, DND_CPFORMAT fmt,
+                          void **buf, size_t *size);
 Bool CPClipboard_ItemExists(const CPClipboard *clip, DND_CPFORMAT fmt);
 Bool CPClipboard_IsEmpty(const CPClipboard *clip);
 #if !defined(SWIG)
 size_t CPClipboard_GetTotalSize(const CPClipboard *clip);
 #endif
 Bool CPClipboard_Copy(CPClipboard *dest, const CPClipboard *src);
+size_t CPClipboard_GetSerializedSize(const CPClipboard *clip);
 Bool CPClipboard_Serialize(const CPClipboard *clip, DynBuf *buf);
+Bool CPClipboard_ReadSerialized(const CPClipboard *clip, size_t offset,
+                                void *buf, size_t size);
+Bool CPClipboard_FitSerializedSize(CPClipboard *clip, size_t maxSize);
 Bool CPClipboard_Unserialize(CPClipboard *clip, const void *buf, size_t len);
+Bool CPClipboard_UnserializeCompressed(CPClipboard *clip, const void *buf,
+                                       size_t len, uint32 compressed);
+Bool CPClipboard_UnserializeTake(CPClipboard *clip, void *buf, size_t len,
+                                 uint32 compressed);
+#ifndef _WIN32
+Bool CPClipboard_UnserializeFile(CPClipboard *clip, int fd, size_t len);
+Bool CPClipboard_UnserializeFileCompressed(CPClipboard *clip, int fd,
+                                           size_t len, uint32 compressed);
+#endif
 Bool CPClipboard_Strip(CPClipboard *clip, uint32 caps);
+uint64 CPClipboard_GetHash(const CPClipboard *clip);
+Bool CPClipboard_Compress(CPClipboard *dest, const CPClipboard *src,
+                          uint32 *formats);
 
 #endif // _DND_CLIPBOARD_H_
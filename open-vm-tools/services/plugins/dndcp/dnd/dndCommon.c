@@ -702,15 +702,54 @@ DnD_TransportBufInit(DnDTransportBuffer *buf, // OUT
                      size_t msgSize,          // IN
                      uint32 seqNum)           // IN
 {
+   uint8 *copy;
+
    ASSERT(buf);
    ASSERT(msgSize <= DNDMSG_MAX_ARGSZ);
 
+   copy = Util_SafeMalloc(msgSize);
+   memcpy(copy, msg, msgSize);
+   DnD_TransportBufInitOwned(buf, copy, msgSize, seqNum);
+   buf->allocs++;
+   buf->bytesCopied += msgSize;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DnD_TransportBufInitOwned --
+ *
+ *    Initialize transport layer buffer with DnD message, taking ownership of
+ *    msg instead of copying it. msg must have been allocated with malloc and
+ *    is freed by DnD_TransportBufReset.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    Any previous buffer is freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+DnD_TransportBufInitOwned(DnDTransportBuffer *buf, // OUT
+                          uint8 *msg,              // IN: ownership taken
+                          size_t msgSize,          // IN
+                          uint32 seqNum)           // IN
+{
+   ASSERT(buf);
+   ASSERT(msg);
+   ASSERT(msgSize <= DNDMSG_MAX_ARGSZ);
+
    free(buf->buffer);
-   buf->buffer = Util_SafeMalloc(msgSize);
-   memcpy(buf->buffer, msg, msgSize);
+   buf->buffer = msg;
    buf->seqNum = seqNum;
    buf->totalSize = msgSize;
    buf->offset = 0;
+   buf->allocs = 0;
+   buf->bytesCopied = 0;
 }
 
 
@@ -742,6 +781,8 @@ DnD_TransportBufReset(DnDTransportBuffer *buf) // IN/OUT
    buf->totalSize = 0;
    buf->offset = 0;
    buf->lastUpdateTime = 0;
+   buf->allocs = 0;
+   buf->bytesCopied = 0;
 }
 
 
@@ -791,6 +832,8 @@ DnD_TransportBufGetPacket(DnDTransportBuffer *buf,           // IN/OUT
           buf->buffer + buf->offset,
           payloadSize);
    buf->offset += payloadSize;
+   buf->allocs++;
+   buf->bytesCopied += payloadSize;
 
    /* This time is used for timeout purpose. */
    buf->lastUpdateTime = Hostinfo_SystemTimerUS();
@@ -850,6 +893,8 @@ DnD_TransportBufAppendPacket(DnDTransportBuffer *buf,          // IN/OUT
       buf->totalSize = packet->totalSize;
       buf->seqNum = packet->seqNum;
       buf->offset = 0;
+      buf->allocs = 1;
+      buf->bytesCopied = 0;
    }
 
    if (buf->offset != packet->offset) {
@@ -860,6 +905,7 @@ DnD_TransportBufAppendPacket(DnDTransportBuffer *buf,          // IN/OUT
           packet->payload,
           packet->payloadSize);
    buf->offset += packet->payloadSize;
+   buf->bytesCopied += packet->payloadSize;
    return TRUE;
 
 error:
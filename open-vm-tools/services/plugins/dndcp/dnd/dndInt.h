@@ -54,4 +54,15 @@ Bool DnDReadBuffer(BufRead *b, void *out, size_t len);
 
 Bool DnDSlideBuffer(BufRead *b, size_t len);
 
+#ifndef _WIN32
+/* Spool file helpers, see dndLinux.c. */
+Bool DnDReadFile(int fd, uint64 offset, void *buf, size_t len);
+
+Bool DnDWriteFile(int fd, uint64 offset, const void *buf, size_t len);
+
+int DnDDupFile(int fd);
+
+void DnDCloseFile(int fd);
+#endif
+
 #endif /*  __DND_INT_H__ */
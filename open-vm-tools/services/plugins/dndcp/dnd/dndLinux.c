@@ -28,6 +28,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "vmware.h"
 #include "dndInt.h"
@@ -310,6 +311,174 @@ DnD_UriIsNonFileSchemes(const char *uri)
 }
 
 
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DnD_CreateSpoolFile --
+ *
+ *    Creates an anonymous file in the safe temp directory to hold clipboard
+ *    data that is too big to keep in memory. The file is unlinked right
+ *    away, so it goes away with the last descriptor that refers to it.
+ *
+ * Results:
+ *    The file descriptor, or -1 on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+DnD_CreateSpoolFile(void)
+{
+   Unicode path = NULL;
+   int fd;
+
+   fd = File_MakeSafeTemp("vmware-dnd", &path);
+   if (fd < 0) {
+      LOG(1, ("%s: File_MakeSafeTemp failed.\n", __FUNCTION__));
+      return -1;
+   }
+   if (File_Unlink(path) != 0) {
+      LOG(1, ("%s: File_Unlink failed.\n", __FUNCTION__));
+      close(fd);
+      fd = -1;
+   }
+   Unicode_Free(path);
+   return fd;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DnDReadFile --
+ *
+ *    Reads exactly len bytes at offset from fd into buf.
+ *
+ * Results:
+ *    TRUE on success, FALSE on error or if the file is too short.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+DnDReadFile(int fd,             // IN
+            uint64 offset,      // IN
+            void *buf,          // OUT
+            size_t len)         // IN
+{
+   uint8 *p = buf;
+
+   while (len > 0) {
+      ssize_t n = pread(fd, p, len, offset);
+
+      if (n < 0 && errno == EINTR) {
+         continue;
+      }
+      if (n <= 0) {
+         return FALSE;
+      }
+      p += n;
+      offset += n;
+      len -= n;
+   }
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DnDWriteFile --
+ *
+ *    Writes len bytes from buf to fd at offset.
+ *
+ * Results:
+ *    TRUE on success, FALSE on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+Bool
+DnDWriteFile(int fd,            // IN
+             uint64 offset,     // IN
+             const void *buf,   // IN
+             size_t len)        // IN
+{
+   const uint8 *p = buf;
+
+   while (len > 0) {
+      ssize_t n = pwrite(fd, p, len, offset);
+
+      if (n < 0 && errno == EINTR) {
+         continue;
+      }
+      if (n <= 0) {
+         return FALSE;
+      }
+      p += n;
+      offset += n;
+      len -= n;
+   }
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DnDDupFile --
+ *
+ *    Duplicates a spool file descriptor.
+ *
+ * Results:
+ *    The new descriptor, or -1 on failure.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+DnDDupFile(int fd)      // IN
+{
+   return dup(fd);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DnDCloseFile --
+ *
+ *    Closes a spool file descriptor. The file goes away with its last
+ *    descriptor, since spool files are unlinked when they are created.
+ *
+ * Results:
+ *    None.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+DnDCloseFile(int fd)    // IN
+{
+   close(fd);
+}
+
+
 /* We need to make this suck less. */
 #if defined(linux) || defined(sun) || defined(__FreeBSD__)
 
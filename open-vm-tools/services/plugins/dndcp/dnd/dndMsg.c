@@ -415,7 +415,9 @@ DnDMsg_UnserializeHeader(DnDMsg *msg,   // IN/OUT: the message
  *      DNDMSG_ERR on any other error.
  *
  * Side effects:
- *      On success, arguments found in buf are unserialized into msg.
+ *      On success, arguments found in buf are unserialized into msg. The
+ *      arguments refer to buf directly instead of holding copies, so buf
+ *      must stay valid and unchanged until msg is destroyed.
  *
  *----------------------------------------------------------------------------
  */
@@ -429,8 +431,7 @@ DnDMsg_UnserializeArgs(DnDMsg *msg,     // IN/OUT: the message
    uint32 count;
    BufRead r;
    uint32 readArgsSz = 0;
-
-   void *data = NULL;
+   DynBuf arg;
    DnDMsgErr ret = DNDMSG_SUCCESS;
 
    ASSERT(msg);
@@ -457,33 +458,31 @@ DnDMsg_UnserializeArgs(DnDMsg *msg,     // IN/OUT: the message
          goto err;
       }
 
-      data = malloc(argSz);
-      if (!data) {
-         ret = DNDMSG_NOMEM;
-         goto err;
-      }
-
-      if (!DnDReadBuffer(&r, data, argSz)) {
+      /*
+       * Borrow the argument straight out of buf rather than copying it into
+       * a fresh allocation: the reassembled transport buffer is already the
+       * only copy we need to keep around while the message is handled.
+       */
+      if (argSz > r.unreadLen) {
          ret = DNDMSG_ERR;
          goto err;
       }
 
-      if (!DnDMsg_AppendArg(msg, data, argSz)) {
+      DynBuf_InitWithStorage(&arg, (void *)r.pos, argSz);
+      DynBuf_SetSize(&arg, argSz);
+      if (!DynBufArray_Push(&msg->args, arg)) {
+         DynBuf_Destroy(&arg);
          ret = DNDMSG_NOMEM;
          goto err;
       }
+      DnDSlideBuffer(&r, argSz);
       readArgsSz += argSz + sizeof (uint32);
-      free(data);
    }
 
    ASSERT(ret == DNDMSG_SUCCESS);
    return ret;
 
 err:
-   if (data) {
-      free(data);
-   }
-
    count = DynBufArray_Count(&msg->args);
    for (i = 0; i < count; ++i) {
       DynBuf *b = DynArray_AddressOf(&msg->args, i);
@@ -90,6 +90,11 @@ public:
    virtual void HandleMsg(RpcParams *params,
                           const uint8 *binary,
                           uint32 binarySize);
+#ifndef _WIN32
+   virtual bool HandleMsgFile(RpcParams *params,
+                              int fd,
+                              uint32 binarySize);
+#endif
    virtual bool SendPacket(uint32 destId,
                            const uint8 *packet,
                            size_t length);
@@ -41,6 +41,12 @@ public:
 
    sigc::signal<void, uint32, const uint8 *, size_t> HgfsPacketReceived;
    sigc::signal<void, uint32, const uint8 *, size_t> HgfsReplyReceived;
+   /* sessionId, streamId, offset, path. */
+   sigc::signal<void, uint32, uint32, uint64, const char *> StreamFileReceived;
+   /* sessionId, streamId, offset. */
+   sigc::signal<void, uint32, uint32, uint64> StreamAckReceived;
+   /* sessionId, streamId. */
+   sigc::signal<void, uint32, uint32> StreamCancelReceived;
 
    virtual void Init(void) = 0;
    virtual bool SendHgfsPacket(uint32 sessionId,
@@ -49,6 +55,16 @@ public:
    virtual bool SendHgfsReply(uint32 sessionId,
                               const uint8 *packet,
                               uint32 packetSize) = 0;
+   virtual bool SendStreamData(uint32 sessionId,
+                               uint32 streamId,
+                               uint64 offset,
+                               const uint8 *data,
+                               uint32 dataSize,
+                               bool success) = 0;
+   virtual bool SendStreamProgress(uint32 sessionId,
+                                   uint32 streamId,
+                                   uint64 bytes,
+                                   uint32 bytesPerSec) = 0;
 };
 
 #endif // FILE_TRANSFER_RPC_HH
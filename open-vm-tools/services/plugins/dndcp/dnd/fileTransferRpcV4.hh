@@ -48,6 +48,16 @@ public:
    virtual bool SendHgfsReply(uint32 sessionId,
                               const uint8 *packet,
                               uint32 packetSize);
+   virtual bool SendStreamData(uint32 sessionId,
+                               uint32 streamId,
+                               uint64 offset,
+                               const uint8 *data,
+                               uint32 dataSize,
+                               bool success);
+   virtual bool SendStreamProgress(uint32 sessionId,
+                                   uint32 streamId,
+                                   uint64 bytes,
+                                   uint32 bytesPerSec);
    virtual void HandleMsg(RpcParams *params,
                           const uint8 *binary,
                           uint32 binarySize);
@@ -85,8 +85,26 @@ typedef struct RpcParams {
          uint32 minor;
          uint32 capability;
          uint32 isActive;
+         /* 1 << DND_CPFORMAT bits of zlib items, DND_CP_CAP_CLIPBOARD_COMPRESS. */
+         uint32 compressed;
       } cpInfo;
 
+      struct {
+         uint32 major;
+         uint32 minor;
+         uint32 capability;
+         uint32 isActive;
+         uint32 hashLow;
+         uint32 hashHigh;
+      } cpClipHash;
+
+      struct {
+         uint32 streamId;
+         uint32 offsetLow;
+         uint32 offsetHigh;
+         uint32 bytesPerSec;
+      } ftStream;
+
       struct {
          uint32 param1;
          uint32 param2;
@@ -111,5 +129,21 @@ public:
    virtual void HandleMsg(RpcParams *params,
                           const uint8 *binary,
                           uint32 binarySize) = 0;
+   /*
+    * Same as HandleMsg for a binary that was received into a file because it
+    * is too big for memory. fd is only valid during the call. Returns false
+    * if the message was not handled.
+    */
+   virtual bool HandleMsgFile(RpcParams *params,
+                              int fd,
+                              uint32 binarySize) { return false; }
+   /*
+    * Same as HandleMsg, but may take ownership of binary, which was
+    * allocated with malloc, to keep it instead of a copy. Returns false if
+    * it did not, and the caller then calls HandleMsg.
+    */
+   virtual bool HandleMsgOwned(RpcParams *params,
+                               uint8 *binary,
+                               uint32 binarySize) { return false; }
 };
 #endif // RPC_BASE_H
@@ -57,8 +57,8 @@ public:
    uint32 GetVersionMinor(void) { return mVersionMinor; }
 
 private:
-   bool SendMsg(const uint8 *binary,
-                uint32 binarySize);
+   bool SendMsgOwned(uint8 *binary,
+                     uint32 binarySize);
    RpcBase *mRpc;
    uint32 mVersionMajor;
    uint32 mVersionMinor;
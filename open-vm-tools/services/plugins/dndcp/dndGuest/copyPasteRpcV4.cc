@@ -51,9 +51,16 @@ CopyPasteRpcV4::CopyPasteRpcV4(DnDCPTransport *transport)
 #else
      mTransportInterface(TRANSPORT_HOST_CONTROLLER_CP)
 #endif
+   , mHaveLastRecvClip(false),
+     mLastRecvHash(0),
+     mHaveLastSentHash(false),
+     mLastSentHash(0),
+     mLastSentIsActive(false)
 {
    ASSERT(mTransport);
 
+   CPClipboard_Init(&mLastRecvClip);
+
 #ifdef VMX86_TOOLS
    mUtil.Init(this, DND_CP_MSG_SRC_GUEST, DND_CP_MSG_TYPE_CP);
 #else
@@ -62,6 +69,30 @@ CopyPasteRpcV4::CopyPasteRpcV4(DnDCPTransport *transport)
 }
 
 
+/**
+ * Destructor.
+ */
+
+CopyPasteRpcV4::~CopyPasteRpcV4(void)
+{
+   CPClipboard_Destroy(&mLastRecvClip);
+}
+
+
+/**
+ * Forget the clipboards exchanged so far. Called whenever the channel is
+ * (re)established because the peer may not remember them any more.
+ */
+
+void
+CopyPasteRpcV4::ResetClipHashes(void)
+{
+   CPClipboard_Clear(&mLastRecvClip);
+   mHaveLastRecvClip = false;
+   mHaveLastSentHash = false;
+}
+
+
 /**
  * Init.
  */
@@ -83,6 +114,7 @@ CopyPasteRpcV4::Init()
 void
 CopyPasteRpcV4::SendPing(uint32 caps)
 {
+   ResetClipHashes();
    mUtil.SendPingMsg(DEFAULT_CONNECTION_ID, caps);
 }
 
@@ -115,7 +147,9 @@ CopyPasteRpcV4::SrcRequestClip(uint32 sessionId,
 
 
 /**
- * Send cmd CP_CMD_SEND_CLIPBOARD to controller.
+ * Send cmd CP_CMD_SEND_CLIPBOARD to controller. If the controller supports
+ * DND_CP_CAP_CLIPBOARD_HASH and clip is the same as the one sent last time,
+ * send the short CP_CMD_SEND_CLIPBOARD_UNCHANGED instead.
  *
  * @param[in] sessionId active session id the controller assigned earlier.
  * @param[in] isActive active or passive CopyPaste
@@ -130,6 +164,9 @@ CopyPasteRpcV4::DestSendClip(uint32 sessionId,
                              const CPClipboard* clip)
 {
    RpcParams params;
+   uint64 hash = 0;
+   bool sent = false;
+   bool ret = false;
 
    memset(&params, 0, sizeof params);
    params.addrId = DEFAULT_CONNECTION_ID;
@@ -139,7 +176,45 @@ CopyPasteRpcV4::DestSendClip(uint32 sessionId,
    params.optional.cpInfo.minor = mUtil.GetVersionMinor();
    params.optional.cpInfo.isActive = isActive;
 
-   return mUtil.SendMsg(&params, clip);
+   if (clip && mUtil.IsCapNegotiated(DND_CP_CAP_CLIPBOARD_HASH)) {
+      hash = CPClipboard_GetHash(clip);
+      if (mHaveLastSentHash && hash == mLastSentHash) {
+         LOG(4, ("%s: clipboard unchanged, hash %" FMT64 "x.\n",
+                 __FUNCTION__, hash));
+         params.cmd = CP_CMD_SEND_CLIPBOARD_UNCHANGED;
+         params.optional.cpClipHash.hashLow = (uint32)hash;
+         params.optional.cpClipHash.hashHigh = (uint32)(hash >> 32);
+         mLastSentIsActive = isActive;
+         return mUtil.SendMsg(&params);
+      }
+   }
+
+#ifdef HAVE_ZLIB
+   if (clip && mUtil.IsCapNegotiated(DND_CP_CAP_CLIPBOARD_COMPRESS)) {
+      CPClipboard packed;
+      uint32 formats = 0;
+
+      CPClipboard_Init(&packed);
+      if (CPClipboard_Compress(&packed, clip, &formats) && formats != 0) {
+         LOG(4, ("%s: sending compressed formats 0x%x.\n",
+                 __FUNCTION__, formats));
+         params.optional.cpInfo.compressed = formats;
+         ret = mUtil.SendMsg(&params, &packed);
+         CPClipboard_Destroy(&packed);
+         sent = true;
+      } else {
+         CPClipboard_Destroy(&packed);
+      }
+   }
+#endif
+
+   if (!sent) {
+      ret = mUtil.SendMsg(&params, clip);
+   }
+   mHaveLastSentHash = ret && hash != 0;
+   mLastSentHash = hash;
+   mLastSentIsActive = isActive;
+   return ret;
 }
 
 
@@ -268,19 +343,27 @@ CopyPasteRpcV4::HandleMsg(RpcParams *params,
 
    switch (params->cmd) {
    case CP_CMD_RECV_CLIPBOARD:
-      CPClipboard clip;
+      /*
+       * Unserialize straight into mLastRecvClip so that a later
+       * CP_CMD_RECV_CLIPBOARD_UNCHANGED can replay it without a copy.
+       */
+      CPClipboard_Destroy(&mLastRecvClip);
+      mHaveLastRecvClip = false;
       if (!binary || binarySize == 0) {
          LOG(0, ("%s: invalid clipboard data.\n", __FUNCTION__));
          break;
       }
-      if (!CPClipboard_Unserialize(&clip, (void *)binary, binarySize)) {
+      if (!CPClipboard_UnserializeCompressed(&mLastRecvClip,
+                                             (void *)binary,
+                                             binarySize,
+                                             GetCompressedFormats(params))) {
          LOG(0, ("%s: CPClipboard_Unserialize failed.\n", __FUNCTION__));
          break;
       }
-      srcRecvClipChanged.emit(params->sessionId,
-                              1 == params->optional.cpInfo.isActive,
-                              &clip);
-      CPClipboard_Destroy(&clip);
+      HandleRecvClip(params);
+      break;
+   case CP_CMD_RECV_CLIPBOARD_UNCHANGED:
+      HandleRecvClipUnchanged(params);
       break;
    case CP_CMD_REQUEST_CLIPBOARD:
       destRequestClipChanged.emit(params->sessionId,
@@ -300,6 +383,16 @@ CopyPasteRpcV4::HandleMsg(RpcParams *params,
       break;
    case DNDCP_CMP_REPLY:
       LOG(0, ("%s: Got cmp reply command %d.\n", __FUNCTION__, params->cmd));
+      if (CP_CMD_SEND_CLIPBOARD_UNCHANGED == params->optional.replyToCmd.cmd &&
+          DND_CP_MSG_STATUS_SUCCESS != params->status) {
+         /*
+          * The controller no longer has the clipboard we referred to. Ask
+          * the UI for it again, it will go out in full this time.
+          */
+         mHaveLastSentHash = false;
+         destRequestClipChanged.emit(params->sessionId, mLastSentIsActive);
+         break;
+      }
       cmdReplyChanged.emit(params->cmd, params->status);
       break;
    default:
@@ -309,6 +402,153 @@ CopyPasteRpcV4::HandleMsg(RpcParams *params,
 }
 
 
+/**
+ * Handle a received message, keeping its binary if it is a clipboard. The
+ * clipboard items then point into binary instead of being copied out of it.
+ *
+ * @param[in] params parameter list for received message.
+ * @param[in] binary attached binary data, malloc'd, taken if true is returned.
+ * @param[in] binarySize in bytes
+ *
+ * @return true if the message was handled, false otherwise.
+ */
+
+bool
+CopyPasteRpcV4::HandleMsgOwned(RpcParams *params,
+                               uint8 *binary,
+                               uint32 binarySize)
+{
+   ASSERT(params);
+   ASSERT(binary);
+
+   if (CP_CMD_RECV_CLIPBOARD != params->cmd || 0 == binarySize) {
+      return false;
+   }
+
+   LOG(4, ("%s: Got %s[%d], sessionId %d, srcId %d, binary size %d.\n",
+           __FUNCTION__, DnDCPMsgV4_LookupCmd(params->cmd), params->cmd,
+           params->sessionId, params->addrId, binarySize));
+
+   CPClipboard_Destroy(&mLastRecvClip);
+   mHaveLastRecvClip = false;
+   if (!CPClipboard_UnserializeTake(&mLastRecvClip, binary, binarySize,
+                                    GetCompressedFormats(params))) {
+      LOG(0, ("%s: CPClipboard_Unserialize failed.\n", __FUNCTION__));
+      return true;
+   }
+   HandleRecvClip(params);
+   return true;
+}
+
+
+#ifndef _WIN32
+/**
+ * Handle a received message whose binary was received into a file. Only a
+ * clipboard can be that big.
+ *
+ * @param[in] params parameter list for received message.
+ * @param[in] fd file holding the binary.
+ * @param[in] binarySize in bytes
+ *
+ * @return true if the message was handled, false otherwise.
+ */
+
+bool
+CopyPasteRpcV4::HandleMsgFile(RpcParams *params,
+                              int fd,
+                              uint32 binarySize)
+{
+   ASSERT(params);
+
+   LOG(4, ("%s: Got %s[%d], sessionId %d, srcId %d, binary size %d.\n",
+           __FUNCTION__, DnDCPMsgV4_LookupCmd(params->cmd), params->cmd,
+           params->sessionId, params->addrId, binarySize));
+
+   if (CP_CMD_RECV_CLIPBOARD != params->cmd) {
+      return false;
+   }
+
+   /* Big items stay in the file, the clipboard keeps it open. */
+   CPClipboard_Destroy(&mLastRecvClip);
+   mHaveLastRecvClip = false;
+   if (!CPClipboard_UnserializeFileCompressed(&mLastRecvClip, fd, binarySize,
+                                              GetCompressedFormats(params))) {
+      LOG(0, ("%s: CPClipboard_UnserializeFile failed.\n", __FUNCTION__));
+      return true;
+   }
+   HandleRecvClip(params);
+   return true;
+}
+#endif
+
+
+/**
+ * Formats of a received clipboard that the peer sent as zlib streams. Only
+ * trusted if DND_CP_CAP_CLIPBOARD_COMPRESS was negotiated, param5 means
+ * nothing to older peers.
+ *
+ * @param[in] params parameter list for received message.
+ *
+ * @return mask of (1 << DND_CPFORMAT) bits.
+ */
+
+uint32
+CopyPasteRpcV4::GetCompressedFormats(const RpcParams *params)
+{
+   if (!mUtil.IsCapNegotiated(DND_CP_CAP_CLIPBOARD_COMPRESS)) {
+      return 0;
+   }
+   return params->optional.cpInfo.compressed;
+}
+
+
+/**
+ * Cache the clipboard just unserialized into mLastRecvClip and pass it on.
+ *
+ * @param[in] params parameter list for received message.
+ */
+
+void
+CopyPasteRpcV4::HandleRecvClip(RpcParams *params)
+{
+   mHaveLastRecvClip = true;
+   mLastRecvHash = mUtil.IsCapNegotiated(DND_CP_CAP_CLIPBOARD_HASH)
+                   ? CPClipboard_GetHash(&mLastRecvClip)
+                   : 0;
+   srcRecvClipChanged.emit(params->sessionId,
+                           1 == params->optional.cpInfo.isActive,
+                           &mLastRecvClip);
+}
+
+
+/**
+ * Handle CP_CMD_RECV_CLIPBOARD_UNCHANGED: the controller is sending the same
+ * clipboard as last time. Replay the cached one if the hash matches,
+ * otherwise tell the controller to send the clipboard in full.
+ *
+ * @param[in] params parameter list for received message.
+ */
+
+void
+CopyPasteRpcV4::HandleRecvClipUnchanged(RpcParams *params)
+{
+   uint64 hash = params->optional.cpClipHash.hashLow |
+                 (uint64)params->optional.cpClipHash.hashHigh << 32;
+
+   if (!mHaveLastRecvClip || 0 == mLastRecvHash || hash != mLastRecvHash) {
+      LOG(1, ("%s: no clipboard with hash %" FMT64 "x.\n", __FUNCTION__, hash));
+      mUtil.SendCmdReplyMsg(params->addrId,
+                            CP_CMD_RECV_CLIPBOARD_UNCHANGED,
+                            DND_CP_MSG_STATUS_ERROR);
+      return;
+   }
+
+   srcRecvClipChanged.emit(params->sessionId,
+                           1 == params->optional.cpClipHash.isActive,
+                           &mLastRecvClip);
+}
+
+
 /**
  * Callback from transport layer after received a packet from srcId.
  *
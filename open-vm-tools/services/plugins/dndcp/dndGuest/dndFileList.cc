@@ -46,6 +46,8 @@
 #include <afx.h>
 #endif
 
+#include <string.h>
+
 #include "dndFileList.hh"
 
 extern "C" {
@@ -267,31 +269,47 @@ DnDFileList::AddFileAttributes(const CPFileAttributes& attributes)  // IN
 void
 DnDFileList::SetRelPathsStr(const std::string inpath)   // IN:
 {
-   std::string::size_type mPos = 0;
-   std::string curFile;
-   std::string path;
-   const char* cpath;
+   SetRelPaths(inpath.data(), inpath.size());
+}
 
-   if (inpath.empty()) {
-      return;
-   }
 
-   if (inpath[inpath.size()-1] != '\0') {
-      path = inpath + '\0';
-   } else {
-      path = inpath;
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DnDFileList::SetRelPaths --
+ *
+ *      Set the relative paths from len bytes of NUL separated paths, the
+ *      last NUL being optional. Each path is copied once, straight from
+ *      paths.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+void
+DnDFileList::SetRelPaths(const char *paths,     // IN:
+                         size_t len)            // IN:
+{
+   const char *end = paths + len;
+
+   if (0 == len) {
+      return;
    }
 
-   cpath = path.c_str();
    mRelPaths.clear();
-   curFile = cpath;
-   mPos = path.find('\0', mPos);
-
-   while (mPos != std::string::npos) {
-      mPos++;
-      mRelPaths.push_back(curFile);
-      curFile = cpath + mPos;
-      mPos = path.find('\0', mPos);
+   while (paths < end) {
+      const char *nul = (const char *)memchr(paths, '\0', end - paths);
+
+      if (!nul) {
+         nul = end;
+      }
+      mRelPaths.push_back(std::string(paths, nul - paths));
+      paths = nul + 1;
    }
 }
 
@@ -474,7 +492,7 @@ DnDFileList::GetUriPathsStr(void)
  *      Loads the filelist from a buffer, typically from CPClipboard.
  *
  * Results:
- *      None.
+ *      true on success, false if the buffer is shorter than the filelist.
  *
  * Side effects:
  *      None.
@@ -487,24 +505,26 @@ DnDFileList::FromCPClipboard(const void *buf,   // IN: Source buffer
                              size_t len)        // IN: Buffer length
 {
    const CPFileList *flist;
-   std::string relPaths;
 
    ASSERT(buf);
    ASSERT(len);
-   if (!buf || !len) {
+   if (!buf || len < CPFILELIST_HEADER_SIZE) {
       return false;
    }
 
    flist = reinterpret_cast<const CPFileList *>(buf);
-   relPaths.assign(
-      reinterpret_cast<const char *>(flist->filelists), flist->relPathsLen);
+   if (len - CPFILELIST_HEADER_SIZE <
+       (uint64)flist->relPathsLen + flist->fulPathsLen) {
+      return false;
+   }
 
    mRelPaths.clear();
    mFullPaths.clear();
 
    mFileSize = flist->fileSize;
 
-   SetRelPathsStr(relPaths);
+   SetRelPaths(reinterpret_cast<const char *>(flist->filelists),
+               flist->relPathsLen);
    mFullPathsBinary.assign(
       reinterpret_cast<const char *>(flist->filelists + flist->relPathsLen),
       flist->fulPathsLen);
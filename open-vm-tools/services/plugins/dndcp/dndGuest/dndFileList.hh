@@ -70,6 +70,7 @@ class DnDFileList {
       void Clear();
 
    private:
+      void SetRelPaths(const char *paths, size_t len);
 
       std::vector<std::string> mRelPaths;
       std::vector<std::string> mFullPaths;
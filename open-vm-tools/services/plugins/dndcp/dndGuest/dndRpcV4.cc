@@ -768,6 +768,46 @@ DnDRpcV4::HandleMsg(RpcParams *params,
 }
 
 
+#ifndef _WIN32
+/**
+ * Handle a received message whose binary was received into a file. Only a
+ * clipboard can be that big.
+ *
+ * @param[in] params parameter list for received message.
+ * @param[in] fd file holding the binary.
+ * @param[in] binarySize
+ *
+ * @return true if the message was handled, false otherwise.
+ */
+
+bool
+DnDRpcV4::HandleMsgFile(RpcParams *params,
+                        int fd,
+                        uint32 binarySize)
+{
+   CPClipboard clip;
+
+   ASSERT(params);
+
+   LOG(4, ("%s: Got %s[%d], sessionId %d, srcId %d, binary size %d.\n",
+           __FUNCTION__, DnDCPMsgV4_LookupCmd(params->cmd), params->cmd,
+           params->sessionId, params->addrId, binarySize));
+
+   if (DND_CMD_SRC_DRAG_BEGIN != params->cmd) {
+      return false;
+   }
+
+   if (!CPClipboard_UnserializeFile(&clip, fd, binarySize)) {
+      LOG(0, ("%s: CPClipboard_UnserializeFile failed.\n", __FUNCTION__));
+      return true;
+   }
+   srcDragBeginChanged.emit(params->sessionId, &clip);
+   CPClipboard_Destroy(&clip);
+   return true;
+}
+#endif
+
+
 /**
  * Callback from transport layer after received a packet from srcId.
  *
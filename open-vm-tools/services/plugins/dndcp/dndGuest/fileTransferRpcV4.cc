@@ -133,6 +133,77 @@ FileTransferRpcV4::SendHgfsReply(uint32 sessionId,
 }
 
 
+/**
+ * Sends FT_CMD_STREAM_DATA to peer. An empty one ends the stream.
+ *
+ * @param[in] sessionId DnD/CopyPaste session id.
+ * @param[in] streamId stream id the controller assigned.
+ * @param[in] offset file offset of data.
+ * @param[in] data file data.
+ * @param[in] dataSize at most DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4.
+ * @param[in] success false if the stream ends because of an error.
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+FileTransferRpcV4::SendStreamData(uint32 sessionId,
+                                  uint32 streamId,
+                                  uint64 offset,
+                                  const uint8 *data,
+                                  uint32 dataSize,
+                                  bool success)
+{
+   RpcParams params;
+
+   ASSERT(dataSize <= DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4);
+
+   memset(&params, 0, sizeof params);
+   params.addrId = DEFAULT_CONNECTION_ID;
+   params.cmd = FT_CMD_STREAM_DATA;
+   params.sessionId = sessionId;
+   params.status = success ? DND_CP_MSG_STATUS_SUCCESS
+                           : DND_CP_MSG_STATUS_ERROR;
+   params.optional.ftStream.streamId = streamId;
+   params.optional.ftStream.offsetLow = (uint32)offset;
+   params.optional.ftStream.offsetHigh = (uint32)(offset >> 32);
+
+   return mUtil.SendMsg(&params, data, dataSize);
+}
+
+
+/**
+ * Sends FT_CMD_STREAM_PROGRESS to peer.
+ *
+ * @param[in] sessionId DnD/CopyPaste session id.
+ * @param[in] streamId stream id the controller assigned.
+ * @param[in] bytes bytes of the stream sent so far.
+ * @param[in] bytesPerSec average throughput of the stream.
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+FileTransferRpcV4::SendStreamProgress(uint32 sessionId,
+                                      uint32 streamId,
+                                      uint64 bytes,
+                                      uint32 bytesPerSec)
+{
+   RpcParams params;
+
+   memset(&params, 0, sizeof params);
+   params.addrId = DEFAULT_CONNECTION_ID;
+   params.cmd = FT_CMD_STREAM_PROGRESS;
+   params.sessionId = sessionId;
+   params.optional.ftStream.streamId = streamId;
+   params.optional.ftStream.offsetLow = (uint32)bytes;
+   params.optional.ftStream.offsetHigh = (uint32)(bytes >> 32);
+   params.optional.ftStream.bytesPerSec = bytesPerSec;
+
+   return mUtil.SendMsg(&params);
+}
+
+
 /**
  * Send a packet.
  *
@@ -178,7 +249,30 @@ FileTransferRpcV4::HandleMsg(RpcParams *params,
    case FT_CMD_HGFS_REPLY:
       HgfsReplyReceived.emit(params->sessionId, binary, binarySize);
       break;
-   case DNDCP_CMD_PING_REPLY:
+   case FT_CMD_STREAM_FILE:
+      /* The path has to be NUL terminated, with no NUL before the end. */
+      if (!binary || 0 == binarySize || binary[binarySize - 1] != '\0' ||
+          strlen((const char *)binary) != binarySize - 1) {
+         LOG(0, ("%s: invalid stream path.\n", __FUNCTION__));
+         SendStreamData(params->sessionId, params->optional.ftStream.streamId,
+                        0, NULL, 0, false);
+         break;
+      }
+      StreamFileReceived.emit(params->sessionId,
+                              params->optional.ftStream.streamId,
+                              params->optional.ftStream.offsetLow |
+                              (uint64)params->optional.ftStream.offsetHigh << 32,
+                              (const char *)binary);
+      break;
+   case FT_CMD_STREAM_ACK:
+      StreamAckReceived.emit(params->sessionId,
+                             params->optional.ftStream.streamId,
+                             params->optional.ftStream.offsetLow |
+                             (uint64)params->optional.ftStream.offsetHigh << 32);
+      break;
+   case FT_CMD_STREAM_CANCEL:
+      StreamCancelReceived.emit(params->sessionId,
+                                params->optional.ftStream.streamId);
       break;
    default:
       LOG(0, ("%s: Got unknown command %d.\n", __FUNCTION__, params->cmd));
@@ -277,7 +277,12 @@ GuestCopyPasteMgr::VmxCopyPasteVersionChanged(uint32 version)
          sigc::mem_fun(this, &GuestCopyPasteMgr::OnRpcDestRequestClip));
       mRpc->Init();
       mRpc->SendPing(GuestDnDCPMgr::GetInstance()->GetCaps() &
-                     (DND_CP_CAP_CP | DND_CP_CAP_FORMATS_CP | DND_CP_CAP_VALID));
+                     (DND_CP_CAP_CP | DND_CP_CAP_FORMATS_CP |
+                      DND_CP_CAP_WINDOWED_BIG_BUFFER |
+                      DND_CP_CAP_CLIPBOARD_HASH |
+                      DND_CP_CAP_LARGE_CLIPBOARD |
+                      DND_CP_CAP_CLIPBOARD_COMPRESS |
+                      DND_CP_CAP_FILE_STREAM | DND_CP_CAP_VALID));
    }
 
    ResetCopyPaste();
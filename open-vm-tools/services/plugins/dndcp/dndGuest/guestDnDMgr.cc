@@ -667,7 +667,9 @@ GuestDnDMgr::VmxDnDVersionChanged(uint32 version)
       mRpc->Init();
       mRpc->SendPing(GuestDnDCPMgr::GetInstance()->GetCaps() &
                      (DND_CP_CAP_DND | DND_CP_CAP_FORMATS_DND |
-                      DND_CP_CAP_VALID));
+                      DND_CP_CAP_WINDOWED_BIG_BUFFER |
+                      DND_CP_CAP_LARGE_CLIPBOARD |
+                      DND_CP_CAP_FILE_STREAM | DND_CP_CAP_VALID));
    }
 
    ResetDnD();
@@ -0,0 +1,322 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @guestFileStream.cc --
+ *
+ * Streams file contents to the controller, the alternative to HGFS requests
+ * for a guest that advertises DND_CP_CAP_FILE_STREAM.
+ *
+ * The file is read a block of FT_STREAM_BLOCK_SIZE at a time with one
+ * pread, and sent as packet sized FT_CMD_STREAM_DATA messages. Reading a
+ * block hints the kernel to fetch the next one, so the disk works on it
+ * while the current block goes out. The guest keeps sending until
+ * DND_CP_FILE_STREAM_WINDOW bytes are unacknowledged, and carries on as
+ * FT_CMD_STREAM_ACK messages come in. Only one file is streamed at a time.
+ *
+ * The controller gets the same access to guest files as through the HGFS
+ * server on the file transfer channel.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "guestFileStream.hh"
+
+extern "C" {
+   #include <glib.h>
+
+   #include "dnd.h"
+   #include "dndCPMsgV4.h"
+   #include "hostinfo.h"
+   #include "posix.h"
+}
+
+/* Bytes read from the file at once. */
+#define FT_STREAM_BLOCK_SIZE (1 << 20)
+
+/* How often the throughput of a running stream is reported. */
+#define FT_STREAM_PROGRESS_INTERVAL_US (1000 * 1000)
+
+
+/**
+ * Constructor.
+ *
+ * @param[in] rpc file transfer rpc to stream through.
+ */
+
+GuestFileStream::GuestFileStream(FileTransferRpc *rpc)
+   : mRpc(rpc),
+     mFd(-1),
+     mSessionId(0),
+     mStreamId(0),
+     mStartOffset(0),
+     mSentOffset(0),
+     mAckedOffset(0),
+     mBlock(NULL),
+     mBlockSize(0),
+     mBlockPos(0),
+     mStartUS(0),
+     mLastReportUS(0)
+{
+   ASSERT(mRpc);
+   mRpc->StreamFileReceived.connect(
+      sigc::mem_fun(this, &GuestFileStream::OnStreamFile));
+   mRpc->StreamAckReceived.connect(
+      sigc::mem_fun(this, &GuestFileStream::OnStreamAck));
+   mRpc->StreamCancelReceived.connect(
+      sigc::mem_fun(this, &GuestFileStream::OnStreamCancel));
+}
+
+
+/**
+ * Destructor.
+ */
+
+GuestFileStream::~GuestFileStream(void)
+{
+   Close();
+}
+
+
+/**
+ * Start streaming path from offset. Replaces the stream in progress, if any.
+ *
+ * @param[in] sessionId DnD/CopyPaste session id.
+ * @param[in] streamId stream id the controller assigned.
+ * @param[in] offset where to start in the file.
+ * @param[in] path UTF-8 path of the file.
+ */
+
+void
+GuestFileStream::OnStreamFile(uint32 sessionId,
+                              uint32 streamId,
+                              uint64 offset,
+                              const char *path)
+{
+   struct stat st;
+
+   Close();
+   mSessionId = sessionId;
+   mStreamId = streamId;
+   mStartOffset = offset;
+   mSentOffset = offset;
+   mAckedOffset = offset;
+   mStartUS = Hostinfo_SystemTimerUS();
+   mLastReportUS = mStartUS;
+
+   mFd = Posix_Open(path, O_RDONLY);
+   if (mFd < 0 || fstat(mFd, &st) != 0 || !S_ISREG(st.st_mode)) {
+      g_debug("%s: can't stream %s: %s\n", __FUNCTION__, path,
+              mFd < 0 ? strerror(errno) : "not a regular file");
+      Finish(false);
+      return;
+   }
+   mBlock = (uint8 *)malloc(FT_STREAM_BLOCK_SIZE);
+   if (!mBlock) {
+      Finish(false);
+      return;
+   }
+#ifdef __linux__
+   /* Only hints: failure is harmless, so ignore it. */
+   (void)posix_fadvise(mFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+   (void)posix_fadvise(mFd, offset, FT_STREAM_BLOCK_SIZE,
+                       POSIX_FADV_WILLNEED);
+#endif
+
+   g_debug("%s: session %u: streaming %s from %" FMT64 "u as %u\n",
+           __FUNCTION__, sessionId, path, offset, streamId);
+   Pump();
+}
+
+
+/**
+ * The controller received the stream up to offset. Send more.
+ *
+ * @param[in] sessionId DnD/CopyPaste session id.
+ * @param[in] streamId stream id the controller assigned.
+ * @param[in] offset file offset received so far.
+ */
+
+void
+GuestFileStream::OnStreamAck(uint32 sessionId,
+                             uint32 streamId,
+                             uint64 offset)
+{
+   /* Acks for an old stream, or beyond what was sent, are ignored. */
+   if (mFd < 0 || sessionId != mSessionId || streamId != mStreamId ||
+       offset < mAckedOffset || offset > mSentOffset) {
+      return;
+   }
+   mAckedOffset = offset;
+   Pump();
+}
+
+
+/**
+ * Stop the stream.
+ *
+ * @param[in] sessionId DnD/CopyPaste session id.
+ * @param[in] streamId stream id the controller assigned.
+ */
+
+void
+GuestFileStream::OnStreamCancel(uint32 sessionId,
+                                uint32 streamId)
+{
+   if (mFd >= 0 && sessionId == mSessionId && streamId == mStreamId) {
+      g_debug("%s: stream %u cancelled at %" FMT64 "u\n", __FUNCTION__,
+              streamId, mSentOffset);
+      Close();
+   }
+}
+
+
+/**
+ * Send as much of the file as the window allows, reading the next block
+ * when the current one is all sent. Ends the stream at the end of the file.
+ */
+
+void
+GuestFileStream::Pump(void)
+{
+   while (mFd >= 0 && mSentOffset - mAckedOffset < DND_CP_FILE_STREAM_WINDOW) {
+      uint32 size;
+
+      if (mBlockPos == mBlockSize) {
+         int ret = ReadBlock();
+
+         if (ret <= 0) {
+            Finish(0 == ret);
+            return;
+         }
+      }
+
+      size = MIN(mBlockSize - mBlockPos, DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4);
+      size = (uint32)MIN(size, DND_CP_FILE_STREAM_WINDOW -
+                               (mSentOffset - mAckedOffset));
+      if (!mRpc->SendStreamData(mSessionId, mStreamId, mSentOffset,
+                                mBlock + mBlockPos, size, true)) {
+         g_debug("%s: SendStreamData failed\n", __FUNCTION__);
+         Close();
+         return;
+      }
+      mBlockPos += size;
+      mSentOffset += size;
+   }
+   ReportProgress(false);
+}
+
+
+/**
+ * Read the next block of the file at mSentOffset, and hint the kernel to
+ * read the one after it in the background.
+ *
+ * @return bytes read, 0 at the end of the file, -1 on error.
+ */
+
+int
+GuestFileStream::ReadBlock(void)
+{
+   ssize_t ret;
+
+   do {
+      ret = pread(mFd, mBlock, FT_STREAM_BLOCK_SIZE, mSentOffset);
+   } while (ret < 0 && EINTR == errno);
+
+   if (ret < 0) {
+      g_debug("%s: read failed at %" FMT64 "u: %s\n", __FUNCTION__,
+              mSentOffset, strerror(errno));
+      return -1;
+   }
+
+#ifdef __linux__
+   if (FT_STREAM_BLOCK_SIZE == ret) {
+      (void)posix_fadvise(mFd, mSentOffset + ret, FT_STREAM_BLOCK_SIZE,
+                          POSIX_FADV_WILLNEED);
+   }
+#endif
+   mBlockSize = (uint32)ret;
+   mBlockPos = 0;
+   return (int)ret;
+}
+
+
+/**
+ * End the stream with an empty FT_CMD_STREAM_DATA telling how it went.
+ *
+ * @param[in] success true if the whole file was sent.
+ */
+
+void
+GuestFileStream::Finish(bool success)
+{
+   mRpc->SendStreamData(mSessionId, mStreamId, mSentOffset, NULL, 0, success);
+   ReportProgress(true);
+   g_debug("%s: stream %u %s at %" FMT64 "u\n", __FUNCTION__, mStreamId,
+           success ? "done" : "failed", mSentOffset);
+   Close();
+}
+
+
+/**
+ * Close the file of the current stream, if any.
+ */
+
+void
+GuestFileStream::Close(void)
+{
+   if (mFd >= 0) {
+      close(mFd);
+      mFd = -1;
+   }
+   free(mBlock);
+   mBlock = NULL;
+   mBlockSize = 0;
+   mBlockPos = 0;
+}
+
+
+/**
+ * Send FT_CMD_STREAM_PROGRESS with the throughput of the stream, at most
+ * once per FT_STREAM_PROGRESS_INTERVAL_US unless force is set.
+ *
+ * @param[in] force report even if the last report is recent.
+ */
+
+void
+GuestFileStream::ReportProgress(bool force)
+{
+   VmTimeType now = Hostinfo_SystemTimerUS();
+   uint64 bytes = mSentOffset - mStartOffset;
+   uint32 bytesPerSec;
+
+   if (!force && now - mLastReportUS < FT_STREAM_PROGRESS_INTERVAL_US) {
+      return;
+   }
+   mLastReportUS = now;
+
+   bytesPerSec = now > mStartUS
+                 ? (uint32)MIN(bytes * 1000000 / (now - mStartUS), MAX_UINT32)
+                 : 0;
+   mRpc->SendStreamProgress(mSessionId, mStreamId, bytes, bytesPerSec);
+}
@@ -0,0 +1,74 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @guestFileStream.hh --
+ *
+ * Streams file contents to the controller, see FT_CMD_STREAM_FILE.
+ */
+
+#ifndef GUEST_FILE_STREAM_HH
+#define GUEST_FILE_STREAM_HH
+
+#include <sigc++/trackable.h>
+#include "fileTransferRpc.hh"
+
+extern "C" {
+   #include "vm_basic_types.h"
+}
+
+class GuestFileStream
+   : public sigc::trackable
+{
+public:
+   GuestFileStream(FileTransferRpc *rpc);
+   ~GuestFileStream(void);
+
+private:
+   void OnStreamFile(uint32 sessionId,
+                     uint32 streamId,
+                     uint64 offset,
+                     const char *path);
+   void OnStreamAck(uint32 sessionId,
+                    uint32 streamId,
+                    uint64 offset);
+   void OnStreamCancel(uint32 sessionId,
+                       uint32 streamId);
+   void Pump(void);
+   int ReadBlock(void);
+   void Finish(bool success);
+   void Close(void);
+   void ReportProgress(bool force);
+
+   FileTransferRpc *mRpc;
+   int mFd;
+   uint32 mSessionId;
+   uint32 mStreamId;
+   uint64 mStartOffset;
+   /* File offset of the next byte to send, and of the last one acked. */
+   uint64 mSentOffset;
+   uint64 mAckedOffset;
+   /* Block read ahead of the sends, and how much of it was sent. */
+   uint8 *mBlock;
+   uint32 mBlockSize;
+   uint32 mBlockPos;
+   VmTimeType mStartUS;
+   VmTimeType mLastReportUS;
+};
+
+#endif // GUEST_FILE_STREAM_HH
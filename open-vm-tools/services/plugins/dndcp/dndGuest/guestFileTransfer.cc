@@ -24,12 +24,21 @@
 
 #include "guestFileTransfer.hh"
 #include "fileTransferRpcV4.hh"
+#ifndef _WIN32
+#include "guestFileStream.hh"
+#endif
 
 extern "C" {
+   #include <glib.h>
+
    #include "debug.h"
    #include "hgfsServer.h"
+   #include "hostinfo.h"
 }
 
+/* How often the throughput of a running transfer is reported. */
+#define FT_PROGRESS_INTERVAL_US (1000 * 1000)
+
 
 /**
  * Create transport object and register callback.
@@ -38,12 +47,20 @@ extern "C" {
  */
 
 GuestFileTransfer::GuestFileTransfer(DnDCPTransport *transport)
+   : mStream(NULL),
+     mStatsSessionId(0),
+     mStatsBytes(0),
+     mStatsStartUS(0),
+     mStatsLastReportUS(0)
 {
    ASSERT(transport);
    mRpc = new FileTransferRpcV4(transport);
    mRpc->Init();
    mRpc->HgfsPacketReceived.connect(
       sigc::mem_fun(this, &GuestFileTransfer::OnRpcRecvHgfsPacket));
+#ifndef _WIN32
+   mStream = new GuestFileStream(mRpc);
+#endif
    HgfsServerManager_DataInit(&mHgfsServerMgrData,
                               "DnDGuestHgfsMgr",
                               NULL,
@@ -57,6 +74,10 @@ GuestFileTransfer::GuestFileTransfer(DnDCPTransport *transport)
  */
 GuestFileTransfer::~GuestFileTransfer(void)
 {
+#ifndef _WIN32
+   delete mStream;
+   mStream = NULL;
+#endif
    delete mRpc;
    mRpc = NULL;
    HgfsServerManager_Unregister(&mHgfsServerMgrData);
@@ -89,5 +110,40 @@ GuestFileTransfer::OnRpcRecvHgfsPacket(uint32 sessionId,
                                    replyPacket,
                                    &replyPacketSize);
    mRpc->SendHgfsReply(sessionId, (const uint8 *)replyPacket, replyPacketSize);
+   UpdateStats(sessionId, packetSize + replyPacketSize);
+}
+
+
+/**
+ * Account bytes moved for sessionId, and log the session throughput once per
+ * FT_PROGRESS_INTERVAL_US. The controller drives HGFS transfers and keeps its
+ * own progress; FT_CMD_STREAM_PROGRESS is only sent for streamed files.
+ *
+ * @param[in] sessionId dnd session id.
+ * @param[in] bytes hgfs request plus reply size.
+ */
+
+void
+GuestFileTransfer::UpdateStats(uint32 sessionId,
+                               size_t bytes)
+{
+   VmTimeType now = Hostinfo_SystemTimerUS();
+
+   if (0 == mStatsStartUS || sessionId != mStatsSessionId) {
+      mStatsSessionId = sessionId;
+      mStatsBytes = 0;
+      mStatsStartUS = now;
+      mStatsLastReportUS = now;
+   }
+   mStatsBytes += bytes;
+
+   if (now - mStatsLastReportUS < FT_PROGRESS_INTERVAL_US) {
+      return;
+   }
+   mStatsLastReportUS = now;
+
+   g_debug("%s: session %u: %" FMT64 "u bytes, %" FMT64 "u bytes/s\n",
+           __FUNCTION__, sessionId, mStatsBytes,
+           mStatsBytes * 1000000 / (now - mStatsStartUS));
 }
 
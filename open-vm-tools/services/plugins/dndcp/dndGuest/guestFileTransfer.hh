@@ -32,6 +32,8 @@ extern "C" {
 #include "hgfsServerManager.h"
 }
 
+class GuestFileStream;
+
 class GuestFileTransfer
    : public sigc::trackable
 {
@@ -43,9 +45,17 @@ private:
    void OnRpcRecvHgfsPacket(uint32 sessionId,
                             const uint8 *packet,
                             size_t packetSize);
+   void UpdateStats(uint32 sessionId, size_t bytes);
 
    FileTransferRpc *mRpc;
+   /* Streams files for FT_CMD_STREAM_FILE, not on Windows. */
+   GuestFileStream *mStream;
    HgfsServerMgrData mHgfsServerMgrData;
+   /* Throughput of the current transfer session. */
+   uint32 mStatsSessionId;
+   uint64 mStatsBytes;
+   VmTimeType mStatsStartUS;
+   VmTimeType mStatsLastReportUS;
 };
 
 #endif // GUEST_FILE_TRANSFER_HH
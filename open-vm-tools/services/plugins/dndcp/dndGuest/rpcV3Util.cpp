@@ -130,10 +130,22 @@ RpcV3Util::SendMsg(uint32 cmd,
 {
    DnDMsg msg;
    DynBuf buf;
+   CPClipboard fitted;
    bool ret = false;
 
    DnDMsg_Init(&msg);
    DynBuf_Init(&buf);
+   CPClipboard_Init(&fitted);
+
+   /* Version 3 cannot carry a large clipboard, drop what does not fit. */
+   if (CPClipboard_GetSerializedSize(clip) > CPCLIPITEM_MAX_SIZE_V3) {
+      if (!CPClipboard_Copy(&fitted, clip) ||
+          !CPClipboard_FitSerializedSize(&fitted, CPCLIPITEM_MAX_SIZE_V3)) {
+         LOG(0, ("%s: clipboard is too big.\n", __FUNCTION__));
+         goto exit;
+      }
+      clip = &fitted;
+   }
 
    /* Serialize clip and output into buf. */
    if (!CPClipboard_Serialize(clip, &buf)) {
@@ -151,6 +163,7 @@ RpcV3Util::SendMsg(uint32 cmd,
    ret = SendMsg(&msg);
 
 exit:
+   CPClipboard_Destroy(&fitted);
    DynBuf_Destroy(&buf);
    DnDMsg_Destroy(&msg);
    return ret;
@@ -206,6 +219,8 @@ bool
 RpcV3Util::SendMsg(const DnDMsg *msg)
 {
    DynBuf buf;
+   uint8 *binary;
+   uint32 size;
    bool ret = false;
 
    DynBuf_Init(&buf);
@@ -216,7 +231,16 @@ RpcV3Util::SendMsg(const DnDMsg *msg)
       goto exit;
    }
 
-   ret = SendMsg((uint8 *)DynBuf_Get(&buf), DynBuf_GetSize(&buf));
+   /*
+    * Hand the serialized buffer over rather than copying it again; a big
+    * message is sent straight out of it packet by packet.
+    */
+   size = DynBuf_GetSize(&buf);
+   binary = (uint8 *)DynBuf_Detach(&buf);
+   if (!binary) {
+      goto exit;
+   }
+   ret = SendMsgOwned(binary, size);
 
 exit:
    DynBuf_Destroy(&buf);
@@ -225,17 +249,18 @@ exit:
 
 
 /**
- * Serialize the message and send it to destId.
+ * Send a serialized message to destId. Takes ownership of binary: a big
+ * message becomes the send buffer as is, anything else is freed here.
  *
- * @param[in] binary
+ * @param[in] binary malloc'd serialized message, freed by this function
  * @param[in] binarySize
  *
  * @return true on success, false otherwise.
  */
 
 bool
-RpcV3Util::SendMsg(const uint8 *binary,
-                   uint32 binarySize)
+RpcV3Util::SendMsgOwned(uint8 *binary,
+                        uint32 binarySize)
 {
    DnDTransportPacketHeader *packet = NULL;
    size_t packetSize;
@@ -243,6 +268,7 @@ RpcV3Util::SendMsg(const uint8 *binary,
 
    if (binarySize > DNDMSG_MAX_ARGSZ) {
       LOG(1, ("%s: message is too big, quit.\n", __FUNCTION__));
+      free(binary);
       return false;
    }
 
@@ -253,8 +279,9 @@ RpcV3Util::SendMsg(const uint8 *binary,
        * It is a small size message, so it is not needed to buffer it. Just
        * put message into a packet and send it.
        */
-      packetSize = DnD_TransportMsgToPacket((uint8 *)binary, binarySize,
+      packetSize = DnD_TransportMsgToPacket(binary, binarySize,
                                             mSeqNum, &packet);
+      free(binary);
    } else {
       /*
        * It is a big size message. First buffer it and send it with multiple
@@ -271,10 +298,11 @@ RpcV3Util::SendMsg(const uint8 *binary,
              DND_MAX_TRANSPORT_LATENCY_TIME) {
             LOG(1, ("%s: got a big buffer, but there is another pending one, drop it\n",
                     __FUNCTION__));
+            free(binary);
             return false;
          }
       }
-      DnD_TransportBufInit(&mSendBuf, (uint8 *)binary, binarySize, mSeqNum);
+      DnD_TransportBufInitOwned(&mSendBuf, binary, binarySize, mSeqNum);
       packetSize = DnD_TransportBufGetPacket(&mSendBuf, &packet);
    }
 
@@ -347,6 +375,10 @@ RpcV3Util::OnRecvPacket(uint32 srcId,
          if (!mRpc->SendPacket(0, (const uint8 *)replyPacket, replyPacketSize) ||
              mSendBuf.offset == mSendBuf.totalSize) {
             /* Reset mSendBuf if whole buffer is sent or there is any error. */
+            LOG(4, ("%s: sent %" FMTSZ "u/%" FMTSZ "u bytes, %u allocs, "
+                    "%" FMTSZ "u bytes copied.\n", __FUNCTION__,
+                    mSendBuf.offset, mSendBuf.totalSize, mSendBuf.allocs,
+                    mSendBuf.bytesCopied));
             DnD_TransportBufReset(&mSendBuf);
          }
 
@@ -366,6 +398,9 @@ RpcV3Util::OnRecvPacket(uint32 srcId,
           * Received all packets for the messge, forward it to rpc layer for
           * further processing.
           */
+         LOG(4, ("%s: received %" FMTSZ "u bytes, %u allocs, "
+                 "%" FMTSZ "u bytes copied.\n", __FUNCTION__,
+                 mRecvBuf.totalSize, mRecvBuf.allocs, mRecvBuf.bytesCopied));
          mRpc->HandleMsg(NULL, mRecvBuf.buffer, mRecvBuf.totalSize);
          DnD_TransportBufReset(&mRecvBuf);
       } else {
@@ -52,10 +52,13 @@ extern "C" {
 
 RpcV4Util::RpcV4Util(void)
    : mVersionMajor(4),
-     mVersionMinor(0)
+     mVersionMinor(0),
+     mLocalCaps(0),
+     mPeerCaps(0)
 {
    DnDCPMsgV4_Init(&mBigMsgIn);
    DnDCPMsgV4_Init(&mBigMsgOut);
+   CPClipboard_Init(&mBigClipOut);
    DblLnkLst_Init(&mRpcSentListeners);
    DblLnkLst_Init(&mRpcReceivedListeners);
 }
@@ -68,7 +71,7 @@ RpcV4Util::RpcV4Util(void)
 RpcV4Util::~RpcV4Util(void)
 {
    DnDCPMsgV4_Destroy(&mBigMsgIn);
-   DnDCPMsgV4_Destroy(&mBigMsgOut);
+   DestroyBigMsgOut();
 
    while (DblLnkLst_IsLinked(&mRpcSentListeners)) {
       DnDRpcSentListenerNode *node =
@@ -115,7 +118,8 @@ RpcV4Util::Init(RpcBase *rpc,
 
 /**
  * Serialize the clipboard item if there is one, then send the message to
- * destId.
+ * destId. A clipboard that needs more than one packet is streamed, see
+ * SendBigClip.
  *
  * @param[in] params parameter list for the message
  * @param[in] clip the clipboard item.
@@ -128,6 +132,7 @@ RpcV4Util::SendMsg(RpcParams *params,
                    const CPClipboard *clip)
 {
    DynBuf buf;
+   uint32 binarySize;
    bool ret = false;
 
    ASSERT(params);
@@ -136,6 +141,11 @@ RpcV4Util::SendMsg(RpcParams *params,
       return SendMsg(params);
    }
 
+   if (CPClipboard_GetSerializedSize(clip) >
+       DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4) {
+      return SendBigClip(params, clip);
+   }
+
    DynBuf_Init(&buf);
 
    if (!CPClipboard_Serialize(clip, &buf)) {
@@ -143,9 +153,8 @@ RpcV4Util::SendMsg(RpcParams *params,
       goto exit;
    }
 
-   ret = SendMsg(params,
-                 (const uint8 *)DynBuf_Get(&buf),
-                 (uint32)DynBuf_GetSize(&buf));
+   binarySize = (uint32)DynBuf_GetSize(&buf);
+   ret = SendMsgOwned(params, (uint8 *)DynBuf_Detach(&buf), binarySize);
 
 exit:
    DynBuf_Destroy(&buf);
@@ -153,6 +162,80 @@ exit:
 }
 
 
+/**
+ * Send a clipboard that does not fit in one packet. The clipboard is copied,
+ * which shares the spool files of big items instead of reading them, and
+ * each packet is read from the copy as it goes out. If the peer did not
+ * negotiate DND_CP_CAP_LARGE_CLIPBOARD, formats are dropped until the
+ * clipboard fits in DND_CP_MSG_MAX_BINARY_SIZE_V4.
+ *
+ * @param[in] params parameter list for the message
+ * @param[in] clip the clipboard item.
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+RpcV4Util::SendBigClip(RpcParams *params,
+                       const CPClipboard *clip)
+{
+   size_t maxSize = IsCapNegotiated(DND_CP_CAP_LARGE_CLIPBOARD)
+                    ? DND_CP_MSG_MAX_LARGE_BINARY_SIZE_V4
+                    : DND_CP_MSG_MAX_BINARY_SIZE_V4;
+   size_t binarySize;
+   bool ret;
+
+   DestroyBigMsgOut();
+
+   if (!CPClipboard_Copy(&mBigClipOut, clip)) {
+      LOG(0, ("%s: CPClipboard_Copy failed.\n", __FUNCTION__));
+      DestroyBigMsgOut();
+      return false;
+   }
+
+   if (!CPClipboard_FitSerializedSize(&mBigClipOut, maxSize)) {
+      LOG(0, ("%s: clipboard is too big.\n", __FUNCTION__));
+      DestroyBigMsgOut();
+      return false;
+   }
+
+   binarySize = CPClipboard_GetSerializedSize(&mBigClipOut);
+   if (binarySize <= DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4) {
+      /* What is left after dropping formats fits in one packet. */
+      ret = SendMsg(params, &mBigClipOut);
+      DestroyBigMsgOut();
+      return ret;
+   }
+
+   InitMsg(&mBigMsgOut, params, binarySize);
+   mBigMsgOut.readBinary = ReadBigClip;
+   mBigMsgOut.readData = &mBigClipOut;
+   return SendBigMsg();
+}
+
+
+/**
+ * DnDCPMsgV4ReadFunc for mBigMsgOut when it streams mBigClipOut.
+ *
+ * @param[in] clientData the clipboard
+ * @param[in] offset offset in the serialized clipboard
+ * @param[out] buf
+ * @param[in] size
+ *
+ * @return TRUE on success, FALSE otherwise.
+ */
+
+Bool
+RpcV4Util::ReadBigClip(void *clientData,
+                       uint32 offset,
+                       uint8 *buf,
+                       uint32 size)
+{
+   return CPClipboard_ReadSerialized((const CPClipboard *)clientData,
+                                     offset, buf, size);
+}
+
+
 /**
  * Serialize the message and send it to destId.
  *
@@ -167,27 +250,73 @@ bool
 RpcV4Util::SendMsg(RpcParams *params,
                    const uint8 *binary,
                    uint32 binarySize)
+{
+   uint8 *copy = NULL;
+
+   if (binarySize > 0) {
+      copy = (uint8 *)Util_SafeMalloc(binarySize);
+      memcpy(copy, binary, binarySize);
+   }
+   return SendMsgOwned(params, copy, binarySize);
+}
+
+
+/**
+ * Same as SendMsg, but takes ownership of binary, which must have been
+ * allocated with malloc. binary is freed once the message has been sent, or
+ * on failure.
+ *
+ * @param[in] params parameter list for the message
+ * @param[in] binary
+ * @param[in] binarySize
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+RpcV4Util::SendMsgOwned(RpcParams *params,
+                        uint8 *binary,
+                        uint32 binarySize)
 {
    bool ret = false;
-   DnDCPMsgV4 *msgOut = NULL;
    DnDCPMsgV4 shortMsg;
 
    ASSERT(params);
 
-   DnDCPMsgV4_Init(&shortMsg);
-
    if (binarySize > DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4) {
       /*
        * For big message, all information should be cached in mBigMsgOut
        * because multiple packets and sends are needed.
        */
-      DnDCPMsgV4_Destroy(&mBigMsgOut);
-      msgOut = &mBigMsgOut;
-   } else {
-      /* For short message, the temporary shortMsg is enough. */
-      msgOut = &shortMsg;
+      DestroyBigMsgOut();
+      InitMsg(&mBigMsgOut, params, binarySize);
+      mBigMsgOut.binary = binary;
+      return SendBigMsg();
    }
 
+   /* For short message, the temporary shortMsg is enough. */
+   DnDCPMsgV4_Init(&shortMsg);
+   InitMsg(&shortMsg, params, binarySize);
+   shortMsg.binary = binary;
+   ret = SendMsg(&shortMsg);
+   DnDCPMsgV4_Destroy(&shortMsg);
+   return ret;
+}
+
+
+/**
+ * Fill in the header of msgOut for the message described by params.
+ *
+ * @param[out] msgOut the message
+ * @param[in] params parameter list for the message
+ * @param[in] binarySize
+ */
+
+void
+RpcV4Util::InitMsg(DnDCPMsgV4 *msgOut,
+                   RpcParams *params,
+                   uint32 binarySize)
+{
    msgOut->addrId = params->addrId;
    msgOut->hdr.cmd = params->cmd;
    msgOut->hdr.type = mMsgType;
@@ -203,22 +332,50 @@ RpcV4Util::SendMsg(RpcParams *params,
    msgOut->hdr.binarySize = binarySize;
    msgOut->hdr.payloadOffset = 0;
    msgOut->hdr.payloadSize = 0;
-   msgOut->binary = NULL;
-   if (binarySize > 0) {
-      msgOut->binary = (uint8 *)(Util_SafeMalloc(binarySize));
-      memcpy(msgOut->binary, binary,binarySize);
-   }
+}
+
 
-   ret = SendMsg(msgOut);
-   /* The mBigMsgOut is destroyed when the message sending was failed. */
-   if (!ret && msgOut == &mBigMsgOut) {
-      DnDCPMsgV4_Destroy(&mBigMsgOut);
+/**
+ * Start sending mBigMsgOut. The receiver asks for the rest of it with
+ * DNDCP_CMD_REQUEST_NEXT.
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+RpcV4Util::SendBigMsg(void)
+{
+   bool ret;
+
+   if (IsCapNegotiated(DND_CP_CAP_WINDOWED_BIG_BUFFER)) {
+      /* Fill the whole window right away instead of one packet per ack. */
+      ret = SendBigMsgWindow(0);
+   } else {
+      ret = SendMsg(&mBigMsgOut);
+   }
+   /*
+    * The mBigMsgOut is destroyed when the message sending was failed, or when
+    * the windowed transfer already sent all of it.
+    */
+   if (!ret || mBigMsgOut.hdr.payloadOffset == mBigMsgOut.hdr.binarySize) {
+      DestroyBigMsgOut();
    }
-   DnDCPMsgV4_Destroy(&shortMsg);
    return ret;
 }
 
 
+/**
+ * Destroy mBigMsgOut and the clipboard it may be streaming.
+ */
+
+void
+RpcV4Util::DestroyBigMsgOut(void)
+{
+   DnDCPMsgV4_Destroy(&mBigMsgOut);
+   CPClipboard_Destroy(&mBigClipOut);
+}
+
+
 /**
  * Construct a DNDCP_CMD_PING message and send it to destId.
  *
@@ -239,6 +396,7 @@ RpcV4Util::SendPingMsg(uint32 destId,
    params.optional.version.major = mVersionMajor;
    params.optional.version.minor = mVersionMinor;
    params.optional.version.capability = capability;
+   mLocalCaps = capability;
 
    return SendMsg(&params);
 }
@@ -264,6 +422,7 @@ RpcV4Util::SendPingReplyMsg(uint32 destId,
    params.optional.version.major = mVersionMajor;
    params.optional.version.minor = mVersionMinor;
    params.optional.version.capability = capability;
+   mLocalCaps = capability;
 
    return SendMsg(&params);
 }
@@ -312,13 +471,40 @@ RpcV4Util::RequestNextPacket(void)
    params.cmd = DNDCP_CMD_REQUEST_NEXT;
    params.sessionId = mBigMsgIn.hdr.sessionId;
    params.optional.requestNextCmd.cmd = mBigMsgIn.hdr.cmd;
-   params.optional.requestNextCmd.cmd = mBigMsgIn.hdr.binarySize;
-   params.optional.requestNextCmd.cmd = mBigMsgIn.hdr.payloadOffset;
+   params.optional.requestNextCmd.binarySize = mBigMsgIn.hdr.binarySize;
+   params.optional.requestNextCmd.payloadOffset = mBigMsgIn.hdr.payloadOffset;
 
    return SendMsg(&params);
 }
 
 
+/**
+ * Send packets of mBigMsgOut until either the whole binary is out or
+ * DND_CP_MSG_WINDOW_SIZE_V4 packets past ackedOffset are in flight.
+ *
+ * @param[in] ackedOffset binary size the receiver has acknowledged
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+RpcV4Util::SendBigMsgWindow(uint32 ackedOffset)
+{
+   uint32 windowEnd = ackedOffset +
+      DND_CP_MSG_WINDOW_SIZE_V4 * DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4;
+
+   ASSERT(ackedOffset <= mBigMsgOut.hdr.payloadOffset);
+
+   while (mBigMsgOut.hdr.payloadOffset < mBigMsgOut.hdr.binarySize &&
+          mBigMsgOut.hdr.payloadOffset < windowEnd) {
+      if (!SendMsg(&mBigMsgOut)) {
+         return false;
+      }
+   }
+   return true;
+}
+
+
 /**
  * Serialize a message and send it to msg->addrId.
  *
@@ -426,6 +612,17 @@ RpcV4Util::HandlePacket(uint32 srcId,
                     size_t packetSize,
                     DnDCPMsgPacketType packetType)
 {
+   const DnDCPMsgHdrV4 *msgHdr = (const DnDCPMsgHdrV4 *)packet;
+
+   /* Only a peer that negotiated it may send a binary this big. */
+   if (msgHdr->binarySize > DND_CP_MSG_MAX_BINARY_SIZE_V4 &&
+       !IsCapNegotiated(DND_CP_CAP_LARGE_CLIPBOARD)) {
+      LOG(1, ("%s: binary size %u is too big.\n", __FUNCTION__,
+              msgHdr->binarySize));
+      SendCmdReplyMsg(srcId, DNDCP_CMD_INVALID, DND_CP_MSG_STATUS_INVALID_PACKET);
+      goto cleanup;
+   }
+
    if (!DnDCPMsgV4_UnserializeMultiple(&mBigMsgIn, packet, packetSize)) {
       LOG(1, ("%s: invalid packet. \n", __FUNCTION__));
       SendCmdReplyMsg(srcId, DNDCP_CMD_INVALID, DND_CP_MSG_STATUS_INVALID_PACKET);
@@ -436,9 +633,16 @@ RpcV4Util::HandlePacket(uint32 srcId,
 
    /*
     * If there are multiple packets for the message, sends DNDCP_REQUEST_NEXT
-    * back to sender to ask for next packet.
+    * back to sender to ask for next packet. With the windowed transfer the
+    * sender does not wait for every packet, so only acknowledge once per
+    * DND_CP_MSG_WINDOW_ACK_INTERVAL_V4 packets.
     */
    if (DND_CP_MSG_PACKET_TYPE_MULTIPLE_END != packetType) {
+      if (IsCapNegotiated(DND_CP_CAP_WINDOWED_BIG_BUFFER) &&
+          (mBigMsgIn.hdr.payloadOffset / DND_CP_PACKET_MAX_PAYLOAD_SIZE_V4) %
+             DND_CP_MSG_WINDOW_ACK_INTERVAL_V4 != 0) {
+         return;
+      }
       if (!RequestNextPacket()) {
          LOG(1, ("%s: RequestNextPacket failed.\n", __FUNCTION__));
          goto cleanup;
@@ -476,7 +680,25 @@ RpcV4Util::HandleMsg(DnDCPMsgV4 *msgIn)
        * of data. For details about big buffer support, please refer to
        * https://wiki.eng.vmware.com/DnDVersion4Message#Binary_Buffer
        */
-      bool ret = SendMsg(&mBigMsgOut);
+      bool ret;
+
+      if (IsCapNegotiated(DND_CP_CAP_WINDOWED_BIG_BUFFER)) {
+         /*
+          * param3 is the cumulative binary size the receiver got so far. Acks
+          * can arrive after the last packet went out, or for a message that
+          * has since been replaced, so drop the ones that do not match.
+          */
+         if (0 == mBigMsgOut.hdr.binarySize ||
+             msgIn->hdr.sessionId != mBigMsgOut.hdr.sessionId ||
+             msgIn->hdr.param1 != mBigMsgOut.hdr.cmd ||
+             msgIn->hdr.param3 > mBigMsgOut.hdr.payloadOffset) {
+            LOG(1, ("%s: ignoring stale request next.\n", __FUNCTION__));
+            return;
+         }
+         ret = SendBigMsgWindow(msgIn->hdr.param3);
+      } else {
+         ret = SendMsg(&mBigMsgOut);
+      }
 
       if (!ret) {
          LOG(1, ("%s: SendMsg failed. \n", __FUNCTION__));
@@ -487,11 +709,17 @@ RpcV4Util::HandleMsg(DnDCPMsgV4 *msgIn)
        * been sent.
        */
       if (!ret || mBigMsgOut.hdr.payloadOffset == mBigMsgOut.hdr.binarySize) {
-         DnDCPMsgV4_Destroy(&mBigMsgOut);
+         DestroyBigMsgOut();
       }
       return;
    }
 
+   if (DNDCP_CMD_PING == msgIn->hdr.cmd ||
+       DNDCP_CMD_PING_REPLY == msgIn->hdr.cmd) {
+      /* param3 is version.capability, see SendPingMsg. */
+      mPeerCaps = msgIn->hdr.param3;
+   }
+
    params.addrId = msgIn->addrId;
    params.cmd = msgIn->hdr.cmd;
    params.sessionId = msgIn->hdr.sessionId;
@@ -503,7 +731,20 @@ RpcV4Util::HandleMsg(DnDCPMsgV4 *msgIn)
    params.optional.genericParams.param5 = msgIn->hdr.param5;
    params.optional.genericParams.param6 = msgIn->hdr.param6;
 
-   mRpc->HandleMsg(&params, msgIn->binary, msgIn->hdr.binarySize);
+   if (msgIn->binaryFd >= 0) {
+      if (!mRpc->HandleMsgFile(&params, msgIn->binaryFd,
+                               msgIn->hdr.binarySize)) {
+         LOG(0, ("%s: dropping %s with a %u byte binary.\n", __FUNCTION__,
+                 DnDCPMsgV4_LookupCmd(msgIn->hdr.cmd), msgIn->hdr.binarySize));
+      }
+   } else if (msgIn->binary &&
+              mRpc->HandleMsgOwned(&params, msgIn->binary,
+                                   msgIn->hdr.binarySize)) {
+      /* The binary is mRpc's now. */
+      msgIn->binary = NULL;
+   } else {
+      mRpc->HandleMsg(&params, msgIn->binary, msgIn->hdr.binarySize);
+   }
    FireRpcReceivedCallbacks(msgIn->hdr.cmd, msgIn->addrId, msgIn->hdr.sessionId);
 }
 
@@ -36,6 +36,7 @@
 
 extern "C" {
    #include "dnd.h"
+   #include "dndClipboard.h"
    #include "dndCPMsgV4.h"
 }
 
@@ -79,6 +80,8 @@ public:
       { return SendMsg(params, NULL, 0); }
    uint32 GetVersionMajor(void) { return mVersionMajor; }
    uint32 GetVersionMinor(void) { return mVersionMinor; }
+   bool IsCapNegotiated(uint32 cap) const
+      { return (mLocalCaps & mPeerCaps & cap) == cap; }
 
    bool AddRpcReceivedListener(const DnDRpcListener *obj);
    bool RemoveRpcReceivedListener(const DnDRpcListener *obj);
@@ -89,6 +92,21 @@ private:
    void FireRpcReceivedCallbacks(uint32 cmd, uint32 src, uint32 session);
    void FireRpcSentCallbacks(uint32 cmd, uint32 dest, uint32 session);
    bool SendMsg(DnDCPMsgV4 *msg);
+   bool SendMsgOwned(RpcParams *params,
+                     uint8 *binary,
+                     uint32 binarySize);
+   bool SendBigClip(RpcParams *params,
+                    const CPClipboard *clip);
+   void InitMsg(DnDCPMsgV4 *msgOut,
+                RpcParams *params,
+                uint32 binarySize);
+   bool SendBigMsg(void);
+   void DestroyBigMsgOut(void);
+   static Bool ReadBigClip(void *clientData,
+                           uint32 offset,
+                           uint8 *buf,
+                           uint32 size);
+   bool SendBigMsgWindow(uint32 ackedOffset);
    bool RequestNextPacket(void);
    void HandlePacket(uint32 srcId,
                      const uint8 *packet,
@@ -104,8 +122,12 @@ private:
    uint32 mVersionMinor;
    DnDCPMsgV4 mBigMsgIn;
    DnDCPMsgV4 mBigMsgOut;
+   /* Clipboard streamed out as mBigMsgOut, see SendBigClip. */
+   CPClipboard mBigClipOut;
    uint32 mMsgType;
    uint32 mMsgSrc;
+   uint32 mLocalCaps;
+   uint32 mPeerCaps;
    DblLnkLst_Links mRpcSentListeners;
    DblLnkLst_Links mRpcReceivedListeners;
 };
@@ -1038,7 +1038,7 @@ DnDUIX11::OnGtkDragDataGet(
    }
 
    if (   target == DRAG_TARGET_NAME_URI_LIST
-       && CPClipboard_GetItem(&mClipboard, CPFORMAT_FILELIST, &buf, &sz)) {
+       && CPClipboard_LoadItem(&mClipboard, CPFORMAT_FILELIST, &buf, &sz)) {
 
       /* Provide path within vmblock file system instead of actual path. */
       stagingDirName = GetLastDirName(mHGStagingDir);
@@ -1123,14 +1123,14 @@ DnDUIX11::OnGtkDragDataGet(
    }
 
    if (   TargetIsPlainText(target)
-       && CPClipboard_GetItem(&mClipboard, CPFORMAT_TEXT, &buf, &sz)) {
+       && CPClipboard_LoadItem(&mClipboard, CPFORMAT_TEXT, &buf, &sz)) {
       g_debug("%s: providing plain text, size %"FMTSZ"u\n", __FUNCTION__, sz);
       selection_data.set(target.c_str(), (const char *)buf);
       return;
    }
 
    if (   TargetIsRichText(target)
-       && CPClipboard_GetItem(&mClipboard, CPFORMAT_RTF, &buf, &sz)) {
+       && CPClipboard_LoadItem(&mClipboard, CPFORMAT_RTF, &buf, &sz)) {
       g_debug("%s: providing rtf text, size %"FMTSZ"u\n", __FUNCTION__, sz);
       selection_data.set(target.c_str(), (const char *)buf);
       return;
@@ -2161,7 +2161,7 @@ DnDUIX11::WriteFileContentsToStagingDir()
    size_t i = 0;
    bool ret = false;
 
-   if (!CPClipboard_GetItem(&mClipboard, CPFORMAT_FILECONTENTS, &buf, &sz)) {
+   if (!CPClipboard_LoadItem(&mClipboard, CPFORMAT_FILECONTENTS, &buf, &sz)) {
       return false;
    }
 
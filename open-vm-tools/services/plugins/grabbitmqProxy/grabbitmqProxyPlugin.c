@@ -59,6 +59,7 @@
 #include "asyncsocket.h"
 #include "str.h"
 #include "util.h"
+#include "hostinfo.h"
 #include "guestApp.h"
 
 #include <openssl/ssl.h>
@@ -76,11 +77,36 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
 #define GUEST_RABBITMQ_PROXY_VERSION             "1.0"
 #define CONFGROUP_GRABBITMQ_PROXY                "grabbitmqproxy"
 
-#define DEFAULT_MAX_SEND_QUEUE_LEN               (256 * 1024)
+#define GRABBITMQPROXY_STATS_CMD                 "grabbitmqProxy.stats"
+
+/*
+ * Flow control: reading from a connection is stopped when its peer has more
+ * than sendWindow bytes queued for send, and restarted once the queue has
+ * drained to half of that.  The window of each connection is then resized
+ * to what the peer drains in SEND_WINDOW_TARGET_MS, within the configured
+ * limits.
+ */
+#define DEFAULT_MIN_SEND_QUEUE_LEN               (64 * 1024)
+#define DEFAULT_INIT_SEND_QUEUE_LEN              (256 * 1024)
+#define DEFAULT_MAX_SEND_QUEUE_LEN               (1024 * 1024)
+#define SEND_WINDOW_TARGET_MS                    50
+
+/* socket buffers are grown up to this size along with the send window */
+#define DEFAULT_MAX_SOCK_BUFF_SIZE               (1024 * 1024)
 
 /*user level recv buffer */
 #define RMQ_CLIENT_CONN_RECV_BUFF_SIZE           (64 * 1024)
 
+/*
+ * Room left in front of the data received from a RabbitMQ client, so the
+ * dataMap header of the packet to VMX can be written in place in front of
+ * it.  Must be at least proxyData.dataHdrLen.
+ */
+#define RMQ_DATA_HDR_ROOM                        64
+
+/* number of free client recv buffers kept for reuse */
+#define MAX_FREE_DATA_BUFS                       8
+
 /* these are socket level send/recv buffers */
 #define DEFAULT_RMQCLIENT_CONN_RECV_BUFF_SIZE    (64 * 1024)
 #define DEFAULT_RMQCLIENT_CONN_SEND_BUFF_SIZE    (64 * 1024)
@@ -89,6 +115,16 @@ VM_EMBED_VERSION(VMTOOLSD_VERSION_STRING);
 
 #define VC_UUID_SIZE 36
 
+/* per connection counters, see GRabbitmqProxyStatsCb() */
+typedef struct {
+   VmTimeType connectTime;    /* in us */
+   uint64 bytesRecvd;
+   uint64 bytesSent;
+   int maxSendQueueLen;
+   uint32 recvStops;          /* times reading from this connection stopped */
+   VmTimeType stalledTime;    /* total time reading was stopped, in us */
+} ConnStats;
+
 /*  container for each connection details */
 typedef struct _ConnInfo {
    Bool isRmqClient;
@@ -104,8 +140,13 @@ typedef struct _ConnInfo {
    int recvBufLen;
 
    int sendQueueLen;
+   int sendWindow;            /* stop reading the peer above this queue length */
+   int sockBufSize;           /* socket buffer size requested so far */
 
    gboolean recvStopped;
+   VmTimeType recvStoppedTime;   /* in us */
+
+   ConnStats stats;
 
    struct _ConnInfo *toConn;  /* the corresponding vmx connection for RabbitMq
                                  client connection, or vice versa. */
@@ -123,7 +164,16 @@ typedef struct {
    ToolsAppCtx *ctx;           /* tools context */
    gboolean messageTunnellingEnabled;    /* Status of Message bus Tunnelling */
 
+   int minSendQueueLen;
    int maxSendQueueLen;
+   int maxSockBufSize;
+
+   char dataHdr[RMQ_DATA_HDR_ROOM];  /* serialized header of a COMMAND_DATA
+                                      * packet, see InitDataHeader() */
+   int dataHdrLen;
+
+   char *freeDataBufs[MAX_FREE_DATA_BUFS];
+   int numFreeDataBufs;
 } GuestProxyData;
 
 static GuestProxyData proxyData;
@@ -225,6 +275,275 @@ GetConnName(ConnInfo *conn)            // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * InitConnFlowControl --
+ *
+ *      Set the initial send window and stats of a new connection.
+ *
+ * Result:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+InitConnFlowControl(ConnInfo *conn)    // IN/OUT
+{
+   conn->sendWindow = MIN(MAX(DEFAULT_INIT_SEND_QUEUE_LEN,
+                              proxyData.minSendQueueLen),
+                          proxyData.maxSendQueueLen);
+   conn->stats.connectTime = Hostinfo_SystemTimerUS();
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * AdjustSendWindow --
+ *
+ *      Resize the send window of 'dst' after reading from its peer was
+ *      stopped for 'stalled' us, during which dst drained at least half of
+ *      its window.  The new window is what dst drains in
+ *      SEND_WINDOW_TARGET_MS at that rate, changing by at most a factor of
+ *      two at a time: a fast peer gets a large window and is stopped less
+ *      often, a slow one does not pile up data in the proxy.
+ *
+ *      The socket buffers of both connections are grown with the window,
+ *      so the kernel can take a window's worth of data in large writes.
+ *
+ * Result:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+AdjustSendWindow(ConnInfo *dst,        // IN/OUT
+                 VmTimeType stalled)   // IN
+{
+   ConnInfo *src = dst->toConn;
+   int64 window = dst->sendWindow;
+   int64 target;
+   int sockBufSize;
+
+   if (stalled <= 0) {
+      target = window * 2;
+   } else {
+      /* (window / 2) bytes drained in 'stalled' us */
+      target = (window / 2) * SEND_WINDOW_TARGET_MS * 1000 / stalled;
+      target = MIN(MAX(target, window / 2), window * 2);
+   }
+   target = MIN(MAX(target, proxyData.minSendQueueLen),
+                proxyData.maxSendQueueLen);
+
+   if (target != window) {
+      g_debug("Send window of %s connection %d: %d -> %d bytes.\n",
+              GetConnName(dst), AsyncSocket_GetFd(dst->asock),
+              dst->sendWindow, (int)target);
+      dst->sendWindow = (int)target;
+   }
+
+   sockBufSize = MIN(dst->sendWindow, proxyData.maxSockBufSize);
+   if (sockBufSize > dst->sockBufSize) {
+      /* AsyncSocket_SetBufferSizes() only ever grows the buffers */
+      if (AsyncSocket_SetBufferSizes(dst->asock, sockBufSize, 0) &&
+          AsyncSocket_SetBufferSizes(src->asock, 0, sockBufSize)) {
+         g_debug("Socket buffers of %s connection %d and its peer grown to "
+                 "%d bytes.\n", GetConnName(dst),
+                 AsyncSocket_GetFd(dst->asock), sockBufSize);
+      }
+      dst->sockBufSize = sockBufSize;
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * InitDataHeader --
+ *
+ *      Build the header of the COMMAND_DATA packets sent to VMX: the
+ *      command and version fields, followed by the type, field ID and
+ *      length of the payload field, as encoded by DataMapWriter.  The
+ *      payload itself comes right after it, so a packet can be framed by
+ *      copying this in front of the data and filling in the two lengths.
+ *
+ * Results:
+ *      TRUE on success, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+InitDataHeader(void)
+{
+   DataMapWriter writer;
+   ErrorCode res;
+   uint32 hdrLen;
+   char *payload;
+
+   if (proxyData.dataHdrLen > 0) {
+      return TRUE;
+   }
+
+   DataMapWriter_Init(&writer, proxyData.dataHdr, sizeof proxyData.dataHdr);
+   DataMapWriter_PutInt64(&writer, RMQPROXYDM_FLD_COMMAND, COMMAND_DATA);
+   DataMapWriter_PutString(&writer, RMQPROXYDM_FLD_GUEST_VER_ID,
+                           GUEST_RABBITMQ_PROXY_VERSION, -1);
+   /* the payload length is filled in for each packet */
+   DataMapWriter_ReserveString(&writer, RMQPROXYDM_FLD_PAYLOAD, 0, &payload);
+   res = DataMapWriter_Finish(&writer, &hdrLen);
+   if (res != DMERR_SUCCESS) {
+      goto error;
+   }
+
+   proxyData.dataHdrLen = hdrLen;
+   return TRUE;
+
+error:
+   g_warning("Error in building the dataMap packet header, error=%d.\n", res);
+   return FALSE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FrameDataPacket --
+ *
+ *      Turn data received from a RabbitMQ client into a COMMAND_DATA packet
+ *      for VMX, in place.
+ *      - 'buf': the client recv buffer.  The data starts at
+ *        buf + proxyData.dataHdrLen.
+ *      - 'len': length of the data.
+ *
+ * Results:
+ *      Length of the packet, which starts at buf.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+FrameDataPacket(char *buf,   // IN/OUT
+                int len)     // IN
+{
+   int hdrLen = proxyData.dataHdrLen;
+
+   memcpy(buf, proxyData.dataHdr, hdrLen);
+
+   /* the dataMap length does not include the length field itself */
+   *((uint32 *)buf) = htonl(hdrLen - sizeof(uint32) + len);
+   *((uint32 *)(buf + hdrLen - sizeof(uint32))) = htonl(len);
+
+   return hdrLen + len;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * AllocDataBuf --
+ *
+ *      Get a recv buffer for a RabbitMQ client connection, with room for
+ *      the packet header in front.  Buffers are handed on to the vmx
+ *      connection for sending, and come back through FreeDataBuf().
+ *
+ * Results:
+ *      The buffer, or NULL if out of memory.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static char *
+AllocDataBuf(void)
+{
+   if (proxyData.numFreeDataBufs > 0) {
+      return proxyData.freeDataBufs[--proxyData.numFreeDataBufs];
+   }
+
+   return malloc(RMQ_DATA_HDR_ROOM + RMQ_CLIENT_CONN_RECV_BUFF_SIZE);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FreeDataBuf --
+ *
+ *      Return a buffer from AllocDataBuf(), keeping it for reuse if there
+ *      are not too many free ones already.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+FreeDataBuf(char *buf)     // IN
+{
+   if (buf == NULL) {
+      return;
+   }
+
+   if (proxyData.numFreeDataBufs < MAX_FREE_DATA_BUFS) {
+      proxyData.freeDataBufs[proxyData.numFreeDataBufs++] = buf;
+   } else {
+      free(buf);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * FreeSendBuf --
+ *
+ *      Free a buffer that was queued for send on 'dst'.  Everything sent
+ *      to VMX is a framed client recv buffer; everything sent to a client
+ *      is malloc'ed.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+FreeSendBuf(ConnInfo *dst,      // IN
+            void *buf)          // IN
+{
+   if (dst->isRmqClient) {
+      free(buf);
+   } else {
+      FreeDataBuf(buf);
+   }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
@@ -302,7 +621,11 @@ CloseConn(ConnInfo *conn)   // IN
 
    AsyncSocket_Close(conn->asock);
    conn->asock = NULL;
-   free(conn->recvBuf);
+   if (conn->isRmqClient) {
+      FreeDataBuf(conn->recvBuf);
+   } else {
+      free(conn->recvBuf);
+   }
    conn->recvBuf = NULL;
 
    /* remove the connection from corresponding conn list */
@@ -371,7 +694,7 @@ StartRecvFromRmqClient(ConnInfo *conn)   // IN
 
    if (conn->recvBuf == NULL) {
       conn->recvBufLen = RMQ_CLIENT_CONN_RECV_BUFF_SIZE;
-      conn->recvBuf = malloc(conn->recvBufLen);
+      conn->recvBuf = AllocDataBuf();
       if (conn->recvBuf == NULL) {
          g_info("Error in allocating recv buffer for socket %d, "
                 "closing connection.\n",
@@ -381,7 +704,8 @@ StartRecvFromRmqClient(ConnInfo *conn)   // IN
       }
    }
 
-   res = AsyncSocket_RecvPartial(conn->asock, conn->recvBuf,
+   res = AsyncSocket_RecvPartial(conn->asock,
+                                 conn->recvBuf + proxyData.dataHdrLen,
                                  conn->recvBufLen,
                                  conn->recvCb, conn);
    if (res != ASOCKERR_SUCCESS) {
@@ -487,7 +811,7 @@ ConnSendDoneCb(void *buf,            // IN
 
    g_debug("Entering %s\n", __FUNCTION__);
 
-   free(buf);
+   FreeSendBuf(dst, buf);
 
    if (AsyncSocket_GetState(asock) != AsyncSocketConnected) {
       /* this callback may be called after the connection is closed to
@@ -497,6 +821,7 @@ ConnSendDoneCb(void *buf,            // IN
 
    dst->sendQueueLen -= len;
    ASSERT(dst->sendQueueLen >= 0);
+   dst->stats.bytesSent += len;
 
    if (dst->sendQueueLen == 0 && dst->shutDown) {
       g_info("Closing %s connection %d as sendbuffer is now empty.\n",
@@ -510,10 +835,15 @@ ConnSendDoneCb(void *buf,            // IN
            dst->sendQueueLen);
 
    if ((!(dst->shutDown)) && src->recvStopped &&
-       (dst->sendQueueLen < proxyData.maxSendQueueLen)) {
+       (dst->sendQueueLen <= dst->sendWindow / 2)) {
+      VmTimeType stalled = Hostinfo_SystemTimerUS() - src->recvStoppedTime;
+
       g_debug("Restart reading from connection %d.\n",
               AsyncSocket_GetFd(src->asock));
 
+      src->stats.stalledTime += stalled;
+      AdjustSendWindow(dst, stalled);
+
       src->recvStopped = FALSE;
       if (src->isRmqClient) {
          StartRecvFromRmqClient(src);
@@ -549,6 +879,8 @@ StopRecvFromConn(ConnInfo *conn)   // IN
    res = AsyncSocket_CancelRecvEx(conn->asock, NULL, NULL, NULL, TRUE);
    ASSERT(res == ASOCKERR_SUCCESS);
    conn->recvStopped = TRUE;
+   conn->recvStoppedTime = Hostinfo_SystemTimerUS();
+   conn->stats.recvStops++;
 }
 
 
@@ -558,7 +890,7 @@ StopRecvFromConn(ConnInfo *conn)   // IN
  * SendToConn --
  *
  *      Call AsyncSocket_Send to queue the buffer for send.
- *      - If there is too much data queued, then recv from
+ *      - If more than the send window is queued, then recv from
  *        source connection is temporarily stopped.
  *
  * Result:
@@ -586,7 +918,7 @@ SendToConn(ConnInfo *dst,          // IN/OUT
       g_info("Error in AsyncSocket_Send for socket %d, "
              "closing connection: %s\n",
              AsyncSocket_GetFd(dst->asock), AsyncSocket_Err2String(res));
-      free(buf);     /* need to free here */
+      FreeSendBuf(dst, buf);     /* need to free here */
       CloseConn(dst);
       return FALSE;
    }
@@ -597,8 +929,11 @@ SendToConn(ConnInfo *dst,          // IN/OUT
    dst->sendQueueLen += len;
    g_debug("Socket %d sendQueueLen = %d\n",
            AsyncSocket_GetFd(dst->asock), dst->sendQueueLen);
+   if (dst->sendQueueLen > dst->stats.maxSendQueueLen) {
+      dst->stats.maxSendQueueLen = dst->sendQueueLen;
+   }
 
-   if ((!src->recvStopped) && (dst->sendQueueLen > proxyData.maxSendQueueLen)) {
+   if ((!src->recvStopped) && (dst->sendQueueLen > dst->sendWindow)) {
       StopRecvFromConn(src);
       return FALSE;
    }
@@ -665,6 +1000,8 @@ SendVmxConnectRequest(void)
  * SendToVmxRmqProxy --
  *
  *      Package RabbitMQ Client data and send it to VMX RabbitMQ Proxy.
+ *      The client's recv buffer is framed in place and handed to the vmx
+ *      connection; the client gets a new one for its next recv.
  *
  * Result:
  *      TRUE on sucess, FALSE on error
@@ -677,69 +1014,13 @@ SendVmxConnectRequest(void)
 
 static gboolean
 SendToVmxRmqProxy(ConnInfo *cli,     // IN
-                  char *buf,         // IN
                   int len)           // IN
 {
-   DataMap map;
-   ErrorCode res;
-   char *newBuf;
-   char *serBuf;
-   int bufLen;
-   gboolean mapCreated = FALSE;
-   char *ver;
-
-   res = DataMap_Create(&map);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
-   }
-
-   mapCreated = TRUE;
-
-   res = DataMap_SetInt64(&map, RMQPROXYDM_FLD_COMMAND,
-                          COMMAND_DATA, TRUE);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
-   }
-
-   ver = strdup(GUEST_RABBITMQ_PROXY_VERSION);
-   if (ver == NULL) {
-      res = DMERR_INSUFFICIENT_MEM;
-      goto quit;
-   }
-   res = DataMap_SetString(&map, RMQPROXYDM_FLD_GUEST_VER_ID, ver, -1, TRUE);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
-   }
-
-   newBuf = malloc(len);
-   if (newBuf == NULL) {
-      g_warning("Error in allocating memory.\n");
-      goto quit;
-   }
-   memcpy(newBuf, buf, len);
-   res = DataMap_SetString(&map, RMQPROXYDM_FLD_PAYLOAD, newBuf,
-                           len, TRUE);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
-   }
+   char *buf = cli->recvBuf;
 
-   res = DataMap_Serialize(&map, &serBuf, &bufLen);
-   if (res != DMERR_SUCCESS) {
-      goto quit;
-   }
-
-   DataMap_Destroy(&map);
-   return SendToConn(cli->toConn, serBuf, bufLen);
+   cli->recvBuf = NULL;
 
-quit:
-   if (mapCreated) {
-      DataMap_Destroy(&map);
-   }
-   g_info("Error in dataMap encoding for socket %d, error=%d, "
-          "closing connection.\n",
-          AsyncSocket_GetFd(cli->asock), res);
-   CloseConn(cli);
-   return FALSE;
+   return SendToConn(cli->toConn, buf, FrameDataPacket(buf, len));
 }
 
 
@@ -771,8 +1052,9 @@ RmqClientConnRecvedCb(void *buf,            // IN
 
    g_debug("Recved %d bytes from client connection %d\n", len,
            AsyncSocket_GetFd(conn->asock));
-   ASSERT(buf == conn->recvBuf);
-   if (SendToVmxRmqProxy(conn, conn->recvBuf, len)) {
+   ASSERT(buf == conn->recvBuf + proxyData.dataHdrLen);
+   conn->stats.bytesRecvd += len;
+   if (SendToVmxRmqProxy(conn, len)) {
       StartRecvFromRmqClient(conn);
    }
 }
@@ -783,7 +1065,9 @@ RmqClientConnRecvedCb(void *buf,            // IN
  *
  * ProcessVmxDataPacket --
  *
- *      Process the dataMap packet received from VMX.
+ *      Process the dataMap packet received from VMX, once decoded.  The
+ *      payload of a COMMAND_DATA packet points into the decoded packet and
+ *      is copied out.
  *
  * Result:
  *      TRUE on success, FALSE on error.
@@ -795,26 +1079,18 @@ RmqClientConnRecvedCb(void *buf,            // IN
  */
 
 static gboolean
-ProcessVmxDataPacket(ConnInfo *cli,     // IN
-                     DataMap *map)      // IN
+ProcessVmxDataPacket(ConnInfo *cli,            // IN
+                     int64 cmdType,            // IN
+                     const char *payload,      // IN
+                     int32 payloadLen)         // IN
 {
-   ErrorCode res;
-   int64 cmdType;
-
-   res = DataMap_GetInt64(map, RMQPROXYDM_FLD_COMMAND, &cmdType);
-   ASSERT(res == DMERR_SUCCESS);
-
    switch (cmdType) {
       case COMMAND_DATA:
          {
             char *buf;
-            int payloadLen;
-            char *payload;
 
-            res = DataMap_GetString(map, RMQPROXYDM_FLD_PAYLOAD,
-                                    &payload, &payloadLen);
-            ASSERT(res == DMERR_SUCCESS && payloadLen > 0);
-            buf = malloc(payloadLen); /* get rid of this ? */
+            ASSERT(payload != NULL && payloadLen > 0);
+            buf = malloc(payloadLen);
 
             if (buf) {
                memcpy(buf, payload, payloadLen);
@@ -919,19 +1195,49 @@ VmxConnRecvedCb(void *buf,            // IN
       ASSERT(len == sizeof conn->packetLen);
       ProcessPacketHeaderLen(conn, len);
    } else {
+      DataMapView view;
       DataMap map;
+      gboolean haveMap = FALSE;
       ErrorCode res;
+      int64 cmdType = 0;
+      const char *payload = NULL;
+      int32 payloadLen = 0;
       int packetLen = len + sizeof conn->packetLen;
 
-      /* decoding the packet */
-      res = DataMap_Deserialize(conn->recvBuf, packetLen, &map);
+      conn->stats.bytesRecvd += packetLen;
+
+      /* decoding the packet, without copying it */
+      res = DataMapView_Init(&view, conn->recvBuf, packetLen);
+      if (res == DMERR_SUCCESS) {
+         res = DataMapView_GetInt64(&view, RMQPROXYDM_FLD_COMMAND, &cmdType);
+         if (res == DMERR_SUCCESS && cmdType == COMMAND_DATA) {
+            res = DataMapView_GetString(&view, RMQPROXYDM_FLD_PAYLOAD,
+                                        &payload, &payloadLen);
+         }
+      } else if (res == DMERR_BUFFER_TOO_SMALL) {
+         /* more fields than a view holds */
+         res = DataMap_Deserialize(conn->recvBuf, packetLen, &map);
+         haveMap = res == DMERR_SUCCESS;
+         if (haveMap) {
+            res = DataMap_GetInt64(&map, RMQPROXYDM_FLD_COMMAND, &cmdType);
+         }
+         if (res == DMERR_SUCCESS && cmdType == COMMAND_DATA) {
+            char *str = NULL;
+
+            res = DataMap_GetString(&map, RMQPROXYDM_FLD_PAYLOAD,
+                                    &str, &payloadLen);
+            payload = str;
+         }
+      }
       ASSERT(res == DMERR_SUCCESS);
 
-      if (ProcessVmxDataPacket(conn->toConn, &map)) {
+      if (ProcessVmxDataPacket(conn->toConn, cmdType, payload, payloadLen)) {
          StartRecvFromVmx(conn); /* continue to recv next packet */
       }
 
-      DataMap_Destroy(&map);
+      if (haveMap) {
+         DataMap_Destroy(&map);
+      }
    }
 
 }
@@ -1017,6 +1323,7 @@ VmxListenSockConnectedCb(AsyncSocket *asock,    // IN
    }
 
    conn->asock = asock;
+   InitConnFlowControl(conn);
    conn->recvCb = VmxConnRecvedCb;
    conn->sendCb = ConnSendDoneCb;
    conn->errorCb = ConnErrorHandlerCb;
@@ -1096,6 +1403,7 @@ RmqClientSockHandShakeCb(Bool status,           // IN
 
    conn->isRmqClient = TRUE;
    conn->asock = asock;
+   InitConnFlowControl(conn);
    conn->recvCb = RmqClientConnRecvedCb;
    conn->sendCb = ConnSendDoneCb;
    conn->errorCb = ConnErrorHandlerCb;
@@ -1538,8 +1846,15 @@ InitProxyData(ToolsAppCtx *ctx)   // IN
 
    proxyData.ctx = ctx;
    proxyData.messageTunnellingEnabled = FALSE;
+   proxyData.minSendQueueLen = GetConfigInt("minSendQueueLen",
+                                            DEFAULT_MIN_SEND_QUEUE_LEN);
    proxyData.maxSendQueueLen = GetConfigInt("maxSendQueueLen",
                                             DEFAULT_MAX_SEND_QUEUE_LEN);
+   if (proxyData.maxSendQueueLen < proxyData.minSendQueueLen) {
+      proxyData.maxSendQueueLen = proxyData.minSendQueueLen;
+   }
+   proxyData.maxSockBufSize = GetConfigInt("maxSocketBufferSize",
+                                           DEFAULT_MAX_SOCK_BUFF_SIZE);
 }
 
 
@@ -1727,6 +2042,10 @@ GRabbitmqProxyDisableMessageTunnelling()
       CloseConn(cli);
    }
 
+   while (proxyData.numFreeDataBufs > 0) {
+      free(proxyData.freeDataBufs[--proxyData.numFreeDataBufs]);
+   }
+
    proxyData.messageTunnellingEnabled = FALSE;
 }
 
@@ -1774,7 +2093,8 @@ GRabbitmqProxyEnableMessageTunnelling()
 
    free(vcUuid);
 
-   if (!CreateVmxListenSocket() || !CreateRmqListenSocket()) {
+   if (!InitDataHeader() ||
+       !CreateVmxListenSocket() || !CreateRmqListenSocket()) {
       g_warning("The proxy is disabled due to initialization error.\n");
       GRabbitmqProxyDisableMessageTunnelling();
       return;
@@ -1813,6 +2133,90 @@ GRabbitmqProxyShutdown(gpointer src,                 // IN
 }
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * AppendConnStats --
+ *
+ *      Append a line with the stats of a connection to 'str'.
+ *
+ * Result:
+ *      None
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+AppendConnStats(GString *str,          // IN/OUT
+                ConnInfo *conn,        // IN
+                VmTimeType now)        // IN
+{
+   VmTimeType stalled = conn->stats.stalledTime;
+
+   if (conn->recvStopped) {
+      stalled += now - conn->recvStoppedTime;
+   }
+
+   g_string_append_printf(str,
+                          "%s %d: up %"FMT64"dms, recvd %"FMT64"u, "
+                          "sent %"FMT64"u, queued %d, window %d, "
+                          "maxQueued %d, stops %u, stalled %"FMT64"dms\n",
+                          GetConnName(conn), AsyncSocket_GetFd(conn->asock),
+                          (now - conn->stats.connectTime) / 1000,
+                          conn->stats.bytesRecvd, conn->stats.bytesSent,
+                          conn->sendQueueLen, conn->sendWindow,
+                          conn->stats.maxSendQueueLen, conn->stats.recvStops,
+                          stalled / 1000);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * GRabbitmqProxyStatsCb --
+ *
+ *      Handles the GRABBITMQPROXY_STATS_CMD RPC: returns one line of
+ *      throughput and queue stats per connection, each client connection
+ *      followed by its vmx connection.
+ *
+ * Result:
+ *      TRUE on success, FALSE if the tunnel is not enabled.
+ *
+ * Side-effects:
+ *      None
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static gboolean
+GRabbitmqProxyStatsCb(RpcInData *data)    // IN/OUT
+{
+   GString *str;
+   GList *lp;
+   VmTimeType now = Hostinfo_SystemTimerUS();
+
+   if (!proxyData.messageTunnellingEnabled) {
+      return RPCIN_SETRETVALS(data, "Message bus tunnel is not enabled",
+                              FALSE);
+   }
+
+   str = g_string_new(NULL);
+   for (lp = proxyData.rmqConnList; lp; lp = g_list_next(lp)) {
+      ConnInfo *cli = (ConnInfo *)(lp->data);
+
+      AppendConnStats(str, cli, now);
+      if (cli->toConn != NULL) {
+         AppendConnStats(str, cli->toConn, now);
+      }
+   }
+
+   return RPCIN_SETRETVALSF(data, g_string_free(str, FALSE), TRUE);
+}
+
+
 /*
  *----------------------------------------------------------------------------
  *
@@ -1916,11 +2320,16 @@ ToolsOnLoad(ToolsAppCtx *ctx)           // IN
 {
    static ToolsPluginData regData = { "grabbitmqProxy", NULL, NULL, NULL };
 
+   RpcChannelCallback rpcs[] = {
+      { GRABBITMQPROXY_STATS_CMD, GRabbitmqProxyStatsCb, NULL, NULL, NULL, 0 }
+   };
    ToolsPluginSignalCb sigs[] = {
       { TOOLS_CORE_SIG_SHUTDOWN, GRabbitmqProxyShutdown, &regData },
       { TOOLS_CORE_SIG_SET_OPTION, GRabbitmqProxySetOption, &regData }
    };
    ToolsAppReg regs[] = {
+      { TOOLS_APP_GUESTRPC,
+        VMTools_WrapArray(rpcs, sizeof *rpcs, ARRAYSIZE(rpcs)) },
       { TOOLS_APP_SIGNALS,
         VMTools_WrapArray(sigs, sizeof *sigs, ARRAYSIZE(sigs)) }
    };
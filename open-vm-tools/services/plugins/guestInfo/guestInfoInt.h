@@ -29,6 +29,7 @@
 #include <glib.h>
 
 #include "nicInfo.h"
+#include "vmware/tools/plugin.h"
 
 extern int guestInfoPollInterval;
 
@@ -44,5 +45,11 @@ GuestInfo_GetDiskInfo(void);
 void
 GuestInfo_FreeDiskInfo(GuestDiskInfo *di);
 
+void
+GuestInfo_TweakGuestlibStats(ToolsAppCtx *ctx, gboolean enable);
+
+void
+GuestInfo_ShutdownGuestlibStats(void);
+
 #endif /* _GUESTINFOINT_H_ */
 
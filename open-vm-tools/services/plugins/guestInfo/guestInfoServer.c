@@ -1090,7 +1090,8 @@ TweakGatherLoop(ToolsAppCtx *ctx,
  ******************************************************************************
  * GuestInfoServerConfReload --                                          */ /**
  *
- * @brief Reconfigures the poll loop interval upon config file reload.
+ * @brief Reconfigures the poll loop and guestlib stats intervals upon config
+ * file reload.
  *
  * @param[in]  src     The source object.
  * @param[in]  ctx     The application context.
@@ -1105,6 +1106,7 @@ GuestInfoServerConfReload(gpointer src,
                           gpointer data)
 {
    TweakGatherLoop(ctx, TRUE);
+   GuestInfo_TweakGuestlibStats(ctx, TRUE);
 }
 
 
@@ -1130,6 +1132,7 @@ GuestInfoServerIOFreeze(gpointer src,
                         gpointer data)
 {
    TweakGatherLoop(ctx, !freeze);
+   GuestInfo_TweakGuestlibStats(ctx, !freeze);
 }
 
 
@@ -1158,6 +1161,8 @@ GuestInfoServerShutdown(gpointer src,
       gatherTimeoutSource = NULL;
    }
 
+   GuestInfo_ShutdownGuestlibStats();
+
 #ifdef _WIN32
    NetUtil_FreeIpHlpApiDll();
 #endif
@@ -1331,6 +1336,7 @@ ToolsOnLoad(ToolsAppCtx *ctx)
        * Set up the GuestInfoGather loop.
        */
       TweakGatherLoop(ctx, TRUE);
+      GuestInfo_TweakGuestlibStats(ctx, TRUE);
 
       return &regData;
    }
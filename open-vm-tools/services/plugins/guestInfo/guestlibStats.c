@@ -0,0 +1,393 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * guestlibStats.c --
+ *
+ *      Collector for the guestlib stats snapshot.  Once per interval this
+ *      fetches the guestlib stats from the host, the same way libguestlib
+ *      does, and publishes the reply in the shared segment described in
+ *      guestlibStatsShm.h, where libguestlib picks it up without a
+ *      backdoor call of its own.
+ *
+ *      The collector is off unless an interval is configured: it queries
+ *      the host whether or not anybody reads the snapshot, which only pays
+ *      off in guests that run guestlib consumers.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vmware.h"
+#include "conf.h"
+#include "guestInfoInt.h"
+#include "guestlibStatsShm.h"
+#include "vmGuestLibInt.h"
+#include "vmware/tools/plugin.h"
+#include "vmware/tools/utils.h"
+
+/**
+ * Default collection interval, in seconds; disabled.
+ */
+#define GUESTLIB_STATS_INTERVAL_SEC 0
+
+/** Collection timeout source. */
+static GSource *statsTimeoutSource = NULL;
+
+/** Current collection interval, in seconds; 0 if disabled. */
+static gint statsInterval = 0;
+
+/** The published segment, mapped read/write. */
+static GuestlibStatsShm *statsShm = NULL;
+
+/** Protocol version negotiated with the host; 0 to renegotiate. */
+static uint32 statsHostVersion = 0;
+
+/** Session ID of the last reply. */
+static VMSessionId statsSessionId = 0;
+
+
+/*
+ ******************************************************************************
+ * GuestlibStatsCreate --                                                */ /**
+ *
+ * Creates the shared segment and maps it.  Whatever is found at the path
+ * is removed first rather than reused, so that a file planted there by
+ * somebody else is never published.
+ *
+ * @return TRUE if the segment is mapped.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+GuestlibStatsCreate(void)
+{
+   int fd;
+   void *addr;
+
+   if (unlink(GUESTLIB_STATS_SHM_PATH) != 0 && errno != ENOENT) {
+      g_warning("Cannot remove %s: %s\n", GUESTLIB_STATS_SHM_PATH,
+                strerror(errno));
+      return FALSE;
+   }
+
+   fd = open(GUESTLIB_STATS_SHM_PATH, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW,
+             0644);
+   if (fd < 0) {
+      g_warning("Cannot create %s: %s\n", GUESTLIB_STATS_SHM_PATH,
+                strerror(errno));
+      return FALSE;
+   }
+
+   /* Don't depend on the umask; readers insist on 0644. */
+   if (fchmod(fd, 0644) != 0 ||
+       ftruncate(fd, GUESTLIB_STATS_SHM_SIZE) != 0) {
+      g_warning("Cannot set up %s: %s\n", GUESTLIB_STATS_SHM_PATH,
+                strerror(errno));
+      goto error;
+   }
+
+   addr = mmap(NULL, GUESTLIB_STATS_SHM_SIZE, PROT_READ | PROT_WRITE,
+               MAP_SHARED, fd, 0);
+   if (addr == MAP_FAILED) {
+      g_warning("Cannot map %s: %s\n", GUESTLIB_STATS_SHM_PATH,
+                strerror(errno));
+      goto error;
+   }
+   close(fd);
+
+   /* The file is zero-filled: no snapshot yet, 'seq' is even. */
+   statsShm = addr;
+   statsShm->version = GUESTLIB_STATS_SHM_VERSION;
+   statsShm->magic = GUESTLIB_STATS_SHM_MAGIC;
+
+   return TRUE;
+
+error:
+   close(fd);
+   unlink(GUESTLIB_STATS_SHM_PATH);
+   return FALSE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestlibStatsPublish --                                               */ /**
+ *
+ * Updates the segment under the sequence lock.
+ *
+ * @param[in]  reply      The host's reply, NULL if there's none.
+ * @param[in]  replyLen   Length of @a reply.
+ * @param[in]  interval   Interval until the next update, 0 if none will
+ *                        follow.  A segment with a zero interval is stale.
+ *
+ ******************************************************************************
+ */
+
+static void
+GuestlibStatsPublish(const char *reply,
+                     size_t replyLen,
+                     gint interval)
+{
+   ASSERT(replyLen <= GUESTLIB_STATS_SHM_MAX_REPLY);
+
+   Atomic_Inc(&statsShm->seq);
+   GUESTLIB_STATS_SHM_BARRIER();
+
+   statsShm->interval = interval;
+   statsShm->updateTime = interval > 0 ? time(NULL) : 0;
+   statsShm->hostVersion = statsHostVersion;
+   statsShm->replyLen = replyLen;
+   if (replyLen > 0) {
+      memcpy(statsShm->reply, reply, replyLen);
+   }
+
+   GUESTLIB_STATS_SHM_BARRIER();
+   Atomic_Inc(&statsShm->seq);
+}
+
+
+/*
+ ******************************************************************************
+ * GuestlibStatsFetch --                                                 */ /**
+ *
+ * Fetches the stats from the host, negotiating the protocol version like
+ * VMGuestLibUpdateInfo() does.
+ *
+ * @param[in]  ctx        The application context.
+ * @param[out] reply      The reply, to be freed with RpcChannel_Free().
+ * @param[out] replyLen   Length of @a reply.
+ *
+ * @return TRUE on success.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+GuestlibStatsFetch(ToolsAppCtx *ctx,
+                   char **reply,
+                   size_t *replyLen)
+{
+   if (statsHostVersion == 0) {
+      statsHostVersion = VMGUESTLIB_DATA_VERSION;
+   }
+
+   for (;;) {
+      gchar *cmd = g_strdup_printf("%s %u", VMGUESTLIB_BACKDOOR_COMMAND_STRING,
+                                   statsHostVersion);
+      gboolean ok;
+
+      *reply = NULL;
+      ok = RpcChannel_Send(ctx->rpc, cmd, strlen(cmd), reply, replyLen);
+      g_free(cmd);
+
+      if (ok) {
+         const VMGuestLibHeader *hdr = (const VMGuestLibHeader *) *reply;
+
+         if (*replyLen < sizeof *hdr || hdr->version != statsHostVersion) {
+            g_debug("Bad guestlib reply from host.\n");
+            break;
+         }
+         if (statsSessionId != 0 && statsSessionId != hdr->sessionId &&
+             statsHostVersion != VMGUESTLIB_DATA_VERSION) {
+            /* New session, maybe on a newer host: renegotiate. */
+            statsHostVersion = VMGUESTLIB_DATA_VERSION;
+            statsSessionId = 0;
+            RpcChannel_Free(*reply);
+            continue;
+         }
+         statsSessionId = hdr->sessionId;
+         return TRUE;
+      }
+
+      /*
+       * A v2 host fails requests for v3 without saying which version it
+       * supports, so fall back to v2; no newer version exists to parse
+       * out of the reply.
+       */
+      if (statsHostVersion > 2 && (*reply == NULL ||
+          strncmp(*reply, "Unknown command", sizeof "Unknown command") != 0)) {
+         statsHostVersion = 2;
+         statsSessionId = 0;
+         RpcChannel_Free(*reply);
+         continue;
+      }
+      g_debug("Guestlib stats not available: %s\n",
+              *reply != NULL ? *reply : "NULL");
+      break;
+   }
+
+   RpcChannel_Free(*reply);
+   *reply = NULL;
+   statsHostVersion = 0;
+   statsSessionId = 0;
+   return FALSE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestlibStatsCollect --                                               */ /**
+ *
+ * Timer callback: fetches the stats and publishes them.  If the host has
+ * none to give, an empty snapshot is published so that readers ask the
+ * host themselves and get its error.
+ *
+ * @param[in]  data     The application context.
+ *
+ * @return TRUE, to keep the timer going.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+GuestlibStatsCollect(gpointer data)
+{
+   ToolsAppCtx *ctx = data;
+   char *reply;
+   size_t replyLen;
+
+   if (!GuestlibStatsFetch(ctx, &reply, &replyLen)) {
+      GuestlibStatsPublish(NULL, 0, statsInterval);
+      return TRUE;
+   }
+
+   if (replyLen > GUESTLIB_STATS_SHM_MAX_REPLY) {
+      g_debug("Guestlib reply too large to publish (%"FMTSZ"u bytes).\n",
+              replyLen);
+      GuestlibStatsPublish(NULL, 0, statsInterval);
+   } else {
+      GuestlibStatsPublish(reply, replyLen, statsInterval);
+   }
+   RpcChannel_Free(reply);
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_TweakGuestlibStats --                                       */ /**
+ *
+ * Starts, stops or reconfigures the guestlib stats collector.
+ *
+ * Only the root instance publishes; the path is root's, and readers trust
+ * nothing else.  Nothing is collected unless the interval is configured.  While the collector is stopped the segment stays in place
+ * but is marked stale, so readers go to the host.
+ *
+ * @param[in]  ctx      The app context.
+ * @param[in]  enable   Whether to enable the collector.
+ *
+ * @sa CONFNAME_GUESTINFO_GUESTLIBSTATSINTERVAL
+ *
+ ******************************************************************************
+ */
+
+void
+GuestInfo_TweakGuestlibStats(ToolsAppCtx *ctx,
+                             gboolean enable)
+{
+   GError *gError = NULL;
+   gint interval = 0;
+
+   if (enable && geteuid() == 0) {
+      interval = GUESTLIB_STATS_INTERVAL_SEC;
+
+      if (g_key_file_has_key(ctx->config, CONFGROUPNAME_GUESTINFO,
+                             CONFNAME_GUESTINFO_GUESTLIBSTATSINTERVAL, NULL)) {
+         interval = g_key_file_get_integer(ctx->config, CONFGROUPNAME_GUESTINFO,
+                                           CONFNAME_GUESTINFO_GUESTLIBSTATSINTERVAL,
+                                           &gError);
+         if (interval < 0 || gError) {
+            g_warning("Invalid %s.%s value.  Using default.\n",
+                      CONFGROUPNAME_GUESTINFO,
+                      CONFNAME_GUESTINFO_GUESTLIBSTATSINTERVAL);
+            interval = GUESTLIB_STATS_INTERVAL_SEC;
+         }
+      }
+   }
+   g_clear_error(&gError);
+
+   if (statsInterval == interval) {
+      return;
+   }
+
+   if (statsTimeoutSource != NULL) {
+      g_source_destroy(statsTimeoutSource);
+      statsTimeoutSource = NULL;
+   }
+
+   statsInterval = interval;
+
+   if (statsInterval == 0) {
+      if (statsShm != NULL) {
+         GuestlibStatsPublish(NULL, 0, 0);
+      }
+      g_info("Guestlib stats collection disabled.\n");
+      return;
+   }
+
+   if (statsShm == NULL && !GuestlibStatsCreate()) {
+      statsInterval = 0;
+      return;
+   }
+
+   g_info("Collecting guestlib stats every %ds.\n", statsInterval);
+
+   /* Publish right away, so readers don't wait for the first interval. */
+   GuestlibStatsCollect(ctx);
+
+   statsTimeoutSource = g_timeout_source_new_seconds(statsInterval);
+   VMTOOLSAPP_ATTACH_SOURCE(ctx, statsTimeoutSource, GuestlibStatsCollect,
+                            ctx, NULL);
+   g_source_unref(statsTimeoutSource);
+}
+
+
+/*
+ ******************************************************************************
+ * GuestInfo_ShutdownGuestlibStats --                                    */ /**
+ *
+ * Stops the collector and removes the segment.  Readers that still have it
+ * mapped find it stale and go to the host.
+ *
+ ******************************************************************************
+ */
+
+void
+GuestInfo_ShutdownGuestlibStats(void)
+{
+   if (statsTimeoutSource != NULL) {
+      g_source_destroy(statsTimeoutSource);
+      statsTimeoutSource = NULL;
+   }
+   statsInterval = 0;
+
+   if (statsShm != NULL) {
+      GuestlibStatsPublish(NULL, 0, 0);
+      munmap(statsShm, GUESTLIB_STATS_SHM_SIZE);
+      statsShm = NULL;
+      unlink(GUESTLIB_STATS_SHM_PATH);
+   }
+}
@@ -26,10 +26,103 @@
  */
 
 #define G_LOG_DOMAIN "timeSync"
+#include <glib.h>
 #include "vm_basic_types.h"
 
 #define US_PER_SEC 1000000
 
+/* Sync the time once a minute. */
+#define TIMESYNC_TIME 60
+/* Correct PERCENT_CORRECTION percent of the error each period. */
+#define TIMESYNC_PERCENT_CORRECTION 50
+
+typedef enum TimeSyncState {
+   TIMESYNC_INITIALIZING,
+   TIMESYNC_STOPPED,
+   TIMESYNC_RUNNING,
+} TimeSyncState;
+
+typedef enum TimeSyncSlewState {
+   TimeSyncUncalibrated,
+   TimeSyncCalibrating,
+   TimeSyncPLL,
+} TimeSyncSlewState;
+
+/**
+ * Where the time sync loop reads host time from and how it reads and
+ * corrects guest time.  The plugin uses the backdoor and the platform's
+ * TimeSync_* functions; the same loop can be driven by a simulator.
+ */
+
+typedef struct TimeSyncSource {
+   Bool (*readHost)(int64 *host, int64 *apparentError,
+                    Bool *apparentErrorValid, int64 *maxTimeError);
+   void (*stopCatchup)(void);
+   Bool (*getCurrentTime)(int64 *now);
+   Bool (*addToCurrentTime)(int64 delta);
+   Bool (*slew)(int64 delta, int64 timeSyncPeriod, int64 *remaining);
+   Bool (*disableTimeSlew)(void);
+   Bool (*pllUpdate)(int64 offset);
+   Bool (*pllSetFrequency)(int64 ppmCorrection);
+   Bool (*pllSupported)(void);
+} TimeSyncSource;
+
+/**
+ * State of the servo, which disciplines the guest clock's frequency from
+ * a filtered offset estimate instead of slewing a percentage of the last
+ * measured error.
+ */
+
+typedef struct TimeSyncServo {
+   gboolean  locked;       /* The error is within the servo's range. */
+   uint32    updates;      /* Estimates since the servo started tracking. */
+   int64     lastOffset;   /* Last error estimate. */
+   int64     lastTime;     /* Guest time of lastOffset. */
+   int64     freq;         /* Frequency correction, ppm << 16. */
+   int64     correction;   /* Correction applied since lastTime, ppm << 16. */
+} TimeSyncServo;
+
+typedef struct TimeSyncData {
+   gboolean           slewActive;
+   gboolean           slewCorrection;
+   gboolean           servo;
+   uint32             slewPercentCorrection;
+   uint32             timeSyncPeriod;         /* In seconds. */
+   TimeSyncState      state;
+   TimeSyncSlewState  slewState;
+   int64              calibrationStart;
+   int64              calibrationAdjustment;
+   TimeSyncServo      servoState;
+   const TimeSyncSource *source;
+   GSource           *timer;
+} TimeSyncData;
+
+void
+TimeSync_InitData(TimeSyncData *data,
+                  const TimeSyncSource *source);
+
+gboolean
+TimeSync_DoSync(TimeSyncData *data,
+                Bool slewCorrection,
+                Bool syncOnce,
+                Bool allowBackwardSync);
+
+void
+TimeSync_ResetSlew(TimeSyncData *data);
+
+void
+TimeSync_SetSlewState(TimeSyncData *data,
+                      gboolean active);
+
+Bool
+TimeSync_BackdoorReadHost(int64 *host,
+                          int64 *apparentError,
+                          Bool *apparentErrorValid,
+                          int64 *maxTimeError);
+
+void
+TimeSync_BackdoorStopCatchup(void);
+
 Bool
 TimeSync_GetCurrentTime(int64 *now);
 
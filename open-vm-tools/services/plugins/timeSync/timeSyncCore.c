@@ -0,0 +1,692 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file timeSyncCore.c
+ *
+ * Measurement and correction of the guest OS time error.  Host time and
+ * the guest clock are accessed through the TimeSyncSource in TimeSyncData,
+ * so the same code runs in the plugin and against a simulated clock.
+ *
+ * Periodic corrections are either made by slewing a percentage of the
+ * measured error each period and, once the error is small, handing over
+ * to the platform's PLL (see TimeSyncSlewTime), or by the servo (see
+ * TimeSyncServoSync).  The servo estimates the error from several samples
+ * and disciplines the guest clock's frequency itself, which removes the
+ * error left behind by a frequency offset without waiting for the PLL
+ * calibration period.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "timeSync.h"
+#include "vm_assert.h"
+#include "vm_basic_defs.h"
+#include "msg.h"
+
+
+/* When measuring the difference between time on the host and time in the
+ * guest we try up to TIMESYNC_MAX_SAMPLES times to read a sample
+ * where the two host reads are within TIMESYNC_GOOD_SAMPLE_THRESHOLD
+ * microseconds. */
+#define TIMESYNC_MAX_SAMPLES 4
+#define TIMESYNC_GOOD_SAMPLE_THRESHOLD 2000
+
+/* Once the error drops below TIMESYNC_PLL_ACTIVATE, activate the PLL.
+ * 500ppm error acumulated over a 60 second interval can produce 30ms of
+ * error. */
+#define TIMESYNC_PLL_ACTIVATE (30 * 1000) /* 30ms. */
+/* If the error goes above TIMESYNC_PLL_UNSYNC, deactivate the PLL. */
+#define TIMESYNC_PLL_UNSYNC (2 * TIMESYNC_PLL_ACTIVATE)
+/* Period during which the frequency error of guest time is measured. */
+#define TIMESYNC_CALIBRATION_DURATION (15 * 60 * US_PER_SEC) /* 15min. */
+
+/* The servo takes TIMESYNC_SERVO_SAMPLES samples each period and
+ * estimates the error from the half of them with the shortest host round
+ * trip.  It only handles errors up to TIMESYNC_PLL_UNSYNC, which can be
+ * corrected within a period at TIMESYNC_SERVO_MAX_PPM. */
+#define TIMESYNC_SERVO_SAMPLES 8
+#define TIMESYNC_SERVO_MAX_PPM 500
+/* Percentage of a frequency error the servo corrects per period. */
+#define TIMESYNC_SERVO_FREQ_GAIN(percent) ((percent) / 2)
+
+typedef struct TimeSyncSample {
+   int64 offset;
+   int64 delay;
+} TimeSyncSample;
+
+
+/**
+ * Read the Guest OS time and the Host OS time.
+ *
+ * There are three time domains that are revelant here:
+ * 1. Guest time     - the time reported by the guest
+ * 2. Apparent time  - the time reported by the virtualization layer
+ * 3. Host time      - the time reported by the host operating system.
+ *
+ * This function reports the host time, the guest time and the difference
+ * between apparent time and host time (apparentError).  The host and
+ * guest time may be sampled multiple times to ensure an accurate reading.
+ *
+ * @param[in]   data                Structure tracking time sync state.
+ * @param[out]  host                Time on the Host.
+ * @param[out]  guest               Time in the Guest.
+ * @param[out]  apparentError       Apparent time error = apparent - real.
+ * @param[out]  apparentErrorValid  Did the platform inform us of apparentError.
+ * @param[out]  maxTimeError        Maximum amount of error than can go.
+ *                                  uncorrected.
+ *
+ * @return TRUE on success.
+ */
+
+static gboolean
+TimeSyncReadHostAndGuest(TimeSyncData *data, int64 *host, int64 *guest,
+                         int64 *apparentError, Bool *apparentErrorValid,
+                         int64 *maxTimeError)
+{
+   int64 host1, host2, hostDiff;
+   int64 tmpGuest, tmpApparentError, tmpMaxTimeError;
+   Bool tmpApparentErrorValid;
+   int64 bestHostDiff = MAX_INT64;
+   int iter = 0;
+   DEBUG_ONLY(static int64 lastHost = 0);
+
+   *apparentErrorValid = FALSE;
+   *host = *guest = *apparentError = *maxTimeError = 0;
+
+   if (!data->source->readHost(&host2, &tmpApparentError,
+                               &tmpApparentErrorValid, &tmpMaxTimeError)) {
+      return FALSE;
+   }
+
+   do {
+      iter++;
+      host1 = host2;
+
+      if (!data->source->getCurrentTime(&tmpGuest)) {
+         g_warning("Unable to retrieve the guest OS time: %s.\n\n", 
+                   Msg_ErrString());
+         return FALSE;
+      }
+      
+      if (!data->source->readHost(&host2, &tmpApparentError,
+                                  &tmpApparentErrorValid,
+                                  &tmpMaxTimeError)) {
+         return FALSE;
+      }
+      
+      if (host1 < host2) {
+         hostDiff = host2 - host1;
+      } else {
+         hostDiff = 0;
+      }
+
+      if (hostDiff <= bestHostDiff) {
+         bestHostDiff = hostDiff;
+         *host = host1 + hostDiff / 2;
+         *guest = tmpGuest;
+         *apparentError = tmpApparentError;
+         *apparentErrorValid = tmpApparentErrorValid;
+         *maxTimeError = tmpMaxTimeError;
+      }
+   } while (iter < TIMESYNC_MAX_SAMPLES && 
+            bestHostDiff > TIMESYNC_GOOD_SAMPLE_THRESHOLD);
+
+   ASSERT(*host != 0 && *guest != 0);
+
+#ifdef VMX86_DEBUG
+   g_debug("Daemon: Guest vs host error %.6fs; guest vs apparent error %.6fs; "
+           "limit=%.2fs; apparentError %.6fs; iter=%d error=%.6fs; "
+           "%.6f secs since last update\n",
+           (*guest - *host) / 1000000.0, 
+           (*guest - *host - *apparentError) / 1000000.0, 
+           *maxTimeError / 1000000.0, *apparentError / 1000000.0,
+           iter, bestHostDiff / 1000000.0,
+           (*host - lastHost) / 1000000.0);
+   lastHost = *host;
+#endif
+
+   return TRUE;
+}
+
+
+/**
+ * Set the guest OS time to the host OS time by stepping the time.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ * @param[in]  adjustment        Amount to correct the guest time.
+ */
+
+static gboolean
+TimeSyncStepTime(TimeSyncData *data, int64 adjustment)
+{
+   int64 before;
+   int64 after;
+
+   if (vmx86_debug) {
+      data->source->getCurrentTime(&before);
+   }
+
+   /* Stepping invalidates the current slew, reset to nominal. */
+   TimeSync_SetSlewState(data, FALSE);
+
+   if (!data->source->addToCurrentTime(adjustment)) {
+      return FALSE;
+   }
+
+   /* 
+    * Tell timetracker to stop trying to catch up, since we have corrected
+    * both the guest OS error and the apparent time error. 
+    */
+   data->source->stopCatchup();
+
+   if (vmx86_debug) {
+      data->source->getCurrentTime(&after);
+      
+      g_debug("Time changed by %"FMT64"dus from %"FMT64"d.%06"FMT64"d -> "
+              "%"FMT64"d.%06"FMT64"d\n", adjustment,
+              before / US_PER_SEC, before % US_PER_SEC, 
+              after / US_PER_SEC, after % US_PER_SEC);
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Slew the guest OS time advancement to correct the time.
+ *
+ * In addition to standard slewing (implemented via TimeSync_Slew), we
+ * also support using an NTP style PLL to slew the time.  The PLL can take
+ * a while to end up with an accurate measurement of the frequency error,
+ * so before entering PLL mode we calibrate the frequency error over a
+ * period of TIMESYNC_PLL_ACTIVATE seconds.  
+ *
+ * When using standard slewing, only correct slewPercentCorrection of the
+ * error.  This is to avoid overcorrection when the error is mis-measured,
+ * or overcorrection caused by the daemon waking up later than it is
+ * supposed to leaving the slew in place for longer than anticpiated.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ * @param[in]  adjustment        Amount to correct the guest time.
+ */
+
+static gboolean
+TimeSyncSlewTime(TimeSyncData *data, int64 adjustment)
+{
+   int64 now;
+   int64 remaining = 0;
+   int64 timeSyncPeriodUS = data->timeSyncPeriod * US_PER_SEC;
+   int64 slewDiff = (adjustment * data->slewPercentCorrection) / 100;
+   
+   if (!data->source->getCurrentTime(&now)) {
+      return FALSE;
+   }
+
+   if (adjustment > TIMESYNC_PLL_UNSYNC && 
+       data->slewState != TimeSyncUncalibrated) {
+      g_debug("Adjustment too large (%"FMT64"d), resetting PLL state.\n", 
+              adjustment);
+      data->slewState = TimeSyncUncalibrated;
+   }
+
+   if (data->slewState == TimeSyncUncalibrated) {
+      g_debug("Slewing time: adjustment %"FMT64"d\n", adjustment);
+      if (!data->source->slew(slewDiff, timeSyncPeriodUS, &remaining)) {
+         data->slewState = TimeSyncUncalibrated;
+         return FALSE;
+      }
+      if (adjustment < TIMESYNC_PLL_ACTIVATE && data->source->pllSupported()) {
+         g_debug("Starting PLL calibration.\n");
+         data->calibrationStart = now;
+         /* Starting out the calibration period we are adjustment behind,
+          * but have already requested to correct slewDiff of that. */
+         data->calibrationAdjustment = slewDiff - adjustment;
+         data->slewState = TimeSyncCalibrating;
+      }
+   } else if (data->slewState == TimeSyncCalibrating) {
+      if (now > data->calibrationStart + TIMESYNC_CALIBRATION_DURATION) {
+         int64 ppmErr;
+         /* Reset slewing to nominal and find out remaining slew. */
+         data->source->slew(0, timeSyncPeriodUS, &remaining);
+         data->calibrationAdjustment += adjustment;
+         data->calibrationAdjustment -= remaining;
+         ppmErr = ((1000000 * data->calibrationAdjustment) << 16) / 
+                   (now - data->calibrationStart);
+         if (ppmErr >> 16 < 500 && ppmErr >> 16 > -500) {
+            g_debug("Activating PLL ppmEst=%"FMT64"d (%"FMT64"d)\n", 
+                    ppmErr >> 16, ppmErr);
+            data->source->pllUpdate(adjustment);
+            data->source->pllSetFrequency(ppmErr);
+            data->slewState = TimeSyncPLL;
+         } else {
+            /* PPM error is too large to try the PLL. */
+            g_debug("PPM error too large: %"FMT64"d (%"FMT64"d) "
+                    "not activating PLL\n", ppmErr >> 16, ppmErr);
+            data->slewState = TimeSyncUncalibrated;
+         }
+      } else {
+         g_debug("Calibrating error: adjustment %"FMT64"d\n", adjustment);
+         if (!data->source->slew(slewDiff, timeSyncPeriodUS, &remaining)) {
+            return FALSE;
+         }
+         data->calibrationAdjustment += slewDiff;
+         data->calibrationAdjustment -= remaining;
+      }
+   } else {
+      ASSERT(data->slewState == TimeSyncPLL);
+      g_debug("Updating PLL: adjustment %"FMT64"d\n", adjustment);
+      if (!data->source->pllUpdate(adjustment)) {
+         TimeSync_ResetSlew(data);
+      }
+   }
+   return TRUE;
+}
+
+
+/**
+ * Reset the slew to nominal.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ */
+
+void
+TimeSync_ResetSlew(TimeSyncData *data)
+{
+   int64 remaining;
+   int64 timeSyncPeriodUS = data->timeSyncPeriod * US_PER_SEC;
+   data->slewState = TimeSyncUncalibrated;
+   data->source->slew(0, timeSyncPeriodUS, &remaining);
+   if (data->source->pllSupported()) {
+      data->source->pllUpdate(0);
+      data->source->pllSetFrequency(0);
+   }
+}
+
+
+/**
+ * Update whether slewing is used for time correction.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ * @param[in]  active            Is slewing active.
+ */
+
+void
+TimeSync_SetSlewState(TimeSyncData *data,
+                      gboolean active)
+{
+   if (active != data->slewActive) {
+      g_debug(active ? "Starting slew.\n" : "Stopping slew.\n");
+      if (!active) {
+         TimeSync_ResetSlew(data);
+      }
+      data->slewActive = active;
+   }
+}
+
+
+/**
+ * qsort comparator ordering samples by host round trip.
+ */
+
+static int
+TimeSyncCompareDelay(const void *a, const void *b)
+{
+   const TimeSyncSample *sa = a;
+   const TimeSyncSample *sb = b;
+
+   return (sa->delay > sb->delay) - (sa->delay < sb->delay);
+}
+
+
+/**
+ * qsort comparator ordering int64s.
+ */
+
+static int
+TimeSyncCompareInt64(const void *a, const void *b)
+{
+   int64 ia = *(const int64 *)a;
+   int64 ib = *(const int64 *)b;
+
+   return (ia > ib) - (ia < ib);
+}
+
+
+/**
+ * Estimate the guest OS error from several samples of host and guest time.
+ *
+ * Each sample brackets a guest time read with two host time reads.  A
+ * long round trip means the guest was descheduled somewhere in between
+ * and the sample is probably off by up to half of it, so the estimate is
+ * the median offset of the half of the samples with the shortest round
+ * trip.
+ *
+ * @param[in]   data                Structure tracking time sync state.
+ * @param[out]  gosError            Estimated guest OS error.
+ * @param[out]  apparentError       Apparent time error = apparent - real.
+ * @param[out]  apparentErrorValid  Did the platform inform us of apparentError.
+ * @param[out]  maxTimeError        Maximum amount of error than can go.
+ *                                  uncorrected.
+ *
+ * @return TRUE on success.
+ */
+
+static gboolean
+TimeSyncServoMeasure(TimeSyncData *data, int64 *gosError,
+                     int64 *apparentError, Bool *apparentErrorValid,
+                     int64 *maxTimeError)
+{
+   TimeSyncSample samples[TIMESYNC_SERVO_SAMPLES];
+   int64 offsets[TIMESYNC_SERVO_SAMPLES / 2];
+   int64 host1, host2;
+   int64 guest;
+   int i;
+
+   if (!data->source->readHost(&host2, apparentError, apparentErrorValid,
+                               maxTimeError)) {
+      return FALSE;
+   }
+
+   for (i = 0; i < ARRAYSIZE(samples); i++) {
+      host1 = host2;
+
+      if (!data->source->getCurrentTime(&guest)) {
+         g_warning("Unable to retrieve the guest OS time: %s.\n\n",
+                   Msg_ErrString());
+         return FALSE;
+      }
+
+      if (!data->source->readHost(&host2, apparentError, apparentErrorValid,
+                                  maxTimeError)) {
+         return FALSE;
+      }
+
+      samples[i].delay = host2 - host1;
+      samples[i].offset = guest - (host1 + host2) / 2 - *apparentError;
+   }
+
+   qsort(samples, ARRAYSIZE(samples), sizeof samples[0],
+         TimeSyncCompareDelay);
+   for (i = 0; i < ARRAYSIZE(offsets); i++) {
+      offsets[i] = samples[i].offset;
+   }
+   qsort(offsets, ARRAYSIZE(offsets), sizeof offsets[0],
+         TimeSyncCompareInt64);
+   i = ARRAYSIZE(offsets) / 2;
+   *gosError = (offsets[i - 1] + offsets[i]) / 2;
+
+   g_debug("Servo: guest vs apparent error %.6fs; round trip %.6fs to "
+           "%.6fs; limit=%.2fs\n", *gosError / 1000000.0,
+           samples[0].delay / 1000000.0,
+           samples[ARRAYSIZE(offsets) - 1].delay / 1000000.0,
+           *maxTimeError / 1000000.0);
+
+   return TRUE;
+}
+
+
+/**
+ * Feed an error estimate to the servo and correct the guest clock's
+ * frequency for the next period.
+ *
+ * The servo corrects phase and frequency separately.  The phase term
+ * removes slewPercentCorrection percent of the error over the next
+ * period.  The error left over from the previous period beyond what the
+ * phase term should have left is the frequency error that hasn't been
+ * corrected yet; the first time it is measured it is corrected in full,
+ * afterwards by FREQ_GAIN(slewPercentCorrection) percent, which filters
+ * the noise of the estimates.
+ *
+ * The correction goes through the PLL frequency when the platform has
+ * one, because a slew is limited to the granularity of the tick length;
+ * otherwise the correction for the period is slewed.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ * @param[in]  offset            Estimated guest OS error.
+ * @param[in]  now               Current guest time.
+ *
+ * @return TRUE on success.
+ */
+
+static gboolean
+TimeSyncServoUpdate(TimeSyncData *data, int64 offset, int64 now)
+{
+   TimeSyncServo *servo = &data->servoState;
+   int64 percent = data->slewPercentCorrection;
+   int64 timeSyncPeriodUS = data->timeSyncPeriod * US_PER_SEC;
+   int64 maxFreq = (int64)TIMESYNC_SERVO_MAX_PPM << 16;
+   int64 freq;
+   int64 remaining;
+
+   if (servo->updates > 0) {
+      int64 elapsed = now - servo->lastTime;
+      int64 predicted;
+      int64 gain;
+
+      /* Don't let a late wakeup or a long pause skew the frequency. */
+      elapsed = MAX(elapsed, timeSyncPeriodUS / 2);
+      elapsed = MIN(elapsed, timeSyncPeriodUS * 2);
+
+      predicted = servo->lastOffset + (servo->correction - servo->freq) *
+                                      elapsed / ((int64)US_PER_SEC << 16);
+      gain = servo->updates == 1 ? 100 : TIMESYNC_SERVO_FREQ_GAIN(percent);
+      servo->freq += -(offset - predicted) * ((int64)US_PER_SEC << 16) /
+                     elapsed * gain / 100;
+      servo->freq = MAX(MIN(servo->freq, maxFreq), -maxFreq);
+   }
+
+   freq = servo->freq +
+          (-offset * ((int64)US_PER_SEC << 16) / timeSyncPeriodUS) *
+          percent / 100;
+   freq = MAX(MIN(freq, maxFreq), -maxFreq);
+
+   servo->lastOffset = offset;
+   servo->lastTime = now;
+   servo->correction = freq;
+   servo->updates++;
+
+   g_debug("Servo: error %"FMT64"d frequency %.3fppm correction %.3fppm\n",
+           offset, servo->freq / 65536.0, freq / 65536.0);
+
+   if (data->source->pllSupported()) {
+      return data->source->pllSetFrequency(freq);
+   }
+   return data->source->slew(freq * timeSyncPeriodUS /
+                             ((int64)US_PER_SEC << 16),
+                             timeSyncPeriodUS, &remaining);
+}
+
+
+/**
+ * Periodic synchronization with the servo.
+ *
+ * As without the servo, a guest OS error of more than maxTimeError behind
+ * is stepped, and the time is only slewed if we can distinguish guest
+ * error from apparent time error.  Errors outside of the servo's range
+ * are slewed by TimeSyncSlewTime; once in range, the servo takes over.
+ * The servo's frequency estimate survives steps and large errors.
+ *
+ * @param[in]  data              Structure tracking time sync state.
+ * @param[in]  slewCorrection    Is clock slewing enabled?
+ *
+ * @return TRUE on success.
+ */
+
+static gboolean
+TimeSyncServoSync(TimeSyncData *data, Bool slewCorrection)
+{
+   TimeSyncServo *servo = &data->servoState;
+   int64 gosError, apparentError, maxTimeError;
+   int64 now;
+   Bool apparentErrorValid;
+
+   if (!TimeSyncServoMeasure(data, &gosError, &apparentError,
+                             &apparentErrorValid, &maxTimeError) ||
+       !data->source->getCurrentTime(&now)) {
+      return FALSE;
+   }
+
+   TimeSync_SetSlewState(data, apparentErrorValid && slewCorrection);
+
+   if (gosError < -maxTimeError) {
+      g_debug("Servo: stepping time.\n");
+      servo->locked = FALSE;
+      servo->updates = 0;
+      return TimeSyncStepTime(data, -gosError + -apparentError);
+   }
+
+   if (!slewCorrection || !apparentErrorValid) {
+      servo->locked = FALSE;
+      servo->updates = 0;
+      return TRUE;
+   }
+
+   if (gosError > TIMESYNC_PLL_UNSYNC || gosError < -TIMESYNC_PLL_UNSYNC) {
+      if (servo->locked) {
+         g_debug("Servo: error too large (%"FMT64"d), unlocking.\n",
+                 gosError);
+         TimeSync_ResetSlew(data);
+         servo->locked = FALSE;
+      }
+      servo->updates = 0;
+      return TimeSyncSlewTime(data, -gosError);
+   }
+
+   if (!servo->locked) {
+      g_debug("Servo: locking, error %"FMT64"d.\n", gosError);
+      /* Stop any slew left by TimeSyncSlewTime. */
+      TimeSync_ResetSlew(data);
+      servo->locked = TRUE;
+   }
+
+   return TimeSyncServoUpdate(data, gosError, now);
+}
+
+
+/**
+ * Set the guest OS time to the host OS time.
+ *
+ * When the servo is enabled, periodic synchronization is left to it.
+ *
+ * @param[in]  data              Time sync data.
+ * @param[in]  slewCorrection    Is clock slewing enabled?
+ * @param[in]  syncOnce          Is this function called in a loop?
+ * @param[in]  allowBackwardSync Can we sync time backwards when doing syncOnce?
+ *
+ * @return TRUE on success.
+ */
+
+gboolean
+TimeSync_DoSync(TimeSyncData *data,
+                Bool slewCorrection,
+                Bool syncOnce,
+                Bool allowBackwardSync)
+{
+   int64 guest, host;
+   int64 gosError, apparentError, maxTimeError;
+   Bool apparentErrorValid;
+
+   g_debug("Synchronizing time: "
+           "syncOnce %d, slewCorrection %d, allowBackwardSync %d.\n",
+           syncOnce, slewCorrection, allowBackwardSync);
+
+   if (data->servo && !syncOnce) {
+      return TimeSyncServoSync(data, slewCorrection);
+   }
+
+   if (!TimeSyncReadHostAndGuest(data, &host, &guest, &apparentError,
+                                 &apparentErrorValid, &maxTimeError)) {
+      return FALSE;
+   }
+
+   gosError = guest - host - apparentError;
+
+   if (syncOnce) {
+
+      /*
+       * Non-loop behavior:
+       *
+       * Perform a step correction if:
+       * 1) The guest OS error is behind by more than maxTimeError.
+       * 2) The guest OS is ahead of the host OS.
+       */
+
+      if (gosError < -maxTimeError || 
+          (gosError + apparentError > 0 && allowBackwardSync)) {
+         g_debug("One time synchronization: stepping time.\n");
+         if (!TimeSyncStepTime(data, -gosError + -apparentError)) {
+            return FALSE;
+         }
+      } else {
+         g_debug("One time synchronization: correction not needed.\n");
+      }
+   } else {
+
+      /*
+       * Loop behavior:
+       *
+       * If guest error is more than maxTimeError behind perform a step
+       * correction.  Otherwise, if we can distinguish guest error from
+       * apparent time error perform a slew correction .
+       */
+
+      TimeSync_SetSlewState(data, apparentErrorValid && slewCorrection);
+
+      if (gosError < -maxTimeError) {
+         g_debug("Periodic synchronization: stepping time.\n");
+         if (!TimeSyncStepTime(data, -gosError + -apparentError)) {
+            return FALSE;
+         }
+      } else if (slewCorrection && apparentErrorValid) {
+         g_debug("Periodic synchronization: slewing time.\n");
+         if (!TimeSyncSlewTime(data, -gosError)) {
+            return FALSE;
+         }
+      }
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Initialize the time sync state.
+ *
+ * @param[out] data              Time sync data.
+ * @param[in]  source            Where to read and correct time.
+ */
+
+void
+TimeSync_InitData(TimeSyncData *data,
+                  const TimeSyncSource *source)
+{
+   data->slewActive = FALSE;
+   data->slewCorrection = FALSE;
+   data->servo = FALSE;
+   data->slewPercentCorrection = TIMESYNC_PERCENT_CORRECTION;
+   data->state = TIMESYNC_INITIALIZING;
+   data->slewState = TimeSyncUncalibrated;
+   data->timeSyncPeriod = TIMESYNC_TIME;
+   data->calibrationStart = 0;
+   data->calibrationAdjustment = 0;
+   memset(&data->servoState, 0, sizeof data->servoState);
+   data->source = source;
+   data->timer = NULL;
+}
@@ -29,11 +29,14 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 #include "toolsCoreInt.h"
 #include "conf.h"
 #include "guestApp.h"
+#include "poll.h"
 #include "serviceObj.h"
 #include "system.h"
+#include "userlock.h"
 #include "util.h"
 #include "vmcheck.h"
 #include "vm_tools_version.h"
@@ -125,6 +128,37 @@ ToolsCoreInitializeDebug(ToolsServiceState *state)
 }
 
 
+/**
+ * Starts the Poll implementation chosen in the config file, before the RPC
+ * channel or any plugin starts the default one with Poll_InitGtk(), which is
+ * then a no-op.
+ *
+ * @param[in]  state    Service state.
+ */
+
+static void
+ToolsCoreInitPoll(ToolsServiceState *state)
+{
+   gchar *backend = g_key_file_get_string(state->ctx.config,
+                                          "vmtools",
+                                          CONFNAME_POLLBACKEND,
+                                          NULL);
+
+   if (backend == NULL || strcmp(backend, "gtk") == 0) {
+      /* Default: started on demand with Poll_InitGtk(). */
+#if defined(__linux__)
+   } else if (strcmp(backend, "epoll") == 0) {
+      g_message("Using the epoll poll backend.\n");
+      Poll_InitEpoll();
+#endif
+   } else {
+      g_warning("Unknown %s '%s', using the default.\n",
+                CONFNAME_POLLBACKEND, backend);
+   }
+   g_free(backend);
+}
+
+
 /**
  * Timer callback that just calls ToolsCore_ReloadConfig().
  *
@@ -361,6 +395,15 @@ ToolsCore_ReloadConfig(ToolsServiceState *state,
       state->ctx.config = g_key_file_new();
    }
 
+   if (first || loaded) {
+      gint sampleRate = g_key_file_get_integer(state->ctx.config,
+                                               "vmtools",
+                                               CONFNAME_LOCKCONTENTIONSAMPLERATE,
+                                               NULL);
+
+      MXUser_SetContentionSampling(sampleRate > 0 ? sampleRate : 0);
+   }
+
    if (reset || loaded) {
       VMTools_ConfigLogging(state->name,
                             state->ctx.config,
@@ -407,6 +450,7 @@ ToolsCore_Setup(ToolsServiceState *state)
 #endif
    state->ctx.isVMware = VmCheck_IsVirtualWorld();
    g_main_context_unref(gctx);
+   ToolsCoreInitPoll(state);
 
    g_type_init();
    state->ctx.serviceObj = g_object_new(TOOLSCORE_TYPE_SERVICE, NULL);
@@ -33,6 +33,7 @@
 #include "str.h"
 #include "strutil.h"
 #include "toolsCoreInt.h"
+#include "userlock.h"
 #include "vm_tools_version.h"
 #include "vmware/tools/utils.h"
 #include "vm_version.h"
@@ -164,6 +165,13 @@ ToolsCoreRpcCapReg(RpcInData *data)
 }
 
 
+/**
+ * Longest option name "Set_Option" accepts. Option names are short config
+ * keys; anything longer cannot match a registered option anyway.
+ */
+#define TOOLSCORE_MAX_OPTION_NAME 128
+
+
 /**
  * Handles a "set option" RPC. Calls the plugins which have registered interest
  * in the option being set.
@@ -178,37 +186,86 @@ ToolsCoreRpcSetOption(RpcInData *data)
 {
 
    gboolean retVal = FALSE;
-   char *option;
-   char *value;
+   char option[TOOLSCORE_MAX_OPTION_NAME];
+   const char *token;
+   size_t optionLen;
+   const char *value;
    unsigned int index = 0;
    ToolsServiceState *state = data->clientData;
 
-   /* Parse the option & value string. */
-   option = StrUtil_GetNextToken(&index, data->args, " ");
-   /* Ignore leading space before value. */
-   index++;
-   value = StrUtil_GetNextToken(&index, data->args, "");
-
-   if (option != NULL && value != NULL && strlen(value) != 0) {
-
-      g_debug("Setting option '%s' to '%s'.\n", option, value);
-      g_signal_emit_by_name(state->ctx.serviceObj,
-                            TOOLS_CORE_SIG_SET_OPTION,
-                            &state->ctx,
-                            option,
-                            value,
-                            &retVal);
+   /*
+    * Parse the option & value string. The value is the rest of the
+    * arguments, so it is used in place; only the option name is copied out
+    * to terminate it.
+    */
+   if (StrUtil_GetNextTokenView(&index, data->args, " ", &token, &optionLen) &&
+       optionLen < sizeof option &&
+       data->args[index] != '\0') {
+      memcpy(option, token, optionLen);
+      option[optionLen] = '\0';
+
+      /* Ignore leading space before value. */
+      value = data->args + index + 1;
+
+      if (*value != '\0') {
+         g_debug("Setting option '%s' to '%s'.\n", option, value);
+         g_signal_emit_by_name(state->ctx.serviceObj,
+                               TOOLS_CORE_SIG_SET_OPTION,
+                               &state->ctx,
+                               option,
+                               value,
+                               &retVal);
+      }
    }
 
-   vm_free(option);
-   vm_free(value);
-
    RPCIN_SETRETVALS(data, retVal ? "" : "Unknown or invalid option", retVal);
 
    return retVal;
 }
 
 
+/** Max number of locks reported by the "Lock_Contention" RPC. */
+#define TOOLSCORE_MAX_CONTENDED_LOCKS 16
+
+
+/**
+ * Handles a "Lock_Contention" RPC. Reports the most contended MXUser locks
+ * in this process, as gathered by the sampled contention profiler (see the
+ * "lock-contention-sample-rate" config option).
+ *
+ * The reply starts with a "rate=<N> acquisitions=<count>" line, followed by
+ * one "<name> <sampled> <contended> <waitNS>" line per lock, most contended
+ * first. Wait times are those of the sampled acquisitions only.
+ *
+ * @param[in]  data     The RPC data.
+ *
+ * @return TRUE.
+ */
+
+static gboolean
+ToolsCoreRpcLockContention(RpcInData *data)
+{
+   MXUserContentionInfo locks[TOOLSCORE_MAX_CONTENDED_LOCKS];
+   uint64 acquisitions;
+   uint32 numLocks;
+   uint32 i;
+   char *reply;
+
+   numLocks = MXUser_QueryContention(locks, ARRAYSIZE(locks), &acquisitions);
+
+   reply = Str_SafeAsprintf(NULL, "rate=%u acquisitions=%"FMT64"u\n",
+                            MXUser_GetContentionSampling(), acquisitions);
+
+   for (i = 0; i < numLocks; i++) {
+      StrUtil_SafeStrcatF(&reply, "%s %"FMT64"u %"FMT64"u %"FMT64"u\n",
+                          locks[i].name, locks[i].sampled,
+                          locks[i].contended, locks[i].waitTimeNS);
+   }
+
+   return RPCIN_SETRETVALSF(data, reply, TRUE);
+}
+
+
 /**
  * Initializes the RPC channel. Currently this instantiates an RpcIn loop.
  * This function should only be called once.
@@ -224,6 +281,7 @@ ToolsCore_InitRpc(ToolsServiceState *state)
    static RpcChannelCallback rpcs[] = {
       { "Capabilities_Register", ToolsCoreRpcCapReg, NULL, NULL, NULL, 0 },
       { "Set_Option", ToolsCoreRpcSetOption, NULL, NULL, NULL, 0 },
+      { "Lock_Contention", ToolsCoreRpcLockContention, NULL, NULL, NULL, 0 },
    };
 
    size_t i;
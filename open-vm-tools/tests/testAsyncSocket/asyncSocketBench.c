@@ -0,0 +1,254 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * asyncSocketBench.c --
+ *
+ *   Send throughput benchmark for AsyncSocket over a local socketpair.
+ *   Messages of several sizes are queued with AsyncSocket_Send() and
+ *   written with AsyncSocket_Flush(), either one at a time or in batches
+ *   that go out gathered into writev() calls, while a thread drains the
+ *   other end.  The messages and megabytes per second of each combination
+ *   are reported.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "asyncsocket.h"
+#include "poll.h"
+
+#define DEFAULT_SECONDS         0.5
+#define FLUSH_TIMEOUT_MS        5000
+#define MAX_BATCH               64
+
+static const int messageSizes[] = { 64, 512, 4096, 65536 };
+static const int batchSizes[] = { 1, MAX_BATCH };
+
+typedef struct BenchSink {
+   int fd;
+   uint64 received;
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+} BenchSink;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Now --
+ *
+ *    Current time in seconds.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Now(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * SinkThread --
+ *
+ *    Read and discard everything from the peer end until it is closed.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+SinkThread(void *data)  // IN
+{
+   BenchSink *sink = data;
+   static char buf[256 * 1024];
+
+   for (;;) {
+      ssize_t n = read(sink->fd, buf, sizeof buf);
+
+      if (n <= 0 && !(n < 0 && errno == EINTR)) {
+         break;
+      }
+      if (n > 0) {
+         pthread_mutex_lock(&sink->lock);
+         sink->received += n;
+         pthread_cond_signal(&sink->cond);
+         pthread_mutex_unlock(&sink->lock);
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *    Send 'size' byte messages 'batch' at a time for about 'seconds' and
+ *    print a line of results.
+ *
+ * Results:
+ *    TRUE if every send and flush succeeded.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchRun(int size,         // IN
+         int batch,        // IN
+         double seconds)   // IN
+{
+   AsyncSocket *asock;
+   BenchSink sink;
+   pthread_t thread;
+   char *buf;
+   uint64 messages = 0;
+   uint64 bytes;
+   double start;
+   double elapsed;
+   int fds[2];
+   int error;
+   Bool ok = TRUE;
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+      fprintf(stderr, "socketpair: %s\n", strerror(errno));
+      return FALSE;
+   }
+
+   asock = AsyncSocket_AttachToFd(fds[0], NULL, &error);
+   if (asock == NULL) {
+      fprintf(stderr, "Can't attach to the socket (%d).\n", error);
+      close(fds[0]);
+      close(fds[1]);
+      return FALSE;
+   }
+
+   /* The messages are never modified, so they can all share one buffer. */
+   buf = malloc(size);
+   memset(buf, 'x', size);
+
+   memset(&sink, 0, sizeof sink);
+   sink.fd = fds[1];
+   pthread_mutex_init(&sink.lock, NULL);
+   pthread_cond_init(&sink.cond, NULL);
+   if (pthread_create(&thread, NULL, SinkThread, &sink) != 0) {
+      fprintf(stderr, "Can't start the sink thread.\n");
+      AsyncSocket_Close(asock);
+      close(fds[1]);
+      free(buf);
+      return FALSE;
+   }
+
+   start = Now();
+   do {
+      int i;
+
+      for (i = 0; i < batch && ok; i++) {
+         ok = AsyncSocket_Send(asock, buf, size, NULL, NULL) ==
+              ASOCKERR_SUCCESS;
+      }
+      ok = ok && AsyncSocket_Flush(asock, FLUSH_TIMEOUT_MS) ==
+                 ASOCKERR_SUCCESS;
+      messages += batch;
+   } while (ok && Now() - start < seconds);
+
+   /* Count the time until the sink has read everything. */
+   bytes = messages * size;
+   pthread_mutex_lock(&sink.lock);
+   while (ok && sink.received < bytes) {
+      pthread_cond_wait(&sink.cond, &sink.lock);
+   }
+   pthread_mutex_unlock(&sink.lock);
+   elapsed = Now() - start;
+
+   AsyncSocket_Close(asock);
+   pthread_join(thread, NULL);
+   close(fds[1]);
+   pthread_mutex_destroy(&sink.lock);
+   pthread_cond_destroy(&sink.cond);
+   free(buf);
+
+   if (!ok) {
+      fprintf(stderr, "%d byte messages, batch %d: send failed.\n", size,
+              batch);
+      return FALSE;
+   }
+
+   printf("%7d %6d %12.0f %10.1f\n", size, batch, messages / elapsed,
+          bytes / elapsed / 1e6);
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    Usage: asyncSocketBench [seconds per measurement]
+ *
+ * Results:
+ *    EXIT_SUCCESS and EXIT_FAILURE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   double seconds = DEFAULT_SECONDS;
+   Bool ok = TRUE;
+   unsigned int i;
+   unsigned int j;
+
+   if (argc > 2 || (argc == 2 && (seconds = atof(argv[1])) <= 0)) {
+      fprintf(stderr, "Usage: %s [seconds per measurement]\n", argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   Poll_InitGtk();
+
+   printf("%7s %6s %12s %10s\n", "bytes", "batch", "messages/s", "MB/s");
+
+   for (i = 0; i < ARRAYSIZE(messageSizes); i++) {
+      for (j = 0; j < ARRAYSIZE(batchSizes); j++) {
+         ok = BenchRun(messageSizes[i], batchSizes[j], seconds) && ok;
+      }
+   }
+
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,239 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * asyncSocketReentry.c --
+ *
+ *   Regression test for send callbacks that re-enter the AsyncSocket send
+ *   path.  Three buffers are queued on one end of a socketpair and flushed
+ *   so that they go out in a single writev().  The first buffer's callback
+ *   then calls AsyncSocket_Flush() or AsyncSocket_DoOneMsg(), which write
+ *   whatever is still queued.  The peer must receive every byte exactly
+ *   once and in order, and every callback must fire exactly once.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "asyncsocket.h"
+#include "poll.h"
+
+#define FLUSH_TIMEOUT_MS        5000
+#define NUM_BUFS                3
+
+typedef enum {
+   REENTER_FLUSH,
+   REENTER_DOONEMSG,
+} ReentryMode;
+
+typedef struct ReentryTest {
+   const char *name;
+   ReentryMode mode;
+   AsyncSocket *asock;
+   char bufs[NUM_BUFS][256];
+   int lens[NUM_BUFS];
+   int numSent[NUM_BUFS];
+   int order[NUM_BUFS];
+   int numDone;
+   int reentryStatus;
+} ReentryTest;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * SendDone --
+ *
+ *    Send completion.  Record it and, for the first buffer, re-enter the
+ *    send path while the other buffers' callbacks are still pending.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+SendDone(void *buf,            // IN
+         int len,              // IN
+         AsyncSocket *asock,   // IN
+         void *clientData)     // IN
+{
+   ReentryTest *test = clientData;
+   int i = ((char *) buf - test->bufs[0]) / sizeof test->bufs[0];
+
+   test->numSent[i]++;
+   if (test->numDone < NUM_BUFS) {
+      test->order[test->numDone] = i;
+   }
+   test->numDone++;
+
+   if (i != 0) {
+      return;
+   }
+
+   if (test->mode == REENTER_FLUSH) {
+      test->reentryStatus = AsyncSocket_Flush(asock, FLUSH_TIMEOUT_MS);
+   } else {
+      test->reentryStatus = AsyncSocket_DoOneMsg(asock, FALSE,
+                                                 FLUSH_TIMEOUT_MS);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * RunTest --
+ *
+ *    Run one re-entry scenario.
+ *
+ * Results:
+ *    TRUE if the peer got every byte once and in order and every callback
+ *    fired once.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+RunTest(ReentryTest *test)  // IN/OUT
+{
+   char expected[NUM_BUFS * sizeof test->bufs[0]];
+   char got[2 * sizeof expected];
+   size_t expectedLen = 0;
+   size_t gotLen = 0;
+   int fds[2];
+   int error;
+   int status;
+   Bool ok = TRUE;
+   int i;
+
+   for (i = 0; i < NUM_BUFS; i++) {
+      test->lens[i] = 100 + 50 * i;
+      memset(test->bufs[i], 'a' + i, test->lens[i]);
+      memcpy(expected + expectedLen, test->bufs[i], test->lens[i]);
+      expectedLen += test->lens[i];
+   }
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+      fprintf(stderr, "%s: socketpair: %s\n", test->name, strerror(errno));
+      return FALSE;
+   }
+
+   test->asock = AsyncSocket_AttachToFd(fds[0], NULL, &error);
+   if (test->asock == NULL) {
+      fprintf(stderr, "%s: can't attach to the socket (%d).\n", test->name,
+              error);
+      close(fds[0]);
+      close(fds[1]);
+      return FALSE;
+   }
+
+   /*
+    * Nothing is written until the flush below, so one writev() sends all
+    * the buffers.
+    */
+
+   for (i = 0; i < NUM_BUFS; i++) {
+      status = AsyncSocket_Send(test->asock, test->bufs[i], test->lens[i],
+                                SendDone, test);
+      if (status != ASOCKERR_SUCCESS) {
+         fprintf(stderr, "%s: send failed (%d).\n", test->name, status);
+         ok = FALSE;
+         goto exit;
+      }
+   }
+
+   status = AsyncSocket_Flush(test->asock, FLUSH_TIMEOUT_MS);
+   if (status != ASOCKERR_SUCCESS ||
+       test->reentryStatus != ASOCKERR_SUCCESS) {
+      fprintf(stderr, "%s: flush failed (%d, %d).\n", test->name, status,
+              test->reentryStatus);
+      ok = FALSE;
+   }
+
+   for (;;) {
+      ssize_t n = recv(fds[1], got + gotLen, sizeof got - gotLen,
+                       MSG_DONTWAIT);
+
+      if (n <= 0) {
+         break;
+      }
+      gotLen += n;
+   }
+
+   if (gotLen != expectedLen || memcmp(got, expected, gotLen) != 0) {
+      fprintf(stderr, "%s: peer got %"FMTSZ"u bytes, expected %"FMTSZ"u.\n",
+              test->name, gotLen, expectedLen);
+      ok = FALSE;
+   }
+   if (test->numDone != NUM_BUFS) {
+      fprintf(stderr, "%s: %d send callbacks, expected %d.\n", test->name,
+              test->numDone, NUM_BUFS);
+      ok = FALSE;
+   }
+   for (i = 0; i < NUM_BUFS && i < test->numDone; i++) {
+      if (test->numSent[i] != 1 || test->order[i] != i) {
+         fprintf(stderr, "%s: buffer %d completed %d times, in position "
+                 "%d.\n", test->name, i, test->numSent[i], test->order[i]);
+         ok = FALSE;
+      }
+   }
+
+exit:
+   AsyncSocket_Close(test->asock);
+   close(fds[1]);
+
+   printf("%-20s %s\n", test->name, ok ? "passed" : "FAILED");
+   return ok;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    Usage: asyncSocketReentry
+ *
+ * Results:
+ *    EXIT_SUCCESS if every scenario passed, EXIT_FAILURE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   ReentryTest flushTest = { "flush in callback", REENTER_FLUSH };
+   ReentryTest doOneMsgTest = { "doonemsg in callback", REENTER_DOONEMSG };
+   Bool ok;
+
+   Poll_InitGtk();
+
+   ok = RunTest(&flushTest);
+   ok = RunTest(&doOneMsgTest) && ok;
+
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,295 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * codeSetBench.c --
+ *
+ *   Benchmark for CodeSet_GenericToGenericDb().  Converts ASCII and mixed
+ *   text among UTF-8, UTF-16LE and US-ASCII, once with the native paths
+ *   and once with them disabled so that the conversion goes through ICU
+ *   (or iconv when built without ICU), checks that both give the same
+ *   result and reports the time per conversion and the throughput of each.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "codeset.h"
+#include "dynbuf.h"
+
+#define DEFAULT_SECONDS         0.25
+
+#if defined(NO_ICU)
+#define GENERIC_PATH            "iconv"
+#else
+#define GENERIC_PATH            "ICU"
+#endif
+
+/* A short string, as in a file name, and a large one, as in a clipboard. */
+static const size_t textSizes[] = { 32, 64 * 1024 };
+
+typedef struct BenchCase {
+   const char *name;
+   const char *codeIn;
+   const char *codeOut;
+   Bool ascii;          // ASCII input rather than mixed text.
+} BenchCase;
+
+static const BenchCase benchCases[] = {
+   { "ascii",   "UTF-8",    "UTF-16LE", TRUE },
+   { "ascii",   "UTF-16LE", "UTF-8",    TRUE },
+   { "ascii",   "US-ASCII", "UTF-16LE", TRUE },
+   { "ascii",   "UTF-16LE", "US-ASCII", TRUE },
+   { "ascii",   "UTF-8",    "US-ASCII", TRUE },
+   { "mixed",   "UTF-8",    "UTF-16LE", FALSE },
+   { "mixed",   "UTF-16LE", "UTF-8",    FALSE },
+};
+
+/* Latin-1, Greek, CJK and a supplementary character, in UTF-8. */
+static const char mixedText[] =
+   "File n\xc3\xa4me \xce\xb1\xce\xb2\xce\xb3 "
+   "\xe6\x96\x87\xe4\xbb\xb6 \xf0\x9f\x98\x80 ";
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Now --
+ *
+ *    Current time in seconds.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Now(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * MakeText --
+ *
+ *    Build about 'size' bytes of UTF-8 text, ASCII or mixed, without
+ *    splitting a character.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+MakeText(Bool ascii,     // IN
+         size_t size,    // IN
+         DynBuf *text)   // OUT
+{
+   static const char asciiText[] = "The quick brown fox jumps over it. ";
+   const char *unit = ascii ? asciiText : mixedText;
+   size_t unitSize = strlen(unit);
+
+   DynBuf_Init(text);
+   while (DynBuf_GetSize(text) + unitSize <= size) {
+      DynBuf_Append(text, unit, unitSize);
+   }
+   if (DynBuf_GetSize(text) == 0) {
+      DynBuf_Append(text, unit, MIN(size, strlen(asciiText)));
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Time --
+ *
+ *    Convert 'in' repeatedly for about 'seconds'.
+ *
+ * Results:
+ *    Seconds per conversion, allocation of the output included, or a
+ *    negative value if the conversion failed. 'out' holds the result of
+ *    the last conversion.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Time(const BenchCase *bc,   // IN
+     const DynBuf *in,      // IN
+     double seconds,        // IN
+     DynBuf *out)           // OUT
+{
+   uint64 iterations = 0;
+   uint64 batch = 1;
+   double start = Now();
+   double elapsed;
+
+   do {
+      uint64 i;
+
+      for (i = 0; i < batch; i++) {
+         /*
+          * A fresh buffer each time, as in CodeSet_GenericToGeneric: the
+          * iconv path enlarges the buffer it is given on every call.
+          */
+         DynBuf_Destroy(out);
+         DynBuf_Init(out);
+         if (!CodeSet_GenericToGenericDb(bc->codeIn, DynBuf_Get(in),
+                                         DynBuf_GetSize(in), bc->codeOut,
+                                         CSGTG_NORMAL, out)) {
+            return -1;
+         }
+      }
+      iterations += batch;
+      batch *= 2;
+      elapsed = Now() - start;
+   } while (elapsed < seconds);
+
+   return elapsed / iterations;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *    Time a conversion with and without the native paths and print a line
+ *    of results.
+ *
+ * Results:
+ *    TRUE if both paths succeeded and agreed.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchRun(const BenchCase *bc,   // IN
+         size_t size,           // IN
+         double seconds)        // IN
+{
+   DynBuf text;
+   DynBuf in;
+   DynBuf fastOut;
+   DynBuf genericOut;
+   double fast;
+   double generic;
+   Bool ok = FALSE;
+
+   DynBuf_Init(&in);
+   DynBuf_Init(&fastOut);
+   DynBuf_Init(&genericOut);
+   MakeText(bc->ascii, size, &text);
+
+   /* The benchmark text is UTF-8; get it into the input encoding. */
+   CodeSet_SetFastPath(TRUE);
+   if (!CodeSet_GenericToGenericDb("UTF-8", DynBuf_Get(&text),
+                                   DynBuf_GetSize(&text), bc->codeIn,
+                                   CSGTG_NORMAL, &in)) {
+      fprintf(stderr, "Can't convert the %s text to %s.\n", bc->name,
+              bc->codeIn);
+      goto exit;
+   }
+
+   fast = Time(bc, &in, seconds, &fastOut);
+   CodeSet_SetFastPath(FALSE);
+   generic = Time(bc, &in, seconds, &genericOut);
+   CodeSet_SetFastPath(TRUE);
+
+   if (fast < 0 || generic < 0) {
+      fprintf(stderr, "%s %s -> %s: conversion failed.\n", bc->name,
+              bc->codeIn, bc->codeOut);
+      goto exit;
+   }
+   if (DynBuf_GetSize(&fastOut) != DynBuf_GetSize(&genericOut) ||
+       memcmp(DynBuf_Get(&fastOut), DynBuf_Get(&genericOut),
+              DynBuf_GetSize(&fastOut)) != 0) {
+      fprintf(stderr, "%s %s -> %s: the paths disagree.\n", bc->name,
+              bc->codeIn, bc->codeOut);
+      goto exit;
+   }
+
+   printf("%-6s %-8s %-8s %7"FMTSZ"u %10.0f %10.0f %11.1f %11.1f %7.1fx\n",
+          bc->name, bc->codeIn, bc->codeOut, DynBuf_GetSize(&in),
+          fast * 1e9, generic * 1e9,
+          DynBuf_GetSize(&in) / fast / 1e6,
+          DynBuf_GetSize(&in) / generic / 1e6, generic / fast);
+   ok = TRUE;
+
+exit:
+   DynBuf_Destroy(&text);
+   DynBuf_Destroy(&in);
+   DynBuf_Destroy(&fastOut);
+   DynBuf_Destroy(&genericOut);
+   return ok;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    Usage: codeSetBench [seconds per measurement]
+ *
+ * Results:
+ *    EXIT_SUCCESS and EXIT_FAILURE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   double seconds = DEFAULT_SECONDS;
+   Bool ok = TRUE;
+   unsigned int i;
+   unsigned int j;
+
+   if (argc > 2 || (argc == 2 && (seconds = atof(argv[1])) <= 0)) {
+      fprintf(stderr, "Usage: %s [seconds per measurement]\n", argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   if (!CodeSet_Init(NULL)) {
+      fprintf(stderr, "CodeSet_Init failed.\n");
+      return EXIT_FAILURE;
+   }
+
+   printf("%-6s %-8s %-8s %7s %10s %10s %11s %11s %8s\n", "text", "from",
+          "to", "bytes", "native/ns", GENERIC_PATH "/ns", "native MB/s",
+          GENERIC_PATH " MB/s", "speedup");
+
+   for (i = 0; i < ARRAYSIZE(textSizes); i++) {
+      for (j = 0; j < ARRAYSIZE(benchCases); j++) {
+         ok = BenchRun(&benchCases[j], textSizes[i], seconds) && ok;
+      }
+   }
+
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,336 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * dataMapBench.c --
+ *
+ *   Benchmark for the DataMap encodings, using the packets the guest
+ *   RabbitMQ proxy exchanges with VMX: connect and close requests, and data
+ *   packets with payloads of various sizes.  Each packet is encoded with
+ *   DataMap_Serialize() and with DataMapWriter, and decoded with
+ *   DataMap_Deserialize() and with DataMapView, and the time per packet is
+ *   reported for each.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "vm_basic_types.h"
+#include "dataMap.h"
+#include "rabbitmqProxyConst.h"
+
+#define DEFAULT_ITERATIONS      200000
+#define PROXY_VERSION           "1.0"
+#define VC_UUID                 "52 8e 3a 4f 1c 2d 9b 70-a1 b2 c3 d4 e5 f6 07 18"
+
+typedef struct Packet {
+   const char *name;
+   int64 command;
+   int32 payloadLen;          /* -1: no payload field */
+} Packet;
+
+static const Packet packets[] = {
+   { "connect",    COMMAND_CONNECT, -1 },
+   { "close",      COMMAND_CLOSE,   -1 },
+   { "data 0",     COMMAND_DATA,    0 },
+   { "data 64",    COMMAND_DATA,    64 },
+   { "data 1K",    COMMAND_DATA,    1024 },
+   { "data 16K",   COMMAND_DATA,    16 * 1024 },
+   { "data 64K",   COMMAND_DATA,    64 * 1024 },
+};
+
+static char *payload;
+static volatile int64 sink;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Now --
+ *
+ *    Current time in seconds.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Now(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * EncodeMap --
+ *
+ *    Encode a packet by building a DataMap and serializing it.
+ *
+ * Results:
+ *    The malloc'ed packet, its length in *len.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static char *
+EncodeMap(const Packet *pkt,    // IN
+          uint32 *len)          // OUT
+{
+   DataMap map;
+   char *buf = NULL;
+   char *str;
+
+   DataMap_Create(&map);
+   DataMap_SetInt64(&map, RMQPROXYDM_FLD_COMMAND, pkt->command, TRUE);
+   str = strdup(PROXY_VERSION);
+   DataMap_SetString(&map, RMQPROXYDM_FLD_GUEST_VER_ID, str, -1, TRUE);
+   if (pkt->command == COMMAND_CONNECT) {
+      str = strdup(VC_UUID);
+      DataMap_SetString(&map, RMQPROXYDM_FLD_VC_UUID, str, -1, TRUE);
+   }
+   if (pkt->payloadLen >= 0) {
+      str = malloc(pkt->payloadLen);
+      memcpy(str, payload, pkt->payloadLen);
+      DataMap_SetString(&map, RMQPROXYDM_FLD_PAYLOAD, str, pkt->payloadLen,
+                        TRUE);
+   }
+   if (DataMap_Serialize(&map, &buf, len) != DMERR_SUCCESS) {
+      fprintf(stderr, "DataMap_Serialize failed\n");
+      exit(EXIT_FAILURE);
+   }
+   DataMap_Destroy(&map);
+
+   return buf;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * EncodeWriter --
+ *
+ *    Encode a packet into 'buf' with DataMapWriter.
+ *
+ * Results:
+ *    The packet length.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static uint32
+EncodeWriter(const Packet *pkt,    // IN
+             char *buf,            // OUT
+             uint32 bufLen)        // IN
+{
+   DataMapWriter writer;
+   uint32 len;
+
+   DataMapWriter_Init(&writer, buf, bufLen);
+   DataMapWriter_PutInt64(&writer, RMQPROXYDM_FLD_COMMAND, pkt->command);
+   DataMapWriter_PutString(&writer, RMQPROXYDM_FLD_GUEST_VER_ID,
+                           PROXY_VERSION, -1);
+   if (pkt->command == COMMAND_CONNECT) {
+      DataMapWriter_PutString(&writer, RMQPROXYDM_FLD_VC_UUID, VC_UUID, -1);
+   }
+   if (pkt->payloadLen >= 0) {
+      DataMapWriter_PutString(&writer, RMQPROXYDM_FLD_PAYLOAD, payload,
+                              pkt->payloadLen);
+   }
+   if (DataMapWriter_Finish(&writer, &len) != DMERR_SUCCESS) {
+      fprintf(stderr, "DataMapWriter_Finish failed\n");
+      exit(EXIT_FAILURE);
+   }
+
+   return len;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DecodeMap --
+ *
+ *    Decode a packet with DataMap_Deserialize() and read its fields.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+DecodeMap(const char *buf,    // IN
+          uint32 len)         // IN
+{
+   DataMap map;
+   int64 command;
+   char *str;
+   int32 strLen;
+
+   if (DataMap_Deserialize(buf, len, &map) != DMERR_SUCCESS ||
+       DataMap_GetInt64(&map, RMQPROXYDM_FLD_COMMAND, &command) !=
+          DMERR_SUCCESS) {
+      fprintf(stderr, "DataMap_Deserialize failed\n");
+      exit(EXIT_FAILURE);
+   }
+   if (DataMap_GetString(&map, RMQPROXYDM_FLD_PAYLOAD, &str,
+                         &strLen) == DMERR_SUCCESS && strLen > 0) {
+      sink += str[strLen - 1];
+   }
+   sink += command;
+   DataMap_Destroy(&map);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * DecodeView --
+ *
+ *    Decode a packet with DataMapView and read its fields.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+DecodeView(const char *buf,    // IN
+           uint32 len)         // IN
+{
+   DataMapView view;
+   int64 command;
+   const char *str;
+   int32 strLen;
+
+   if (DataMapView_Init(&view, buf, len) != DMERR_SUCCESS ||
+       DataMapView_GetInt64(&view, RMQPROXYDM_FLD_COMMAND, &command) !=
+          DMERR_SUCCESS) {
+      fprintf(stderr, "DataMapView_Init failed\n");
+      exit(EXIT_FAILURE);
+   }
+   if (DataMapView_GetString(&view, RMQPROXYDM_FLD_PAYLOAD, &str,
+                             &strLen) == DMERR_SUCCESS && strLen > 0) {
+      sink += str[strLen - 1];
+   }
+   sink += command;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    Usage: dataMapBench [iterations]
+ *
+ *    Runs every packet kind through both encoders and both decoders, and
+ *    reports ns per packet.
+ *
+ * Results:
+ *    EXIT_SUCCESS and EXIT_FAILURE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+   uint32 bufLen = 128 * 1024;
+   char *buf;
+   unsigned int i;
+   int n;
+
+   if (iterations <= 0) {
+      fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   payload = malloc(bufLen);
+   buf = malloc(bufLen);
+   if (payload == NULL || buf == NULL) {
+      return EXIT_FAILURE;
+   }
+   memset(payload, 'x', bufLen);
+
+   printf("%-10s %12s %12s %12s %12s  (ns/packet)\n", "packet",
+          "serialize", "writer", "deserialize", "view");
+
+   for (i = 0; i < ARRAYSIZE(packets); i++) {
+      const Packet *pkt = &packets[i];
+      double start;
+      double encMap;
+      double encWriter;
+      double decMap;
+      double decView;
+      char *mapBuf;
+      uint32 mapLen;
+      uint32 len;
+
+      /* both encodings must decode to the same packet */
+      mapBuf = EncodeMap(pkt, &mapLen);
+      len = EncodeWriter(pkt, buf, bufLen);
+      if (len != mapLen) {
+         fprintf(stderr, "%s: serialized %u bytes, writer %u bytes\n",
+                 pkt->name, mapLen, len);
+         return EXIT_FAILURE;
+      }
+      DecodeMap(buf, len);
+      DecodeView(mapBuf, mapLen);
+      free(mapBuf);
+
+      start = Now();
+      for (n = 0; n < iterations; n++) {
+         free(EncodeMap(pkt, &mapLen));
+      }
+      encMap = Now() - start;
+
+      start = Now();
+      for (n = 0; n < iterations; n++) {
+         sink += EncodeWriter(pkt, buf, bufLen);
+      }
+      encWriter = Now() - start;
+
+      start = Now();
+      for (n = 0; n < iterations; n++) {
+         DecodeMap(buf, len);
+      }
+      decMap = Now() - start;
+
+      start = Now();
+      for (n = 0; n < iterations; n++) {
+         DecodeView(buf, len);
+      }
+      decView = Now() - start;
+
+      printf("%-10s %12.0f %12.0f %12.0f %12.0f\n", pkt->name,
+             encMap * 1e9 / iterations, encWriter * 1e9 / iterations,
+             decMap * 1e9 / iterations, decView * 1e9 / iterations);
+   }
+
+   free(buf);
+   free(payload);
+
+   return EXIT_SUCCESS;
+}
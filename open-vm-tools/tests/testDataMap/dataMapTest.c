@@ -0,0 +1,632 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * dataMapTest.c --
+ *
+ *   Checks that DataMapView decodes exactly what DataMap_Deserialize()
+ *   does.  The view parses packets VMX sends to the guest RabbitMQ proxy,
+ *   so it must accept and reject the same buffers and return the same
+ *   values.  Every buffer is decoded both ways and compared:
+ *
+ *   - maps with every field type, and the proxy packets;
+ *   - every truncation of those;
+ *   - maps around DATAMAP_VIEW_MAX_FIELDS, where the view gives up with
+ *     DMERR_BUFFER_TOO_SMALL and callers fall back to DataMap_Deserialize();
+ *   - random buffers, and random corruptions of valid maps.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "vm_basic_types.h"
+#include "dataMap.h"
+#include "rabbitmqProxyConst.h"
+
+#define DEFAULT_ITERATIONS      200000
+#define FUZZ_MAX_LEN            256
+
+typedef struct Stats {
+   uint32 accepted;
+   uint32 rejected;
+   uint32 fallback;
+} Stats;
+
+static uint32 seed = 1;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Random --
+ *
+ *    Deterministic pseudo random numbers, so that a failure can be
+ *    reproduced on any platform.
+ *
+ * Results:
+ *    A number in [0, 2^31).
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static uint32
+Random(void)
+{
+   seed = seed * 1103515245 + 12345;
+   return (seed >> 1) & 0x7fffffff;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CompareField --
+ *
+ *    Compare one field of a view with the same field of a map.
+ *
+ * Results:
+ *    TRUE if they hold the same value.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+CompareField(const DataMapView *view,    // IN
+             const DataMap *map,         // IN
+             DMKeyType fieldId)          // IN
+{
+   DMFieldType type = DataMapView_GetType(view, fieldId);
+   Bool ok = FALSE;
+
+   if (type != DataMap_GetType(map, fieldId)) {
+      return FALSE;
+   }
+
+   switch (type) {
+   case DMFIELDTYPE_INT64:
+      {
+         int64 v1;
+         int64 v2;
+
+         ok = DataMapView_GetInt64(view, fieldId, &v1) == DMERR_SUCCESS &&
+              DataMap_GetInt64(map, fieldId, &v2) == DMERR_SUCCESS &&
+              v1 == v2;
+         break;
+      }
+   case DMFIELDTYPE_STRING:
+      {
+         const char *s1;
+         char *s2;
+         int32 len1;
+         int32 len2;
+
+         ok = DataMapView_GetString(view, fieldId, &s1,
+                                    &len1) == DMERR_SUCCESS &&
+              DataMap_GetString(map, fieldId, &s2, &len2) == DMERR_SUCCESS &&
+              len1 == len2 && memcmp(s1, s2, len1) == 0;
+         break;
+      }
+   case DMFIELDTYPE_INT64LIST:
+      {
+         int64 *l1;
+         int64 *l2;
+         int32 len1 = 0;
+         int32 len2;
+
+         /* the first call only gets the length */
+         DataMapView_GetInt64List(view, fieldId, NULL, &len1);
+         l1 = malloc((len1 + 1) * sizeof *l1);
+         ok = l1 != NULL &&
+              DataMapView_GetInt64List(view, fieldId, l1,
+                                       &len1) == DMERR_SUCCESS &&
+              DataMap_GetInt64List(map, fieldId, &l2,
+                                   &len2) == DMERR_SUCCESS &&
+              len1 == len2 && memcmp(l1, l2, len1 * sizeof *l1) == 0;
+         free(l1);
+         break;
+      }
+   case DMFIELDTYPE_STRINGLIST:
+      {
+         const char **l1;
+         int32 *lens1;
+         char **l2;
+         int32 *lens2;
+         int32 len1 = 0;
+         int32 i;
+
+         DataMapView_GetStringList(view, fieldId, NULL, NULL, &len1);
+         l1 = malloc((len1 + 1) * sizeof *l1);
+         lens1 = malloc((len1 + 1) * sizeof *lens1);
+         ok = l1 != NULL && lens1 != NULL &&
+              DataMapView_GetStringList(view, fieldId, l1, lens1,
+                                        &len1) == DMERR_SUCCESS &&
+              DataMap_GetStringList(map, fieldId, &l2,
+                                    &lens2) == DMERR_SUCCESS;
+         /* the map's list is NULL terminated */
+         for (i = 0; ok && i < len1; i++) {
+            ok = l2[i] != NULL && lens1[i] == lens2[i] &&
+                 memcmp(l1[i], l2[i], lens1[i]) == 0;
+         }
+         ok = ok && l2[len1] == NULL;
+         free(l1);
+         free(lens1);
+         break;
+      }
+   default:
+      break;
+   }
+
+   return ok;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Check --
+ *
+ *    Decode buf with DataMapView and with DataMap_Deserialize(), and make
+ *    sure both agree.  A view that runs out of fields is not compared:
+ *    callers fall back to DataMap_Deserialize() then.
+ *
+ * Results:
+ *    TRUE if they agree, FALSE otherwise.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+Check(const char *name,     // IN
+      const char *buf,      // IN
+      int32 len,            // IN
+      Stats *stats)         // IN/OUT
+{
+   DataMapView view;
+   DataMapView again;
+   DataMap map;
+   ErrorCode viewRes;
+   ErrorCode mapRes;
+   char *serBuf = NULL;
+   uint32 serLen;
+   Bool ok = TRUE;
+   int32 i;
+
+   viewRes = DataMapView_Init(&view, buf, len);
+   mapRes = DataMap_Deserialize(buf, len, &map);
+
+   if (viewRes == DMERR_BUFFER_TOO_SMALL) {
+      stats->fallback++;
+      if (mapRes == DMERR_SUCCESS) {
+         DataMap_Destroy(&map);
+      }
+      return TRUE;
+   }
+
+   if ((viewRes == DMERR_SUCCESS) != (mapRes == DMERR_SUCCESS)) {
+      fprintf(stderr, "%s: %d bytes: view returned %d, "
+              "DataMap_Deserialize %d\n", name, len, viewRes, mapRes);
+      if (mapRes == DMERR_SUCCESS) {
+         DataMap_Destroy(&map);
+      }
+      return FALSE;
+   }
+
+   if (viewRes != DMERR_SUCCESS) {
+      stats->rejected++;
+      return TRUE;
+   }
+   stats->accepted++;
+
+   for (i = 0; ok && i < view.numFields; i++) {
+      ok = CompareField(&view, &map, view.fields[i].fieldId);
+      if (!ok) {
+         fprintf(stderr, "%s: %d bytes: field %d differs\n", name, len,
+                 view.fields[i].fieldId);
+      }
+   }
+
+   /* the map has no other field: it serializes to as many */
+   if (ok &&
+       (DataMap_Serialize(&map, &serBuf, &serLen) != DMERR_SUCCESS ||
+        DataMapView_Init(&again, serBuf, serLen) != DMERR_SUCCESS ||
+        again.numFields != view.numFields)) {
+      fprintf(stderr, "%s: %d bytes: the map has other fields than the "
+              "view\n", name, len);
+      ok = FALSE;
+   }
+
+   free(serBuf);
+   DataMap_Destroy(&map);
+   return ok;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CheckTruncations --
+ *
+ *    Check buf and every truncation of it, once keeping the encoded
+ *    length and once fixing it up to match, so the decoders see both a
+ *    short buffer and a map that ends in the middle of a field.
+ *
+ * Results:
+ *    TRUE if the decoders agree on all of them.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+CheckTruncations(const char *name,     // IN
+                 const char *buf,      // IN
+                 uint32 len,           // IN
+                 Stats *stats)         // IN/OUT
+{
+   char *copy = malloc(len);
+   uint32 n;
+   Bool ok = copy != NULL;
+
+   for (n = 0; ok && n <= len; n++) {
+      memcpy(copy, buf, n);
+      ok = Check(name, copy, n, stats);
+      if (ok && n >= sizeof(int32)) {
+         uint32 contentLen = n - sizeof(int32);
+
+         copy[0] = (char)(contentLen >> 24);
+         copy[1] = (char)(contentLen >> 16);
+         copy[2] = (char)(contentLen >> 8);
+         copy[3] = (char)contentLen;
+         ok = Check(name, copy, n, stats);
+      }
+   }
+
+   free(copy);
+   return ok;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BuildAllTypes --
+ *
+ *    Serialize a map with every field type, empty values included.
+ *
+ * Results:
+ *    The malloc'ed map, its length in *len.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static char *
+BuildAllTypes(uint32 *len)     // OUT
+{
+   static const int64 nums[] = { 0, -1, MAX_INT64, MIN_INT64, 1 << 20 };
+   static const char *strs[] = { "first", "", "third" };
+   char *buf = NULL;
+   DataMap map;
+   ErrorCode res;
+   int64 *numList;
+   char **strList;
+   int32 *strLens;
+   unsigned int i;
+
+   /* the map takes ownership of the values */
+   DataMap_Create(&map);
+   res = DataMap_SetInt64(&map, 1, -42, TRUE);
+   if (res == DMERR_SUCCESS) {
+      res = DataMap_SetString(&map, 2, strdup("hello"), -1, TRUE);
+   }
+   if (res == DMERR_SUCCESS) {
+      res = DataMap_SetString(&map, 3, strdup(""), 0, TRUE);
+   }
+   if (res == DMERR_SUCCESS) {
+      numList = malloc(sizeof nums);
+      memcpy(numList, nums, sizeof nums);
+      res = DataMap_SetInt64List(&map, 4, numList, ARRAYSIZE(nums), TRUE);
+   }
+   if (res == DMERR_SUCCESS) {
+      res = DataMap_SetInt64List(&map, 5, malloc(sizeof *numList), 0, TRUE);
+   }
+   if (res == DMERR_SUCCESS) {
+      strList = calloc(ARRAYSIZE(strs) + 1, sizeof *strList);
+      strLens = calloc(ARRAYSIZE(strs), sizeof *strLens);
+      for (i = 0; i < ARRAYSIZE(strs); i++) {
+         strList[i] = strdup(strs[i]);
+         strLens[i] = strlen(strs[i]);
+      }
+      res = DataMap_SetStringList(&map, 6, strList, strLens, TRUE);
+   }
+   if (res == DMERR_SUCCESS) {
+      strList = calloc(1, sizeof *strList);
+      strLens = calloc(1, sizeof *strLens);
+      res = DataMap_SetStringList(&map, 7, strList, strLens, TRUE);
+   }
+   if (res == DMERR_SUCCESS) {
+      res = DataMap_Serialize(&map, &buf, len);
+   }
+   DataMap_Destroy(&map);
+
+   return res == DMERR_SUCCESS ? buf : NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BuildProxyPacket --
+ *
+ *    Encode a packet like the ones VMX sends to the RabbitMQ proxy.
+ *
+ * Results:
+ *    The packet length, 0 on failure.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static uint32
+BuildProxyPacket(int64 command,       // IN
+                 int32 payloadLen,    // IN: -1 for no payload
+                 char *buf,           // OUT
+                 uint32 bufLen)       // IN
+{
+   DataMapWriter writer;
+   char *payload;
+   uint32 len;
+
+   DataMapWriter_Init(&writer, buf, bufLen);
+   DataMapWriter_PutInt64(&writer, RMQPROXYDM_FLD_COMMAND, command);
+   DataMapWriter_PutString(&writer, RMQPROXYDM_FLD_GUEST_VER_ID, "1.0", -1);
+   if (payloadLen >= 0 &&
+       DataMapWriter_ReserveString(&writer, RMQPROXYDM_FLD_PAYLOAD,
+                                   payloadLen, &payload) == DMERR_SUCCESS) {
+      memset(payload, 'p', payloadLen);
+   }
+   if (DataMapWriter_Finish(&writer, &len) != DMERR_SUCCESS) {
+      return 0;
+   }
+
+   return len;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BuildFields --
+ *
+ *    Encode a map with numFields int64 fields.
+ *
+ * Results:
+ *    The map length, 0 on failure.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static uint32
+BuildFields(int32 numFields,    // IN
+            char *buf,          // OUT
+            uint32 bufLen)      // IN
+{
+   DataMapWriter writer;
+   uint32 len;
+   int32 i;
+
+   DataMapWriter_Init(&writer, buf, bufLen);
+   for (i = 0; i < numFields; i++) {
+      DataMapWriter_PutInt64(&writer, i + 1, i);
+   }
+   if (DataMapWriter_Finish(&writer, &len) != DMERR_SUCCESS) {
+      return 0;
+   }
+
+   return len;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestFieldLimit --
+ *
+ *    A view holds DATAMAP_VIEW_MAX_FIELDS fields.  One more and it returns
+ *    DMERR_BUFFER_TOO_SMALL, while DataMap_Deserialize() still decodes the
+ *    map.
+ *
+ * Results:
+ *    TRUE on success.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+TestFieldLimit(Stats *stats)     // IN/OUT
+{
+   char buf[1024];
+   DataMapView view;
+   DataMap map;
+   int64 value;
+   uint32 len;
+
+   len = BuildFields(DATAMAP_VIEW_MAX_FIELDS, buf, sizeof buf);
+   if (len == 0 || !Check("max fields", buf, len, stats) ||
+       DataMapView_Init(&view, buf, len) != DMERR_SUCCESS) {
+      fprintf(stderr, "max fields: the view did not take the map\n");
+      return FALSE;
+   }
+
+   len = BuildFields(DATAMAP_VIEW_MAX_FIELDS + 1, buf, sizeof buf);
+   if (len == 0 ||
+       DataMapView_Init(&view, buf, len) != DMERR_BUFFER_TOO_SMALL) {
+      fprintf(stderr, "too many fields: the view took the map\n");
+      return FALSE;
+   }
+   if (DataMap_Deserialize(buf, len, &map) != DMERR_SUCCESS) {
+      fprintf(stderr, "too many fields: DataMap_Deserialize failed\n");
+      return FALSE;
+   }
+   if (DataMap_GetInt64(&map, DATAMAP_VIEW_MAX_FIELDS + 1,
+                        &value) != DMERR_SUCCESS ||
+       value != DATAMAP_VIEW_MAX_FIELDS) {
+      fprintf(stderr, "too many fields: the last field is wrong\n");
+      DataMap_Destroy(&map);
+      return FALSE;
+   }
+   DataMap_Destroy(&map);
+
+   return CheckTruncations("too many fields", buf, len, stats);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Fuzz --
+ *
+ *    Check random buffers: half are random bytes, mostly small values so
+ *    that types and lengths are plausible, and half are valid maps with a
+ *    few bytes changed.
+ *
+ * Results:
+ *    TRUE if the decoders agree on all of them.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+Fuzz(const char *valid,      // IN: a valid map to corrupt
+     uint32 validLen,        // IN
+     int iterations,         // IN
+     Stats *stats)           // IN/OUT
+{
+   char buf[FUZZ_MAX_LEN];
+   int n;
+
+   for (n = 0; n < iterations; n++) {
+      uint32 len;
+      uint32 i;
+
+      if (n % 2 == 0) {
+         len = Random() % FUZZ_MAX_LEN;
+         for (i = 0; i < len; i++) {
+            buf[i] = Random() % 4 == 0 ? Random() : Random() % 3;
+         }
+         if (len >= sizeof(int32)) {
+            /* a length that matches, most of the time */
+            uint32 contentLen = len - sizeof(int32) -
+                                (Random() % 8 == 0 ? Random() % 8 : 0);
+
+            buf[0] = (char)(contentLen >> 24);
+            buf[1] = (char)(contentLen >> 16);
+            buf[2] = (char)(contentLen >> 8);
+            buf[3] = (char)contentLen;
+         }
+      } else {
+         uint32 changes = 1 + Random() % 4;
+
+         len = MIN(validLen, sizeof buf);
+         memcpy(buf, valid, len);
+         for (i = 0; i < changes; i++) {
+            uint32 pos = sizeof(int32) + Random() % (len - sizeof(int32));
+
+            buf[pos] = Random() % 2 ? Random() : buf[pos] + 1;
+         }
+      }
+
+      if (!Check("fuzz", buf, len, stats)) {
+         fprintf(stderr, "fuzz: iteration %d failed\n", n);
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    Usage: dataMapTest [fuzz iterations]
+ *
+ * Results:
+ *    EXIT_SUCCESS if DataMapView and DataMap_Deserialize() agreed on every
+ *    buffer, EXIT_FAILURE otherwise.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   static const struct {
+      const char *name;
+      int64 command;
+      int32 payloadLen;
+   } proxyPackets[] = {
+      { "connect",    COMMAND_CONNECT, -1 },
+      { "close",      COMMAND_CLOSE,   -1 },
+      { "data 0",     COMMAND_DATA,    0 },
+      { "data 1",     COMMAND_DATA,    1 },
+      { "data 100",   COMMAND_DATA,    100 },
+   };
+   int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+   Stats stats = { 0, 0, 0 };
+   char packet[1024];
+   char *allTypes;
+   uint32 allTypesLen;
+   unsigned int i;
+   Bool ok;
+
+   if (iterations < 0) {
+      fprintf(stderr, "Usage: %s [fuzz iterations]\n", argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   allTypes = BuildAllTypes(&allTypesLen);
+   if (allTypes == NULL) {
+      fprintf(stderr, "could not build the map\n");
+      return EXIT_FAILURE;
+   }
+
+   ok = CheckTruncations("all types", allTypes, allTypesLen, &stats);
+   for (i = 0; ok && i < ARRAYSIZE(proxyPackets); i++) {
+      uint32 len = BuildProxyPacket(proxyPackets[i].command,
+                                    proxyPackets[i].payloadLen,
+                                    packet, sizeof packet);
+
+      ok = len > 0 &&
+           CheckTruncations(proxyPackets[i].name, packet, len, &stats);
+   }
+   ok = ok && TestFieldLimit(&stats);
+   ok = ok && Fuzz(allTypes, allTypesLen, iterations, &stats);
+
+   free(allTypes);
+
+   printf("%s: %u accepted, %u rejected, %u too many fields for a view\n",
+          ok ? "PASS" : "FAIL", stats.accepted, stats.rejected,
+          stats.fallback);
+
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
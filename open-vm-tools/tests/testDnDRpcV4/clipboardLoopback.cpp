@@ -0,0 +1,460 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @clipboardLoopback.cpp --
+ *
+ * Test for big clipboards over DnD/CP version 4. A clipboard with a small
+ * text item and a big image is sent from a host end to a guest end of an
+ * in-memory link. With DND_CP_CAP_LARGE_CLIPBOARD negotiated, the image must
+ * arrive intact even though it is bigger than DND_CP_MSG_MAX_BINARY_SIZE_V4,
+ * and the resident set of the process must not grow by more than
+ * MAX_RSS_GROWTH while it is sent and received. Without the capability the
+ * image must be dropped and the text must still arrive.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "loopbackTransport.hpp"
+#include "rpcV4Util.hpp"
+
+extern "C" {
+   #include "dndClipboard.h"
+}
+
+#define DEFAULT_IMAGE_MB         64
+#define MAX_RSS_GROWTH           (8 << 20)
+#define TEST_SESSION_ID          42
+#define TEST_TEXT                "big clipboard test"
+
+static size_t peakRss;
+
+
+/**
+ * Current time in seconds.
+ */
+
+static double
+Now(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+/**
+ * Current resident set size of the process.
+ *
+ * @return the size in bytes, or 0 if it cannot be read.
+ */
+
+static size_t
+GetRss(void)
+{
+   FILE *f = fopen("/proc/self/statm", "r");
+   unsigned long size;
+   unsigned long resident = 0;
+
+   if (f) {
+      if (fscanf(f, "%lu %lu", &size, &resident) != 2) {
+         resident = 0;
+      }
+      fclose(f);
+   }
+   return resident * sysconf(_SC_PAGESIZE);
+}
+
+
+/**
+ * Update peakRss with the current resident set size.
+ */
+
+static void
+SampleRss(void)
+{
+   size_t rss = GetRss();
+
+   if (rss > peakRss) {
+      peakRss = rss;
+   }
+}
+
+
+/**
+ * Byte i of the test image. Differs from packet to packet, so a misplaced
+ * packet does not go unseen.
+ */
+
+static uint8
+ImageByte(size_t i)
+{
+   return (uint8)(i * 7 + (i >> 16));
+}
+
+
+/**
+ * LoopbackTransport that keeps track of the peak resident set size, sampled
+ * every time a packet is sent.
+ */
+
+class RssTransport
+   : public LoopbackTransport
+{
+public:
+   virtual bool SendPacket(uint32 destId,
+                           TransportInterfaceType type,
+                           const uint8 *msg,
+                           size_t length)
+   {
+      SampleRss();
+      return LoopbackTransport::SendPacket(destId, type, msg, length);
+   }
+};
+
+
+/**
+ * Minimal copy paste rpc over a LoopbackTransport that keeps the last
+ * clipboard it received.
+ */
+
+class ClipboardRpc
+   : public RpcBase
+{
+public:
+   ClipboardRpc(LoopbackTransport *transport,
+                uint32 msgSrc);
+   virtual ~ClipboardRpc(void);
+
+   virtual void OnRecvPacket(uint32 srcId,
+                             const uint8 *packet,
+                             size_t packetSize)
+      { mUtil.OnRecvPacket(srcId, packet, packetSize); }
+   virtual bool SendPacket(uint32 destId,
+                           const uint8 *packet,
+                           size_t length)
+      { return mTransport->SendPacket(destId, TRANSPORT_GUEST_CONTROLLER_CP,
+                                      packet, length); }
+   virtual void HandleMsg(RpcParams *params,
+                          const uint8 *binary,
+                          uint32 binarySize);
+   virtual bool HandleMsgFile(RpcParams *params,
+                              int fd,
+                              uint32 binarySize);
+
+   RpcV4Util mUtil;
+   CPClipboard mClip;
+   bool mHaveClip;
+   uint32 mBinarySize;
+   bool mFromFile;
+
+private:
+   LoopbackTransport *mTransport;
+};
+
+
+/**
+ * Constructor.
+ *
+ * @param[in] transport the transport to send and receive through
+ * @param[in] msgSrc source of the messages (host/guest/controller)
+ */
+
+ClipboardRpc::ClipboardRpc(LoopbackTransport *transport,
+                           uint32 msgSrc)
+   : mHaveClip(false),
+     mBinarySize(0),
+     mFromFile(false),
+     mTransport(transport)
+{
+   CPClipboard_Init(&mClip);
+   mUtil.Init(this, DND_CP_MSG_TYPE_CP, msgSrc);
+   mTransport->RegisterRpc(this, TRANSPORT_GUEST_CONTROLLER_CP);
+}
+
+
+/**
+ * Destructor.
+ */
+
+ClipboardRpc::~ClipboardRpc(void)
+{
+   mTransport->UnregisterRpc(TRANSPORT_GUEST_CONTROLLER_CP);
+   CPClipboard_Destroy(&mClip);
+}
+
+
+/**
+ * Unserialize a received clipboard.
+ *
+ * @param[in] params parameter list for the message
+ * @param[in] binary
+ * @param[in] binarySize
+ */
+
+void
+ClipboardRpc::HandleMsg(RpcParams *params,
+                        const uint8 *binary,
+                        uint32 binarySize)
+{
+   if (CP_CMD_RECV_CLIPBOARD != params->cmd) {
+      return;
+   }
+   CPClipboard_Destroy(&mClip);
+   mHaveClip = CPClipboard_Unserialize(&mClip, binary, binarySize);
+   mBinarySize = binarySize;
+   mFromFile = false;
+}
+
+
+/**
+ * Unserialize a received clipboard that was spooled to a file.
+ *
+ * @param[in] params parameter list for the message
+ * @param[in] fd file holding the binary
+ * @param[in] binarySize
+ *
+ * @return true if the message was handled, false otherwise.
+ */
+
+bool
+ClipboardRpc::HandleMsgFile(RpcParams *params,
+                            int fd,
+                            uint32 binarySize)
+{
+   if (CP_CMD_RECV_CLIPBOARD != params->cmd) {
+      return false;
+   }
+   CPClipboard_Destroy(&mClip);
+   mHaveClip = CPClipboard_UnserializeFile(&mClip, fd, binarySize);
+   mBinarySize = binarySize;
+   mFromFile = true;
+   return true;
+}
+
+
+/**
+ * Check that the image item of clip is the test image. A spooled image is
+ * read into memory.
+ *
+ * @param[in/out] clip the clipboard
+ * @param[in] imageSize size of the test image
+ *
+ * @return true if it is, false otherwise.
+ */
+
+static bool
+CheckImage(CPClipboard *clip,
+           size_t imageSize)
+{
+   void *buf;
+   size_t size;
+   size_t i;
+
+   if (!CPClipboard_LoadItem(clip, CPFORMAT_IMG_PNG, &buf, &size) ||
+       size != imageSize) {
+      return false;
+   }
+   for (i = 0; i < size; i++) {
+      if (((uint8 *)buf)[i] != ImageByte(i)) {
+         return false;
+      }
+   }
+   return true;
+}
+
+
+/**
+ * Negotiate caps between a host and a guest end, then send clip from the
+ * host to the guest and print a line of results.
+ *
+ * @param[in] name name of the case
+ * @param[in] caps capabilities both ends advertise
+ * @param[in] clip the clipboard to send
+ * @param[in] imageSize size of the image in clip
+ * @param[in] expectImage whether the image should make it to the guest
+ *
+ * @return true if the guest got what it should, false otherwise.
+ */
+
+static bool
+RunTransfer(const char *name,
+            uint32 caps,
+            const CPClipboard *clip,
+            size_t imageSize,
+            bool expectImage)
+{
+   RssTransport guestTransport;
+   RssTransport hostTransport;
+   ClipboardRpc guest(&guestTransport, DND_CP_MSG_SRC_GUEST);
+   ClipboardRpc host(&hostTransport, DND_CP_MSG_SRC_HOST);
+   RpcParams params;
+   size_t startRss;
+   double start;
+   double elapsed;
+   uint32 packets;
+   void *text;
+   size_t textSize;
+
+   guestTransport.SetPeer(&hostTransport);
+   hostTransport.SetPeer(&guestTransport);
+
+   host.mUtil.SendPingMsg(DEFAULT_CONNECTION_ID, caps);
+   RunLink(&guestTransport, &hostTransport);
+   guest.mUtil.SendPingReplyMsg(DEFAULT_CONNECTION_ID, caps);
+   RunLink(&guestTransport, &hostTransport);
+
+   memset(&params, 0, sizeof params);
+   params.addrId = DEFAULT_CONNECTION_ID;
+   params.cmd = CP_CMD_RECV_CLIPBOARD;
+   params.sessionId = TEST_SESSION_ID;
+
+   startRss = GetRss();
+   peakRss = startRss;
+   start = Now();
+   if (!host.mUtil.SendMsg(&params, clip)) {
+      fprintf(stderr, "%s: SendMsg failed.\n", name);
+      return false;
+   }
+   RunLink(&guestTransport, &hostTransport);
+   elapsed = Now() - start;
+   SampleRss();
+   packets = hostTransport.GetPacketsSent() + guestTransport.GetPacketsSent();
+
+   printf("%-12s %10u %8s %8u %10.1f %14.1f\n", name, guest.mBinarySize,
+          guest.mFromFile ? "file" : "memory", packets,
+          guest.mBinarySize / elapsed / 1e6,
+          (peakRss - startRss) / 1048576.0);
+
+   if (!guest.mHaveClip) {
+      fprintf(stderr, "%s: the guest got no clipboard.\n", name);
+      return false;
+   }
+   if (!CPClipboard_GetItem(&guest.mClip, CPFORMAT_TEXT, &text, &textSize) ||
+       textSize != sizeof TEST_TEXT || memcmp(text, TEST_TEXT, textSize) != 0) {
+      fprintf(stderr, "%s: the text did not arrive.\n", name);
+      return false;
+   }
+   if (!expectImage) {
+      if (CPClipboard_ItemExists(&guest.mClip, CPFORMAT_IMG_PNG) ||
+          guest.mBinarySize > DND_CP_MSG_MAX_BINARY_SIZE_V4) {
+         fprintf(stderr, "%s: the image was not dropped.\n", name);
+         return false;
+      }
+      return true;
+   }
+
+   if (peakRss - startRss > MAX_RSS_GROWTH) {
+      fprintf(stderr, "%s: the resident set grew by %.1f MB.\n", name,
+              (peakRss - startRss) / 1048576.0);
+      return false;
+   }
+   if (CPClipboard_GetHash(&guest.mClip) != CPClipboard_GetHash(clip)) {
+      fprintf(stderr, "%s: the clipboard hashes differ.\n", name);
+      return false;
+   }
+   /* Reads the image into memory, so only after the resident set check. */
+   if (!CheckImage(&guest.mClip, imageSize)) {
+      fprintf(stderr, "%s: the image did not arrive intact.\n", name);
+      return false;
+   }
+   return true;
+}
+
+
+/**
+ * Build a clipboard with TEST_TEXT and a test image of imageSize bytes.
+ *
+ * @param[out] clip the clipboard
+ * @param[in] imageSize
+ *
+ * @return true on success, false otherwise.
+ */
+
+static bool
+MakeClipboard(CPClipboard *clip,
+              size_t imageSize)
+{
+   uint8 *image = (uint8 *)malloc(imageSize);
+   bool ret;
+   size_t i;
+
+   if (!image) {
+      return false;
+   }
+   for (i = 0; i < imageSize; i++) {
+      image[i] = ImageByte(i);
+   }
+   CPClipboard_Init(clip);
+   ret = CPClipboard_SetItem(clip, CPFORMAT_TEXT, TEST_TEXT,
+                             sizeof TEST_TEXT) &&
+         CPClipboard_SetItem(clip, CPFORMAT_IMG_PNG, image, imageSize);
+   free(image);
+   return ret;
+}
+
+
+/**
+ * Usage: clipboardLoopback [image size in MB]
+ *
+ * @return EXIT_SUCCESS if every case passed, EXIT_FAILURE otherwise.
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   uint32 caps = DND_CP_CAP_VALID | DND_CP_CAP_CP | DND_CP_CAP_FORMATS_CP |
+                 DND_CP_CAP_BIG_BUFFER | DND_CP_CAP_WINDOWED_BIG_BUFFER;
+   int imageMB = DEFAULT_IMAGE_MB;
+   size_t imageSize;
+   CPClipboard bigClip;
+   CPClipboard smallClip;
+   bool ok;
+
+   if (argc > 2 ||
+       (argc == 2 && ((imageMB = atoi(argv[1])) <= 4 || imageMB > 512))) {
+      fprintf(stderr, "Usage: %s [image size in MB, 5 to 512]\n", argv[0]);
+      return EXIT_FAILURE;
+   }
+   imageSize = (size_t)imageMB << 20;
+
+   /* Under DND_CP_MSG_MAX_BINARY_SIZE_V4, so any peer can take it. */
+   if (!MakeClipboard(&smallClip, 3 << 20) ||
+       !MakeClipboard(&bigClip, imageSize)) {
+      fprintf(stderr, "Can't build the clipboards.\n");
+      return EXIT_FAILURE;
+   }
+
+   printf("%-12s %10s %8s %8s %10s %14s\n", "case", "bytes", "received",
+          "packets", "MB/s", "RSS growth MB");
+
+   ok = RunTransfer("large", caps | DND_CP_CAP_LARGE_CLIPBOARD, &bigClip,
+                    imageSize, true);
+   ok = RunTransfer("4 MB peer", caps, &bigClip, imageSize, false) && ok;
+   ok = RunTransfer("small", caps, &smallClip, 3 << 20, true) && ok;
+
+   CPClipboard_Destroy(&bigClip);
+   CPClipboard_Destroy(&smallClip);
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
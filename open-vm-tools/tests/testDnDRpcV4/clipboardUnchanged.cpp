@@ -0,0 +1,570 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @clipboardUnchanged.cpp --
+ *
+ * Test for the DND_CP_CAP_CLIPBOARD_HASH short messages. A CopyPasteRpcV4 on
+ * the guest end of an in-memory link talks to a minimal host end. With the
+ * capability negotiated, a clipboard sent twice in a row must go out the
+ * second time as CP_CMD_SEND_CLIPBOARD_UNCHANGED without a binary, and a
+ * CP_CMD_RECV_CLIPBOARD_UNCHANGED from the host must replay the clipboard
+ * the guest last received. Without the capability every clipboard must go
+ * out in full.
+ *
+ * Also tests DND_CP_CAP_CLIPBOARD_COMPRESS: with it, big text and RTF items
+ * must go over the link as zlib streams in both directions and arrive
+ * intact, and a truncated or corrupt stream must be dropped. Without it,
+ * clipboards must go out uncompressed and the format mask is ignored.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "copyPasteRpcV4.hh"
+#include "loopbackTransport.hpp"
+#include "vm_basic_defs.h"
+
+extern "C" {
+   #include "dndClipboard.h"
+}
+
+#define TEST_SESSION_ID          42
+#define TEST_TEXT                "unchanged clipboard test"
+#define TEST_IMAGE_SIZE          (1 << 20)
+#define TEST_BIG_TEXT_SIZE       (2 << 20)
+#define TEST_RTF_SIZE            (256 << 10)
+
+
+/**
+ * A message received by the host end.
+ */
+
+struct HostMsg {
+   uint32 cmd;
+   uint32 status;
+   uint32 binarySize;
+   RpcParams params;
+};
+
+
+/**
+ * Minimal host end of a copy paste link over a LoopbackTransport. Records
+ * every message it receives.
+ */
+
+class HostRpc
+   : public RpcBase
+{
+public:
+   HostRpc(LoopbackTransport *transport);
+   virtual ~HostRpc(void)
+      { mTransport->UnregisterRpc(TRANSPORT_GUEST_CONTROLLER_CP); }
+
+   virtual void OnRecvPacket(uint32 srcId,
+                             const uint8 *packet,
+                             size_t packetSize)
+      { mUtil.OnRecvPacket(srcId, packet, packetSize); }
+   virtual bool SendPacket(uint32 destId,
+                           const uint8 *packet,
+                           size_t length)
+      { return mTransport->SendPacket(destId, TRANSPORT_GUEST_CONTROLLER_CP,
+                                      packet, length); }
+   virtual void HandleMsg(RpcParams *params,
+                          const uint8 *binary,
+                          uint32 binarySize);
+   virtual bool HandleMsgFile(RpcParams *params,
+                              int fd,
+                              uint32 binarySize)
+      { return false; }
+
+   RpcV4Util mUtil;
+   std::vector<HostMsg> mMsgs;
+
+private:
+   LoopbackTransport *mTransport;
+};
+
+
+/**
+ * Constructor.
+ *
+ * @param[in] transport the transport to send and receive through
+ */
+
+HostRpc::HostRpc(LoopbackTransport *transport)
+   : mTransport(transport)
+{
+   mUtil.Init(this, DND_CP_MSG_TYPE_CP, DND_CP_MSG_SRC_HOST);
+   mTransport->RegisterRpc(this, TRANSPORT_GUEST_CONTROLLER_CP);
+}
+
+
+/**
+ * Record a received message.
+ *
+ * @param[in] params parameter list for the message
+ * @param[in] binary
+ * @param[in] binarySize
+ */
+
+void
+HostRpc::HandleMsg(RpcParams *params,
+                   const uint8 *binary,
+                   uint32 binarySize)
+{
+   HostMsg msg;
+
+   msg.cmd = params->cmd;
+   msg.status = params->status;
+   msg.binarySize = binarySize;
+   msg.params = *params;
+   mMsgs.push_back(msg);
+}
+
+
+/**
+ * Counts the clipboards the guest end passes on to the UI and remembers the
+ * hash of the last one, and whether it kept the received message buffer.
+ */
+
+class GuestListener
+{
+public:
+   GuestListener(void) : mCount(0), mHash(0), mZeroCopy(false) {}
+
+   void OnRecvClip(uint32 sessionId,
+                   bool isActive,
+                   const CPClipboard *clip)
+   {
+      mCount++;
+      mHash = CPClipboard_GetHash(clip);
+      mZeroCopy = NULL != clip->serialized;
+   }
+
+   uint32 mCount;
+   uint64 mHash;
+   bool mZeroCopy;
+};
+
+
+/**
+ * Build a clipboard with text and a 1 MB image.
+ *
+ * @param[out] clip the clipboard
+ * @param[in] text the text item
+ *
+ * @return true on success, false otherwise.
+ */
+
+static bool
+MakeClipboard(CPClipboard *clip,
+              const char *text)
+{
+   uint8 *image = (uint8 *)malloc(TEST_IMAGE_SIZE);
+   bool ret;
+   size_t i;
+
+   if (!image) {
+      return false;
+   }
+   for (i = 0; i < TEST_IMAGE_SIZE; i++) {
+      image[i] = (uint8)(i * 7);
+   }
+   CPClipboard_Init(clip);
+   ret = CPClipboard_SetItem(clip, CPFORMAT_TEXT, text, strlen(text) + 1) &&
+         CPClipboard_SetItem(clip, CPFORMAT_IMG_PNG, image, TEST_IMAGE_SIZE);
+   free(image);
+   return ret;
+}
+
+
+/**
+ * Send clip from the host end to the guest end.
+ *
+ * @param[in] host the host end
+ * @param[in] cmd CP_CMD_RECV_CLIPBOARD or CP_CMD_RECV_CLIPBOARD_UNCHANGED
+ * @param[in] clip the clipboard, only for CP_CMD_RECV_CLIPBOARD
+ * @param[in] hash the hash, only for CP_CMD_RECV_CLIPBOARD_UNCHANGED
+ * @param[in] compressed formats of clip that are zlib streams
+ * @param[in] guestTransport
+ * @param[in] hostTransport
+ *
+ * @return true on success, false otherwise.
+ */
+
+static bool
+HostSendClip(HostRpc *host,
+             uint32 cmd,
+             const CPClipboard *clip,
+             uint64 hash,
+             uint32 compressed,
+             LoopbackTransport *guestTransport,
+             LoopbackTransport *hostTransport)
+{
+   RpcParams params;
+   bool ret;
+
+   memset(&params, 0, sizeof params);
+   params.addrId = DEFAULT_CONNECTION_ID;
+   params.cmd = cmd;
+   params.sessionId = TEST_SESSION_ID;
+   params.optional.cpClipHash.isActive = 1;
+   params.optional.cpClipHash.hashLow = (uint32)hash;
+   params.optional.cpClipHash.hashHigh = (uint32)(hash >> 32);
+   if (compressed) {
+      params.optional.cpInfo.compressed = compressed;
+   }
+   ret = clip ? host->mUtil.SendMsg(&params, clip)
+              : host->mUtil.SendMsg(&params);
+   RunLink(guestTransport, hostTransport);
+   return ret;
+}
+
+
+/**
+ * Negotiate caps, send a clipboard twice from the guest end, then twice from
+ * the host end, and check what went over the link.
+ *
+ * @param[in] name name of the case
+ * @param[in] caps capabilities both ends advertise
+ *
+ * @return true if every check passed, false otherwise.
+ */
+
+static bool
+RunCase(const char *name,
+        uint32 caps)
+{
+   bool hashCap = (caps & DND_CP_CAP_CLIPBOARD_HASH) != 0;
+   LoopbackTransport guestTransport;
+   LoopbackTransport hostTransport;
+   CopyPasteRpcV4 guest(&guestTransport);
+   HostRpc host(&hostTransport);
+   GuestListener listener;
+   CPClipboard clip;
+   CPClipboard otherClip;
+   const CPClipboard *sendOrder[] = { &clip, &clip, &otherClip };
+   uint64 hash;
+   size_t i;
+   bool ok = false;
+
+   CPClipboard_Init(&clip);
+   CPClipboard_Init(&otherClip);
+   guestTransport.SetPeer(&hostTransport);
+   hostTransport.SetPeer(&guestTransport);
+   guest.Init();
+   guest.srcRecvClipChanged.connect(
+      sigc::mem_fun(listener, &GuestListener::OnRecvClip));
+
+   guest.SendPing(caps);
+   RunLink(&guestTransport, &hostTransport);
+   host.mUtil.SendPingReplyMsg(DEFAULT_CONNECTION_ID, caps);
+   RunLink(&guestTransport, &hostTransport);
+   host.mMsgs.clear();
+
+   if (!MakeClipboard(&clip, TEST_TEXT) ||
+       !MakeClipboard(&otherClip, "another " TEST_TEXT)) {
+      fprintf(stderr, "%s: can't build the clipboards.\n", name);
+      goto exit;
+   }
+   hash = CPClipboard_GetHash(&clip);
+
+   /* Guest to host: full, then unchanged, then full again for a new one. */
+   for (i = 0; i < ARRAYSIZE(sendOrder); i++) {
+      if (!guest.DestSendClip(TEST_SESSION_ID, true, sendOrder[i])) {
+         fprintf(stderr, "%s: DestSendClip failed.\n", name);
+         goto exit;
+      }
+      RunLink(&guestTransport, &hostTransport);
+   }
+   if (host.mMsgs.size() != 3) {
+      fprintf(stderr, "%s: the host got %u messages, not 3.\n", name,
+              (uint32)host.mMsgs.size());
+      goto exit;
+   }
+   printf("%-12s send: %s %u bytes, %s %u bytes, %s %u bytes\n", name,
+          DnDCPMsgV4_LookupCmd(host.mMsgs[0].cmd), host.mMsgs[0].binarySize,
+          DnDCPMsgV4_LookupCmd(host.mMsgs[1].cmd), host.mMsgs[1].binarySize,
+          DnDCPMsgV4_LookupCmd(host.mMsgs[2].cmd), host.mMsgs[2].binarySize);
+   if (host.mMsgs[0].cmd != CP_CMD_SEND_CLIPBOARD ||
+       host.mMsgs[0].binarySize == 0 ||
+       host.mMsgs[2].cmd != CP_CMD_SEND_CLIPBOARD ||
+       host.mMsgs[2].binarySize == 0) {
+      fprintf(stderr, "%s: a new clipboard did not go out in full.\n", name);
+      goto exit;
+   }
+   if (hashCap) {
+      const RpcParams *p = &host.mMsgs[1].params;
+
+      if (host.mMsgs[1].cmd != CP_CMD_SEND_CLIPBOARD_UNCHANGED ||
+          host.mMsgs[1].binarySize != 0) {
+         fprintf(stderr, "%s: the same clipboard went out again.\n", name);
+         goto exit;
+      }
+      if ((p->optional.cpClipHash.hashLow |
+           (uint64)p->optional.cpClipHash.hashHigh << 32) != hash) {
+         fprintf(stderr, "%s: CLIPBOARD_UNCHANGED has the wrong hash.\n", name);
+         goto exit;
+      }
+   } else if (host.mMsgs[1].cmd != CP_CMD_SEND_CLIPBOARD ||
+              host.mMsgs[1].binarySize != host.mMsgs[0].binarySize) {
+      fprintf(stderr, "%s: CLIPBOARD_UNCHANGED without the cap.\n", name);
+      goto exit;
+   }
+
+   /* Host to guest: full, then unchanged with the right and a wrong hash. */
+   host.mMsgs.clear();
+   if (!HostSendClip(&host, CP_CMD_RECV_CLIPBOARD, &clip, 0, 0,
+                     &guestTransport, &hostTransport) ||
+       listener.mCount != 1 || listener.mHash != hash) {
+      fprintf(stderr, "%s: the guest did not get the clipboard.\n", name);
+      goto exit;
+   }
+   if (!listener.mZeroCopy) {
+      fprintf(stderr, "%s: the guest copied the clipboard items.\n", name);
+      goto exit;
+   }
+   if (!HostSendClip(&host, CP_CMD_RECV_CLIPBOARD_UNCHANGED, NULL, hash, 0,
+                     &guestTransport, &hostTransport)) {
+      fprintf(stderr, "%s: sending CLIPBOARD_UNCHANGED failed.\n", name);
+      goto exit;
+   }
+   if (hashCap) {
+      if (listener.mCount != 2 || listener.mHash != hash ||
+          !host.mMsgs.empty()) {
+         fprintf(stderr, "%s: the guest did not replay the clipboard.\n",
+                 name);
+         goto exit;
+      }
+   } else if (listener.mCount != 1 || host.mMsgs.size() != 1 ||
+              host.mMsgs[0].cmd != DNDCP_CMP_REPLY ||
+              host.mMsgs[0].status == DND_CP_MSG_STATUS_SUCCESS) {
+      fprintf(stderr, "%s: CLIPBOARD_UNCHANGED was not refused.\n", name);
+      goto exit;
+   }
+
+   host.mMsgs.clear();
+   if (!HostSendClip(&host, CP_CMD_RECV_CLIPBOARD_UNCHANGED, NULL, hash + 1, 0,
+                     &guestTransport, &hostTransport) ||
+       host.mMsgs.size() != 1 ||
+       host.mMsgs[0].cmd != DNDCP_CMP_REPLY ||
+       host.mMsgs[0].status == DND_CP_MSG_STATUS_SUCCESS) {
+      fprintf(stderr, "%s: a wrong hash was not refused.\n", name);
+      goto exit;
+   }
+   printf("%-12s recv: %u clipboards passed on, wrong hash refused\n", name,
+          listener.mCount);
+   ok = true;
+
+exit:
+   CPClipboard_Destroy(&clip);
+   CPClipboard_Destroy(&otherClip);
+   return ok;
+}
+
+
+/**
+ * Build a clipboard with a big text item, spooled to a file, and an RTF
+ * item kept in memory. Both compress well.
+ *
+ * @param[out] clip the clipboard
+ *
+ * @return true on success, false otherwise.
+ */
+
+static bool
+MakeTextClipboard(CPClipboard *clip)
+{
+   char *text = (char *)malloc(TEST_BIG_TEXT_SIZE);
+   char *rtf = (char *)malloc(TEST_RTF_SIZE);
+   size_t len;
+   bool ret = false;
+
+   CPClipboard_Init(clip);
+   if (!text || !rtf) {
+      goto exit;
+   }
+   for (len = 0; len + 64 < TEST_BIG_TEXT_SIZE; ) {
+      len += snprintf(text + len, 64, "line %u of the clipboard text\n",
+                      (uint32)len);
+   }
+   for (len = 0; len + 64 < TEST_RTF_SIZE; ) {
+      len += snprintf(rtf + len, 64, "{\\rtf1 \\b paragraph %u\\b0 }",
+                      (uint32)len);
+   }
+   ret = CPClipboard_SetItem(clip, CPFORMAT_TEXT, text, strlen(text) + 1) &&
+         CPClipboard_SetItem(clip, CPFORMAT_RTF, rtf, len);
+
+exit:
+   free(text);
+   free(rtf);
+   return ret;
+}
+
+
+/**
+ * Negotiate caps, send a text clipboard from the guest end and from the
+ * host end, and check that it is compressed on the link only with
+ * DND_CP_CAP_CLIPBOARD_COMPRESS and always arrives intact.
+ *
+ * @param[in] name name of the case
+ * @param[in] caps capabilities both ends advertise
+ *
+ * @return true if every check passed, false otherwise.
+ */
+
+static bool
+RunCompressCase(const char *name,
+                uint32 caps)
+{
+   bool compressCap = (caps & DND_CP_CAP_CLIPBOARD_COMPRESS) != 0;
+   uint32 mask = 1 << CPFORMAT_TEXT | 1 << CPFORMAT_RTF;
+   LoopbackTransport guestTransport;
+   LoopbackTransport hostTransport;
+   CopyPasteRpcV4 guest(&guestTransport);
+   HostRpc host(&hostTransport);
+   GuestListener listener;
+   CPClipboard clip;
+   CPClipboard packed;
+   CPClipboard bad;
+   uint32 formats = 0;
+   uint32 fullSize;
+   void *buf;
+   size_t size;
+   uint64 hash;
+   bool ok = false;
+
+   CPClipboard_Init(&packed);
+   CPClipboard_Init(&bad);
+   guestTransport.SetPeer(&hostTransport);
+   hostTransport.SetPeer(&guestTransport);
+   guest.Init();
+   guest.srcRecvClipChanged.connect(
+      sigc::mem_fun(listener, &GuestListener::OnRecvClip));
+
+   guest.SendPing(caps);
+   RunLink(&guestTransport, &hostTransport);
+   host.mUtil.SendPingReplyMsg(DEFAULT_CONNECTION_ID, caps);
+   RunLink(&guestTransport, &hostTransport);
+   host.mMsgs.clear();
+
+   if (!MakeTextClipboard(&clip) ||
+       (compressCap && (!CPClipboard_Compress(&packed, &clip, &formats) ||
+                        formats != mask))) {
+      fprintf(stderr, "%s: can't build the clipboards.\n", name);
+      goto exit;
+   }
+   hash = CPClipboard_GetHash(&clip);
+   fullSize = CPClipboard_GetSerializedSize(&clip);
+
+   /* Guest to host. */
+   if (!guest.DestSendClip(TEST_SESSION_ID, true, &clip)) {
+      fprintf(stderr, "%s: DestSendClip failed.\n", name);
+      goto exit;
+   }
+   RunLink(&guestTransport, &hostTransport);
+   if (host.mMsgs.size() != 1 ||
+       host.mMsgs[0].cmd != CP_CMD_SEND_CLIPBOARD) {
+      fprintf(stderr, "%s: the host did not get the clipboard.\n", name);
+      goto exit;
+   }
+   printf("%-12s send: %u of %u bytes, formats 0x%x\n", name,
+          host.mMsgs[0].binarySize, fullSize,
+          host.mMsgs[0].params.optional.cpInfo.compressed);
+   if (compressCap) {
+      if (host.mMsgs[0].params.optional.cpInfo.compressed != mask ||
+          host.mMsgs[0].binarySize != CPClipboard_GetSerializedSize(&packed)) {
+         fprintf(stderr, "%s: the clipboard was not compressed.\n", name);
+         goto exit;
+      }
+   } else if (host.mMsgs[0].params.optional.cpInfo.compressed != 0 ||
+              host.mMsgs[0].binarySize != fullSize) {
+      fprintf(stderr, "%s: compressed without the cap.\n", name);
+      goto exit;
+   }
+
+   /* Host to guest, with a mask only if negotiated. */
+   if (!HostSendClip(&host, CP_CMD_RECV_CLIPBOARD,
+                     compressCap ? &packed : &clip, 0,
+                     compressCap ? mask : 0,
+                     &guestTransport, &hostTransport) ||
+       listener.mCount != 1 || listener.mHash != hash) {
+      fprintf(stderr, "%s: the guest did not get the clipboard intact.\n",
+              name);
+      goto exit;
+   }
+
+   /*
+    * A mask from a peer that did not negotiate the cap means nothing. With
+    * the cap, raw or truncated items under the mask must be refused.
+    */
+   if (!HostSendClip(&host, CP_CMD_RECV_CLIPBOARD, &clip, 0, mask,
+                     &guestTransport, &hostTransport) ||
+       listener.mCount != (compressCap ? 1 : 2)) {
+      fprintf(stderr, "%s: a raw clipboard under the mask was %s.\n", name,
+              compressCap ? "accepted" : "refused");
+      goto exit;
+   }
+   if (compressCap) {
+      if (!CPClipboard_GetItem(&packed, CPFORMAT_RTF, &buf, &size) ||
+          !CPClipboard_SetItem(&bad, CPFORMAT_RTF, buf, size / 2) ||
+          !HostSendClip(&host, CP_CMD_RECV_CLIPBOARD, &bad, 0,
+                        1 << CPFORMAT_RTF, &guestTransport, &hostTransport) ||
+          listener.mCount != 1) {
+         fprintf(stderr, "%s: a truncated stream was accepted.\n", name);
+         goto exit;
+      }
+   }
+   printf("%-12s recv: %u clipboards passed on, %s\n", name,
+          listener.mCount,
+          compressCap ? "bad streams refused" : "mask ignored");
+   ok = true;
+
+exit:
+   CPClipboard_Destroy(&clip);
+   CPClipboard_Destroy(&packed);
+   CPClipboard_Destroy(&bad);
+   return ok;
+}
+
+
+/**
+ * Usage: clipboardUnchanged
+ *
+ * @return EXIT_SUCCESS if every case passed, EXIT_FAILURE otherwise.
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   uint32 caps = DND_CP_CAP_VALID | DND_CP_CAP_CP | DND_CP_CAP_FORMATS_CP |
+                 DND_CP_CAP_BIG_BUFFER | DND_CP_CAP_WINDOWED_BIG_BUFFER;
+   bool ok;
+
+   ok = RunCase("hash", caps | DND_CP_CAP_CLIPBOARD_HASH);
+   ok = RunCase("no hash", caps) && ok;
+#ifdef HAVE_ZLIB
+   ok = RunCompressCase("compress", caps | DND_CP_CAP_CLIPBOARD_COMPRESS) && ok;
+#endif
+   ok = RunCompressCase("no compress", caps) && ok;
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
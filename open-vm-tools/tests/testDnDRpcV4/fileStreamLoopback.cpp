@@ -0,0 +1,417 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @fileStreamLoopback.cpp --
+ *
+ * Test for the DND_CP_CAP_FILE_STREAM commands. A FileTransferRpcV4 and a
+ * GuestFileStream on the guest end of an in-memory link stream a temporary
+ * file to a minimal controller end, which acknowledges what it receives.
+ * The file must arrive intact and in order, the guest must never have more
+ * than DND_CP_FILE_STREAM_WINDOW bytes unacknowledged, and the stream must
+ * end with an empty FT_CMD_STREAM_DATA telling whether it succeeded. Bad
+ * paths must fail the stream, and a cancelled stream must stop.
+ *
+ * Prints the throughput of the link, which only measures the guest side:
+ * reading the file and building the packets.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "fileTransferRpcV4.hh"
+#include "guestFileStream.hh"
+#include "loopbackTransport.hpp"
+#include "vm_basic_defs.h"
+
+extern "C" {
+   #include "dndCPMsgV4.h"
+   #include "hostinfo.h"
+}
+
+#define TEST_SESSION_ID          42
+#define TEST_STREAM_ID           7
+#define TEST_FILE_SIZE           ((32 << 20) + 12345)
+#define TEST_ACK_INTERVAL        (512 << 10)
+
+
+/**
+ * Minimal controller end of a file transfer link over a LoopbackTransport.
+ * Reassembles the streamed file and acknowledges it as it comes in.
+ */
+
+class HostRpc
+   : public RpcBase
+{
+public:
+   HostRpc(LoopbackTransport *transport);
+   virtual ~HostRpc(void)
+      { mTransport->UnregisterRpc(TRANSPORT_GUEST_CONTROLLER_FT); }
+
+   virtual void OnRecvPacket(uint32 srcId,
+                             const uint8 *packet,
+                             size_t packetSize)
+      { mUtil.OnRecvPacket(srcId, packet, packetSize); }
+   virtual bool SendPacket(uint32 destId,
+                           const uint8 *packet,
+                           size_t length)
+      { return mTransport->SendPacket(destId, TRANSPORT_GUEST_CONTROLLER_FT,
+                                      packet, length); }
+   virtual void HandleMsg(RpcParams *params,
+                          const uint8 *binary,
+                          uint32 binarySize);
+   virtual bool HandleMsgFile(RpcParams *params,
+                              int fd,
+                              uint32 binarySize)
+      { return false; }
+
+   bool StartStream(const char *path,
+                    uint64 offset,
+                    uint64 ackInterval);
+   bool SendStreamCmd(uint32 cmd,
+                      uint64 offset,
+                      const char *path);
+
+   RpcV4Util mUtil;
+   std::vector<uint8> mData;
+   uint64 mOffset;
+   uint64 mAckedOffset;
+   uint64 mMaxUnacked;
+   uint64 mProgressBytes;
+   uint32 mDataMsgs;
+   uint32 mProgressMsgs;
+   bool mEnded;
+   bool mSucceeded;
+   bool mBad;
+
+private:
+   LoopbackTransport *mTransport;
+   uint64 mAckInterval;
+};
+
+
+/**
+ * Constructor.
+ *
+ * @param[in] transport the transport to send and receive through
+ */
+
+HostRpc::HostRpc(LoopbackTransport *transport)
+   : mTransport(transport)
+{
+   mUtil.Init(this, DND_CP_MSG_SRC_HOST, DND_CP_MSG_TYPE_FT);
+   mTransport->RegisterRpc(this, TRANSPORT_GUEST_CONTROLLER_FT);
+}
+
+
+/**
+ * Send a stream command to the guest end.
+ *
+ * @param[in] cmd FT_CMD_STREAM_FILE, FT_CMD_STREAM_ACK or FT_CMD_STREAM_CANCEL
+ * @param[in] offset start offset or offset received up to
+ * @param[in] path the file, only for FT_CMD_STREAM_FILE
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+HostRpc::SendStreamCmd(uint32 cmd,
+                       uint64 offset,
+                       const char *path)
+{
+   RpcParams params;
+
+   memset(&params, 0, sizeof params);
+   params.addrId = DEFAULT_CONNECTION_ID;
+   params.cmd = cmd;
+   params.sessionId = TEST_SESSION_ID;
+   params.optional.ftStream.streamId = TEST_STREAM_ID;
+   params.optional.ftStream.offsetLow = (uint32)offset;
+   params.optional.ftStream.offsetHigh = (uint32)(offset >> 32);
+   return path ? mUtil.SendMsg(&params, (const uint8 *)path,
+                               (uint32)strlen(path) + 1)
+               : mUtil.SendMsg(&params);
+}
+
+
+/**
+ * Ask the guest end for path from offset.
+ *
+ * @param[in] path the file
+ * @param[in] offset where to start in the file
+ * @param[in] ackInterval acknowledge every this many bytes, 0 to leave
+ *                        acknowledging to the caller
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+HostRpc::StartStream(const char *path,
+                     uint64 offset,
+                     uint64 ackInterval)
+{
+   mData.clear();
+   mOffset = offset;
+   mAckedOffset = offset;
+   mMaxUnacked = 0;
+   mProgressBytes = 0;
+   mDataMsgs = 0;
+   mProgressMsgs = 0;
+   mEnded = false;
+   mSucceeded = false;
+   mBad = false;
+   mAckInterval = ackInterval;
+   return SendStreamCmd(FT_CMD_STREAM_FILE, offset, path);
+}
+
+
+/**
+ * Take in stream data and progress, acknowledging the data as set up by
+ * StartStream.
+ *
+ * @param[in] params parameter list for the message
+ * @param[in] binary
+ * @param[in] binarySize
+ */
+
+void
+HostRpc::HandleMsg(RpcParams *params,
+                   const uint8 *binary,
+                   uint32 binarySize)
+{
+   uint64 offset = params->optional.ftStream.offsetLow |
+                   (uint64)params->optional.ftStream.offsetHigh << 32;
+
+   if (params->sessionId != TEST_SESSION_ID ||
+       params->optional.ftStream.streamId != TEST_STREAM_ID) {
+      fprintf(stderr, "got %s for the wrong stream.\n",
+              DnDCPMsgV4_LookupCmd(params->cmd));
+      mBad = true;
+      return;
+   }
+
+   switch (params->cmd) {
+   case FT_CMD_STREAM_DATA:
+      mDataMsgs++;
+      if (mEnded || offset != mOffset) {
+         fprintf(stderr, "data at %" FMT64 "u, expected %" FMT64 "u%s.\n",
+                 offset, mOffset, mEnded ? " after the end" : "");
+         mBad = true;
+         return;
+      }
+      if (0 == binarySize) {
+         mEnded = true;
+         mSucceeded = DND_CP_MSG_STATUS_SUCCESS == params->status;
+         return;
+      }
+      mData.insert(mData.end(), binary, binary + binarySize);
+      mOffset += binarySize;
+      mMaxUnacked = MAX(mMaxUnacked, mOffset - mAckedOffset);
+      if (mAckInterval && mOffset - mAckedOffset >= mAckInterval) {
+         mAckedOffset = mOffset;
+         SendStreamCmd(FT_CMD_STREAM_ACK, mOffset, NULL);
+      }
+      break;
+   case FT_CMD_STREAM_PROGRESS:
+      mProgressMsgs++;
+      mProgressBytes = offset;
+      break;
+   default:
+      fprintf(stderr, "unexpected %s.\n", DnDCPMsgV4_LookupCmd(params->cmd));
+      mBad = true;
+      break;
+   }
+}
+
+
+/**
+ * Stream path from offset and check what the controller end got.
+ *
+ * @param[in] name name of the case
+ * @param[in] host the controller end
+ * @param[in] guestTransport
+ * @param[in] hostTransport
+ * @param[in] path the file
+ * @param[in] offset where to start in the file
+ * @param[in] expected the file contents, NULL if the stream should fail
+ * @param[in] expectedSize
+ *
+ * @return true if every check passed, false otherwise.
+ */
+
+static bool
+RunStream(const char *name,
+          HostRpc *host,
+          LoopbackTransport *guestTransport,
+          LoopbackTransport *hostTransport,
+          const char *path,
+          uint64 offset,
+          const uint8 *expected,
+          uint64 expectedSize)
+{
+   VmTimeType start = Hostinfo_SystemTimerUS();
+   VmTimeType elapsed;
+
+   if (!host->StartStream(path, offset, TEST_ACK_INTERVAL)) {
+      fprintf(stderr, "%s: can't send FT_CMD_STREAM_FILE.\n", name);
+      return false;
+   }
+   RunLink(guestTransport, hostTransport);
+   elapsed = Hostinfo_SystemTimerUS() - start;
+
+   if (host->mBad || !host->mEnded) {
+      fprintf(stderr, "%s: the stream did not end properly.\n", name);
+      return false;
+   }
+   if (!expected) {
+      if (host->mSucceeded || !host->mData.empty()) {
+         fprintf(stderr, "%s: the stream did not fail.\n", name);
+         return false;
+      }
+      printf("%-12s failed as expected\n", name);
+      return true;
+   }
+   if (!host->mSucceeded) {
+      fprintf(stderr, "%s: the stream failed.\n", name);
+      return false;
+   }
+   if (host->mData.size() != expectedSize - offset ||
+       (!host->mData.empty() &&
+        memcmp(&host->mData[0], expected + offset, host->mData.size()) != 0)) {
+      fprintf(stderr, "%s: got %u bytes that don't match the file.\n", name,
+              (uint32)host->mData.size());
+      return false;
+   }
+   if (host->mMaxUnacked > DND_CP_FILE_STREAM_WINDOW) {
+      fprintf(stderr, "%s: %" FMT64 "u bytes were unacknowledged.\n", name,
+              host->mMaxUnacked);
+      return false;
+   }
+   if (0 == host->mProgressMsgs ||
+       host->mProgressBytes != expectedSize - offset) {
+      fprintf(stderr, "%s: progress was not reported.\n", name);
+      return false;
+   }
+   printf("%-12s %u bytes in %u messages, at most %u unacked, %.1f MB/s\n",
+          name, (uint32)host->mData.size(), host->mDataMsgs,
+          (uint32)host->mMaxUnacked,
+          elapsed > 0 ? host->mData.size() / (double)elapsed : 0.0);
+   return true;
+}
+
+
+/**
+ * Usage: fileStreamLoopback
+ *
+ * @return EXIT_SUCCESS if every case passed, EXIT_FAILURE otherwise.
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   char path[] = "/tmp/vmware-filestream-XXXXXX";
+   char dir[] = "/tmp/vmware-filestream-dir-XXXXXX";
+   LoopbackTransport guestTransport;
+   LoopbackTransport hostTransport;
+   FileTransferRpcV4 guest(&guestTransport);
+   GuestFileStream stream(&guest);
+   HostRpc host(&hostTransport);
+   std::vector<uint8> contents(TEST_FILE_SIZE);
+   size_t i;
+   int fd;
+   bool ok = false;
+
+   guestTransport.SetPeer(&hostTransport);
+   hostTransport.SetPeer(&guestTransport);
+   guest.Init();
+
+   for (i = 0; i < contents.size(); i++) {
+      contents[i] = (uint8)(i * 7 + (i >> 16));
+   }
+   fd = mkstemp(path);
+   if (fd < 0 || write(fd, &contents[0], contents.size()) !=
+                 (ssize_t)contents.size()) {
+      fprintf(stderr, "can't write %s.\n", path);
+      goto exit;
+   }
+   if (!mkdtemp(dir)) {
+      fprintf(stderr, "can't create %s.\n", dir);
+      goto exit;
+   }
+
+   ok = RunStream("whole file", &host, &guestTransport, &hostTransport,
+                  path, 0, &contents[0], contents.size());
+   ok = RunStream("from offset", &host, &guestTransport, &hostTransport,
+                  path, (3 << 20) + 5, &contents[0], contents.size()) && ok;
+   ok = RunStream("at the end", &host, &guestTransport, &hostTransport,
+                  path, contents.size(), &contents[0], contents.size()) && ok;
+   ok = RunStream("missing", &host, &guestTransport, &hostTransport,
+                  "/tmp/vmware-filestream-missing", 0, NULL, 0) && ok;
+   ok = RunStream("directory", &host, &guestTransport, &hostTransport,
+                  dir, 0, NULL, 0) && ok;
+
+   /*
+    * Without acks the guest must stop at the window, and go on by as much as
+    * an ack frees. A cancelled stream then stops without an end message.
+    */
+   if (!host.StartStream(path, 0, 0)) {
+      fprintf(stderr, "window: can't send FT_CMD_STREAM_FILE.\n");
+      ok = false;
+      goto exit;
+   }
+   RunLink(&guestTransport, &hostTransport);
+   if (host.mBad || host.mEnded ||
+       host.mData.size() != DND_CP_FILE_STREAM_WINDOW) {
+      fprintf(stderr, "window: the guest sent %u bytes unacknowledged.\n",
+              (uint32)host.mData.size());
+      ok = false;
+      goto exit;
+   }
+   host.SendStreamCmd(FT_CMD_STREAM_ACK, TEST_ACK_INTERVAL, NULL);
+   RunLink(&guestTransport, &hostTransport);
+   if (host.mBad || host.mEnded ||
+       host.mData.size() != DND_CP_FILE_STREAM_WINDOW + TEST_ACK_INTERVAL) {
+      fprintf(stderr, "window: an ack let %u bytes through.\n",
+              (uint32)host.mData.size());
+      ok = false;
+      goto exit;
+   }
+   host.SendStreamCmd(FT_CMD_STREAM_CANCEL, host.mOffset, NULL);
+   host.SendStreamCmd(FT_CMD_STREAM_ACK, host.mOffset, NULL);
+   RunLink(&guestTransport, &hostTransport);
+   if (host.mBad || host.mEnded ||
+       host.mData.size() != DND_CP_FILE_STREAM_WINDOW + TEST_ACK_INTERVAL) {
+      fprintf(stderr, "cancel: the stream did not stop.\n");
+      ok = false;
+   } else {
+      printf("%-12s stopped at %u bytes, cancelled\n", "window",
+             (uint32)host.mData.size());
+   }
+
+exit:
+   if (fd >= 0) {
+      close(fd);
+      unlink(path);
+   }
+   rmdir(dir);
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,109 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @loopbackTransport.cpp --
+ *
+ * Implements loopbackTransport.hpp.
+ */
+
+#include "loopbackTransport.hpp"
+#include "rpcBase.h"
+
+extern "C" {
+   #include "dnd.h"
+   #include "vm_assert.h"
+}
+
+
+/**
+ * Queue a packet on the peer.
+ *
+ * @param[in] destId destination address id
+ * @param[in] type transport interface type
+ * @param[in] msg the packet
+ * @param[in] length length of the packet
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+LoopbackTransport::SendPacket(uint32 destId,
+                              TransportInterfaceType type,
+                              const uint8 *msg,
+                              size_t length)
+{
+   if (NULL == mPeer || length > DND_MAX_TRANSPORT_PACKET_SIZE) {
+      return false;
+   }
+   mPeer->mInbound.push_back(std::vector<uint8>(msg, msg + length));
+   mPacketsSent++;
+   return true;
+}
+
+
+/**
+ * Hand the first count queued packets to the registered rpc.
+ *
+ * @param[in] count number of packets to deliver
+ */
+
+void
+LoopbackTransport::Deliver(size_t count)
+{
+   ASSERT(count <= mInbound.size());
+
+   while (count-- > 0) {
+      std::vector<uint8> packet;
+
+      packet.swap(mInbound.front());
+      mInbound.pop_front();
+      if (mRpc) {
+         mRpc->OnRecvPacket(DEFAULT_CONNECTION_ID, &packet[0], packet.size());
+      }
+   }
+}
+
+
+/**
+ * Deliver packets in both directions until the link is idle. Each round
+ * delivers the packets that were in flight when it started, packets sent in
+ * response are left for the next round.
+ *
+ * @param[in] a one end of the link
+ * @param[in] b the other end of the link
+ *
+ * @return the number of rounds it took.
+ */
+
+uint32
+RunLink(LoopbackTransport *a,
+        LoopbackTransport *b)
+{
+   uint32 rounds = 0;
+
+   while (a->GetPacketsQueued() > 0 || b->GetPacketsQueued() > 0) {
+      size_t aQueued = a->GetPacketsQueued();
+      size_t bQueued = b->GetPacketsQueued();
+
+      a->Deliver(aQueued);
+      b->Deliver(bQueued);
+      rounds++;
+   }
+   return rounds;
+}
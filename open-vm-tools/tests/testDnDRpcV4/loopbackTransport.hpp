@@ -0,0 +1,72 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @loopbackTransport.hpp --
+ *
+ * In-memory DnDCPTransport for the DnD/CP version 4 tests.
+ */
+
+#ifndef LOOPBACK_TRANSPORT_HPP
+#define LOOPBACK_TRANSPORT_HPP
+
+#include <stdlib.h>
+#include <deque>
+#include <vector>
+
+#include "dndCPTransport.h"
+
+
+/**
+ * One end of an in-memory link. Packets sent through it are queued on the
+ * peer and only delivered by Deliver(), so a whole round of packets is in
+ * flight at once the way it would be on a real transport.
+ */
+
+class LoopbackTransport
+   : public DnDCPTransport
+{
+public:
+   LoopbackTransport(void) : mPeer(NULL), mRpc(NULL), mPacketsSent(0) {}
+
+   void SetPeer(LoopbackTransport *peer) { mPeer = peer; }
+   uint32 GetPacketsSent(void) const { return mPacketsSent; }
+   size_t GetPacketsQueued(void) const { return mInbound.size(); }
+
+   virtual bool RegisterRpc(RpcBase *rpc,
+                            TransportInterfaceType type)
+      { mRpc = rpc; return true; }
+   virtual bool UnregisterRpc(TransportInterfaceType type)
+      { mRpc = NULL; return true; }
+   virtual bool SendPacket(uint32 destId,
+                           TransportInterfaceType type,
+                           const uint8 *msg,
+                           size_t length);
+   void Deliver(size_t count);
+
+private:
+   LoopbackTransport *mPeer;
+   RpcBase *mRpc;
+   uint32 mPacketsSent;
+   std::deque<std::vector<uint8> > mInbound;
+};
+
+
+uint32 RunLink(LoopbackTransport *a, LoopbackTransport *b);
+
+#endif // LOOPBACK_TRANSPORT_HPP
@@ -0,0 +1,276 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @rpcV4Loopback.cpp --
+ *
+ * Test and benchmark for DnD/CP version 4 big buffer transfers. Two
+ * RpcV4Util objects are connected by a pair of in-memory DnDCPTransport
+ * objects, and a 4 MB message is sent from one to the other, once with the
+ * windowed transfer negotiated and once with one packet per
+ * DNDCP_CMD_REQUEST_NEXT. The transports deliver packets in rounds, where a
+ * round is one trip across the link, so the number of rounds is what the
+ * transfer would cost in latency on a real backdoor. The received binary
+ * must match the sent one in both modes, and the windowed transfer must take
+ * fewer rounds.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <vector>
+
+#include "loopbackTransport.hpp"
+#include "rpcV4Util.hpp"
+
+#define DEFAULT_LATENCY_US       100
+#define BIG_MSG_SIZE             DND_CP_MSG_MAX_BINARY_SIZE_V4
+#define TEST_SESSION_ID          42
+#define NUM_RUNS                 3
+
+
+/**
+ * Current time in seconds.
+ */
+
+static double
+Now(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+/**
+ * Minimal copy paste rpc over a LoopbackTransport that keeps the last
+ * message it received.
+ */
+
+class LoopbackRpc
+   : public RpcBase
+{
+public:
+   LoopbackRpc(LoopbackTransport *transport,
+               uint32 msgSrc);
+   virtual ~LoopbackRpc(void)
+      { mTransport->UnregisterRpc(TRANSPORT_GUEST_CONTROLLER_CP); }
+
+   virtual void OnRecvPacket(uint32 srcId,
+                             const uint8 *packet,
+                             size_t packetSize)
+      { mUtil.OnRecvPacket(srcId, packet, packetSize); }
+   virtual bool SendPacket(uint32 destId,
+                           const uint8 *packet,
+                           size_t length)
+      { return mTransport->SendPacket(destId, TRANSPORT_GUEST_CONTROLLER_CP,
+                                      packet, length); }
+   virtual void HandleMsg(RpcParams *params,
+                          const uint8 *binary,
+                          uint32 binarySize);
+
+   RpcV4Util mUtil;
+   uint32 mLastCmd;
+   uint32 mLastSessionId;
+   std::vector<uint8> mLastBinary;
+
+private:
+   LoopbackTransport *mTransport;
+};
+
+
+/**
+ * Constructor.
+ *
+ * @param[in] transport the transport to send and receive through
+ * @param[in] msgSrc source of the messages (host/guest/controller)
+ */
+
+LoopbackRpc::LoopbackRpc(LoopbackTransport *transport,
+                         uint32 msgSrc)
+   : mLastCmd(DNDCP_CMD_INVALID),
+     mLastSessionId(0),
+     mTransport(transport)
+{
+   mUtil.Init(this, DND_CP_MSG_TYPE_CP, msgSrc);
+   mTransport->RegisterRpc(this, TRANSPORT_GUEST_CONTROLLER_CP);
+}
+
+
+/**
+ * Record a received message.
+ *
+ * @param[in] params parameter list for the message
+ * @param[in] binary
+ * @param[in] binarySize
+ */
+
+void
+LoopbackRpc::HandleMsg(RpcParams *params,
+                       const uint8 *binary,
+                       uint32 binarySize)
+{
+   mLastCmd = params->cmd;
+   mLastSessionId = params->sessionId;
+   if (binarySize > 0) {
+      mLastBinary.assign(binary, binary + binarySize);
+   } else {
+      mLastBinary.clear();
+   }
+}
+
+
+/**
+ * Negotiate caps between a guest and a host end, then send binary from the
+ * guest to the host NUM_RUNS times and print a line of results for the
+ * fastest run. The first run also pays for faulting in the buffers.
+ *
+ * @param[in] name name of the mode
+ * @param[in] caps capabilities both ends advertise
+ * @param[in] binary the message binary
+ * @param[in] latencyUs one way latency of the link to estimate the time with
+ *
+ * @return the number of rounds the transfer took, or 0 on failure.
+ */
+
+static uint32
+RunTransfer(const char *name,
+            uint32 caps,
+            const std::vector<uint8> &binary,
+            uint32 latencyUs)
+{
+   LoopbackTransport guestTransport;
+   LoopbackTransport hostTransport;
+   LoopbackRpc guest(&guestTransport, DND_CP_MSG_SRC_GUEST);
+   LoopbackRpc host(&hostTransport, DND_CP_MSG_SRC_HOST);
+   RpcParams params;
+   uint32 packets = 0;
+   uint32 rounds = 0;
+   double best = 0;
+   int run;
+   bool windowed = (caps & DND_CP_CAP_WINDOWED_BIG_BUFFER) != 0;
+
+   guestTransport.SetPeer(&hostTransport);
+   hostTransport.SetPeer(&guestTransport);
+
+   guest.mUtil.SendPingMsg(DEFAULT_CONNECTION_ID, caps);
+   RunLink(&guestTransport, &hostTransport);
+   host.mUtil.SendPingReplyMsg(DEFAULT_CONNECTION_ID, caps);
+   RunLink(&guestTransport, &hostTransport);
+
+   if (guest.mUtil.IsCapNegotiated(DND_CP_CAP_WINDOWED_BIG_BUFFER) != windowed ||
+       host.mUtil.IsCapNegotiated(DND_CP_CAP_WINDOWED_BIG_BUFFER) != windowed) {
+      fprintf(stderr, "%s: caps were not negotiated.\n", name);
+      return 0;
+   }
+
+   memset(&params, 0, sizeof params);
+   params.addrId = DEFAULT_CONNECTION_ID;
+   params.cmd = DNDCP_CMD_TEST_BIG_BINARY;
+
+   for (run = 0; run < NUM_RUNS; run++) {
+      uint32 sent = guestTransport.GetPacketsSent() +
+                    hostTransport.GetPacketsSent();
+      double start;
+      double elapsed;
+
+      params.sessionId = TEST_SESSION_ID + run;
+      host.mLastBinary.clear();
+
+      start = Now();
+      if (!guest.mUtil.SendMsg(&params, &binary[0], binary.size())) {
+         fprintf(stderr, "%s: SendMsg failed.\n", name);
+         return 0;
+      }
+      rounds = RunLink(&guestTransport, &hostTransport);
+      elapsed = Now() - start;
+      packets = guestTransport.GetPacketsSent() +
+                hostTransport.GetPacketsSent() - sent;
+
+      if (host.mLastCmd != DNDCP_CMD_TEST_BIG_BINARY ||
+          host.mLastSessionId != params.sessionId ||
+          host.mLastBinary != binary) {
+         fprintf(stderr, "%s: the host got %u bytes for command %u, "
+                 "expected %u bytes for command %u.\n", name,
+                 (uint32)host.mLastBinary.size(), host.mLastCmd,
+                 (uint32)binary.size(), DNDCP_CMD_TEST_BIG_BINARY);
+         return 0;
+      }
+      if (0 == run || elapsed < best) {
+         best = elapsed;
+      }
+   }
+
+   printf("%-14s %8u %8u %12.1f %14.1f\n", name, packets, rounds,
+          binary.size() / best / 1e6,
+          (rounds * (double)latencyUs / 1e6 + best) * 1e3);
+   return rounds;
+}
+
+
+/**
+ * Usage: rpcV4Loopback [one way latency in us]
+ *
+ * @return EXIT_SUCCESS if both transfers delivered the binary intact and the
+ *         windowed one took fewer rounds, EXIT_FAILURE otherwise.
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   std::vector<uint8> binary(BIG_MSG_SIZE);
+   int latencyUs = DEFAULT_LATENCY_US;
+   uint32 windowedRounds;
+   uint32 requestNextRounds;
+   size_t i;
+
+   if (argc > 2 || (argc == 2 && (latencyUs = atoi(argv[1])) < 0)) {
+      fprintf(stderr, "Usage: %s [one way latency in us]\n", argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   /* Differs from packet to packet, so a misplaced packet does not go unseen. */
+   for (i = 0; i < binary.size(); i++) {
+      binary[i] = (uint8)(i * 7 + (i >> 16));
+   }
+
+   printf("%-14s %8s %8s %12s %14s\n", "mode", "packets", "rounds", "MB/s",
+          "ms at latency");
+
+   windowedRounds = RunTransfer("windowed",
+                                DND_CP_CAP_VALID | DND_CP_CAP_BIG_BUFFER |
+                                DND_CP_CAP_WINDOWED_BIG_BUFFER,
+                                binary, latencyUs);
+   requestNextRounds = RunTransfer("request-next",
+                                   DND_CP_CAP_VALID | DND_CP_CAP_BIG_BUFFER,
+                                   binary, latencyUs);
+
+   if (0 == windowedRounds || 0 == requestNextRounds) {
+      return EXIT_FAILURE;
+   }
+   if (windowedRounds >= requestNextRounds) {
+      fprintf(stderr, "The windowed transfer took %u rounds, request-next "
+              "took %u.\n", windowedRounds, requestNextRounds);
+      return EXIT_FAILURE;
+   }
+
+   return EXIT_SUCCESS;
+}
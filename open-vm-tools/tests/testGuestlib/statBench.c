@@ -0,0 +1,248 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * statBench.c --
+ *
+ *   Benchmark for fetching guestlib semi-structured stats, to be run in a
+ *   virtual machine.  A sample of 1, 10 and 50 stats is taken with one
+ *   VMGuestLib_StatGet() per stat, with an uncached VMGuestLib_StatGetBatch()
+ *   and with a cached one, and the time per sample is reported for each.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "vm_basic_types.h"
+#include "vm_basic_defs.h"
+#include "vmGuestLib.h"
+
+#define DEFAULT_SAMPLES         100
+#define DEFAULT_STALENESS_MS    1000
+#define DEFAULT_ENCODING        "text"
+
+static const uint32 sampleSizes[] = { 1, 10, 50 };
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Now --
+ *
+ *    Current time in seconds.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Now(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * SampleEach --
+ *
+ *    Fetch the stats with one VMGuestLib_StatGet() each.
+ *
+ * Results:
+ *    The number of stats that couldn't be fetched.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static uint32
+SampleEach(const char *encoding,       // IN
+           const char * const *stats,  // IN
+           uint32 numStats)            // IN
+{
+   uint32 failed = 0;
+   uint32 i;
+
+   for (i = 0; i < numStats; i++) {
+      char *reply = NULL;
+      size_t replySize = 0;
+
+      if (VMGuestLib_StatGet(encoding, stats[i], &reply, &replySize) !=
+          VMGUESTLIB_ERROR_SUCCESS) {
+         failed++;
+      }
+      VMGuestLib_StatFree(reply, replySize);
+   }
+
+   return failed;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * SampleBatch --
+ *
+ *    Fetch the stats with VMGuestLib_StatGetBatch().
+ *
+ * Results:
+ *    The number of stats that couldn't be fetched.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static uint32
+SampleBatch(VMGuestLibStatCache cache,      // IN
+            const char * const *stats,      // IN
+            uint32 numStats,                // IN
+            uint32 maxStalenessMs,          // IN
+            VMGuestLibStatResult *results)  // OUT
+{
+   uint32 failed = 0;
+   uint32 i;
+
+   if (VMGuestLib_StatGetBatch(cache, stats, numStats, maxStalenessMs,
+                               results) != VMGUESTLIB_ERROR_SUCCESS) {
+      return numStats;
+   }
+   for (i = 0; i < numStats; i++) {
+      if (results[i].error != VMGUESTLIB_ERROR_SUCCESS) {
+         failed++;
+      }
+   }
+
+   return failed;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    Usage: statBench [-e encoding] [-n samples] [-s stalenessMs] stat...
+ *
+ *    Stat names are given on the command line; sample sizes larger than
+ *    the number of names are skipped, so that every stat in a sample is
+ *    distinct.
+ *
+ * Results:
+ *    EXIT_SUCCESS and EXIT_FAILURE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   const char *encoding = DEFAULT_ENCODING;
+   int samples = DEFAULT_SAMPLES;
+   int stalenessMs = DEFAULT_STALENESS_MS;
+   const char * const *stats;
+   uint32 numStats;
+   VMGuestLibStatResult *results;
+   VMGuestLibStatCache cache;
+   unsigned int i;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "e:n:s:")) != -1) {
+      switch (opt) {
+      case 'e':
+         encoding = optarg;
+         break;
+      case 'n':
+         samples = atoi(optarg);
+         break;
+      case 's':
+         stalenessMs = atoi(optarg);
+         break;
+      default:
+         samples = 0;
+         break;
+      }
+   }
+   if (samples <= 0 || stalenessMs <= 0 || optind >= argc) {
+      fprintf(stderr, "Usage: %s [-e encoding] [-n samples] "
+              "[-s stalenessMs] stat...\n", argv[0]);
+      return EXIT_FAILURE;
+   }
+   stats = (const char * const *)&argv[optind];
+   numStats = argc - optind;
+
+   results = calloc(numStats, sizeof *results);
+   if (results == NULL ||
+       VMGuestLib_StatCacheOpen(encoding, &cache) != VMGUESTLIB_ERROR_SUCCESS) {
+      return EXIT_FAILURE;
+   }
+
+   printf("%-6s %12s %12s %12s  (us/sample, %d samples)\n", "stats",
+          "each", "batch", "cached", samples);
+
+   for (i = 0; i < ARRAYSIZE(sampleSizes); i++) {
+      uint32 n = sampleSizes[i];
+      uint32 failed = 0;
+      double start;
+      double each;
+      double batch;
+      double cached;
+      int s;
+
+      if (n > numStats) {
+         break;
+      }
+
+      start = Now();
+      for (s = 0; s < samples; s++) {
+         failed += SampleEach(encoding, stats, n);
+      }
+      each = Now() - start;
+
+      start = Now();
+      for (s = 0; s < samples; s++) {
+         failed += SampleBatch(cache, stats, n, 0, results);
+      }
+      batch = Now() - start;
+
+      start = Now();
+      for (s = 0; s < samples; s++) {
+         failed += SampleBatch(cache, stats, n, stalenessMs, results);
+      }
+      cached = Now() - start;
+
+      printf("%-6u %12.1f %12.1f %12.1f", n, each * 1e6 / samples,
+             batch * 1e6 / samples, cached * 1e6 / samples);
+      if (failed > 0) {
+         printf("  (%u stats failed)", failed);
+      }
+      printf("\n");
+   }
+
+   VMGuestLib_StatCacheClose(cache);
+   free(results);
+
+   return EXIT_SUCCESS;
+}
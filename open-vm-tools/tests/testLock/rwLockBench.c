@@ -0,0 +1,311 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * rwLockBench.c --
+ *
+ *   Benchmark for MXUserRWLock read scaling.  1 to 64 reader threads
+ *   acquire a lock for read, check a small shared structure and release
+ *   it, with the classic and the reader-optimized flavors.  A writer
+ *   thread can update the structure at a fixed interval.  The total number
+ *   of read acquires per second and the number of writes are reported for
+ *   each thread count and flavor.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "vmware.h"
+#include "userlock.h"
+#include "vm_atomic.h"
+
+#define DEFAULT_SECONDS         1.0
+#define DEFAULT_WRITE_US        0
+#define MAX_THREADS             64
+
+static const uint32 threadCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+typedef struct BenchShared {
+   MXUserRWLock *lock;
+   Atomic_uint32 stop;
+   uint32 writeIntervalUs;
+   /* The data the lock protects; the writer keeps a == b. */
+   volatile uint64 a;
+   volatile uint64 b;
+   uint64 writes;
+} BenchShared;
+
+typedef struct BenchReader {
+   BenchShared *shared;
+   uint64 reads;
+   uint64 torn;
+   /* Keep readers' counters off each other's cache lines. */
+   char pad[64];
+} BenchReader;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Now --
+ *
+ *    Current time in seconds.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Now(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * ReaderThread --
+ *
+ *    Acquire the lock for read until told to stop, checking that the
+ *    writer's update is never seen half done.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+ReaderThread(void *data)  // IN
+{
+   BenchReader *reader = data;
+   BenchShared *shared = reader->shared;
+
+   while (Atomic_Read32(&shared->stop) == 0) {
+      uint32 i;
+
+      for (i = 0; i < 256; i++) {
+         MXUser_AcquireForRead(shared->lock);
+         if (shared->a != shared->b) {
+            reader->torn++;
+         }
+         MXUser_ReleaseRWLock(shared->lock);
+      }
+      reader->reads += i;
+   }
+
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * WriterThread --
+ *
+ *    Update the shared structure every writeIntervalUs until told to stop.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+WriterThread(void *data)  // IN
+{
+   BenchShared *shared = data;
+
+   while (Atomic_Read32(&shared->stop) == 0) {
+      usleep(shared->writeIntervalUs);
+
+      MXUser_AcquireForWrite(shared->lock);
+      shared->a++;
+      shared->b++;
+      MXUser_ReleaseRWLock(shared->lock);
+      shared->writes++;
+   }
+
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *    Run 'numThreads' readers, and a writer if asked for, on a lock for
+ *    'seconds'.
+ *
+ * Results:
+ *    Read acquires per second, or a negative value if the threads could
+ *    not be started or a reader saw a torn update.  'writes' is the number
+ *    of write acquires.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+BenchRun(MXUserRWLock *lock,        // IN
+         uint32 numThreads,         // IN
+         uint32 writeIntervalUs,    // IN
+         double seconds,            // IN
+         uint64 *writes)            // OUT
+{
+   BenchShared shared;
+   BenchReader readers[MAX_THREADS];
+   pthread_t threads[MAX_THREADS];
+   pthread_t writer;
+   uint64 reads = 0;
+   uint64 torn = 0;
+   double start;
+   double elapsed;
+   uint32 started;
+   uint32 i;
+
+   memset(&shared, 0, sizeof shared);
+   shared.lock = lock;
+   shared.writeIntervalUs = writeIntervalUs;
+   Atomic_Write32(&shared.stop, 0);
+
+   start = Now();
+   for (started = 0; started < numThreads; started++) {
+      memset(&readers[started], 0, sizeof readers[started]);
+      readers[started].shared = &shared;
+      if (pthread_create(&threads[started], NULL, ReaderThread,
+                         &readers[started]) != 0) {
+         break;
+      }
+   }
+   if (started == numThreads && writeIntervalUs != 0 &&
+       pthread_create(&writer, NULL, WriterThread, &shared) != 0) {
+      writeIntervalUs = 0;
+      started = 0;
+   }
+
+   if (started == numThreads) {
+      usleep(seconds * 1e6);
+   }
+   Atomic_Write32(&shared.stop, 1);
+
+   for (i = 0; i < started; i++) {
+      pthread_join(threads[i], NULL);
+      reads += readers[i].reads;
+      torn += readers[i].torn;
+   }
+   if (writeIntervalUs != 0) {
+      pthread_join(writer, NULL);
+   }
+   elapsed = Now() - start;
+
+   *writes = shared.writes;
+   if (started != numThreads) {
+      fprintf(stderr, "Can't start %u threads.\n", numThreads);
+      return -1;
+   }
+   if (torn != 0) {
+      fprintf(stderr, "Readers saw %"FMT64"u torn updates.\n", torn);
+      return -1;
+   }
+
+   return reads / elapsed;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    Usage: rwLockBench [-s seconds] [-w write interval in us]
+ *
+ * Results:
+ *    EXIT_SUCCESS and EXIT_FAILURE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   double seconds = DEFAULT_SECONDS;
+   int writeIntervalUs = DEFAULT_WRITE_US;
+   unsigned int i;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "s:w:")) != -1) {
+      switch (opt) {
+      case 's':
+         seconds = atof(optarg);
+         break;
+      case 'w':
+         writeIntervalUs = atoi(optarg);
+         break;
+      default:
+         seconds = 0;
+         break;
+      }
+   }
+   if (seconds <= 0 || writeIntervalUs < 0 || optind < argc) {
+      fprintf(stderr, "Usage: %s [-s seconds] [-w write interval in us]\n",
+              argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   printf("%7s %14s %8s %14s %8s %8s\n", "readers", "classic/s", "writes",
+          "readeropt/s", "writes", "speedup");
+
+   for (i = 0; i < ARRAYSIZE(threadCounts); i++) {
+      MXUserRWLock *classic = MXUser_CreateRWLock("benchClassic",
+                                                  RANK_UNRANKED);
+      MXUserRWLock *readerOpt = MXUser_CreateReaderOptRWLock("benchReaderOpt",
+                                                             RANK_UNRANKED);
+      uint64 classicWrites;
+      uint64 readerOptWrites;
+      double classicRate;
+      double readerOptRate;
+
+      if (classic == NULL || readerOpt == NULL) {
+         fprintf(stderr, "Can't create the locks.\n");
+         return EXIT_FAILURE;
+      }
+
+      classicRate = BenchRun(classic, threadCounts[i], writeIntervalUs,
+                             seconds, &classicWrites);
+      readerOptRate = BenchRun(readerOpt, threadCounts[i], writeIntervalUs,
+                               seconds, &readerOptWrites);
+      MXUser_DestroyRWLock(classic);
+      MXUser_DestroyRWLock(readerOpt);
+
+      if (classicRate < 0 || readerOptRate < 0) {
+         return EXIT_FAILURE;
+      }
+
+      printf("%7u %14.0f %8"FMT64"u %14.0f %8"FMT64"u %7.1fx\n",
+             threadCounts[i], classicRate, classicWrites, readerOptRate,
+             readerOptWrites, readerOptRate / classicRate);
+   }
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,216 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * pollBench.c --
+ *
+ *   Scalability benchmark for the Poll implementations: many registered,
+ *   mostly idle sockets with a few of them becoming readable on every pass
+ *   of the main loop.  Read callbacks are registered for NUM_SOCKETS
+ *   sockets, then NUM_ROUNDS passes are run with ACTIVE_PCT percent of the
+ *   sockets ready, and the callbacks are removed.  The time taken by each
+ *   step is reported.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "vmware.h"
+#include "poll.h"
+
+#define NUM_SOCKETS     10000
+#define NUM_ROUNDS      1000
+#define ACTIVE_PCT      1
+
+static int benchFds[NUM_SOCKETS];
+static unsigned int benchSockets;
+static unsigned int benchReads;
+static unsigned int benchExpected;
+static unsigned int benchRound;
+static GMainLoop *benchLoop;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Now --
+ *
+ *    Current time in seconds.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Now(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BenchRead --
+ *
+ *    Device callback of the benchmark sockets: drain the socket.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+BenchRead(void *clientData)  // IN: socket
+{
+   char buf[16];
+
+   if (read((int)(intptr_t)clientData, buf, sizeof buf) > 0) {
+      benchReads++;
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BenchStep --
+ *
+ *    Main loop callback driving the benchmark.  Once every read of a round
+ *    has been seen, make ACTIVE_PCT percent of the sockets readable for the
+ *    next one, or quit the main loop after NUM_ROUNDS rounds.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+BenchStep(void *clientData)  // IN: unused
+{
+   unsigned int stride = 100 / ACTIVE_PCT;
+   unsigned int i;
+
+   if (benchReads < benchExpected) {
+      return;
+   }
+
+   if (benchRound++ == NUM_ROUNDS) {
+      Poll_CallbackRemove(POLL_CS_MAIN, POLL_FLAG_PERIODIC, BenchStep,
+                          NULL, POLL_MAIN_LOOP);
+      g_main_loop_quit(benchLoop);
+      return;
+   }
+
+   /* Sockets come in pairs; writing to the odd one wakes the even one. */
+   for (i = (benchRound % stride) * 2 + 1; i < benchSockets; i += 2 * stride) {
+      if (write(benchFds[i], "x", 1) == 1) {
+         benchExpected++;
+      }
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    Usage: pollBench [gtk|epoll]
+ *
+ * Results:
+ *    EXIT_SUCCESS and EXIT_FAILURE.
+ *
+ * Side effects:
+ *    Needs about NUM_SOCKETS descriptors.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   const char *impl = argc == 2 ? argv[1] : "gtk";
+   double start;
+   double elapsed;
+   unsigned int i;
+
+   if (argc > 2) {
+      goto usage;
+   }
+   if (strcmp(impl, "gtk") == 0) {
+      Poll_InitGtk();
+#if defined(__linux__)
+   } else if (strcmp(impl, "epoll") == 0) {
+      Poll_InitEpoll();
+#endif
+   } else {
+      goto usage;
+   }
+   benchLoop = g_main_loop_new(NULL, FALSE);
+
+   while (benchSockets < NUM_SOCKETS &&
+          socketpair(AF_UNIX, SOCK_STREAM, 0, &benchFds[benchSockets]) == 0) {
+      benchSockets += 2;
+   }
+   if (benchSockets < NUM_SOCKETS) {
+      fprintf(stderr, "Only %u sockets (raise RLIMIT_NOFILE).\n",
+              benchSockets);
+   }
+
+   start = Now();
+   for (i = 0; i < benchSockets; i++) {
+      Poll_Callback(POLL_CS_MAIN, POLL_FLAG_READ | POLL_FLAG_PERIODIC,
+                    BenchRead, (void *)(intptr_t)benchFds[i], POLL_DEVICE,
+                    benchFds[i], NULL);
+   }
+   printf("%s: registering %u callbacks: %.1f ms\n", impl, benchSockets,
+          (Now() - start) * 1e3);
+
+   start = Now();
+   Poll_Callback(POLL_CS_MAIN, POLL_FLAG_PERIODIC, BenchStep, NULL,
+                 POLL_MAIN_LOOP, 0, NULL);
+   g_main_loop_run(benchLoop);
+   elapsed = Now() - start;
+   printf("%s: %u rounds, %u reads: %.1f ms, %.3f ms/round\n", impl,
+          NUM_ROUNDS, benchReads, elapsed * 1e3, elapsed * 1e3 / NUM_ROUNDS);
+
+   start = Now();
+   for (i = 0; i < benchSockets; i++) {
+      Poll_CallbackRemove(POLL_CS_MAIN, POLL_FLAG_READ | POLL_FLAG_PERIODIC,
+                          BenchRead, (void *)(intptr_t)benchFds[i],
+                          POLL_DEVICE);
+   }
+   printf("%s: removing %u callbacks: %.1f ms\n", impl, benchSockets,
+          (Now() - start) * 1e3);
+
+   for (i = 0; i < benchSockets; i++) {
+      close(benchFds[i]);
+   }
+   g_main_loop_unref(benchLoop);
+
+   return benchReads == benchExpected ? EXIT_SUCCESS : EXIT_FAILURE;
+
+usage:
+   fprintf(stderr, "Usage: %s [gtk|epoll]\n", argv[0]);
+   return EXIT_FAILURE;
+}
@@ -0,0 +1,270 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * rpcDispatchBench.c --
+ *
+ *   Benchmark for guest RPC dispatch.  A channel without a backend gets
+ *   handlers registered for a set of commands modelled on the ones vmtoolsd
+ *   handles, which parse their arguments the way the real ones do.  A mix
+ *   of commands is then run through RpcChannel_Dispatch(), and the
+ *   dispatched RPCs per second are reported, along with the commands per
+ *   second for tokenizing each command alone with StrUtil_GetNextTokenView().
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "vmware.h"
+#include "strutil.h"
+#include "vmware/tools/guestrpc.h"
+
+#define DEFAULT_SECONDS         1.0
+#define BATCH                   1000
+
+static const char *benchCommands[] = {
+   "Resolution_Set 1920 1080",
+   "Set_Option synctime 1",
+   "Capabilities_Register",
+   "time.synchronize 1",
+   "vmbackup.start 1 0 0 1",
+   "Set_Option   broadcastIP 1",
+};
+
+/*
+ * Registered without being dispatched, so the handler table is realistic.
+ * RpcChannel_Setup() registers "reset" and "ping" itself.
+ */
+static const char *otherCommands[] = {
+   "OS_Halt", "OS_Reboot", "OS_PowerOn", "OS_Resume",
+   "OS_Suspend", "Unity_Enter", "Unity_Exit", "vmsvc.dnd", "copypaste.v4",
+   "vmbackup.abort", "vmbackup.snapshotDone", "deployPkg.begin",
+   "deployPkg.deploy", "guestInfo.broadcast", "Vix_1_Relayed_Command",
+   "Vix_1_Mount_Volumes", "hgfs.usability", "Display_Topology_Set",
+};
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Now --
+ *
+ *    Current time in seconds.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static double
+Now(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BenchNoArgs --
+ *
+ *    Handler for commands without arguments.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static gboolean
+BenchNoArgs(RpcInData *data)  // IN/OUT
+{
+   return RPCIN_SETRETVALS(data, "", TRUE);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BenchUints --
+ *
+ *    Handler that parses all its arguments as unsigned numbers, like
+ *    Resolution_Set and vmbackup.start.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static gboolean
+BenchUints(RpcInData *data)  // IN/OUT
+{
+   unsigned int index = 0;
+   uint32 value;
+
+   while (StrUtil_GetNextUintToken(&value, &index, data->args, " ")) {
+   }
+   if (index != strlen(data->args)) {
+      return RPCIN_SETRETVALS(data, "Invalid arguments", FALSE);
+   }
+   return RPCIN_SETRETVALS(data, "", TRUE);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BenchSetOption --
+ *
+ *    Handler that splits off an option name and takes the rest of the
+ *    arguments as its value, like Set_Option.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static gboolean
+BenchSetOption(RpcInData *data)  // IN/OUT
+{
+   unsigned int index = 0;
+   const char *option;
+   size_t optionLen;
+   const char *value;
+
+   if (!StrUtil_GetNextTokenView(&index, data->args, " ", &option,
+                                 &optionLen)) {
+      return RPCIN_SETRETVALS(data, "Invalid option", FALSE);
+   }
+   value = data->args + index + strspn(data->args + index, " ");
+   if (*value == '\0') {
+      return RPCIN_SETRETVALS(data, "Invalid value", FALSE);
+   }
+   return RPCIN_SETRETVALS(data, "", TRUE);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    Usage: rpcDispatchBench [seconds per measurement]
+ *
+ * Results:
+ *    EXIT_SUCCESS and EXIT_FAILURE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   RpcChannelCallback callbacks[ARRAYSIZE(benchCommands) +
+                                ARRAYSIZE(otherCommands)];
+   RpcChannel *chan;
+   double seconds = DEFAULT_SECONDS;
+   double start;
+   double elapsed;
+   uint64 dispatched = 0;
+   uint64 tokenized = 0;
+   uint64 tokens = 0;
+   unsigned int numCallbacks = 0;
+   unsigned int i;
+
+   if (argc > 2 || (argc == 2 && (seconds = atof(argv[1])) <= 0)) {
+      fprintf(stderr, "Usage: %s [seconds per measurement]\n", argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   chan = RpcChannel_Create();
+   RpcChannel_Setup(chan, "rpcDispatchBench", g_main_context_default(), NULL,
+                    NULL, NULL);
+   memset(callbacks, 0, sizeof callbacks);
+
+   for (i = 0; i < ARRAYSIZE(otherCommands); i++) {
+      callbacks[numCallbacks].name = otherCommands[i];
+      callbacks[numCallbacks].callback = BenchNoArgs;
+      RpcChannel_RegisterCallback(chan, &callbacks[numCallbacks++]);
+   }
+   callbacks[numCallbacks].name = "Resolution_Set";
+   callbacks[numCallbacks].callback = BenchUints;
+   RpcChannel_RegisterCallback(chan, &callbacks[numCallbacks++]);
+   callbacks[numCallbacks].name = "Set_Option";
+   callbacks[numCallbacks].callback = BenchSetOption;
+   RpcChannel_RegisterCallback(chan, &callbacks[numCallbacks++]);
+   callbacks[numCallbacks].name = "Capabilities_Register";
+   callbacks[numCallbacks].callback = BenchNoArgs;
+   RpcChannel_RegisterCallback(chan, &callbacks[numCallbacks++]);
+   callbacks[numCallbacks].name = "time.synchronize";
+   callbacks[numCallbacks].callback = BenchUints;
+   RpcChannel_RegisterCallback(chan, &callbacks[numCallbacks++]);
+   callbacks[numCallbacks].name = "vmbackup.start";
+   callbacks[numCallbacks].callback = BenchUints;
+   RpcChannel_RegisterCallback(chan, &callbacks[numCallbacks++]);
+
+   start = Now();
+   do {
+      for (i = 0; i < BATCH; i++) {
+         const char *cmd = benchCommands[i % ARRAYSIZE(benchCommands)];
+         RpcInData data;
+
+         memset(&data, 0, sizeof data);
+         data.args = cmd;
+         data.argsSize = strlen(cmd);
+         data.clientData = chan;
+         if (!RpcChannel_Dispatch(&data)) {
+            fprintf(stderr, "Dispatching '%s' failed: %s\n", cmd,
+                    data.result);
+            return EXIT_FAILURE;
+         }
+         if (data.freeResult) {
+            free(data.result);
+         }
+      }
+      dispatched += BATCH;
+      elapsed = Now() - start;
+   } while (elapsed < seconds);
+   printf("%-28s %12.0f\n", "dispatched RPCs/s", dispatched / elapsed);
+
+   start = Now();
+   do {
+      for (i = 0; i < BATCH; i++) {
+         const char *cmd = benchCommands[i % ARRAYSIZE(benchCommands)];
+         unsigned int index = 0;
+         const char *token;
+         size_t tokenLen;
+
+         while (StrUtil_GetNextTokenView(&index, cmd, " ", &token,
+                                         &tokenLen)) {
+            tokens++;
+         }
+      }
+      tokenized += BATCH;
+      elapsed = Now() - start;
+   } while (elapsed < seconds);
+   printf("%-28s %12.0f (%"FMT64"u tokens)\n", "tokenized commands/s",
+          tokenized / elapsed, tokens);
+
+   for (i = 0; i < numCallbacks; i++) {
+      RpcChannel_UnregisterCallback(chan, &callbacks[i]);
+   }
+   RpcChannel_Destroy(chan);
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,358 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * timeSyncBench.c --
+ *
+ *   Benchmark for the time sync loop.  Runs the loop of the timeSync
+ *   plugin, with and without the servo, against simulated clocks and
+ *   reports how long the guest takes to converge, the RMS and maximum
+ *   error once it has, and how many times the time was stepped.
+ *
+ *   In a virtual machine with time sync disabled, it can also record a
+ *   trace of the uncorrected guest OS error for the simulator to replay.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "timeSyncSim.h"
+#include "vm_basic_defs.h"
+
+#define DEFAULT_HOURS           6
+#define DEFAULT_SEED            1
+
+/* The guest has converged once the error stays within 1ms. */
+#define CONVERGED_ERROR         1000
+
+typedef struct BenchScenario {
+   const char *name;
+   TimeSyncSimParams params;
+} BenchScenario;
+
+/*
+ *    seed, initialError, driftPpm, wanderPpm, jitter, preemptChance,
+ *    preemptTime, lag, pauseInterval, pauseLength, catchupPpm,
+ *    maxTimeError, lagSupported, pllSupported
+ */
+static const BenchScenario scenarios[] = {
+   { "drift",   { 0, 20000, 35, 0, 20, 0, 0, 0, 0, 0,
+                  100000, US_PER_SEC, TRUE, TRUE } },
+   { "behind",  { 0, -45000, -120, 0, 20, 0, 0, 0, 0, 0,
+                  100000, US_PER_SEC, TRUE, TRUE } },
+   { "wander",  { 0, 5000, 50, 5, 20, 0, 0, 0, 0, 0,
+                  100000, US_PER_SEC, TRUE, TRUE } },
+   { "jitter",  { 0, 5000, 20, 0, 500, 0.05, 10000, 0, 0, 0,
+                  100000, US_PER_SEC, TRUE, TRUE } },
+   { "lag",     { 0, 5000, 15, 0, 20, 0, 0, 4000, 0, 0,
+                  100000, US_PER_SEC, TRUE, TRUE } },
+   { "pauses",  { 0, 5000, 25, 0, 20, 0.01, 2000, 1000,
+                  20 * 60 * US_PER_SEC, 4 * US_PER_SEC,
+                  100000, US_PER_SEC, TRUE, TRUE } },
+   { "step",    { 0, -3 * US_PER_SEC, 80, 0, 20, 0, 0, 0, 0, 0,
+                  100000, US_PER_SEC, TRUE, TRUE } },
+};
+
+/* Used when replaying a trace. */
+static const TimeSyncSimParams traceParams =
+   { 0, 0, 0, 0, 20, 0.01, 2000, 1000, 0, 0,
+     100000, US_PER_SEC, TRUE, TRUE };
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BenchLog --
+ *
+ *    Log handler that drops the time sync loop's debug messages.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+BenchLog(const gchar *domain,           // IN
+         GLogLevelFlags level,          // IN
+         const gchar *message,          // IN
+         gpointer data)                 // IN
+{
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BenchRun --
+ *
+ *    Run the time sync loop against the simulator and print a line of
+ *    results.  The error is sampled every second; the RMS and maximum
+ *    error are those of the second half of the run.
+ *
+ * Results:
+ *    TRUE on success.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchRun(const char *name,                  // IN
+         const TimeSyncSimParams *params,   // IN
+         const char *traceFile,             // IN
+         gboolean servo,                    // IN
+         int64 duration,                    // IN
+         uint32 period)                     // IN
+{
+   TimeSyncData data;
+   double *errors;
+   double sumSquares = 0;
+   double maxError = 0;
+   size_t numErrors = 0;
+   size_t maxErrors;
+   size_t converged;
+   size_t i;
+   int64 nextSync;
+
+   if (!TimeSyncSim_Init(params, traceFile)) {
+      return FALSE;
+   }
+   if (traceFile != NULL) {
+      duration = TimeSyncSim_TraceLength();
+   }
+
+   maxErrors = duration / US_PER_SEC + 1;
+   errors = malloc(maxErrors * sizeof *errors);
+   if (errors == NULL) {
+      return FALSE;
+   }
+
+   TimeSync_InitData(&data, &timeSyncSim);
+   data.slewCorrection = TRUE;
+   data.servo = servo;
+   data.timeSyncPeriod = period;
+
+   /* As in TimeSyncStartLoop. */
+   TimeSync_ResetSlew(&data);
+   TimeSync_DoSync(&data, data.slewCorrection, FALSE, FALSE);
+   nextSync = TimeSyncSim_Elapsed() + period * (int64)US_PER_SEC;
+
+   while (numErrors < maxErrors && TimeSyncSim_Elapsed() < duration) {
+      TimeSyncSim_Advance(US_PER_SEC);
+      errors[numErrors++] = TimeSyncSim_GuestError();
+
+      if (TimeSyncSim_Elapsed() >= nextSync) {
+         TimeSync_DoSync(&data, data.slewCorrection, FALSE, FALSE);
+         nextSync = TimeSyncSim_Elapsed() + period * (int64)US_PER_SEC;
+      }
+   }
+
+   for (converged = numErrors; converged > 0; converged--) {
+      if (fabs(errors[converged - 1]) > CONVERGED_ERROR) {
+         break;
+      }
+   }
+   for (i = numErrors / 2; i < numErrors; i++) {
+      sumSquares += errors[i] * errors[i];
+      maxError = MAX(maxError, fabs(errors[i]));
+   }
+
+   printf("%-8s %-8s ", name, servo ? "servo" : "classic");
+   if (converged < numErrors) {
+      printf("%10.0f", converged * (double)duration / numErrors / US_PER_SEC);
+   } else {
+      printf("%10s", "never");
+   }
+   printf(" %10.0f %10.0f %6u\n", sqrt(sumSquares / (numErrors - numErrors / 2)),
+          maxError, TimeSyncSim_Steps());
+
+   free(errors);
+   TimeSyncSim_Exit();
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * BenchRecord --
+ *
+ *    Record the guest OS error every 'period' seconds for 'duration'.
+ *    Time sync must be disabled while recording.
+ *
+ * Results:
+ *    TRUE on success.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static Bool
+BenchRecord(const char *traceFile,  // IN
+            int64 duration,         // IN
+            uint32 period)          // IN
+{
+   FILE *f = fopen(traceFile, "w");
+   int64 start = 0;
+
+   if (f == NULL) {
+      fprintf(stderr, "Can't create %s.\n", traceFile);
+      return FALSE;
+   }
+   fprintf(f, "# seconds, guest OS error (us)\n");
+
+   for (;;) {
+      int64 bestDelay = MAX_INT64;
+      int64 error = 0;
+      int64 host = 0;
+      int i;
+
+      for (i = 0; i < 4; i++) {
+         int64 host1, host2, apparentError, maxTimeError;
+         Bool apparentErrorValid;
+         struct timeval tv;
+
+         if (!TimeSync_BackdoorReadHost(&host1, &apparentError,
+                                        &apparentErrorValid, &maxTimeError) ||
+             gettimeofday(&tv, NULL) < 0 ||
+             !TimeSync_BackdoorReadHost(&host2, &apparentError,
+                                        &apparentErrorValid, &maxTimeError)) {
+            fclose(f);
+            return FALSE;
+         }
+         if (host2 - host1 < bestDelay) {
+            bestDelay = MAX(host2 - host1, 0);
+            host = host1 + bestDelay / 2;
+            error = (int64)tv.tv_sec * US_PER_SEC + tv.tv_usec - host -
+                    apparentError;
+         }
+      }
+
+      if (start == 0) {
+         start = host;
+      }
+      fprintf(f, "%.3f %"FMT64"d\n", (host - start) / (double)US_PER_SEC,
+              error);
+      fflush(f);
+
+      if (host - start >= duration) {
+         break;
+      }
+      sleep(period);
+   }
+
+   fclose(f);
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    Usage: timeSyncBench [-d hours] [-p period] [-s seed] [-t trace]
+ *           timeSyncBench -r trace [-d hours] [-p period]
+ *
+ *    Without -t, runs the built-in scenarios; with -t, replays a trace.
+ *    -r records a trace; it must be run in a virtual machine.
+ *
+ * Results:
+ *    EXIT_SUCCESS and EXIT_FAILURE.
+ *
+ * Side effects:
+ *    None.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   const char *replay = NULL;
+   const char *record = NULL;
+   double hours = DEFAULT_HOURS;
+   int period = TIMESYNC_TIME;
+   int seed = DEFAULT_SEED;
+   int64 duration;
+   unsigned int i;
+   int opt;
+
+   while ((opt = getopt(argc, argv, "d:p:r:s:t:")) != -1) {
+      switch (opt) {
+      case 'd':
+         hours = atof(optarg);
+         break;
+      case 'p':
+         period = atoi(optarg);
+         break;
+      case 'r':
+         record = optarg;
+         break;
+      case 's':
+         seed = atoi(optarg);
+         break;
+      case 't':
+         replay = optarg;
+         break;
+      default:
+         period = 0;
+         break;
+      }
+   }
+   if (hours <= 0 || period <= 0 || optind < argc ||
+       (record != NULL && replay != NULL)) {
+      fprintf(stderr, "Usage: %s [-d hours] [-p period] [-s seed] "
+              "[-t trace]\n       %s -r trace [-d hours] [-p period]\n",
+              argv[0], argv[0]);
+      return EXIT_FAILURE;
+   }
+   duration = (int64)(hours * 3600 * US_PER_SEC);
+
+   if (record != NULL) {
+      return BenchRecord(record, duration, period) ? EXIT_SUCCESS
+                                                   : EXIT_FAILURE;
+   }
+
+   g_log_set_handler(G_LOG_DOMAIN, G_LOG_LEVEL_DEBUG, BenchLog, NULL);
+
+   printf("%-8s %-8s %10s %10s %10s %6s\n", "scenario", "mode",
+          "converge/s", "rms/us", "max/us", "steps");
+
+   if (replay != NULL) {
+      TimeSyncSimParams params = traceParams;
+
+      params.seed = seed;
+      if (!BenchRun("trace", &params, replay, FALSE, duration, period) ||
+          !BenchRun("trace", &params, replay, TRUE, duration, period)) {
+         return EXIT_FAILURE;
+      }
+      return EXIT_SUCCESS;
+   }
+
+   for (i = 0; i < ARRAYSIZE(scenarios); i++) {
+      TimeSyncSimParams params = scenarios[i].params;
+
+      params.seed = seed;
+      BenchRun(scenarios[i].name, &params, NULL, FALSE, duration, period);
+      BenchRun(scenarios[i].name, &params, NULL, TRUE, duration, period);
+   }
+
+   return EXIT_SUCCESS;
+}
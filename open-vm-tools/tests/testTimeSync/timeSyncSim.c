@@ -0,0 +1,675 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file timeSyncSim.c
+ *
+ * A time sync source that simulates the host and the guest clock.
+ *
+ * Real time starts at TIMESYNC_SIM_EPOCH and only moves when the caller
+ * advances it, or when reading the host "takes" time.  The guest OS error
+ * is the sum of the error the guest clock would have if nobody corrected
+ * it, and of the corrections made through the source.  The uncorrected
+ * error either follows an initial error, a frequency error and a random
+ * walk of that frequency, or is replayed from a trace recorded in a
+ * virtual machine with time sync disabled.  A trace has one
+ * "<seconds> <guest OS error in us>" pair per line, in time order;
+ * the error is interpolated in between.
+ *
+ * The guest clock is corrected like Linux does it: a slew changes the
+ * tick length, which can only be set to whole microseconds per tick, and
+ * the PLL follows the kernel discipline with the time constant the plugin
+ * sets.  Apparent time falls behind during VM pauses and catches up
+ * afterwards; the host reports that lag if lagSupported is set.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "timeSyncSim.h"
+#include "vm_assert.h"
+#include "vm_basic_defs.h"
+
+#define TIMESYNC_SIM_EPOCH      (1451606400LL * US_PER_SEC)  /* 2016-01-01. */
+#define TIMESYNC_SIM_READ_TIME  2       /* A host read takes 2us. */
+#define TIMESYNC_SIM_STEP       US_PER_SEC
+
+/* Tick slewing, as in slewLinux.c. */
+#define TIMESYNC_SIM_USER_HZ    100
+#define TIMESYNC_SIM_TICK       (US_PER_SEC / TIMESYNC_SIM_USER_HZ)
+#define TIMESYNC_SIM_TICK_MAX   (1100000 / TIMESYNC_SIM_USER_HZ)
+#define TIMESYNC_SIM_TICK_MIN   (900000 / TIMESYNC_SIM_USER_HZ)
+
+/* Kernel PLL: phase is corrected with a time constant of 2^6s, the
+ * frequency is clamped to +/-500ppm. */
+#define TIMESYNC_SIM_PLL_SHIFT  6
+#define TIMESYNC_SIM_PLL_MAXPPM 500.0
+
+static struct {
+   TimeSyncSimParams params;
+   uint64   rng;
+   int64    now;              /* Real time elapsed. */
+   double   freeError;        /* Uncorrected guest OS error. */
+   double   drift;            /* Current frequency error, ppm. */
+   double   correction;       /* Sum of the corrections. */
+   double   lag;              /* Apparent time behind real time. */
+   int64    readLag;          /* Interrupt lag at the last guest read. */
+   int64    nextPause;
+   uint32   steps;
+
+   /* Tick slew. */
+   int64    tickLength;
+   int64    slewStart;
+   int64    slewRequested;
+
+   /* PLL. */
+   double   pllFreq;          /* ppm */
+   double   pllOffset;        /* Phase correction left, in us. */
+   int64    pllUpdate;        /* Time of the last update; 0: none. */
+
+   /* Trace. */
+   int64   *traceTime;
+   double  *traceError;
+   size_t   traceLen;
+   size_t   traceIdx;
+} sim;
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSimRandom --                                                 */ /**
+ *
+ * @return A uniformly distributed number in [0, 1).
+ *
+ ******************************************************************************
+ */
+
+static double
+TimeSyncSimRandom(void)
+{
+   sim.rng ^= sim.rng >> 12;
+   sim.rng ^= sim.rng << 25;
+   sim.rng ^= sim.rng >> 27;
+   return ((sim.rng * CONST64U(2685821657736338717)) >> 11) / 9007199254740992.0;
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSimNormal --                                                 */ /**
+ *
+ * @return A normally distributed number with mean 0 and deviation 1.
+ *
+ ******************************************************************************
+ */
+
+static double
+TimeSyncSimNormal(void)
+{
+   double u = 1.0 - TimeSyncSimRandom();
+   double v = TimeSyncSimRandom();
+
+   return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSimTraceError --                                             */ /**
+ *
+ * @return The uncorrected guest OS error from the trace at time 'now'.
+ *
+ ******************************************************************************
+ */
+
+static double
+TimeSyncSimTraceError(int64 now)
+{
+   size_t i = sim.traceIdx;
+
+   while (i + 1 < sim.traceLen && sim.traceTime[i + 1] <= now) {
+      i++;
+   }
+   sim.traceIdx = i;
+
+   if (i + 1 >= sim.traceLen || now <= sim.traceTime[i]) {
+      return sim.traceError[i];
+   }
+   return sim.traceError[i] +
+          (sim.traceError[i + 1] - sim.traceError[i]) *
+          (now - sim.traceTime[i]) / (sim.traceTime[i + 1] - sim.traceTime[i]);
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSimRun --                                                    */ /**
+ *
+ * Let 'delta' us of real time pass.
+ *
+ ******************************************************************************
+ */
+
+static void
+TimeSyncSimRun(int64 delta)
+{
+   while (delta > 0) {
+      int64 step = MIN(delta, TIMESYNC_SIM_STEP);
+      double secs = step / (double)US_PER_SEC;
+      double slew = (sim.tickLength - TIMESYNC_SIM_TICK) *
+                    (US_PER_SEC / (double)TIMESYNC_SIM_TICK);
+      double phase;
+
+      if (sim.params.pauseInterval != 0 &&
+          sim.now + step >= sim.nextPause) {
+         step = MAX(sim.nextPause - sim.now, 0);
+         secs = step / (double)US_PER_SEC;
+      }
+
+      if (sim.traceLen > 0) {
+         sim.freeError = TimeSyncSimTraceError(sim.now + step);
+      } else {
+         sim.freeError += sim.drift * secs;
+         sim.drift += sim.params.wanderPpm * sqrt(secs / 3600.0) *
+                      TimeSyncSimNormal();
+      }
+
+      phase = sim.pllOffset *
+              (1.0 - exp(-secs / (1 << TIMESYNC_SIM_PLL_SHIFT)));
+      sim.pllOffset -= phase;
+      sim.correction += (slew + sim.pllFreq) * secs + phase;
+
+      sim.lag = MAX(sim.lag - sim.params.catchupPpm * secs, 0.0);
+
+      sim.now += step;
+      delta -= step;
+
+      if (sim.params.pauseInterval != 0 && sim.now >= sim.nextPause) {
+         /* Apparent time stands still while the VM is paused. */
+         sim.now += sim.params.pauseLength;
+         sim.lag += sim.params.pauseLength;
+         sim.nextPause = sim.now + sim.params.pauseInterval;
+      }
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSimRead --                                                   */ /**
+ *
+ * Let the time taken by one read of the host pass, including, sometimes,
+ * the guest being descheduled.
+ *
+ ******************************************************************************
+ */
+
+static void
+TimeSyncSimRead(void)
+{
+   int64 delta = TIMESYNC_SIM_READ_TIME;
+
+   if (TimeSyncSimRandom() < sim.params.preemptChance) {
+      delta += (int64)(-log(1.0 - TimeSyncSimRandom()) *
+                       sim.params.preemptTime);
+   }
+   TimeSyncSimRun(delta);
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSimReadHost --                                               */ /**
+ *
+ * Read the simulated host time.  See TimeSync_BackdoorReadHost.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+TimeSyncSimReadHost(int64 *host,
+                    int64 *apparentError,
+                    Bool *apparentErrorValid,
+                    int64 *maxTimeError)
+{
+   int64 jitter = sim.params.jitter;
+
+   TimeSyncSimRead();
+
+   *host = TIMESYNC_SIM_EPOCH + sim.now;
+   if (jitter > 0) {
+      *host += (int64)(TimeSyncSimRandom() * (2 * jitter + 1)) - jitter;
+   }
+   *maxTimeError = sim.params.maxTimeError;
+   *apparentErrorValid = sim.params.lagSupported;
+   if (sim.params.lagSupported) {
+      *apparentError = -((int64)sim.lag + sim.readLag);
+   } else {
+      *apparentError = 0;
+      *maxTimeError += (int64)sim.lag + sim.readLag;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSimStopCatchup --                                            */ /**
+ *
+ * Stop apparent time from catching up: the time it was behind is lost
+ * by the guest OS.
+ *
+ ******************************************************************************
+ */
+
+static void
+TimeSyncSimStopCatchup(void)
+{
+   sim.correction -= sim.lag;
+   sim.lag = 0;
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSimGetCurrentTime --                                         */ /**
+ *
+ * Read the simulated guest time.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+TimeSyncSimGetCurrentTime(int64 *now)
+{
+   if (sim.params.lag > 0) {
+      sim.readLag = (int64)(TimeSyncSimRandom() * sim.params.lag);
+   }
+   *now = TIMESYNC_SIM_EPOCH + sim.now +
+          (int64)(sim.freeError + sim.correction - sim.lag) - sim.readLag;
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSimAddToCurrentTime --                                       */ /**
+ *
+ * Step the simulated guest time.  Like settimeofday, this drops what is
+ * left of the PLL's phase correction.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+TimeSyncSimAddToCurrentTime(int64 delta)
+{
+   sim.correction += delta;
+   sim.pllOffset = 0;
+   sim.steps++;
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSimSlew --                                                   */ /**
+ *
+ * Slew the simulated guest time.  See slewLinux.c.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+TimeSyncSimSlew(int64 delta,
+                int64 timeSyncPeriod,
+                int64 *remaining)
+{
+   int64 now;
+
+   ASSERT(timeSyncPeriod > 0);
+
+   TimeSyncSimGetCurrentTime(&now);
+   if (sim.slewStart != 0) {
+      int64 ticksElapsed = (now - sim.slewStart) / sim.tickLength;
+      int64 deltaApplied = ticksElapsed * (sim.tickLength - TIMESYNC_SIM_TICK);
+      *remaining = sim.slewRequested - deltaApplied;
+   }
+
+   sim.tickLength = (timeSyncPeriod + delta) /
+                    ((timeSyncPeriod / US_PER_SEC) * TIMESYNC_SIM_USER_HZ);
+   sim.tickLength = MAX(MIN(sim.tickLength, TIMESYNC_SIM_TICK_MAX),
+                        TIMESYNC_SIM_TICK_MIN);
+   sim.slewStart = now;
+   sim.slewRequested = delta;
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSimDisableTimeSlew --                                        */ /**
+ *
+ * Set the simulated tick length back to nominal.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+TimeSyncSimDisableTimeSlew(void)
+{
+   sim.tickLength = TIMESYNC_SIM_TICK;
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSimPLLUpdate --                                              */ /**
+ *
+ * Update the simulated PLL with a new offset.  See pllLinux.c.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+TimeSyncSimPLLUpdate(int64 offset)
+{
+   offset = MAX(MIN(offset, 500000), -500000);
+
+   if (sim.pllUpdate != 0) {
+      int64 secs = (sim.now - sim.pllUpdate) / US_PER_SEC;
+
+      secs = MIN(secs, 1 << (TIMESYNC_SIM_PLL_SHIFT + 1));
+      sim.pllFreq += (double)offset * secs /
+                     (1 << (2 * (TIMESYNC_SIM_PLL_SHIFT + 2)));
+      sim.pllFreq = MAX(MIN(sim.pllFreq, TIMESYNC_SIM_PLL_MAXPPM),
+                        -TIMESYNC_SIM_PLL_MAXPPM);
+   }
+   sim.pllOffset = offset;
+   sim.pllUpdate = sim.now;
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSimPLLSetFrequency --                                        */ /**
+ *
+ * Set the frequency of the simulated PLL.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+TimeSyncSimPLLSetFrequency(int64 ppmCorrection)
+{
+   sim.pllFreq = MAX(MIN(ppmCorrection / 65536.0, TIMESYNC_SIM_PLL_MAXPPM),
+                     -TIMESYNC_SIM_PLL_MAXPPM);
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSimPLLSupported --                                           */ /**
+ *
+ * @return Whether the simulated guest has a PLL.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+TimeSyncSimPLLSupported(void)
+{
+   return sim.params.pllSupported;
+}
+
+
+const TimeSyncSource timeSyncSim = {
+   TimeSyncSimReadHost,
+   TimeSyncSimStopCatchup,
+   TimeSyncSimGetCurrentTime,
+   TimeSyncSimAddToCurrentTime,
+   TimeSyncSimSlew,
+   TimeSyncSimDisableTimeSlew,
+   TimeSyncSimPLLUpdate,
+   TimeSyncSimPLLSetFrequency,
+   TimeSyncSimPLLSupported,
+};
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSimLoadTrace --                                              */ /**
+ *
+ * Load a trace of the uncorrected guest OS error.
+ *
+ * @param[in] traceFile    Path of the trace.
+ *
+ * @return TRUE on success.
+ *
+ ******************************************************************************
+ */
+
+static Bool
+TimeSyncSimLoadTrace(const char *traceFile)
+{
+   FILE *f = fopen(traceFile, "r");
+   size_t size = 0;
+   char line[256];
+   int lineNo = 0;
+
+   if (f == NULL) {
+      fprintf(stderr, "Can't open %s.\n", traceFile);
+      return FALSE;
+   }
+
+   while (fgets(line, sizeof line, f) != NULL) {
+      double secs;
+      double error;
+
+      lineNo++;
+      if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+         continue;
+      }
+      if (sscanf(line, "%lf %lf", &secs, &error) != 2 ||
+          (sim.traceLen > 0 &&
+           secs * US_PER_SEC < sim.traceTime[sim.traceLen - 1])) {
+         fprintf(stderr, "%s:%d: bad sample.\n", traceFile, lineNo);
+         goto error;
+      }
+      if (sim.traceLen == size) {
+         size = size == 0 ? 1024 : size * 2;
+         sim.traceTime = realloc(sim.traceTime, size * sizeof *sim.traceTime);
+         sim.traceError = realloc(sim.traceError,
+                                  size * sizeof *sim.traceError);
+         if (sim.traceTime == NULL || sim.traceError == NULL) {
+            goto error;
+         }
+      }
+      sim.traceTime[sim.traceLen] = (int64)(secs * US_PER_SEC);
+      sim.traceError[sim.traceLen] = error;
+      sim.traceLen++;
+   }
+
+   if (sim.traceLen == 0) {
+      fprintf(stderr, "%s: no samples.\n", traceFile);
+      goto error;
+   }
+
+   fclose(f);
+   return TRUE;
+
+error:
+   fclose(f);
+   TimeSyncSim_Exit();
+   return FALSE;
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSim_Init --                                                  */ /**
+ *
+ * Reset the simulation.
+ *
+ * @param[in] params       Simulation parameters.
+ * @param[in] traceFile    Trace of the uncorrected guest OS error, replacing
+ *                         initialError, driftPpm and wanderPpm; or NULL.
+ *
+ * @return TRUE on success.
+ *
+ ******************************************************************************
+ */
+
+Bool
+TimeSyncSim_Init(const TimeSyncSimParams *params,
+                 const char *traceFile)
+{
+   TimeSyncSim_Exit();
+   memset(&sim, 0, sizeof sim);
+
+   sim.params = *params;
+   sim.rng = params->seed * CONST64U(0x9E3779B97F4A7C15) | 1;
+   sim.drift = params->driftPpm;
+   sim.freeError = params->initialError;
+   sim.tickLength = TIMESYNC_SIM_TICK;
+   sim.nextPause = params->pauseInterval;
+
+   if (traceFile != NULL) {
+      if (!TimeSyncSimLoadTrace(traceFile)) {
+         return FALSE;
+      }
+      sim.now = sim.traceTime[0];
+      sim.freeError = sim.traceError[0];
+      sim.nextPause += sim.now;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSim_Exit --                                                  */ /**
+ *
+ * Free the trace.
+ *
+ ******************************************************************************
+ */
+
+void
+TimeSyncSim_Exit(void)
+{
+   free(sim.traceTime);
+   free(sim.traceError);
+   sim.traceTime = NULL;
+   sim.traceError = NULL;
+   sim.traceLen = 0;
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSim_Advance --                                               */ /**
+ *
+ * Let time pass.
+ *
+ * @param[in] delta        Real time, in us.
+ *
+ ******************************************************************************
+ */
+
+void
+TimeSyncSim_Advance(int64 delta)
+{
+   TimeSyncSimRun(delta);
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSim_Elapsed --                                               */ /**
+ *
+ * @return Real time since the start of the simulation, in us.
+ *
+ ******************************************************************************
+ */
+
+int64
+TimeSyncSim_Elapsed(void)
+{
+   return sim.now - (sim.traceLen > 0 ? sim.traceTime[0] : 0);
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSim_TraceLength --                                           */ /**
+ *
+ * @return Time covered by the trace, in us; 0 without a trace.
+ *
+ ******************************************************************************
+ */
+
+int64
+TimeSyncSim_TraceLength(void)
+{
+   if (sim.traceLen == 0) {
+      return 0;
+   }
+   return sim.traceTime[sim.traceLen - 1] - sim.traceTime[0];
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSim_GuestError --                                            */ /**
+ *
+ * @return The guest OS error, not counting apparent time lag, in us.
+ *
+ ******************************************************************************
+ */
+
+int64
+TimeSyncSim_GuestError(void)
+{
+   return (int64)(sim.freeError + sim.correction);
+}
+
+
+/*
+ ******************************************************************************
+ * TimeSyncSim_Steps --                                                 */ /**
+ *
+ * @return The number of times the guest time was stepped.
+ *
+ ******************************************************************************
+ */
+
+uint32
+TimeSyncSim_Steps(void)
+{
+   return sim.steps;
+}
@@ -0,0 +1,72 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+#ifndef _TIMESYNC_SIM_H_
+#define _TIMESYNC_SIM_H_
+
+/**
+ * @file timeSyncSim.h
+ *
+ * A deterministic simulation of host time and of a guest clock, for
+ * running the time sync loop outside of a virtual machine.
+ */
+
+#include "timeSync.h"
+
+typedef struct TimeSyncSimParams {
+   uint32   seed;             /* Seed of the random number generator. */
+   int64    initialError;     /* Guest OS error at the start, in us. */
+   double   driftPpm;         /* Frequency error of the guest clock. */
+   double   wanderPpm;        /* Random walk of driftPpm, per sqrt(hour). */
+   int64    jitter;           /* Host time read noise, +/- us. */
+   double   preemptChance;    /* Chance the guest is descheduled per read. */
+   int64    preemptTime;      /* Mean time it is descheduled for, in us. */
+   int64    lag;              /* Interrupt lag noise, 0 to lag us. */
+   int64    pauseInterval;    /* Time between VM pauses, in us; 0: none. */
+   int64    pauseLength;      /* Length of a VM pause, in us. */
+   double   catchupPpm;       /* Rate at which apparent time catches up. */
+   int64    maxTimeError;     /* Maximum time lag reported by the host. */
+   Bool     lagSupported;     /* Host has BDOOR_CMD_GETTIMEFULL_WITH_LAG. */
+   Bool     pllSupported;     /* Guest has a PLL. */
+} TimeSyncSimParams;
+
+extern const TimeSyncSource timeSyncSim;
+
+Bool
+TimeSyncSim_Init(const TimeSyncSimParams *params,
+                 const char *traceFile);
+
+void
+TimeSyncSim_Exit(void);
+
+void
+TimeSyncSim_Advance(int64 delta);
+
+int64
+TimeSyncSim_Elapsed(void);
+
+int64
+TimeSyncSim_TraceLength(void);
+
+int64
+TimeSyncSim_GuestError(void);
+
+uint32
+TimeSyncSim_Steps(void);
+
+#endif /* _TIMESYNC_SIM_H_ */
@@ -0,0 +1,603 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * aliasCacheTest.c --
+ *
+ *   Regression test for the VGAuth service's alias store cache.  An alias
+ *   store is set up in a temporary directory, and a user's aliases are
+ *   queried (and so cached) and then changed within the same second:
+ *
+ *   - an alias is removed through the service;
+ *   - the store file is rewritten behind the service's back with content
+ *     of the same size;
+ *   - a mapped alias is added and removed, after the mapping file was
+ *     queried by cert.
+ *
+ *   The next query must see the change.  The store has to be owned by
+ *   root, so the test is skipped when not run as root.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "serviceInt.h"
+
+#define TEST_USER               "root"
+#define EXIT_SKIP               77
+
+PrefHandle gPrefs = NULL;
+
+/* Two self-signed certs, for CN=alias-test-1 and CN=alias-test-2. */
+static const char cert1[] =
+   "-----BEGIN CERTIFICATE-----\n"
+   "MIICCjCCAXOgAwIBAgIUVFecKAl/F8bK7sP7tKGPLomTQR0wDQYJKoZIhvcNAQEL\n"
+   "BQAwFzEVMBMGA1UEAwwMYWxpYXMtdGVzdC0xMB4XDTI2MTAxOTEyNTIwNVoXDTM2\n"
+   "MTAxNjEyNTIwNVowFzEVMBMGA1UEAwwMYWxpYXMtdGVzdC0xMIGfMA0GCSqGSIb3\n"
+   "DQEBAQUAA4GNADCBiQKBgQDLk+DGn/ku4RMKImDRW8h3QiZCffccZI14yTDew5Dd\n"
+   "eKrF8iGO3vQpj98pHeifoWa4uRt/9GudfMjKzcoEXoGFC+6T352M2zQ4R/iB100l\n"
+   "bleMNe77SlD+9vOw0JmfXWTtzAQmaoYpSyvWVf2fT0IQVORI+1vR5UL0p3WSR6NX\n"
+   "YwIDAQABo1MwUTAdBgNVHQ4EFgQUm0SjBAp0BDt/Dosy7LqAeAEPl6kwHwYDVR0j\n"
+   "BBgwFoAUm0SjBAp0BDt/Dosy7LqAeAEPl6kwDwYDVR0TAQH/BAUwAwEB/zANBgkq\n"
+   "hkiG9w0BAQsFAAOBgQAgm8siSek0jQivkcE+BHIoEjS0TXvG4lURNykaSuoxpR4q\n"
+   "UYV6dq+E0HVae5IkxPk78qiBdiKs7DMDJLT20uwTnKDHJcj8UbPmBQ97GNeFVbSd\n"
+   "cJPKLGZ9zdtp5a1TViUEfK9531vCrxstRRBTXtlMox+D1FYlYeK1zZBlb1rJAw==\n"
+   "-----END CERTIFICATE-----\n";
+
+static const char cert2[] =
+   "-----BEGIN CERTIFICATE-----\n"
+   "MIICCjCCAXOgAwIBAgIUWuxUXowzjHtusMQuyyuJUT7LHJcwDQYJKoZIhvcNAQEL\n"
+   "BQAwFzEVMBMGA1UEAwwMYWxpYXMtdGVzdC0yMB4XDTI2MTAxOTEyNTIwNVoXDTM2\n"
+   "MTAxNjEyNTIwNVowFzEVMBMGA1UEAwwMYWxpYXMtdGVzdC0yMIGfMA0GCSqGSIb3\n"
+   "DQEBAQUAA4GNADCBiQKBgQCtGLPQdgH/DjzolD6NIxb6FkAXEMadyVpL040KAl00\n"
+   "4th/sCTKje/opOGtHSIi1uNi2ztpPem1rvwwCZqvQ2G+xuMNeEbfCw+r2Erk71DZ\n"
+   "rSK/fhQMIzL+dKqKfUSbiFGhJCbbTOLOG3rTlRqo/cvv+bQYH58X9MCvBnNEuvgc\n"
+   "BQIDAQABo1MwUTAdBgNVHQ4EFgQU2y5Tdk95j1Fy8njvUBr3Ej6WjjwwHwYDVR0j\n"
+   "BBgwFoAU2y5Tdk95j1Fy8njvUBr3Ej6WjjwwDwYDVR0TAQH/BAUwAwEB/zANBgkq\n"
+   "hkiG9w0BAQsFAAOBgQAwF1i93ZImzhIevonxQ6bTUq2ciaYBPbkwwLhYD+5eQ6Ny\n"
+   "hst0rKP4mma57I2Btmrw9LqfNqUuD013NlvVN5CUSj9Rzvx+CDF7oglEdBFScG8V\n"
+   "/mcQQgtICTJ6beOJCOyoZa9JZUq6c+YAnbibmvarA1J0uakWdtk6ljrplYnRgA==\n"
+   "-----END CERTIFICATE-----\n";
+
+typedef struct AliasTestDir {
+   gchar *root;
+   gchar *conf;
+   gchar *store;
+} AliasTestDir;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * ServiceEncodeUserName --
+ * ServiceDecodeUserName --
+ *
+ *    What the service does on POSIX: user names are used as they are.
+ *    The real ones live in service.c with the rest of the service.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+gchar *
+ServiceEncodeUserName(const char *userName)  // IN
+{
+   return g_strdup(userName);
+}
+
+gchar *
+ServiceDecodeUserName(const char *userName)  // IN
+{
+   return g_strdup(userName);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * QuietLog --
+ *
+ *    Drop the service's informational messages.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+QuietLog(const gchar *domain,     // IN
+         GLogLevelFlags level,    // IN
+         const gchar *message,    // IN
+         gpointer data)           // IN
+{
+   if (level & (G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL |
+                G_LOG_LEVEL_WARNING)) {
+      fprintf(stderr, "%s", message);
+   }
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * SetUpStore --
+ *
+ *    Create a temporary directory holding a config file that points the
+ *    alias store into it, and initialize the store.
+ *
+ * Results:
+ *    TRUE on success.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static gboolean
+SetUpStore(AliasTestDir *dir)  // OUT
+{
+   gchar *contents;
+   gboolean written;
+   char root[] = "/tmp/vgauthAliasTestXXXXXX";
+
+   if (mkdtemp(root) == NULL) {
+      fprintf(stderr, "mkdtemp: %s\n", strerror(errno));
+      return FALSE;
+   }
+   chmod(root, 0755);
+
+   dir->root = g_strdup(root);
+   dir->conf = g_strdup_printf("%s/vgauth.conf", root);
+   dir->store = g_strdup_printf("%s/aliasStore", root);
+
+   contents = g_strdup_printf("[%s]\n%s = %s\n",
+                              VGAUTH_PREF_GROUP_NAME_SERVICE,
+                              VGAUTH_PREF_ALIASSTORE_DIR, dir->store);
+   written = g_file_set_contents(dir->conf, contents, -1, NULL);
+   g_free(contents);
+   if (!written) {
+      fprintf(stderr, "Can't write %s.\n", dir->conf);
+      return FALSE;
+   }
+
+   gPrefs = Pref_Init(dir->conf);
+   if (ServiceAliasInitAliasStore() != VGAUTH_E_OK) {
+      fprintf(stderr, "Can't initialize the alias store in %s.\n",
+              dir->store);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TearDownStore --
+ *
+ *    Remove the temporary directory and everything in it.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void
+TearDownStore(AliasTestDir *dir)  // IN
+{
+   GDir *d = g_dir_open(dir->store, 0, NULL);
+
+   if (d != NULL) {
+      const gchar *name;
+
+      while ((name = g_dir_read_name(d)) != NULL) {
+         gchar *path = g_strdup_printf("%s/%s", dir->store, name);
+
+         g_unlink(path);
+         g_free(path);
+      }
+      g_dir_close(d);
+   }
+   g_rmdir(dir->store);
+   g_unlink(dir->conf);
+   g_rmdir(dir->root);
+
+   Pref_Shutdown(gPrefs);
+   g_free(dir->root);
+   g_free(dir->conf);
+   g_free(dir->store);
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * Now --
+ *
+ *    The current second.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static time_t
+Now(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * StartOfSecond --
+ *
+ *    Wait for the next second to start, so that the steps that follow are
+ *    done within it.
+ *
+ * Results:
+ *    The second.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static time_t
+StartOfSecond(void)
+{
+   struct timeval tv;
+
+   /*
+    * Start a little into it: file timestamps come from a coarse clock
+    * that can lag by a timer tick.
+    */
+   gettimeofday(&tv, NULL);
+   usleep(1000000 - tv.tv_usec + 50000);
+
+   return Now();
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CheckAliases --
+ *
+ *    Query TEST_USER's aliases and check the certs and the comment of the
+ *    first one.
+ *
+ * Results:
+ *    TRUE if they are as expected.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static gboolean
+CheckAliases(const char *test,       // IN
+             int expectedNum,        // IN
+             const char *comment)    // IN
+{
+   ServiceAlias *aList = NULL;
+   int num = 0;
+   gboolean ok;
+
+   if (ServiceAliasQueryAliases(TEST_USER, &num, &aList) != VGAUTH_E_OK) {
+      fprintf(stderr, "%s: query failed.\n", test);
+      return FALSE;
+   }
+
+   ok = num == expectedNum &&
+        (num < 1 || ServiceComparePEMCerts(aList[0].pemCert, cert1)) &&
+        (num < 2 || ServiceComparePEMCerts(aList[1].pemCert, cert2)) &&
+        (num < 1 || (aList[0].num == 1 &&
+                     strcmp(aList[0].infos[0].comment, comment) == 0));
+   if (!ok) {
+      fprintf(stderr, "%s: got %d aliases (%s), expected %d (%s).\n", test,
+              num, num > 0 && aList[0].num > 0 ? aList[0].infos[0].comment
+                                               : "-",
+              expectedNum, comment);
+   }
+   ServiceAliasFreeAliasList(num, aList);
+
+   return ok;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestRemove --
+ *
+ *    Add two aliases, query them, remove one and query again, all within
+ *    one second.
+ *
+ * Results:
+ *    TRUE if the second query doesn't return the removed alias.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static gboolean
+TestRemove(void)
+{
+   static const char *test = "remove";
+   ServiceAliasInfo ai = { SUBJECT_TYPE_NAMED, "subject", "first" };
+   ServiceSubject subj = { SUBJECT_TYPE_UNSET, NULL };
+   time_t second = StartOfSecond();
+   gboolean ok;
+
+   if (ServiceAliasAddAlias(TEST_USER, TEST_USER, FALSE, cert1,
+                            &ai) != VGAUTH_E_OK ||
+       ServiceAliasAddAlias(TEST_USER, TEST_USER, FALSE, cert2,
+                            &ai) != VGAUTH_E_OK) {
+      fprintf(stderr, "%s: can't add the aliases.\n", test);
+      return FALSE;
+   }
+
+   ok = CheckAliases(test, 2, "first");
+
+   if (ServiceAliasRemoveAlias(TEST_USER, TEST_USER, cert2,
+                               &subj) != VGAUTH_E_OK) {
+      fprintf(stderr, "%s: can't remove the alias.\n", test);
+      return FALSE;
+   }
+
+   ok = CheckAliases(test, 1, "first") && ok;
+
+   printf("%-20s %s%s\n", test, ok ? "passed" : "FAILED",
+          Now() == second ? "" : " (crossed a second)");
+   return ok;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * RewriteFile --
+ *
+ *    Rewrite a file in place, keeping its inode.
+ *
+ * Results:
+ *    TRUE on success.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static gboolean
+RewriteFile(const gchar *fileName,   // IN
+            const gchar *contents,   // IN
+            gsize len)               // IN
+{
+   int fd = open(fileName, O_WRONLY | O_TRUNC);
+   gboolean ok;
+
+   if (fd < 0) {
+      return FALSE;
+   }
+   ok = write(fd, contents, len) == len;
+   close(fd);
+
+   return ok;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestRewrite --
+ *
+ *    Within one second: rewrite the store file in place, query the
+ *    aliases, then rewrite the file again with a comment of the same
+ *    length, so that only its contents and timestamps change, and query
+ *    again.
+ *
+ * Results:
+ *    TRUE if the second query sees the new comment.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static gboolean
+TestRewrite(const AliasTestDir *dir)  // IN
+{
+   static const char *test = "rewrite";
+   gchar *fileName = g_strdup_printf("%s/user-%s.xml", dir->store,
+                                     TEST_USER);
+   gchar *contents = NULL;
+   gchar *newContents = NULL;
+   gchar *comment;
+   gsize len;
+   time_t second;
+   gboolean ok = FALSE;
+
+   if (!g_file_get_contents(fileName, &contents, &len, NULL) ||
+       (comment = strstr(contents, "first")) == NULL) {
+      fprintf(stderr, "%s: can't read %s.\n", test, fileName);
+      goto exit;
+   }
+   newContents = g_strdup(contents);
+   memcpy(newContents + (comment - contents), "other", 5);
+
+   second = StartOfSecond();
+   if (!RewriteFile(fileName, contents, len) ||
+       !CheckAliases(test, 1, "first")) {
+      goto exit;
+   }
+
+   /*
+    * Let a timer tick go by, so that even a file system with coarse
+    * timestamps gives the rewrite a different one.
+    */
+   usleep(20000);
+
+   if (!RewriteFile(fileName, newContents, len)) {
+      fprintf(stderr, "%s: can't rewrite %s.\n", test, fileName);
+      goto exit;
+   }
+
+   ok = CheckAliases(test, 1, "other");
+
+   printf("%-20s %s%s\n", test, ok ? "passed" : "FAILED",
+          Now() == second ? "" : " (crossed a second)");
+
+exit:
+   g_free(contents);
+   g_free(newContents);
+   g_free(fileName);
+   return ok;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * CheckMapped --
+ *
+ *    Query the mapped aliases for 'cert' and check how many there are.
+ *
+ * Results:
+ *    TRUE if there are as many as expected, all for TEST_USER.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static gboolean
+CheckMapped(const char *test,       // IN
+            const char *cert,       // IN
+            int expectedNum)        // IN
+{
+   ServiceMappedAlias *maList = NULL;
+   int num = 0;
+   gboolean ok;
+   int i;
+
+   if (ServiceAliasQueryMappedAliasesForCert(cert, &num,
+                                             &maList) != VGAUTH_E_OK) {
+      fprintf(stderr, "%s: mapped query failed.\n", test);
+      return FALSE;
+   }
+
+   ok = num == expectedNum;
+   for (i = 0; i < num; i++) {
+      ok = ok && strcmp(maList[i].userName, TEST_USER) == 0 &&
+           ServiceComparePEMCerts(maList[i].pemCert, cert);
+   }
+   if (!ok) {
+      fprintf(stderr, "%s: got %d mapped aliases, expected %d.\n", test,
+              num, expectedNum);
+   }
+   ServiceAliasFreeMappedAliasList(num, maList);
+
+   return ok;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * TestMapped --
+ *
+ *    Map cert1 and query both certs, then map cert2, query, remove it and
+ *    query again, all within one second.
+ *
+ * Results:
+ *    TRUE if every query sees the mapping file as it was last saved.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static gboolean
+TestMapped(void)
+{
+   static const char *test = "mapped";
+   ServiceAliasInfo ai = { SUBJECT_TYPE_NAMED, "subject", "mapped" };
+   ServiceSubject subj = { SUBJECT_TYPE_UNSET, NULL };
+   time_t second = StartOfSecond();
+   gboolean ok;
+
+   if (ServiceAliasAddAlias(TEST_USER, TEST_USER, TRUE, cert1,
+                            &ai) != VGAUTH_E_OK) {
+      fprintf(stderr, "%s: can't add the mapped alias.\n", test);
+      return FALSE;
+   }
+
+   ok = CheckMapped(test, cert1, 1) && CheckMapped(test, cert2, 0);
+
+   if (ServiceAliasAddAlias(TEST_USER, TEST_USER, TRUE, cert2,
+                            &ai) != VGAUTH_E_OK) {
+      fprintf(stderr, "%s: can't add the mapped alias.\n", test);
+      return FALSE;
+   }
+
+   ok = CheckMapped(test, cert2, 1) && ok;
+
+   if (ServiceAliasRemoveAlias(TEST_USER, TEST_USER, cert2,
+                               &subj) != VGAUTH_E_OK) {
+      fprintf(stderr, "%s: can't remove the mapped alias.\n", test);
+      return FALSE;
+   }
+
+   ok = CheckMapped(test, cert2, 0) && CheckMapped(test, cert1, 1) && ok;
+
+   printf("%-20s %s%s\n", test, ok ? "passed" : "FAILED",
+          Now() == second ? "" : " (crossed a second)");
+   return ok;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    Usage: aliasCacheTest
+ *
+ * Results:
+ *    EXIT_SUCCESS if every test passed, 77 if the tests can't run here,
+ *    EXIT_FAILURE otherwise.
+ *
+ * Side effects:
+ *    Creates and removes a directory under /tmp.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   AliasTestDir dir;
+   gboolean ok;
+
+   if (geteuid() != 0) {
+      printf("The alias store must be owned by root; skipped.\n");
+      return EXIT_SKIP;
+   }
+
+   g_log_set_default_handler(QuietLog, NULL);
+
+   memset(&dir, 0, sizeof dir);
+   ok = SetUpStore(&dir);
+   ok = ok && TestRemove();
+   ok = ok && TestRewrite(&dir);
+   ok = ok && TestMapped();
+   TearDownStore(&dir);
+
+   return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
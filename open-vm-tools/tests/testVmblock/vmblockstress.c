@@ -0,0 +1,217 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * vmblockstress.c --
+ *
+ *   Stress/benchmark program for the vmblock block table.  Adds thousands of
+ *   blocks, as a large DnD operation would, then has a number of threads
+ *   resolve an unblocked entry through the vmblock namespace as fast as they
+ *   can.  Every such access has to search the block table, so the reported
+ *   rate tracks the cost of a lookup miss with a full table.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vmblock_user.h"
+#include "vm_basic_types.h"
+
+#define REALROOT                "/tmp/VMwareDnD/"
+#define TARGETNAME              "stress"
+#define BLOCKNAME_FMT           REALROOT "stress-block-%u"
+#define ACCESSORNAME            VMBLOCK_FS_ROOT "/" TARGETNAME
+
+#define DEFAULT_BLOCKS          5000
+#define DEFAULT_THREADS         8
+#define DEFAULT_SECONDS         10
+
+typedef struct StressThread {
+   pthread_t thread;
+   unsigned long accesses;
+   Bool failed;
+} StressThread;
+
+static volatile Bool programQuit = FALSE;
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * accessor --
+ *
+ *    Entry point for the accessor threads.  Repeatedly resolves the unblocked
+ *    target through the vmblock namespace until told to stop.
+ *
+ * Results:
+ *    NULL.
+ *
+ * Side effects:
+ *    Updates the thread's access count and failure flag.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+static void *
+accessor(void *arg)  // IN
+{
+   StressThread *self = arg;
+   char buf[PATH_MAX];
+
+   while (!programQuit) {
+      if (readlink(ACCESSORNAME, buf, sizeof buf) < 0) {
+         fprintf(stderr, "readlink(%s): %s\n", ACCESSORNAME, strerror(errno));
+         self->failed = TRUE;
+         break;
+      }
+      self->accesses++;
+   }
+
+   return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------------
+ *
+ * main --
+ *
+ *    Usage: vmblockstress [blocks [threads [seconds]]]
+ *
+ *    Adds the requested number of blocks, runs the accessor threads for the
+ *    requested time, reports the aggregate access rate, then removes every
+ *    block again.
+ *
+ * Results:
+ *    EXIT_SUCCESS and EXIT_FAILURE.
+ *
+ * Side effects:
+ *    Creates REALROOT/TARGETNAME if it does not exist.
+ *
+ *----------------------------------------------------------------------------
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   unsigned int numBlocks = argc > 1 ? atoi(argv[1]) : DEFAULT_BLOCKS;
+   unsigned int numThreads = argc > 2 ? atoi(argv[2]) : DEFAULT_THREADS;
+   unsigned int seconds = argc > 3 ? atoi(argv[3]) : DEFAULT_SECONDS;
+   StressThread *threads;
+   unsigned long total = 0;
+   unsigned int added = 0;
+   unsigned int i;
+   struct timeval start;
+   struct timeval end;
+   double elapsed;
+   char name[PATH_MAX];
+   int ret = EXIT_SUCCESS;
+   int blockFd;
+
+   if (numThreads == 0) {
+      fprintf(stderr, "Usage: %s [blocks [threads [seconds]]]\n", argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   if (mkdir(REALROOT TARGETNAME, S_IRWXU | S_IRWXG) != 0 && errno != EEXIST) {
+      fprintf(stderr, "could not create " REALROOT TARGETNAME ": %s\n",
+              strerror(errno));
+      return EXIT_FAILURE;
+   }
+
+   blockFd = open(VMBLOCK_DEVICE, VMBLOCK_DEVICE_MODE);
+   if (blockFd < 0) {
+      fprintf(stderr, "could not open " VMBLOCK_DEVICE ": %s\n",
+              strerror(errno));
+      return EXIT_FAILURE;
+   }
+
+   gettimeofday(&start, NULL);
+   for (added = 0; added < numBlocks; added++) {
+      snprintf(name, sizeof name, BLOCKNAME_FMT, added);
+      if (VMBLOCK_CONTROL(blockFd, VMBLOCK_ADD_FILEBLOCK, name) != 0) {
+         fprintf(stderr, "could not add block on [%s]: %s\n",
+                 name, strerror(errno));
+         ret = EXIT_FAILURE;
+         goto cleanup;
+      }
+   }
+   gettimeofday(&end, NULL);
+   elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+   printf("Added %u blocks in %.3f s.\n", numBlocks, elapsed);
+
+   threads = calloc(numThreads, sizeof *threads);
+   if (threads == NULL) {
+      ret = EXIT_FAILURE;
+      goto cleanup;
+   }
+
+   gettimeofday(&start, NULL);
+   for (i = 0; i < numThreads; i++) {
+      if (pthread_create(&threads[i].thread, NULL, accessor, &threads[i])) {
+         fprintf(stderr, "could not create accessor thread %u\n", i);
+         programQuit = TRUE;
+         numThreads = i;
+         ret = EXIT_FAILURE;
+         break;
+      }
+   }
+
+   if (ret == EXIT_SUCCESS) {
+      sleep(seconds);
+      programQuit = TRUE;
+   }
+
+   for (i = 0; i < numThreads; i++) {
+      pthread_join(threads[i].thread, NULL);
+      total += threads[i].accesses;
+      if (threads[i].failed) {
+         ret = EXIT_FAILURE;
+      }
+   }
+   gettimeofday(&end, NULL);
+   free(threads);
+
+   elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+   printf("%u threads, %u blocks: %lu accesses in %.3f s (%.0f/s).\n",
+          numThreads, numBlocks, total, elapsed, total / elapsed);
+
+cleanup:
+   while (added > 0) {
+      added--;
+      snprintf(name, sizeof name, BLOCKNAME_FMT, added);
+      if (VMBLOCK_CONTROL(blockFd, VMBLOCK_DEL_FILEBLOCK, name) != 0) {
+         fprintf(stderr, "could not delete block on [%s]: %s\n",
+                 name, strerror(errno));
+         ret = EXIT_FAILURE;
+      }
+   }
+   close(blockFd);
+
+   return ret;
+}
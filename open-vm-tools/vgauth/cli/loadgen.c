@@ -0,0 +1,429 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file loadgen.c
+ *
+ *    Load generator for VGAuthService.  Runs a mix of expensive
+ *    (ValidateSamlBearerToken) and cheap (QueryMappedAliases) clients
+ *    against the service for a fixed time, each on its own connection,
+ *    and reports the request rate and latency of each kind.  The latency
+ *    of the cheap requests shows how much the expensive ones hold up
+ *    everybody else.
+ *
+ *    Ticket clients loop on CreateTicket/ValidateTicket/RevokeTicket,
+ *    using a handle from the SAML token.  Creating the ticket happens as
+ *    the token's user and validating it as root, so with a non-root user
+ *    this measures how much switching connections costs; compare runs
+ *    with and without --keep-sessions.
+ *
+ *    Non-root users are subject to the service's per-user connection
+ *    limit (maxDataConnectionsPerUser), so run it as root to use more
+ *    clients than that.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "VGAuthBasicDefs.h"
+#include "VGAuthAlias.h"
+#include "VGAuthAuthentication.h"
+#include "VGAuthCommon.h"
+#include "VGAuthError.h"
+
+typedef enum {
+   LOAD_SAML,
+   LOAD_FAST,
+   LOAD_TICKET,
+} LoadKind;
+
+typedef struct LoadClient {
+   VGAuthContext *ctx;
+   LoadKind kind;
+   VGAuthUserHandle *handle;
+   GThread *thread;
+
+   guint64 requests;
+   guint64 errors;
+   gdouble totalLatency;
+   gdouble maxLatency;
+} LoadClient;
+
+static volatile gboolean loadQuit = FALSE;
+
+static gchar *tokenFile = NULL;
+static gchar *tokenText = NULL;
+static gchar *userName = NULL;
+static gint numSamlClients = 2;
+static gint numFastClients = 2;
+static gint numTicketClients = 0;
+static gboolean keepSessions = FALSE;
+static gint seconds = 10;
+static gboolean verbose = FALSE;
+
+static GOptionEntry loadOptions[] = {
+   { "token", 't', 0, G_OPTION_ARG_FILENAME, &tokenFile,
+      "File containing a SAML bearer token to validate", "file" },
+   { "username", 'u', 0, G_OPTION_ARG_STRING, &userName,
+      "User to validate the token as", "user" },
+   { "saml", 's', 0, G_OPTION_ARG_INT, &numSamlClients,
+      "Number of ValidateSamlBearerToken clients (default 2)", "N" },
+   { "fast", 'f', 0, G_OPTION_ARG_INT, &numFastClients,
+      "Number of QueryMappedAliases clients (default 2)", "N" },
+   { "tickets", 'T', 0, G_OPTION_ARG_INT, &numTicketClients,
+      "Number of ticket create/validate/revoke clients (default 0)", "N" },
+   { "keep-sessions", 'k', 0, G_OPTION_ARG_NONE, &keepSessions,
+      "Keep each client's connections open when it switches user", NULL },
+   { "duration", 'd', 0, G_OPTION_ARG_INT, &seconds,
+      "Seconds to run for (default 10)", "secs" },
+   { "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+      "Show library warnings", NULL },
+   { NULL }
+};
+
+
+/*
+ ******************************************************************************
+ * LoadLog --                                                            */ /**
+ *
+ * Log handler; drops everything unless --verbose was given.
+ *
+ * @param[in]     logDomain   The glib logging domain.
+ * @param[in]     logLevel    The severity of the message.
+ * @param[in]     msg         The message.
+ * @param[in]     userData    Unused.
+ *
+ ******************************************************************************
+ */
+
+static void
+LoadLog(const char *logDomain,
+        int logLevel,
+        const char *msg,
+        void *userData)
+{
+   if (verbose && (logLevel & G_LOG_LEVEL_WARNING)) {
+      g_printerr("%s[%d]: %s", logDomain, logLevel, msg);
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * LoadRequest --                                                        */ /**
+ *
+ * Issues one request of the client's kind.  For ticket clients that is
+ * the whole create/validate/revoke cycle.
+ *
+ * @param[in]  client      The client.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure.
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+LoadRequest(LoadClient *client)
+{
+   VGAuthError err;
+
+   if (LOAD_TICKET == client->kind) {
+      VGAuthUserHandle *handle = NULL;
+      char *ticket = NULL;
+
+      err = VGAuth_CreateTicket(client->ctx, client->handle, 0, NULL,
+                                &ticket);
+      if (VGAUTH_E_OK != err) {
+         return err;
+      }
+      err = VGAuth_ValidateTicket(client->ctx, ticket, 0, NULL, &handle);
+      if (VGAUTH_E_OK == err) {
+         VGAuth_UserHandleFree(handle);
+         err = VGAuth_RevokeTicket(client->ctx, ticket, 0, NULL);
+      }
+      VGAuth_FreeBuffer(ticket);
+   } else if (LOAD_SAML == client->kind) {
+      VGAuthExtraParams infoOnly[] = {
+         { VGAUTH_PARAM_VALIDATE_INFO_ONLY, VGAUTH_PARAM_VALUE_TRUE },
+      };
+      VGAuthUserHandle *handle = NULL;
+
+      err = VGAuth_ValidateSamlBearerToken(client->ctx, tokenText, userName,
+                                           G_N_ELEMENTS(infoOnly), infoOnly,
+                                           &handle);
+      if (VGAUTH_E_OK == err) {
+         VGAuth_UserHandleFree(handle);
+      }
+   } else {
+      VGAuthMappedAlias *maList = NULL;
+      int num = 0;
+
+      err = VGAuth_QueryMappedAliases(client->ctx, 0, NULL, &num, &maList);
+      if (VGAUTH_E_OK == err) {
+         VGAuth_FreeMappedAliasList(num, maList);
+      }
+   }
+
+   return err;
+}
+
+
+/*
+ ******************************************************************************
+ * LoadClientRun --                                                      */ /**
+ *
+ * Client thread.  Issues requests back to back until told to stop.
+ *
+ * @param[in]  data        The LoadClient.
+ *
+ * @return NULL
+ *
+ ******************************************************************************
+ */
+
+static gpointer
+LoadClientRun(gpointer data)
+{
+   LoadClient *client = (LoadClient *) data;
+   GTimer *timer = g_timer_new();
+
+   while (!loadQuit) {
+      VGAuthError err;
+      gdouble elapsed;
+
+      g_timer_start(timer);
+      err = LoadRequest(client);
+      elapsed = g_timer_elapsed(timer, NULL);
+
+      client->requests++;
+      client->totalLatency += elapsed;
+      if (elapsed > client->maxLatency) {
+         client->maxLatency = elapsed;
+      }
+      if (VGAUTH_E_OK != err) {
+         client->errors++;
+      }
+   }
+
+   g_timer_destroy(timer);
+
+   return NULL;
+}
+
+
+/*
+ ******************************************************************************
+ * LoadReport --                                                         */ /**
+ *
+ * Prints the totals for one kind of client.
+ *
+ * @param[in]  label       What the clients were doing.
+ * @param[in]  clients     All the clients.
+ * @param[in]  numClients  The number of clients.
+ * @param[in]  kind        Which kind to report.
+ * @param[in]  elapsed     How long the run took, in seconds.
+ *
+ ******************************************************************************
+ */
+
+static void
+LoadReport(const char *label,
+           const LoadClient *clients,
+           int numClients,
+           LoadKind kind,
+           gdouble elapsed)
+{
+   guint64 requests = 0;
+   guint64 errors = 0;
+   gdouble totalLatency = 0.0;
+   gdouble maxLatency = 0.0;
+   int n = 0;
+   int i;
+
+   for (i = 0; i < numClients; i++) {
+      if (clients[i].kind != kind) {
+         continue;
+      }
+      n++;
+      requests += clients[i].requests;
+      errors += clients[i].errors;
+      totalLatency += clients[i].totalLatency;
+      maxLatency = MAX(maxLatency, clients[i].maxLatency);
+   }
+
+   if (0 == n) {
+      return;
+   }
+
+   printf("%-20s %3d clients %10.1f req/s  avg %8.3f ms  max %8.3f ms  "
+          "%"G_GUINT64_FORMAT" errors\n",
+          label, n, requests / elapsed,
+          requests ? totalLatency * 1000.0 / requests : 0.0,
+          maxLatency * 1000.0, errors);
+}
+
+
+/*
+ ******************************************************************************
+ * main --                                                               */ /**
+ *
+ * Usage: vgauth-loadgen [-t token-file -u user] [-s N] [-f N] [-T N] [-k]
+ *                       [-d secs]
+ *
+ * @return 0 on success, non-zero on failure.
+ *
+ ******************************************************************************
+ */
+
+int
+main(int argc,
+     char *argv[])
+{
+   GOptionContext *context;
+   GError *gErr = NULL;
+   LoadClient *clients;
+   int numClients;
+   GTimer *timer;
+   gdouble elapsed;
+   int ret = 0;
+   int i;
+
+   if (!g_thread_supported()) {
+      g_thread_init(NULL);
+   }
+
+   context = g_option_context_new("- VGAuthService load generator");
+   g_option_context_add_main_entries(context, loadOptions, NULL);
+   if (!g_option_context_parse(context, &argc, &argv, &gErr)) {
+      g_printerr("%s: %s\n", g_get_prgname(), gErr->message);
+      g_error_free(gErr);
+      return 1;
+   }
+   g_option_context_free(context);
+
+   if (numSamlClients < 0 || numFastClients < 0 || numTicketClients < 0 ||
+       seconds <= 0) {
+      g_printerr("%s: bad client count or duration\n", g_get_prgname());
+      return 1;
+   }
+
+   if (NULL == tokenFile) {
+      numSamlClients = 0;
+      numTicketClients = 0;
+   } else if (!g_file_get_contents(tokenFile, &tokenText, NULL, &gErr)) {
+      g_printerr("%s: %s\n", g_get_prgname(), gErr->message);
+      g_error_free(gErr);
+      return 1;
+   }
+
+   numClients = numSamlClients + numFastClients + numTicketClients;
+   if (0 == numClients) {
+      g_printerr("%s: no clients to run\n", g_get_prgname());
+      return 1;
+   }
+
+   VGAuth_SetLogHandler(LoadLog, NULL, 0, NULL);
+
+   /*
+    * Contexts are set up here, since VGAuth_Init() isn't safe to call from
+    * several threads at once.  Each one gets its own connection.
+    */
+   clients = g_new0(LoadClient, numClients);
+   for (i = 0; i < numClients; i++) {
+      VGAuthExtraParams initParams[] = {
+         { VGAUTH_PARAM_KEEP_SESSIONS,
+           keepSessions ? VGAUTH_PARAM_VALUE_TRUE : VGAUTH_PARAM_VALUE_FALSE },
+      };
+      VGAuthError err;
+
+      if (i < numSamlClients) {
+         clients[i].kind = LOAD_SAML;
+      } else if (i < numSamlClients + numFastClients) {
+         clients[i].kind = LOAD_FAST;
+      } else {
+         clients[i].kind = LOAD_TICKET;
+      }
+
+      err = VGAuth_Init(g_get_prgname(), G_N_ELEMENTS(initParams), initParams,
+                        &clients[i].ctx);
+      if (VGAUTH_E_OK != err) {
+         g_printerr("%s: VGAuth_Init() failed: "VGAUTHERR_FMT64X"\n",
+                    g_get_prgname(), err);
+         numClients = i;
+         ret = 1;
+         goto done;
+      }
+
+      if (LOAD_TICKET == clients[i].kind) {
+         err = VGAuth_ValidateSamlBearerToken(clients[i].ctx, tokenText,
+                                              userName, 0, NULL,
+                                              &clients[i].handle);
+         if (VGAUTH_E_OK != err) {
+            g_printerr("%s: failed to get a handle for the ticket clients: "
+                       VGAUTHERR_FMT64X"\n", g_get_prgname(), err);
+            numClients = i + 1;
+            ret = 1;
+            goto done;
+         }
+      }
+   }
+
+   timer = g_timer_new();
+   for (i = 0; i < numClients; i++) {
+      clients[i].thread = g_thread_create(LoadClientRun, &clients[i], TRUE,
+                                          &gErr);
+      if (NULL == clients[i].thread) {
+         g_printerr("%s: failed to start client %d: %s\n", g_get_prgname(),
+                    i, gErr->message);
+         g_clear_error(&gErr);
+         ret = 1;
+         break;
+      }
+   }
+
+   if (0 == ret) {
+      g_usleep((gulong) seconds * G_USEC_PER_SEC);
+   }
+   loadQuit = TRUE;
+
+   for (i = 0; i < numClients; i++) {
+      if (NULL != clients[i].thread) {
+         g_thread_join(clients[i].thread);
+      }
+   }
+   elapsed = g_timer_elapsed(timer, NULL);
+   g_timer_destroy(timer);
+
+   LoadReport("ValidateSamlToken", clients, numClients, LOAD_SAML, elapsed);
+   LoadReport("QueryMappedAliases", clients, numClients, LOAD_FAST, elapsed);
+   LoadReport("Ticket cycle", clients, numClients, LOAD_TICKET, elapsed);
+
+done:
+   for (i = 0; i < numClients; i++) {
+      if (NULL != clients[i].handle) {
+         VGAuth_UserHandleFree(clients[i].handle);
+      }
+      VGAuth_Shutdown(clients[i].ctx);
+   }
+   g_free(clients);
+   g_free(tokenText);
+
+   return ret;
+}
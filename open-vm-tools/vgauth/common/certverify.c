@@ -33,6 +33,7 @@
 #include <openssl/evp.h>
 #include <openssl/x509.h>
 #include <openssl/x509_vfy.h>
+#include <openssl/x509v3.h>
 #include <openssl/err.h>
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -45,6 +46,52 @@ VGAuthError CertVerify_CheckSignature(VGAuthHashAlg hash,
                                       size_t signatureLen,
                                       const unsigned char *signature);
 
+/*
+ * Parsed certificates, keyed by the PEM string they came from.  The same
+ * alias store certs and token issuer certs are fed to CertVerify_CertChain()
+ * over and over, so keep the X509 objects around rather than re-parsing
+ * every PEM on every verify.  The table is simply flushed when it fills.
+ */
+#define CERTVERIFY_X509_CACHE_MAX   256
+
+static GHashTable *x509Cache = NULL;
+G_LOCK_DEFINE_STATIC(x509Cache);
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+/*
+ * Older OpenSSL needs the application to provide its locks before it can
+ * be used from more than one thread.
+ */
+static GMutex **sslLocks = NULL;
+
+
+/*
+ ******************************************************************************
+ * CertVerifyLockingCallback --                                          */ /**
+ *
+ * OpenSSL locking callback.
+ *
+ * @param[in]  mode      CRYPTO_LOCK or CRYPTO_UNLOCK, plus read/write bits.
+ * @param[in]  n         The lock number.
+ * @param[in]  file      Unused.
+ * @param[in]  line      Unused.
+ *
+ ******************************************************************************
+ */
+
+static void
+CertVerifyLockingCallback(int mode,
+                          int n,
+                          const char *file,
+                          int line)
+{
+   if (mode & CRYPTO_LOCK) {
+      g_mutex_lock(sslLocks[n]);
+   } else {
+      g_mutex_unlock(sslLocks[n]);
+   }
+}
+#endif
 
 
 /*
@@ -73,6 +120,21 @@ CertVerify_Init(void)
     * can add a lot of bloat.
     */
    OpenSSL_add_all_digests();
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+   /*
+    * The service verifies tokens on worker threads.
+    */
+   if (g_thread_supported() && CRYPTO_get_locking_callback() == NULL) {
+      int i;
+
+      sslLocks = g_malloc0(CRYPTO_num_locks() * sizeof *sslLocks);
+      for (i = 0; i < CRYPTO_num_locks(); i++) {
+         sslLocks[i] = g_mutex_new();
+      }
+      CRYPTO_set_locking_callback(CertVerifyLockingCallback);
+   }
+#endif
 }
 
 
@@ -377,6 +439,91 @@ done:
 }
 
 
+/*
+ ******************************************************************************
+ * CertVerifyX509Ref --                                                  */ /**
+ *
+ * Takes an additional reference on an X509 object.
+ *
+ * @param[in]  cert      The certificate.
+ *
+ * @return cert, which must be released with X509_free().
+ *
+ ******************************************************************************
+ */
+
+static X509 *
+CertVerifyX509Ref(X509 *cert)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+   X509_up_ref(cert);
+#else
+   CRYPTO_add(&cert->references, 1, CRYPTO_LOCK_X509);
+#endif
+   return cert;
+}
+
+
+/*
+ ******************************************************************************
+ * CertVerifyGetX509 --                                                  */ /**
+ *
+ * Returns an x509 object for a pemCert string, parsing it only if it
+ * isn't already in the cache.
+ *
+ * @param[in]  pemCert      The certificate in PEM format.
+ *
+ * @return an X509 object containing the cert, which must be released with
+ *         X509_free(), or NULL if the cert could not be parsed.
+ *
+ ******************************************************************************
+ */
+
+static X509 *
+CertVerifyGetX509(const char *pemCert)
+{
+   X509 *cert;
+
+   ASSERT(pemCert);
+
+   G_LOCK(x509Cache);
+   if (NULL != x509Cache) {
+      cert = g_hash_table_lookup(x509Cache, pemCert);
+      if (NULL != cert) {
+         cert = CertVerifyX509Ref(cert);
+         G_UNLOCK(x509Cache);
+         return cert;
+      }
+   }
+   G_UNLOCK(x509Cache);
+
+   cert = CertStringToX509(pemCert);
+   if (NULL == cert) {
+      return NULL;
+   }
+
+   /*
+    * OpenSSL caches the decoded extensions in the X509 object the first time
+    * it looks at them, without any locking.  Fill that in now, before the
+    * object can be shared with other threads.
+    */
+   X509_check_purpose(cert, -1, 0);
+
+   G_LOCK(x509Cache);
+   if (NULL == x509Cache) {
+      x509Cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                        (GDestroyNotify) X509_free);
+   } else if (g_hash_table_size(x509Cache) >= CERTVERIFY_X509_CACHE_MAX) {
+      g_hash_table_remove_all(x509Cache);
+   }
+   g_hash_table_replace(x509Cache, g_strdup(pemCert),
+                        CertVerifyX509Ref(cert));
+   G_UNLOCK(x509Cache);
+
+   return cert;
+}
+
+
 /*
  ******************************************************************************
  * CertVerify_IsWellFormedPEMCert --                                     */ /**
@@ -484,7 +631,7 @@ PEMChainToStack(int numCerts,
       }
 
       for (i = 0; i < numCerts; i++) {
-         x509Cert = CertStringToX509(pemCerts[i]);
+         x509Cert = CertVerifyGetX509(pemCerts[i]);
          if (NULL == x509Cert) {
             err = VGAUTH_E_INVALID_CERTIFICATE;
             g_warning("%s: failed to convert PEM cert to X509\n", __FUNCTION__);
@@ -554,7 +701,7 @@ CertVerify_CertChain(const char *pemLeafCert,
    /*
     * Turn the leaf cert into an x509 object.
     */
-   leafCert = CertStringToX509(pemLeafCert);
+   leafCert = CertVerifyGetX509(pemLeafCert);
    if (NULL == leafCert) {
       err = VGAUTH_E_INVALID_CERTIFICATE;
       g_warning("%s: failed to convert PEM cert to X509\n", __FUNCTION__);
@@ -578,6 +725,11 @@ CertVerify_CertChain(const char *pemLeafCert,
 
    /*
     * Build X509 store.
+    *
+    * This stays per-call: the trusted certs depend on which user's
+    * aliases are being checked, so one shared store would let a cert
+    * trusted for one user vouch for another.  The expensive part, parsing
+    * the PEMs, is cached by CertVerifyGetX509().
     */
    store = X509_STORE_new();
    if (NULL == store) {
@@ -93,6 +93,7 @@ loglevel=normal
 enableLogging=true
 enableCoreDumps=true
 clockSkewAdjustment = 300
+samlTokenCacheSize = 128
 
 [ticket]
 ticketTTL=3600
@@ -130,12 +131,16 @@ msgCatalog = /etc/vmware-tools/vgauth/messages
 /** Maximum number of data connections allowed for a non privileged user */
 #define VGAUTH_PREF_NAME_MAX_DATA_CONNECTIONS_PER_USER  \
    "maxDataConnectionsPerUser"
+/** Maximum number of threads handling expensive requests; 0 handles them inline. */
+#define VGAUTH_PREF_NAME_MAX_WORKER_THREADS "maxWorkerThreads"
 /** Where the XML schema files used for SAML parsing were installed. */
 #define VGAUTH_PREF_SAML_SCHEMA_DIR        "samlSchemaDir"
 /** The location of the idstore */
 #define VGAUTH_PREF_ALIASSTORE_DIR         "aliasStoreDir"
 /** The number of seconds slack allowed in either direction in SAML token date checks. */
 #define VGAUTH_PREF_CLOCK_SKEW_SECS        "clockSkewAdjustment"
+/** The number of verified SAML tokens to remember; 0 disables the cache. */
+#define VGAUTH_PREF_SAML_TOKEN_CACHE_SIZE  "samlTokenCacheSize"
 
 /** Ticket group name. */
 #define VGAUTH_PREF_GROUP_NAME_TICKET      "ticket"
@@ -188,7 +193,11 @@ msgCatalog = /etc/vmware-tools/vgauth/messages
 
 #define VGAUTH_PREF_DEFAULT_MAX_DATA_CONNECTIONS_PER_USER 5
 
+#define VGAUTH_PREF_DEFAULT_MAX_WORKER_THREADS 4
+
 #define VGAUTH_PREF_DEFAULT_CLOCK_SKEW_SECS (300)
 
+#define VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_SIZE 128
+
 #endif // _PREFS_H_
 
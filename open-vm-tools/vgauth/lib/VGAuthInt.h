@@ -70,6 +70,8 @@
 #define  NETWORK_FORCE_TINY_PACKETS 0
 
 
+struct ProtoReplyParser;
+
 /*
  * State of the client/service communication channel
  */
@@ -95,6 +97,12 @@ typedef struct VCAGComm {
    int sock;
 #endif
    char *pipeName;
+
+   /*
+    * Reply parser, kept for the life of the connection.  Created on
+    * the first read.
+    */
+   struct ProtoReplyParser *replyParser;
 } VGAuthComm;
 
 struct VGAuthContext {
@@ -126,13 +134,13 @@ struct VGAuthContext {
    gboolean isImpersonating;
 
    /*
-    * XXX optimization -- keep a comm channel alive for superuser?
-    *
-    * An app that just does validation would probably just be connected
-    * as root all the time anyways.  But it could be useful for something
-    * that did both certstore work and validation.
+    * If set (VGAUTH_PARAM_KEEP_SESSIONS), connections to the service as
+    * other users are kept open when switching users, rather than being
+    * closed and set up again on the next switch back.  Most recently
+    * used first.
     */
-
+   gboolean keepSessions;
+   GSList *idleSessions;
 };
 
 
@@ -191,6 +199,7 @@ gboolean VGAuth_IsConnectedToServiceAsAnyUser(VGAuthContext *ctx);
 
 VGAuthError VGAuth_InitConnection(VGAuthContext *ctx);
 VGAuthError VGAuth_CloseConnection(VGAuthContext *ctx);
+void VGAuth_CloseIdleSessions(VGAuthContext *ctx);
 
 VGAuthError VGAuth_CommSendData(VGAuthContext *ctx,
                                 gchar *request);
@@ -199,6 +208,8 @@ VGAuthError VGAuth_CommReadData(VGAuthContext *ctx,
                                 gsize *len,
                                 gchar **response);
 
+void VGAuth_FreeReplyParser(struct ProtoReplyParser *parser);
+
 VGAuthError VGAuth_SendConnectRequest(VGAuthContext *ctx);
 
 VGAuthError VGAuth_SendSessionRequest(VGAuthContext *ctx,
@@ -29,6 +29,13 @@
 #include "VGAuthProto.h"
 #include "usercheck.h"
 
+/*
+ * How many idle connections a context with VGAUTH_PARAM_KEEP_SESSIONS
+ * keeps open.  Each one uses up a connection slot in the service, which
+ * limits how many a non-root user can have.
+ */
+#define VGAUTH_MAX_IDLE_SESSIONS 3
+
 
 /*
  ******************************************************************************
@@ -109,6 +116,54 @@ VGAuth_InitConnection(VGAuthContext *ctx)
 }
 
 
+/*
+ ******************************************************************************
+ * VGAuthCommClose --                                                    */ /**
+ *
+ * Closes a connection and frees its state.
+ *
+ * @param[in]  comm       The connection.
+ *
+ ******************************************************************************
+ */
+
+static void
+VGAuthCommClose(VGAuthComm *comm)
+{
+   comm->sequenceNumber = 0;
+
+   g_free(comm->userName);
+   comm->userName = NULL;
+
+#ifdef _WIN32
+   if (comm->hPipe != INVALID_HANDLE_VALUE) {
+      CloseHandle(comm->hPipe);
+      comm->hPipe = INVALID_HANDLE_VALUE;
+   }
+#else
+   if (comm->sock >= 0) {
+      close(comm->sock);
+      comm->sock = -1;
+   }
+#endif
+
+   g_free(comm->pipeName);
+   comm->pipeName = NULL;
+
+   VGAuth_FreeReplyParser(comm->replyParser);
+   comm->replyParser = NULL;
+
+#ifdef UNITTEST
+   if (comm->fileTest) {
+      fclose(comm->testFp);
+      comm->fileTest = FALSE;
+   }
+#endif
+
+   comm->connected = FALSE;
+}
+
+
 /*
  ******************************************************************************
  * VGAuth_CloseConnection --                                             */ /**
@@ -131,35 +186,116 @@ VGAuth_CloseConnection(VGAuthContext *ctx)
       return err;
    }
 
+   VGAuthCommClose(&ctx->comm);
 
-   ctx->comm.sequenceNumber = 0;
+   return err;
+}
 
-   g_free(ctx->comm.userName);
-   ctx->comm.userName = NULL;
 
-#ifdef _WIN32
-   if (ctx->comm.hPipe != INVALID_HANDLE_VALUE) {
-      CloseHandle(ctx->comm.hPipe);
-      ctx->comm.hPipe = INVALID_HANDLE_VALUE;
+/*
+ ******************************************************************************
+ * VGAuthParkSession --                                                  */ /**
+ *
+ * Moves the current connection, if any, to the context's idle sessions,
+ * leaving the context unconnected.  If that makes too many idle sessions,
+ * the least recently used one is closed.
+ *
+ * @param[in]  ctx        The VGAuthContext.
+ *
+ ******************************************************************************
+ */
+
+static void
+VGAuthParkSession(VGAuthContext *ctx)
+{
+   VGAuthComm *comm;
+   GSList *last;
+
+   if (!ctx->comm.connected) {
+      return;
    }
-#else
-   if (ctx->comm.sock >= 0) {
-      close(ctx->comm.sock);
+
+   comm = g_malloc(sizeof *comm);
+   *comm = ctx->comm;
+   ctx->idleSessions = g_slist_prepend(ctx->idleSessions, comm);
+
+   memset(&ctx->comm, 0, sizeof ctx->comm);
+   VGAuth_InitConnection(ctx);
+
+   if (g_slist_length(ctx->idleSessions) > VGAUTH_MAX_IDLE_SESSIONS) {
+      last = g_slist_last(ctx->idleSessions);
+      comm = (VGAuthComm *) last->data;
+      Debug("%s: closing idle session as '%s'\n", __FUNCTION__,
+            comm->userName);
+      VGAuthCommClose(comm);
+      g_free(comm);
+      ctx->idleSessions = g_slist_delete_link(ctx->idleSessions, last);
    }
-#endif
+}
 
-   g_free(ctx->comm.pipeName);
-   ctx->comm.pipeName = NULL;
 
-#ifdef UNITTEST
-   if (ctx->comm.fileTest) {
-      fclose(ctx->comm.testFp);
+/*
+ ******************************************************************************
+ * VGAuthResumeSession --                                                */ /**
+ *
+ * Makes the idle session for @a userName, if any, the current connection.
+ *
+ * @param[in]  ctx        The VGAuthContext.  Must not be connected.
+ * @param[in]  userName   The user.
+ *
+ * @return TRUE if there was an idle session for the user.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+VGAuthResumeSession(VGAuthContext *ctx,
+                    const char *userName)
+{
+   GSList *l;
+
+   ASSERT(!ctx->comm.connected);
+
+   for (l = ctx->idleSessions; l != NULL; l = l->next) {
+      VGAuthComm *comm = (VGAuthComm *) l->data;
+
+      if (Usercheck_CompareByName(userName, comm->userName)) {
+         VGAuthCommClose(&ctx->comm);
+         ctx->comm = *comm;
+         g_free(comm);
+         ctx->idleSessions = g_slist_delete_link(ctx->idleSessions, l);
+         return TRUE;
+      }
    }
-#endif
 
-   ctx->comm.connected = FALSE;
+   return FALSE;
+}
 
-   return err;
+
+/*
+ ******************************************************************************
+ * VGAuth_CloseIdleSessions --                                           */ /**
+ *
+ * Closes all of the context's idle sessions.
+ *
+ * @param[in]  ctx        The VGAuthContext.
+ *
+ ******************************************************************************
+ */
+
+void
+VGAuth_CloseIdleSessions(VGAuthContext *ctx)
+{
+   GSList *l;
+
+   for (l = ctx->idleSessions; l != NULL; l = l->next) {
+      VGAuthComm *comm = (VGAuthComm *) l->data;
+
+      VGAuthCommClose(comm);
+      g_free(comm);
+   }
+   g_slist_free(ctx->idleSessions);
+   ctx->idleSessions = NULL;
 }
 
 
@@ -194,8 +330,16 @@ VGAuth_ConnectToServiceAsUser(VGAuthContext *ctx,
 
    /*
     * If currently connected (presumably as another user), close down
-    * and re-open.
+    * and re-open.  With sessions kept, put it aside instead, and pick
+    * up an earlier connection as this user if there is one.
     */
+   if (ctx->keepSessions) {
+      VGAuthParkSession(ctx);
+      if (VGAuthResumeSession(ctx, userName)) {
+         Debug("%s: resumed session as '%s'\n", __FUNCTION__, userName);
+         goto done;
+      }
+   }
 
    VGAuth_CloseConnection(ctx);
 
@@ -276,6 +420,14 @@ done:
    VGAuth_CloseConnection(pubCtx);
    g_free(pubCtx);
 
+   /*
+    * Don't leave a half set up connection behind to be used, or kept, by
+    * the next call.
+    */
+   if (VGAUTH_E_OK != err) {
+      VGAuth_CloseConnection(ctx);
+   }
+
    g_free(pipeName);
    return err;
 }
@@ -323,7 +475,9 @@ VGAuth_ConnectToServiceAsCurrentUser(VGAuthContext *ctx)
  ******************************************************************************
  * VGAuth_CommSendData --                                                */ /**
  *
- * Sends a NUL-terminated string to the service.
+ * Sends a NUL-terminated string to the service.  On failure, the
+ * connection is marked as disconnected, so the next request sets up
+ * a new one rather than using this one again.
  *
  * @param[in]  ctx        The VGAuthContext.
  * @param[in]  packet     The data to be sent.
@@ -337,7 +491,14 @@ VGAuthError
 VGAuth_CommSendData(VGAuthContext *ctx,
                     gchar *packet)
 {
-   return VGAuth_NetworkWriteBytes(ctx, strlen(packet), packet);
+   VGAuthError err;
+
+   err = VGAuth_NetworkWriteBytes(ctx, strlen(packet), packet);
+   if (VGAUTH_E_OK != err) {
+      ctx->comm.connected = FALSE;
+   }
+
+   return err;
 }
 
 
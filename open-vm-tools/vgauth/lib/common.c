@@ -99,11 +99,18 @@ VGAuthValidateExtraParamsImpl(const char *funcName,
  *
  * @remark Can be called by any user.
  *
+ * @remark One @a extraParams is supported:
+ *         VGAUTH_PARAM_KEEP_SESSIONS, which must have the value
+ *         VGAUTH_PARAM_VALUE_TRUE or VGAUTH_PARAM_VALUE_FALSE.
+ *         If set, the context keeps its connections to the service open
+ *         when it switches to another user, so callers that alternate
+ *         between users (e.g. creating a ticket as one user and validating
+ *         it as the superuser) don't reconnect on every call.
+ *
  * @param[in]  applicationName   The name of the application.
  * @param[in]  numExtraParams    The number of elements in extraParams.
  * @param[in]  extraParams       Any optional, additional paramaters to the
- *                               function. Currently none are supported, so
- *                               this must be NULL.
+ *                               function.
  * @param[out] ctx               The new VGAuthContext.
  *
  * @retval VGAUTH_E_INVALID_ARGUMENT For a bad argument.
@@ -122,6 +129,7 @@ VGAuth_Init(const char *applicationName,
    VGAuthContext *newCtx = NULL;
    VGAuthError err = VGAUTH_E_OK;
    static gboolean firstTime = TRUE;
+   int keepSessions = -1;
    int i;
 
    /*
@@ -134,8 +142,6 @@ VGAuth_Init(const char *applicationName,
 
    *ctx = NULL;
 
-   /* XXX process any options */
-
    if (!g_utf8_validate(applicationName, -1, NULL)) {
       Warning("%s: invalid applicationName\n", __FUNCTION__);
       return VGAUTH_E_INVALID_ARGUMENT;
@@ -146,6 +152,32 @@ VGAuth_Init(const char *applicationName,
       return err;
    }
 
+   for (i = 0; i < numExtraParams; i++) {
+      if (g_strcmp0(extraParams[i].name, VGAUTH_PARAM_KEEP_SESSIONS) == 0) {
+         // only allow it to be set once
+         if (keepSessions != -1) {
+            Warning("%s: extraParam '%s' passed multiple times\n",
+                    __FUNCTION__, extraParams[i].name);
+            return VGAUTH_E_INVALID_ARGUMENT;
+         }
+         if (extraParams[i].value) {
+            if (g_ascii_strcasecmp(VGAUTH_PARAM_VALUE_TRUE,
+                                   extraParams[i].value) == 0) {
+               keepSessions = 1;
+            } else if (g_ascii_strcasecmp(VGAUTH_PARAM_VALUE_FALSE,
+                                          extraParams[i].value) == 0) {
+               keepSessions = 0;
+            } else {
+               Warning("%s: Unrecognized value '%s' for boolean param %s\n",
+                       __FUNCTION__, extraParams[i].value, extraParams[i].name);
+               return VGAUTH_E_INVALID_ARGUMENT;
+            }
+         } else {
+            return VGAUTH_E_INVALID_ARGUMENT;
+         }
+      }
+   }
+
    newCtx = g_malloc0(sizeof(VGAuthContext));
    if (NULL == newCtx) {
       return VGAUTH_E_OUT_OF_MEMORY;
@@ -153,6 +185,7 @@ VGAuth_Init(const char *applicationName,
 
    newCtx->applicationName = g_strdup(applicationName);
    newCtx->isImpersonating = FALSE;
+   newCtx->keepSessions = (keepSessions == 1);
 
    /*
     * Only init prefs, i18n and auditing once.
@@ -234,6 +267,7 @@ VGAuth_Shutdown(VGAuthContext *ctx)
    VGAuthShutdownAuthentication(ctx);
 
    VGAuth_CloseConnection(ctx);
+   VGAuth_CloseIdleSessions(ctx);
 
    for (i = 0; i < ctx->numExtraParams; i++) {
       g_free(ctx->extraParams[i].name);
@@ -169,6 +169,18 @@ struct ProtoReply {
 typedef struct ProtoReply ProtoReply;
 
 
+/*
+ * Per-connection reply parser.  The parse context is reused for every
+ * reply read on the connection; @a reply is the one being read.
+ */
+struct ProtoReplyParser {
+   GMarkupParseContext *parseContext;
+   ProtoReply *reply;
+};
+
+typedef struct ProtoReplyParser ProtoReplyParser;
+
+
 #if VGAUTH_PROTO_TRACE
 
 /*
@@ -363,7 +375,7 @@ ProtoUserHandleTypeString(const VGAuthUserHandle *userHandle)
  * @param[in]  elementName         The name of the element being started.
  * @param[in]  attributeNames      The names of any attributes on the element.
  * @param[in]  attributeValues     The values of any attributes on the element.
- * @param[in]  userData            The current ProtoReply as callback data.
+ * @param[in]  userData            The ProtoReplyParser as callback data.
  * @param[out] error               Any error.
  *
  ******************************************************************************
@@ -377,7 +389,7 @@ Proto_StartElement(GMarkupParseContext *parseContext,
                    gpointer userData,
                    GError **error)
 {
-   ProtoReply *reply = (ProtoReply *) userData;
+   ProtoReply *reply = ((ProtoReplyParser *) userData)->reply;
 
 #if VGAUTH_PROTO_TRACE
    Debug("%s: elementName '%s', parseState %d, cur reply type %d\n", __FUNCTION__, elementName, reply->parseState, reply->expectedReplyType);
@@ -649,7 +661,7 @@ Proto_StartElement(GMarkupParseContext *parseContext,
  *
  * @param[in]  parseContext        The XML parse context.
  * @param[in]  elementName         The name of the element being started.
- * @param[in]  userData            The current ProtoReply as callback data.
+ * @param[in]  userData            The ProtoReplyParser as callback data.
  * @param[out] error               Any error.
  *
  ******************************************************************************
@@ -661,7 +673,7 @@ Proto_EndElement(GMarkupParseContext *parseContext,
                  gpointer userData,
                  GError **error)
 {
-   ProtoReply *reply = (ProtoReply *) userData;
+   ProtoReply *reply = ((ProtoReplyParser *) userData)->reply;
 
 #if VGAUTH_PROTO_TRACE
    Debug("%s: elementName '%s'\n", __FUNCTION__, elementName);
@@ -774,7 +786,7 @@ Proto_EndElement(GMarkupParseContext *parseContext,
  * @param[in]  text                The contents of the current element
  *                                 (not NUL terminated)
  * @param[in]  textSize            The length of the text.
- * @param[in]  userData            The current ProtoReply as callback data.
+ * @param[in]  userData            The ProtoReplyParser as callback data.
  * @param[out] error               Any error.
  *
  ******************************************************************************
@@ -787,7 +799,7 @@ Proto_TextContents(GMarkupParseContext *parseContext,
                    gpointer userData,
                    GError **error)
 {
-   ProtoReply *reply = (ProtoReply *) userData;
+   ProtoReply *reply = ((ProtoReplyParser *) userData)->reply;
    gchar *val;
    VGAuthUserHandleType t = VGAUTH_AUTH_TYPE_UNKNOWN;
 
@@ -1172,12 +1184,40 @@ Proto_SanityCheckReply(ProtoReply *reply,
 }
 
 
+/*
+ ******************************************************************************
+ * VGAuth_FreeReplyParser --                                             */ /**
+ *
+ * Frees a connection's reply parser.
+ *
+ * @param[in]  parser        The parser to free.  May be NULL.
+ *
+ ******************************************************************************
+ */
+
+void
+VGAuth_FreeReplyParser(ProtoReplyParser *parser)
+{
+   if (NULL == parser) {
+      return;
+   }
+
+   g_markup_parse_context_free(parser->parseContext);
+   g_free(parser);
+}
+
+
 /*
  ******************************************************************************
  * VGAuth_ReadAndParseResponse --                                        */ /**
  *
  * Reads the next reply off the wire and returns it in wireReply.
  *
+ * The connection's parser is reused from one reply to the next.  If the
+ * reply can't be read or parsed, the stream can't be trusted any more;
+ * the connection is marked as disconnected so the next request sets up
+ * a new one.
+ *
  * @param[in]  ctx                       The VGAuthContext.
  * @param[in]  expectedReplyType         The expected reply type.
  * @param[out] wireReply                 The complete reply.  The caller
@@ -1195,7 +1235,7 @@ VGAuth_ReadAndParseResponse(VGAuthContext *ctx,
                             ProtoReply **wireReply)
 {
    VGAuthError err = VGAUTH_E_OK;
-   GMarkupParseContext *parseContext = NULL;
+   ProtoReplyParser *parser = ctx->comm.replyParser;
    gsize len;
    gchar *rawReply = NULL;
    ProtoReply *reply = NULL;
@@ -1204,10 +1244,15 @@ VGAuth_ReadAndParseResponse(VGAuthContext *ctx,
 
    reply = Proto_NewReply(expectedReplyType);
 
-   parseContext = g_markup_parse_context_new(&wireParser,
-                                             0,
-                                             reply,
-                                             NULL);
+   if (NULL == parser) {
+      parser = g_malloc0(sizeof *parser);
+      parser->parseContext = g_markup_parse_context_new(&wireParser,
+                                                        0,
+                                                        parser,
+                                                        NULL);
+      ctx->comm.replyParser = parser;
+   }
+   parser->reply = reply;
 
    /*
     * May take multiple reads if reply is broken up by the underlying
@@ -1230,10 +1275,12 @@ VGAuth_ReadAndParseResponse(VGAuthContext *ctx,
          reply->rawData = g_strdup(rawReply);
       }
 #endif
-      bRet = g_markup_parse_context_parse(parseContext,
+      bRet = g_markup_parse_context_parse(parser->parseContext,
                                           rawReply,
                                           len,
                                           &gErr);
+      g_free(rawReply);
+      rawReply = NULL;
       if (!bRet) {
          /*
           * XXX Could drain the wire here, but since this should
@@ -1249,7 +1296,6 @@ VGAuth_ReadAndParseResponse(VGAuthContext *ctx,
        * XXX need some way to break out if packet never completed
        * yet socket left valid.  timer?
        */
-      g_free(rawReply);
    }
 
 #if VGAUTH_PROTO_TRACE
@@ -1269,14 +1315,23 @@ VGAuth_ReadAndParseResponse(VGAuthContext *ctx,
             reply->errorCode, reply->replyData.error.errorMsg);
       err = reply->errorCode;
    }
+   parser->reply = NULL;
    goto done;
 
 abort:
+   g_free(rawReply);
    Proto_FreeReply(reply);
    reply = NULL;
+
+   /*
+    * The parser is part way through something that will never finish.
+    * Drop it, and make sure this connection isn't used again.
+    */
+   VGAuth_FreeReplyParser(parser);
+   ctx->comm.replyParser = NULL;
+   ctx->comm.connected = FALSE;
 done:
    *wireReply = reply;
-   g_markup_parse_context_free(parseContext);
    return err;
 }
 
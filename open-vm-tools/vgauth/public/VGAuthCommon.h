@@ -67,6 +67,13 @@ typedef struct VGAuthExtraParams {
 #define VGAUTH_PARAM_VALUE_TRUE  "true"
 #define VGAUTH_PARAM_VALUE_FALSE "false"
 
+/**
+ * VGAuth_Init() parameter.  If VGAUTH_PARAM_VALUE_TRUE, the context keeps
+ * its connections to the service open when it has to switch to another
+ * user, and reuses them when it switches back.
+ */
+#define VGAUTH_PARAM_KEEP_SESSIONS "keepSessions"
+
 /*
  * Initalizes library, and specifies any configuration information.
  */
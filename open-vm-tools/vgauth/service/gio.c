@@ -286,6 +286,16 @@ ServiceIOHandleIOGSource(gpointer userData)
       return FALSE;
    }
 
+   /*
+    * The request was handed to a worker thread.  Stop watching the
+    * connection until the reply has gone out; ServiceIOResumeIO() starts
+    * it again.
+    */
+   if (conn->requestPending) {
+      conn->gioId = 0;
+      return FALSE;
+   }
+
    /*
     * Windows needs to initiate a new async read IO before polling again.
     * Do it here instead of immediately after the read() since we like to
@@ -309,6 +319,77 @@ ServiceIOHandleIO(GIOChannel *chan,
 }
 
 
+/*
+ ******************************************************************************
+ * ServiceIOWatchConnection --                                           */ /**
+ *
+ * Starts watching for incoming data on a data connection.
+ *
+ * @param[in]   conn              The ServiceConnection.
+ *
+ ******************************************************************************
+ */
+
+static void
+ServiceIOWatchConnection(ServiceConnection *conn)
+{
+#ifdef _WIN32
+   GSource *gSourceData;
+
+   gSourceData = ServiceIONewHandleGSource(conn->ol.hEvent,
+                                           ServiceIOHandleIOGSource,
+                                           (gpointer) conn);
+   conn->gioId = g_source_attach(gSourceData, NULL);
+   g_source_unref(gSourceData);
+#else
+   GIOChannel *echan;
+
+   echan = g_io_channel_unix_new(conn->sock);
+   conn->gioId = g_io_add_watch(echan, G_IO_IN, ServiceIOHandleIO,
+                                (gpointer) conn);
+   g_io_channel_unref(echan);
+#endif
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceIOResumeIO --                                                  */ /**
+ *
+ * Starts watching a data connection again after a request handed to a
+ * worker thread has been answered.
+ *
+ * @param[in]   conn              The ServiceConnection.
+ *
+ * @return VGAuthError
+ *
+ ******************************************************************************
+ */
+
+VGAuthError
+ServiceIOResumeIO(ServiceConnection *conn)
+{
+   VGAuthError err = VGAUTH_E_OK;
+
+   ASSERT(conn->gioId == 0);
+
+#ifdef _WIN32
+   /*
+    * The read for the next request wasn't started when this one was
+    * handed off; start it now.
+    */
+   err = ServiceNetworkStartRead(conn);
+   if (err != VGAUTH_E_OK) {
+      return err;
+   }
+#endif
+
+   ServiceIOWatchConnection(conn);
+
+   return err;
+}
+
+
 /*
  ******************************************************************************
  * ServiceIOAccept --                                                    */ /**
@@ -336,11 +417,6 @@ ServiceIOAcceptGSource(gpointer userData)
    ServiceConnection *newConn = NULL;
    ServiceConnection *lConn = (ServiceConnection *) userData;
    VGAuthError err = VGAUTH_E_OK;
-#ifdef _WIN32
-   GSource *gSourceData;
-#else
-   GIOChannel *echan;
-#endif
 
    err = ServiceConnectionClone(lConn, &newConn);
    if (VGAUTH_E_OK != err) {
@@ -352,18 +428,7 @@ ServiceIOAcceptGSource(gpointer userData)
    if (VGAUTH_E_OK == err) {
       VGAUTH_LOG_DEBUG("Established a new pipe connection %d on %s", newConn->connId,
                        newConn->pipeName);
-#ifdef _WIN32
-      gSourceData = ServiceIONewHandleGSource(newConn->ol.hEvent,
-                                              ServiceIOHandleIOGSource,
-                                              (gpointer) newConn);
-      newConn->gioId = g_source_attach(gSourceData, NULL);
-      g_source_unref(gSourceData);
-#else
-      echan = g_io_channel_unix_new(newConn->sock);
-      newConn->gioId = g_io_add_watch(echan, G_IO_IN, ServiceIOHandleIO,
-                            (gpointer) newConn);
-      g_io_channel_unref(echan);
-#endif
+      ServiceIOWatchConnection(newConn);
    } else if (VGAUTH_E_TOO_MANY_CONNECTIONS == err) {
       ServiceConnectionShutdown(newConn);
    } else {
@@ -136,7 +136,14 @@ ServiceStartAndRun(void)
       exit(-1);
    }
 
-   err = ServiceRegisterIOFunctions(ServiceIOStartListen, ServiceStopIO);
+   err = ServiceInitWorkers();
+   if (VGAUTH_E_OK != err) {
+      Warning("%s: failed to init worker threads; exiting\n", __FUNCTION__);
+      exit(-1);
+   }
+
+   err = ServiceRegisterIOFunctions(ServiceIOStartListen, ServiceStopIO,
+                                    ServiceIOResumeIO);
    if (VGAUTH_E_OK != err) {
       Warning("%s: failed to register IO functions; exiting\n", __FUNCTION__);
       exit(-1);
@@ -492,6 +499,10 @@ int
 main(int argc,
      char *argv[])
 {
+   if (!g_thread_supported()) {
+      g_thread_init(NULL);
+   }
+
    gPrefs = Pref_Init(VGAUTH_PREF_CONFIG_FILENAME);
 
    /*
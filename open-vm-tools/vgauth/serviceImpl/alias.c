@@ -86,6 +86,12 @@ static gchar *aliasStoreRootDir = DEFAULT_ALIASSTORE_ROOT_DIR;
  */
 #define ALIASSTORE_FILE_MAX_SIZE       (10 * 1024 * 1024)
 
+/*
+ * How many times to re-read the mapping file when a save replaces it
+ * while we're reading it.
+ */
+#define ALIASSTORE_MAPFILE_READ_RETRIES   3
+
 /*
  * Alias store XML details.
  */
@@ -254,6 +260,60 @@ mapping file layout:
  */
 
 
+/*
+ * Parsed alias store files are kept in memory, since every query -- and
+ * every SAML token verification that consults the mapping file -- would
+ * otherwise re-read and re-parse the XML.  A cached copy is only used
+ * while the file's identity, size, timestamps, owner and mode are
+ * unchanged, so edits made behind the service's back are still seen.
+ * The timestamps are kept to the nanosecond: files are replaced by
+ * renaming a temp file over them, the file system may hand the new file
+ * the old inode number, and two versions written within the same second
+ * can have the same size.
+ *
+ * Our own saves drop the affected entries outright and bump the cache
+ * generation, so a load that started before a save can't put what it
+ * read back into the cache afterwards.
+ *
+ * Files are parsed without the aliasCache lock, so a reload doesn't hold
+ * up lookups answered from the cache; the lock only covers looking up and
+ * swapping in entries.  The parsed mapping file is shared: it is not
+ * changed once built, and is reference counted so that lookups can read
+ * it without the lock while a newer one is swapped in.
+ */
+typedef struct AliasFileStamp {
+   guint64 dev;
+   guint64 ino;
+   gint64 size;
+   gint64 mtime;
+   gint64 mtimeNsec;
+   gint64 ctime;
+   gint64 ctimeNsec;
+   guint32 mode;
+   guint32 uid;
+   guint32 gid;
+} AliasFileStamp;
+
+typedef struct AliasCacheEntry {
+   AliasFileStamp stamp;
+   int num;
+   ServiceAlias *aList;
+} AliasCacheEntry;
+
+typedef struct AliasMappedCache {
+   gint refCount;
+   AliasFileStamp stamp;
+   int num;
+   ServiceMappedAlias *maList;
+   GHashTable *certIndex;        // canonical cert -> GSList of maList indices
+} AliasMappedCache;
+
+G_LOCK_DEFINE_STATIC(aliasCache);
+static GHashTable *aliasCache = NULL;     // userName -> AliasCacheEntry
+static AliasMappedCache *mappedCache = NULL;  // NULL until loaded
+static guint64 aliasCacheGen = 0;         // bumped on every invalidation
+
+
 /*
  ******************************************************************************
  * ServiceAliasIsSubjectEqual --                                         */ /**
@@ -1402,14 +1462,16 @@ AliasCheckMapFilePerms(const gchar *fileName)
 
 /*
  ******************************************************************************
- * AliasLoadAliases --                                                   */ /**
+ * AliasReadAliases --                                                   */ /**
  *
- * Reads and parses the Alias file for userName.
+ * Reads and parses the Alias file for userName, bypassing the cache.
  *
  * @param[in]   userName        The user whose store is to be loaded.
  * @param[out]  num             The number of certs read.
  * @param[out]  aList           The Aliases read.  The caller should
  *                              call ServiceAliasFreeAliasList() when done.
+ * @param[out]  parsed          Set to TRUE if the file passed its checks
+ *                              and was parsed, so the result may be cached.
  *
  * @return VGAUTH_E_OK on success, VGAuthError on failure
  *
@@ -1417,9 +1479,10 @@ AliasCheckMapFilePerms(const gchar *fileName)
  */
 
 static VGAuthError
-AliasLoadAliases(const gchar *userName,
+AliasReadAliases(const gchar *userName,
                  int *num,
-                 ServiceAlias **aList)
+                 ServiceAlias **aList,
+                 gboolean *parsed)
 {
    static const GMarkupParser aliasParser = {
       AliasStartElement,
@@ -1439,9 +1502,11 @@ AliasLoadAliases(const gchar *userName,
 
    ASSERT(num);
    ASSERT(aList);
+   ASSERT(parsed);
 
    *num = 0;
    *aList = NULL;
+   *parsed = FALSE;
 
    list.state = ALIAS_PARSE_STATE_NONE;
    list.aList = NULL;
@@ -1476,6 +1541,7 @@ AliasLoadAliases(const gchar *userName,
       err = VGAUTH_E_FAIL;
       goto cleanup;
    }
+   *parsed = TRUE;
 
 done:
    /*
@@ -1739,14 +1805,16 @@ MappedEndElement(GMarkupParseContext *parseContext,
 
 /*
  ******************************************************************************
- * AliasLoadMapped --                                                    */ /**
+ * AliasReadMapped --                                                    */ /**
  *
- * Reads and parses the mapping file.
+ * Reads and parses the mapping file, bypassing the cache.
  *
  * @param[out]  num             The number of entries read.
  * @param[out]  maList          The ServiceMappedAliases read.  The caller
  *                              should call ServiceAliasFreeMappedAliasList()
  *                              when done.
+ * @param[out]  parsed          Set to TRUE if the file passed its checks
+ *                              and was parsed, so the result may be cached.
  *
  * @return VGAUTH_E_OK on success, VGAuthError on failure
  *
@@ -1754,8 +1822,9 @@ MappedEndElement(GMarkupParseContext *parseContext,
  */
 
 static VGAuthError
-AliasLoadMapped(int *num,
-                ServiceMappedAlias **maList)
+AliasReadMapped(int *num,
+                ServiceMappedAlias **maList,
+                gboolean *parsed)
 {
    static const GMarkupParser mappedIdParser = {
       MappedStartElement,
@@ -1775,9 +1844,11 @@ AliasLoadMapped(int *num,
 
    ASSERT(num);
    ASSERT(maList);
+   ASSERT(parsed);
 
    *num = 0;
    *maList = NULL;
+   *parsed = FALSE;
 
    list.state = MAP_PARSE_STATE_NONE;
    list.maList = NULL;
@@ -1814,6 +1885,7 @@ AliasLoadMapped(int *num,
       err = VGAUTH_E_FAIL;
       goto cleanup;
    }
+   *parsed = TRUE;
 
 done:
    /*
@@ -1835,6 +1907,567 @@ cleanup:
    return VGAUTH_E_OK;
 }
 
+/*
+ ******************************************************************************
+ * AliasGetFileStamp --                                                  */ /**
+ *
+ * Gets the identity and change stamp of an alias store file.
+ *
+ * @param[in]   fileName        The file.
+ * @param[out]  stamp           The stamp.
+ *
+ * @return TRUE on success, FALSE if the file can't be stat'd.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+AliasGetFileStamp(const gchar *fileName,
+                  AliasFileStamp *stamp)
+{
+   struct stat stbuf;  // XXX docs say GStatBuf, but what we have
+                       // in the toolchain uses this older format.
+
+   if (g_lstat(fileName, &stbuf) != 0) {
+      return FALSE;
+   }
+
+   stamp->dev = stbuf.st_dev;
+   stamp->ino = stbuf.st_ino;
+   stamp->size = stbuf.st_size;
+   stamp->mtime = stbuf.st_mtime;
+   stamp->ctime = stbuf.st_ctime;
+#if defined(__FreeBSD__) || defined(__APPLE__)
+   stamp->mtimeNsec = stbuf.st_mtimespec.tv_nsec;
+   stamp->ctimeNsec = stbuf.st_ctimespec.tv_nsec;
+#elif defined(__linux__)
+   stamp->mtimeNsec = stbuf.st_mtim.tv_nsec;
+   stamp->ctimeNsec = stbuf.st_ctim.tv_nsec;
+#else
+   /* Whole seconds only; size and ctime still catch most rewrites. */
+   stamp->mtimeNsec = 0;
+   stamp->ctimeNsec = 0;
+#endif
+   stamp->mode = stbuf.st_mode;
+   stamp->uid = stbuf.st_uid;
+   stamp->gid = stbuf.st_gid;
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasFileStampsEqual --                                               */ /**
+ *
+ * Compares two file stamps.
+ *
+ * @param[in]   s1      The first stamp.
+ * @param[in]   s2      The second stamp.
+ *
+ * @return TRUE if the file is unchanged between the two.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+AliasFileStampsEqual(const AliasFileStamp *s1,
+                     const AliasFileStamp *s2)
+{
+   return s1->dev == s2->dev &&
+          s1->ino == s2->ino &&
+          s1->size == s2->size &&
+          s1->mtime == s2->mtime &&
+          s1->mtimeNsec == s2->mtimeNsec &&
+          s1->ctime == s2->ctime &&
+          s1->ctimeNsec == s2->ctimeNsec &&
+          s1->mode == s2->mode &&
+          s1->uid == s2->uid &&
+          s1->gid == s2->gid;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCopyAliasList --                                                 */ /**
+ *
+ * Makes a deep copy of an array of ServiceAlias.
+ *
+ * @param[in]   num     The size of the array.
+ * @param[in]   aList   The list to copy.
+ *
+ * @return The copy.  Free with ServiceAliasFreeAliasList().
+ *
+ ******************************************************************************
+ */
+
+static ServiceAlias *
+AliasCopyAliasList(int num,
+                   const ServiceAlias *aList)
+{
+   ServiceAlias *copy;
+   int i;
+   int j;
+
+   if (0 == num) {
+      return NULL;
+   }
+
+   copy = g_malloc0(sizeof(ServiceAlias) * num);
+   for (i = 0; i < num; i++) {
+      copy[i].pemCert = g_strdup(aList[i].pemCert);
+      copy[i].num = aList[i].num;
+      copy[i].infos = g_malloc0(sizeof(ServiceAliasInfo) * aList[i].num);
+      for (j = 0; j < aList[i].num; j++) {
+         ServiceAliasCopyAliasInfoContents(&(aList[i].infos[j]),
+                                           &(copy[i].infos[j]));
+      }
+   }
+
+   return copy;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCopyMappedAlias --                                               */ /**
+ *
+ * Makes a deep copy of a ServiceMappedAlias.
+ *
+ * @param[in]   src     The entry to copy.
+ * @param[out]  dst     The copy.  Free with
+ *                      ServiceAliasFreeMappedAliasListContents().
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCopyMappedAlias(const ServiceMappedAlias *src,
+                     ServiceMappedAlias *dst)
+{
+   int i;
+
+   dst->pemCert = g_strdup(src->pemCert);
+   dst->userName = g_strdup(src->userName);
+   dst->num = src->num;
+   dst->subjects = g_malloc0(sizeof(ServiceSubject) * src->num);
+   for (i = 0; i < src->num; i++) {
+      dst->subjects[i].type = src->subjects[i].type;
+      if (SUBJECT_TYPE_NAMED == src->subjects[i].type) {
+         dst->subjects[i].name = g_strdup(src->subjects[i].name);
+      }
+   }
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCanonicalCert --                                                 */ /**
+ *
+ * Returns a canonical form of a PEM certificate, such that two certs
+ * compare equal with ServiceComparePEMCerts() iff their canonical forms
+ * are the same string.  Used to key the mapping file's cert index.
+ *
+ * @param[in]   pemCert         The cert.
+ *
+ * @return The canonical form.  Free with g_free().
+ *
+ ******************************************************************************
+ */
+
+static gchar *
+AliasCanonicalCert(const gchar *pemCert)
+{
+   gchar *cleanCert;
+   guchar *binCert;
+   gsize len;
+   gchar *canonical;
+
+   cleanCert = CertVerify_StripPEMCert(pemCert);
+   binCert = g_base64_decode(cleanCert, &len);
+   canonical = g_base64_encode(binCert, len);
+
+   g_free(cleanCert);
+   g_free(binCert);
+
+   return canonical;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheFreeEntry --                                                */ /**
+ *
+ * Frees an AliasCacheEntry.
+ *
+ * @param[in]   data    The entry.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheFreeEntry(gpointer data)
+{
+   AliasCacheEntry *entry = data;
+
+   ServiceAliasFreeAliasList(entry->num, entry->aList);
+   g_free(entry);
+}
+
+
+/*
+ ******************************************************************************
+ * AliasMappedCacheRelease --                                            */ /**
+ *
+ * Drops a reference to a parsed mapping file, freeing it with the last one.
+ *
+ * @param[in]   cache   The parsed mapping file, or NULL.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasMappedCacheRelease(AliasMappedCache *cache)
+{
+   if (NULL == cache || !g_atomic_int_dec_and_test(&cache->refCount)) {
+      return;
+   }
+
+   ServiceAliasFreeMappedAliasList(cache->num, cache->maList);
+   g_hash_table_destroy(cache->certIndex);
+   g_free(cache);
+}
+
+
+/*
+ ******************************************************************************
+ * AliasCacheInvalidate --                                               */ /**
+ *
+ * Drops the cached copies of userName's alias file and, if asked, of the
+ * mapping file, and starts a new cache generation so loads already in
+ * progress don't cache what they read.
+ *
+ * @param[in]   userName        The user whose entry is dropped.
+ * @param[in]   mapped          TRUE to drop the mapping file too.
+ *
+ ******************************************************************************
+ */
+
+static void
+AliasCacheInvalidate(const gchar *userName,
+                     gboolean mapped)
+{
+   AliasMappedCache *oldMapped = NULL;
+
+   G_LOCK(aliasCache);
+   aliasCacheGen++;
+   if (NULL != aliasCache) {
+      g_hash_table_remove(aliasCache, userName);
+   }
+   if (mapped) {
+      oldMapped = mappedCache;
+      mappedCache = NULL;
+   }
+   G_UNLOCK(aliasCache);
+
+   AliasMappedCacheRelease(oldMapped);
+}
+
+
+/*
+ ******************************************************************************
+ * AliasLoadAliases --                                                   */ /**
+ *
+ * Returns the Aliases for userName, from the cache when the file hasn't
+ * changed since it was last parsed.  The ownership and permission check
+ * is still made on every call, since the user's identity can change
+ * without the file changing.
+ *
+ * @param[in]   userName        The user whose store is to be loaded.
+ * @param[out]  num             The number of certs read.
+ * @param[out]  aList           The Aliases read.  The caller should
+ *                              call ServiceAliasFreeAliasList() when done.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+AliasLoadAliases(const gchar *userName,
+                 int *num,
+                 ServiceAlias **aList)
+{
+   gchar *aliasFilename;
+   AliasFileStamp stamp;
+   AliasFileStamp newStamp;
+   AliasCacheEntry *entry;
+   guint64 gen;
+   gboolean haveStamp;
+   gboolean parsed;
+   VGAuthError err;
+
+   ASSERT(num);
+   ASSERT(aList);
+
+   *num = 0;
+   *aList = NULL;
+
+   aliasFilename = ServiceUserNameToAliasStoreFileName(userName);
+   haveStamp = AliasGetFileStamp(aliasFilename, &stamp);
+
+   G_LOCK(aliasCache);
+   if (NULL == aliasCache) {
+      aliasCache = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                         g_free, AliasCacheFreeEntry);
+   }
+   gen = aliasCacheGen;
+   entry = g_hash_table_lookup(aliasCache, userName);
+   if (!haveStamp) {
+      if (NULL != entry) {
+         g_hash_table_remove(aliasCache, userName);
+      }
+   } else if (NULL != entry &&
+              AliasFileStampsEqual(&entry->stamp, &stamp)) {
+      *num = entry->num;
+      *aList = AliasCopyAliasList(entry->num, entry->aList);
+      G_UNLOCK(aliasCache);
+
+      /*
+       * Same failure handling as the uncached read: a file with bad
+       * ownership or permissions simply contributes no aliases.
+       */
+      if (AliasCheckAliasFilePerms(aliasFilename, userName) != VGAUTH_E_OK) {
+         AliasCacheInvalidate(userName, FALSE);
+         ServiceAliasFreeAliasList(*num, *aList);
+         *num = 0;
+         *aList = NULL;
+      }
+      g_free(aliasFilename);
+      return VGAUTH_E_OK;
+   }
+   G_UNLOCK(aliasCache);
+
+   err = AliasReadAliases(userName, num, aList, &parsed);
+
+   /*
+    * Only cache what was parsed from the file we stamped, and only if we
+    * didn't save the file meanwhile; otherwise the next call will just
+    * read it again.
+    */
+   if (VGAUTH_E_OK == err && parsed && haveStamp &&
+       AliasGetFileStamp(aliasFilename, &newStamp) &&
+       AliasFileStampsEqual(&newStamp, &stamp)) {
+      entry = g_malloc0(sizeof *entry);
+      entry->stamp = stamp;
+      entry->num = *num;
+      entry->aList = AliasCopyAliasList(*num, *aList);
+
+      G_LOCK(aliasCache);
+      if (gen == aliasCacheGen) {
+         g_hash_table_replace(aliasCache, g_strdup(userName), entry);
+         entry = NULL;
+      }
+      G_UNLOCK(aliasCache);
+      if (NULL != entry) {
+         AliasCacheFreeEntry(entry);
+      }
+   }
+
+   g_free(aliasFilename);
+   return err;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasMappedCacheNew --                                                */ /**
+ *
+ * Builds a parsed mapping file, indexing the entries by cert.  The same
+ * cert can be mapped for more than one user, so each key holds the list
+ * of matching entries, kept in file order.
+ *
+ * @param[in]   num             The number of entries.
+ * @param[in]   maList          The entries, now owned by the result.
+ *
+ * @return The parsed mapping file, with one reference.
+ *
+ ******************************************************************************
+ */
+
+static AliasMappedCache *
+AliasMappedCacheNew(int num,
+                    ServiceMappedAlias *maList)
+{
+   AliasMappedCache *cache = g_malloc0(sizeof *cache);
+   int i;
+
+   cache->refCount = 1;
+   cache->num = num;
+   cache->maList = maList;
+   cache->certIndex = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free,
+                                            (GDestroyNotify) g_slist_free);
+   for (i = 0; i < num; i++) {
+      gchar *key = AliasCanonicalCert(maList[i].pemCert);
+      GSList *idxList = g_hash_table_lookup(cache->certIndex, key);
+
+      if (NULL == idxList) {
+         idxList = g_slist_append(NULL, GINT_TO_POINTER(i));
+         g_hash_table_insert(cache->certIndex, key, idxList);
+      } else {
+         /* Appending to a non-empty list leaves its head unchanged. */
+         g_slist_append(idxList, GINT_TO_POINTER(i));
+         g_free(key);
+      }
+   }
+
+   return cache;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasMappedCacheGet --                                                */ /**
+ *
+ * Returns the parsed mapping file, re-reading it if it has changed.  The
+ * file is parsed without the aliasCache lock.  A save replaces the file
+ * in two renames, so if the file changed while we read it, what we read
+ * may be neither version and we read it again.  The result is swapped in
+ * for later calls only if it came from the file we stamped and no save
+ * happened meanwhile; it answers this call either way.
+ *
+ * @param[out]  cache   The parsed mapping file.  The caller should call
+ *                      AliasMappedCacheRelease() when done.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+AliasMappedCacheGet(AliasMappedCache **cache)
+{
+   gchar *mapFilename;
+   AliasFileStamp stamp;
+   AliasFileStamp newStamp;
+   AliasMappedCache *newCache;
+   AliasMappedCache *oldCache = NULL;
+   ServiceMappedAlias *maList;
+   guint64 gen;
+   gboolean haveStamp;
+   gboolean haveNewStamp;
+   gboolean stable;
+   gboolean parsed;
+   VGAuthError err;
+   int tries = 0;
+   int num;
+
+   *cache = NULL;
+
+   mapFilename = g_strdup_printf("%s"DIRSEP"%s",
+                                 aliasStoreRootDir,
+                                 ALIASSTORE_MAPFILE_NAME);
+   haveStamp = AliasGetFileStamp(mapFilename, &stamp);
+
+   G_LOCK(aliasCache);
+   if (haveStamp && NULL != mappedCache &&
+       AliasFileStampsEqual(&mappedCache->stamp, &stamp)) {
+      g_atomic_int_inc(&mappedCache->refCount);
+      *cache = mappedCache;
+      G_UNLOCK(aliasCache);
+      g_free(mapFilename);
+      return VGAUTH_E_OK;
+   }
+   gen = aliasCacheGen;
+   G_UNLOCK(aliasCache);
+
+   for (;;) {
+      err = AliasReadMapped(&num, &maList, &parsed);
+      if (VGAUTH_E_OK != err) {
+         g_free(mapFilename);
+         return err;
+      }
+
+      haveNewStamp = AliasGetFileStamp(mapFilename, &newStamp);
+      stable = haveNewStamp == haveStamp &&
+               (!haveStamp || AliasFileStampsEqual(&newStamp, &stamp));
+      if (stable || ++tries > ALIASSTORE_MAPFILE_READ_RETRIES) {
+         break;
+      }
+
+      ServiceAliasFreeMappedAliasList(num, maList);
+      haveStamp = haveNewStamp;
+      if (haveStamp) {
+         stamp = newStamp;
+      }
+   }
+
+   newCache = AliasMappedCacheNew(num, maList);
+
+   if (parsed && haveStamp && stable) {
+      newCache->stamp = stamp;
+      G_LOCK(aliasCache);
+      if (gen == aliasCacheGen) {
+         oldCache = mappedCache;
+         g_atomic_int_inc(&newCache->refCount);
+         mappedCache = newCache;
+      }
+      G_UNLOCK(aliasCache);
+      AliasMappedCacheRelease(oldCache);
+   }
+
+   *cache = newCache;
+   g_free(mapFilename);
+   return VGAUTH_E_OK;
+}
+
+
+/*
+ ******************************************************************************
+ * AliasLoadMapped --                                                    */ /**
+ *
+ * Returns the contents of the mapping file, from the cache when the file
+ * hasn't changed since it was last parsed.
+ *
+ * @param[out]  num             The number of entries read.
+ * @param[out]  maList          The ServiceMappedAliases read.  The caller
+ *                              should call ServiceAliasFreeMappedAliasList()
+ *                              when done.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+AliasLoadMapped(int *num,
+                ServiceMappedAlias **maList)
+{
+   AliasMappedCache *cache;
+   VGAuthError err;
+   int i;
+
+   ASSERT(num);
+   ASSERT(maList);
+
+   *num = 0;
+   *maList = NULL;
+
+   err = AliasMappedCacheGet(&cache);
+   if (VGAUTH_E_OK == err && cache->num > 0) {
+      *num = cache->num;
+      *maList = g_malloc0(sizeof(ServiceMappedAlias) * cache->num);
+      for (i = 0; i < cache->num; i++) {
+         AliasCopyMappedAlias(&(cache->maList[i]), &((*maList)[i]));
+      }
+   }
+   AliasMappedCacheRelease(cache);
+
+   return err;
+}
+
+
 /*
  ******************************************************************************
  * AliasSafeRenameFiles --                                               */ /**
@@ -2346,6 +2979,12 @@ cleanup:
    }
 
 done:
+   /*
+    * Whatever happened, the files on disk may no longer match what
+    * we have cached.
+    */
+   AliasCacheInvalidate(userName, updateMap);
+
    g_free(tmpAliasFilename);
    g_free(tmpMapFilename);
    return err;
@@ -3035,6 +3674,63 @@ ServiceAliasQueryMappedAliases(int *num,
 }
 
 
+/*
+ ******************************************************************************
+ * ServiceAliasQueryMappedAliasesForCert --                              */ /**
+ *
+ * Returns the mapping file entries for a single cert, in file order.
+ * Looked up through an index on the cached mapping file, rather than
+ * comparing the cert against every entry.
+ *
+ * @param[in]   pemCert         The cert to look up.
+ * @param[out]  num             The number of entries being returned.
+ * @param[out]  maList          The ServiceMappedAliases being returned.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+VGAuthError
+ServiceAliasQueryMappedAliasesForCert(const gchar *pemCert,
+                                      int *num,
+                                      ServiceMappedAlias **maList)
+{
+   AliasMappedCache *cache;
+   VGAuthError err;
+   gchar *key;
+   GSList *idxList;
+   GSList *l;
+   int i;
+
+   *num = 0;
+   *maList = NULL;
+
+   key = AliasCanonicalCert(pemCert);
+
+   err = AliasMappedCacheGet(&cache);
+   if (VGAUTH_E_OK != err) {
+      Warning("%s: failed to load mapped aliases\n", __FUNCTION__);
+      goto done;
+   }
+
+   idxList = g_hash_table_lookup(cache->certIndex, key);
+   if (NULL != idxList) {
+      *num = g_slist_length(idxList);
+      *maList = g_malloc0(sizeof(ServiceMappedAlias) * *num);
+      for (l = idxList, i = 0; l != NULL; l = l->next, i++) {
+         AliasCopyMappedAlias(&(cache->maList[GPOINTER_TO_INT(l->data)]),
+                              &((*maList)[i]));
+      }
+   }
+   AliasMappedCacheRelease(cache);
+
+done:
+   g_free(key);
+   return err;
+}
+
+
 /*
  ******************************************************************************
  * ServiceIDVerifyStoreContents --                                       */ /**
@@ -156,8 +156,35 @@ struct ProtoRequest {
 };
 
 
+/*
+ * State for a ValidateSamlBearerToken request handed to a worker thread.
+ * A connection has at most one request with a worker at a time, so the
+ * per-user connection limit also bounds how much work one user can queue.
+ */
+typedef struct ProtoSamlWork {
+   ServiceConnection *conn;
+   const gchar *samlToken;
+   const gchar *userName;
+
+   VGAuthError err;
+   char *userNameOut;
+   char *subjectName;
+   ServiceAliasInfo *ai;
+} ProtoSamlWork;
+
+
 static VGAuthError ServiceProtoValidateSamlBearerToken(ServiceConnection *conn,
                                                        ProtoRequest *req);
+static VGAuthError ServiceProtoStartValidateSamlBearerToken(ServiceConnection *conn,
+                                                            ProtoRequest *req);
+static VGAuthError ServiceProtoReplyValidateSamlBearerToken(ServiceConnection *conn,
+                                                            ProtoRequest *req,
+                                                            VGAuthError err,
+                                                            char *userName,
+                                                            char *subjectName,
+                                                            ServiceAliasInfo *ai);
+static void ServiceProtoFinishPendingRequest(ServiceConnection *conn,
+                                             VGAuthError err);
 
 
 /*
@@ -1161,9 +1188,12 @@ ServiceProtoReadAndProcessRequest(ServiceConnection *conn)
       }
 
       /*
-       * Reset the protocol parser.
+       * Reset the protocol parser, unless a worker thread is still
+       * using the request; ServiceProtoFinishPendingRequest() does it then.
        */
-      ServiceProtoCleanupParseState(conn);
+      if (!conn->requestPending) {
+         ServiceProtoCleanupParseState(conn);
+      }
    }
 
 abort:
@@ -1452,7 +1482,16 @@ ServiceProtoDispatchRequest(ServiceConnection *conn,
       err = ServiceProtoRevokeTicket(conn, req);
       break;
    case PROTO_REQUEST_VALIDATE_SAML_BEARER_TOKEN:
-      err = ServiceProtoValidateSamlBearerToken(conn, req);
+      /*
+       * Token validation can be slow (XML schema and signature checks),
+       * so hand it to a worker thread if there are any, rather than
+       * stalling every other client.
+       */
+      if (ServiceWorkersActive()) {
+         err = ServiceProtoStartValidateSamlBearerToken(conn, req);
+      } else {
+         err = ServiceProtoValidateSamlBearerToken(conn, req);
+      }
       break;
    default:
       /*
@@ -2075,6 +2114,44 @@ ServiceProtoRevokeTicket(ServiceConnection *conn,
 }
 
 
+/*
+ ******************************************************************************
+ * ServiceProtoFinishPendingRequest --                                   */ /**
+ *
+ * Completes a request that was handed to a worker thread, once its reply
+ * has been sent: resets the parser and starts reading from the
+ * connection again.  Any error shuts the connection down, as
+ * ServiceProtoReadAndProcessRequest() does for inline requests.
+ *
+ * @param[in]  conn                       The connection.
+ * @param[in]  err                        The result of sending the reply.
+ *
+ ******************************************************************************
+ */
+
+static void
+ServiceProtoFinishPendingRequest(ServiceConnection *conn,
+                                 VGAuthError err)
+{
+   ASSERT(conn->requestPending);
+
+   Debug("%s: completed reqType %d(%s REQ) on connection %d\n", __FUNCTION__,
+         conn->curRequest->reqType,
+         ProtoRequestTypeText(conn->curRequest->reqType), conn->connId);
+
+   conn->requestPending = FALSE;
+   ServiceProtoCleanupParseState(conn);
+
+   if (err == VGAUTH_E_OK) {
+      err = ServiceConnectionResumeIO(conn);
+   }
+
+   if (err != VGAUTH_E_OK) {
+      ServiceConnectionShutdown(conn);
+   }
+}
+
+
 /*
  ******************************************************************************
  * ServiceProtoValidateSamlBearerToken --                                */ /**
@@ -2094,13 +2171,9 @@ static VGAuthError
 ServiceProtoValidateSamlBearerToken(ServiceConnection *conn,
                                     ProtoRequest *req)
 {
-   VGAuthError err = VGAUTH_E_FAIL;
-   gchar *packet;
-   gchar *sPacket;
+   VGAuthError err;
    char *userName = NULL;
    char *subjectName = NULL;
-   char *comment = NULL;
-   char *tokenStr = NULL;
    ServiceAliasInfo *ai = NULL;
 
    /*
@@ -2111,6 +2184,141 @@ ServiceProtoValidateSamlBearerToken(ServiceConnection *conn,
                                         &userName,
                                         &subjectName,
                                         &ai);
+
+   return ServiceProtoReplyValidateSamlBearerToken(conn, req, err, userName,
+                                                   subjectName, ai);
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceProtoValidateSamlBearerTokenWork --                            */ /**
+ *
+ * Worker thread half of ValidateSamlBearerToken.  Only touches the
+ * ProtoSamlWork; the SAML and alias code do their own locking.
+ *
+ * @param[in]   data          The ProtoSamlWork.
+ *
+ ******************************************************************************
+ */
+
+static void
+ServiceProtoValidateSamlBearerTokenWork(gpointer data)
+{
+   ProtoSamlWork *work = (ProtoSamlWork *) data;
+
+   work->err = SAML_VerifyBearerTokenAndChain(work->samlToken,
+                                              work->userName,
+                                              &work->userNameOut,
+                                              &work->subjectName,
+                                              &work->ai);
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceProtoValidateSamlBearerTokenDone --                            */ /**
+ *
+ * Main loop half of ValidateSamlBearerToken.  Sends the reply and goes
+ * back to reading requests from the connection.
+ *
+ * @param[in]   data          The ProtoSamlWork.
+ *
+ ******************************************************************************
+ */
+
+static void
+ServiceProtoValidateSamlBearerTokenDone(gpointer data)
+{
+   ProtoSamlWork *work = (ProtoSamlWork *) data;
+   ServiceConnection *conn = work->conn;
+   VGAuthError err;
+
+   err = ServiceProtoReplyValidateSamlBearerToken(conn, conn->curRequest,
+                                                  work->err,
+                                                  work->userNameOut,
+                                                  work->subjectName,
+                                                  work->ai);
+   g_free(work);
+
+   ServiceProtoFinishPendingRequest(conn, err);
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceProtoStartValidateSamlBearerToken --                           */ /**
+ *
+ * Hands a ValidateSamlBearerToken request to a worker thread.  The
+ * connection is marked as having a request pending, which stops IO on it
+ * until ServiceProtoValidateSamlBearerTokenDone() sends the reply.
+ *
+ * @param[in]   conn          The ServiceConnection.
+ * @param[in]   req           The ValidateSamlToken request to process.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+ServiceProtoStartValidateSamlBearerToken(ServiceConnection *conn,
+                                         ProtoRequest *req)
+{
+   ProtoSamlWork *work;
+
+   ASSERT(!conn->requestPending);
+
+   work = g_malloc0(sizeof *work);
+   work->conn = conn;
+   work->samlToken = req->reqData.validateSamlBToken.samlToken;
+   work->userName = req->reqData.validateSamlBToken.userName;
+
+   conn->requestPending = TRUE;
+   if (!ServiceSubmitWork(ServiceProtoValidateSamlBearerTokenWork,
+                          ServiceProtoValidateSamlBearerTokenDone,
+                          work)) {
+      conn->requestPending = FALSE;
+      g_free(work);
+      return ServiceProtoValidateSamlBearerToken(conn, req);
+   }
+
+   return VGAUTH_E_OK;
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceProtoReplyValidateSamlBearerToken --                           */ /**
+ *
+ * Generates and sends the reply to a ValidateSamlBearerToken request,
+ * and frees the results of the validation.
+ *
+ * @param[in]   conn          The ServiceConnection.
+ * @param[in]   req           The ValidateSamlToken request.
+ * @param[in]   err           The result of the validation.
+ * @param[in]   userName      The user the token authenticated as.
+ * @param[in]   subjectName   The subject in the token.
+ * @param[in]   ai            The aliasInfo used to verify the token.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+ServiceProtoReplyValidateSamlBearerToken(ServiceConnection *conn,
+                                         ProtoRequest *req,
+                                         VGAuthError err,
+                                         char *userName,
+                                         char *subjectName,
+                                         ServiceAliasInfo *ai)
+{
+   gchar *packet;
+   gchar *sPacket;
+   char *comment = NULL;
+   char *tokenStr = NULL;
+
 #ifdef _WIN32
    /*
     * Only create a token in the non-info-only mode
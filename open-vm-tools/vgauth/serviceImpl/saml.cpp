@@ -23,6 +23,7 @@
  */
 
 #include <iostream>
+#include <map>
 #include <memory>
 #include <sstream>
 #include <vector>
@@ -49,30 +50,20 @@
 #include <xercesc/validators/common/Grammar.hpp>
 
 /*
- * XXX
- *
- * Optimization idea: stash a hash (SHA512) of a valid token, and bypass
- * the full assertion process when we see that token again. The expiration
- * date of the token must also be saved off (and beware the time skew issue).
- *
- * Note that there's some extra complexity here:
- *
- * 1 - AddAlias sets up a cert/user mapping
- * 2 - a SAML token is used (and cached) using this cert/user combo
- * 3 - RemoveAlias removes the combo
- * 4 - the cached token still works
- *
- * So the cache should only bypass the token validation, not the certificate
- * check in ServiceVerifyAndCheckTrustCertChainForSubject()
- *
- * Also TBD is how much this buys us in the real world.  With short
- * token lifetimes, its less interesting.  Its also possible that
- * it will have no measureable affect because the token verification
- * will be lost in the noise of the API plumbing from VC->hostd->VMX->tools.
- *
- * The security folks have signed off on this, so long as we store only
- * in memory.
- *
+ * Verified tokens are cached, keyed by a SHA-256 digest of the token text,
+ * so a bearer token presented repeatedly is only parsed, schema-validated
+ * and signature-checked once.  The cache is in memory only.
+ *
+ * A cache hit only bypasses the token validation, not the certificate
+ * check in ServiceVerifyAndCheckTrustCertChainForSubject(); otherwise
+ * a token would keep working after RemoveAlias removed the cert/user
+ * mapping it was verified against.
+ *
+ * An entry is only used while the current time is inside the range over
+ * which every NotBefore/NotOnOrAfter check the token passed (including
+ * the clock skew slop) would still pass, and never for longer than
+ * SAML_TOKEN_CACHE_MAX_TTL.  Tokens with a <OneTimeUse> condition are
+ * never cached.
  */
 
 /*
@@ -191,6 +182,40 @@ static XMLGrammarPool *pool = NULL;
 
 static int clockSkewAdjustment = VGAUTH_PREF_DEFAULT_CLOCK_SKEW_SECS;
 
+/*
+ * Upper bound on how long a verified token is remembered, for tokens that
+ * carry no time restrictions of their own.
+ */
+#define SAML_TOKEN_CACHE_MAX_TTL (10 * 60)
+
+struct SAMLCachedToken {
+   SAMLTokenData token;
+   vector<string> certs;
+};
+
+static map<string, SAMLCachedToken> tokenCache;
+static int tokenCacheSize = VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_SIZE;
+G_LOCK_DEFINE_STATIC(tokenCache);
+
+
+/**
+ * Holds the token cache lock for the lifetime of the object, so that it is
+ * released even if copying an entry throws.
+ */
+
+class SAMLTokenCacheLock : public Noncopyable {
+public:
+   SAMLTokenCacheLock()
+   {
+      G_LOCK(tokenCache);
+   }
+
+   ~SAMLTokenCacheLock()
+   {
+      G_UNLOCK(tokenCache);
+   }
+};
+
 static bool SAMLLoadSchema(XercesDOMParser &parser,
                            const SAMLGlibString &schemaDir,
                            const char *filename);
@@ -204,7 +229,7 @@ static bool SAMLCheckConditions(const DOMDocument *doc,
                                 SAMLTokenData &token);
 
 static bool SAMLCheckTimeAttr(const DOMElement *elem, const char *attrName,
-                              bool beforeNow);
+                              bool beforeNow, SAMLTokenData &token);
 
 static bool SAMLCheckAudience(const XMLCh *audience);
 
@@ -213,6 +238,12 @@ static bool SAMLCheckSignature(DOMDocument *doc,
 
 static bool SAMLCheckReference(const DOMDocument *doc, DSIGSignature *sig);
 
+static void SAMLTokenCacheFlush();
+
+static VGAuthError SAMLVerifyAssertionCached(const char *xmlText,
+                                             SAMLTokenData &token,
+                                             vector<string> &certs);
+
 static DOMElement *SAMLFindChildByName(const DOMElement *elem,
                                        const char *name);
 
@@ -251,6 +282,12 @@ SAML_Init()
       Log("%s: Allowing %d of clock skew for SAML date validation\n",
           __FUNCTION__, clockSkewAdjustment);
 
+      tokenCacheSize = Pref_GetInt(gPrefs, VGAUTH_PREF_SAML_TOKEN_CACHE_SIZE,
+                                   VGAUTH_PREF_GROUP_NAME_SERVICE,
+                                   VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_SIZE);
+      Log("%s: Caching up to %d verified SAML tokens\n",
+          __FUNCTION__, tokenCacheSize);
+
       return VGAUTH_E_OK;
    } catch (const XMLException& e) {
       SAMLStringWrapper msg(e.getMessage());
@@ -330,6 +367,13 @@ SAMLCreateAndPopulateGrammarPool()
       }
    }
 
+   /*
+    * Tokens are verified on worker threads, each with its own parser.
+    * Locking the pool makes it read-only, which is what makes sharing it
+    * between those parsers safe.
+    */
+   newPool->lockPool();
+
    return newPool;
 }
 
@@ -347,6 +391,7 @@ void
 SAML_Shutdown()
 {
    try {
+      SAMLTokenCacheFlush();
       delete pool;
       pool = NULL;
       XSECPlatformUtils::Terminate();
@@ -372,6 +417,15 @@ SAML_Reload()
 {
    ASSERT(pool != NULL);
 
+   /*
+    * Anything verified against the old schemas or settings has to be
+    * verified again.
+    */
+   SAMLTokenCacheFlush();
+   tokenCacheSize = Pref_GetInt(gPrefs, VGAUTH_PREF_SAML_TOKEN_CACHE_SIZE,
+                                VGAUTH_PREF_GROUP_NAME_SERVICE,
+                                VGAUTH_PREF_DEFAULT_SAML_TOKEN_CACHE_SIZE);
+
    auto_ptr<XMLGrammarPool> myPool = SAMLCreateAndPopulateGrammarPool();
    if (NULL == myPool.get()) {
       Warning("%s: Failed to reload SAML state. Using old settings.\n",
@@ -429,6 +483,172 @@ SAMLLoadSchema(XercesDOMParser &parser,
 }
 
 
+/*
+ ******************************************************************************
+ * SAMLTokenCacheFlush --                                                */ /**
+ *
+ * Discards every cached token.
+ *
+ ******************************************************************************
+ */
+
+static void
+SAMLTokenCacheFlush()
+{
+   SAMLTokenCacheLock lock;
+
+   tokenCache.clear();
+}
+
+
+/*
+ ******************************************************************************
+ * SAMLTokenCacheLookup --                                               */ /**
+ *
+ * Looks for a previously verified token that is still within its validity
+ * range.  Entries found to be out of range are dropped.
+ *
+ * @param[in]  digest    The digest of the token text.
+ * @param[out] token     The data extracted when the token was verified.
+ * @param[out] certs     The issuer's certificate chain.
+ *
+ * @return true if a usable entry was found, false otherwise.
+ *
+ ******************************************************************************
+ */
+
+static bool
+SAMLTokenCacheLookup(const string &digest,
+                     SAMLTokenData &token,
+                     vector<string> &certs)
+{
+   GTimeVal now;
+
+   g_get_current_time(&now);
+
+   SAMLTokenCacheLock lock;
+   map<string, SAMLCachedToken>::iterator it = tokenCache.find(digest);
+   if (it == tokenCache.end()) {
+      return false;
+   }
+
+   if (now.tv_sec < it->second.token.validFrom ||
+       now.tv_sec > it->second.token.validUntil) {
+      tokenCache.erase(it);
+      return false;
+   }
+
+   token = it->second.token;
+   certs = it->second.certs;
+
+   return true;
+}
+
+
+/*
+ ******************************************************************************
+ * SAMLTokenCacheInsert --                                               */ /**
+ *
+ * Remembers a successfully verified token.  When the cache is full, expired
+ * entries are purged first, and if that is not enough the entry closest to
+ * expiring is dropped.
+ *
+ * @param[in]  digest    The digest of the token text.
+ * @param[in]  token     The data extracted from the token.
+ * @param[in]  certs     The issuer's certificate chain.
+ *
+ ******************************************************************************
+ */
+
+static void
+SAMLTokenCacheInsert(const string &digest,
+                     const SAMLTokenData &token,
+                     const vector<string> &certs)
+{
+   if (tokenCacheSize <= 0 || token.oneTimeUse) {
+      return;
+   }
+
+   GTimeVal now;
+   SAMLCachedToken entry;
+
+   g_get_current_time(&now);
+   entry.token = token;
+   entry.certs = certs;
+   entry.token.validUntil = MIN(entry.token.validUntil,
+                                now.tv_sec + SAML_TOKEN_CACHE_MAX_TTL);
+
+   SAMLTokenCacheLock lock;
+   if ((int) tokenCache.size() >= tokenCacheSize) {
+      map<string, SAMLCachedToken>::iterator soonest = tokenCache.end();
+      map<string, SAMLCachedToken>::iterator it = tokenCache.begin();
+
+      while (it != tokenCache.end()) {
+         if (it->second.token.validUntil < now.tv_sec) {
+            tokenCache.erase(it++);
+            continue;
+         }
+         if (soonest == tokenCache.end() ||
+             it->second.token.validUntil < soonest->second.token.validUntil) {
+            soonest = it;
+         }
+         ++it;
+      }
+
+      if ((int) tokenCache.size() >= tokenCacheSize &&
+          soonest != tokenCache.end()) {
+         tokenCache.erase(soonest);
+      }
+   }
+
+   tokenCache[digest] = entry;
+}
+
+
+/*
+ ******************************************************************************
+ * SAMLVerifyAssertionCached --                                          */ /**
+ *
+ * Wrapper around SAMLVerifyAssertion() that skips the parse, schema and
+ * signature checks for a token that has already been verified and is still
+ * within its validity range.
+ *
+ * @param[in]  xmlText   The text of the SAML assertion.
+ * @param[out] token     The interesting bits extracted from the xmlText.
+ * @param[out] certs     The certificate chain for the issuer.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+static VGAuthError
+SAMLVerifyAssertionCached(const char *xmlText,
+                          SAMLTokenData &token,
+                          vector<string> &certs)
+{
+   if (tokenCacheSize <= 0) {
+      return SAMLVerifyAssertion(xmlText, token, certs);
+   }
+
+   SAMLGlibString digest(g_compute_checksum_for_string(G_CHECKSUM_SHA256,
+                                                       xmlText, -1));
+   string key(digest.c_str());
+
+   if (SAMLTokenCacheLookup(key, token, certs)) {
+      Debug("%s: Using cached verification of SAML token\n", __FUNCTION__);
+      return VGAUTH_E_OK;
+   }
+
+   VGAuthError err = SAMLVerifyAssertion(xmlText, token, certs);
+   if (VGAUTH_E_OK == err) {
+      SAMLTokenCacheInsert(key, token, certs);
+   }
+
+   return err;
+}
+
+
 /*
  ******************************************************************************
  * SAML_VerifyBearerToken --                                             */ /**
@@ -463,7 +683,7 @@ SAML_VerifyBearerToken(const char *xmlText,
       VGAuthError err;
       SAMLTokenData token;
 
-      err = SAMLVerifyAssertion(xmlText, token, certs);
+      err = SAMLVerifyAssertionCached(xmlText, token, certs);
       if (VGAUTH_E_OK != err) {
          return err;
       }
@@ -529,7 +749,7 @@ SAML_VerifyBearerTokenAndChain(const char *xmlText,
       ServiceSubject subj;
       int i;
 
-      err = SAMLVerifyAssertion(xmlText, token, certs);
+      err = SAMLVerifyAssertionCached(xmlText, token, certs);
       if (VGAUTH_E_OK != err) {
          return err;
       }
@@ -814,8 +1034,9 @@ SAMLCheckSubject(const DOMDocument *doc,
       subjConfirmData = SAMLFindChildByName(child, name);
       g_free(name);
       if (NULL != subjConfirmData) {
-         if (!SAMLCheckTimeAttr(subjConfirmData, "NotBefore", true) ||
-             !SAMLCheckTimeAttr(subjConfirmData, "NotOnOrAfter", false)) {
+         if (!SAMLCheckTimeAttr(subjConfirmData, "NotBefore", true, token) ||
+             !SAMLCheckTimeAttr(subjConfirmData, "NotOnOrAfter", false,
+                                token)) {
             Debug("%s: subjConfirmData time check failed\n", __FUNCTION__);
             continue;
          }
@@ -883,8 +1104,8 @@ SAMLCheckConditions(const DOMDocument *doc,
       return true;
    }
 
-   if (!SAMLCheckTimeAttr(conditions, "NotBefore", true) ||
-       !SAMLCheckTimeAttr(conditions, "NotOnOrAfter", false)) {
+   if (!SAMLCheckTimeAttr(conditions, "NotBefore", true, token) ||
+       !SAMLCheckTimeAttr(conditions, "NotOnOrAfter", false, token)) {
       return false;
    }
 
@@ -917,9 +1138,9 @@ SAMLCheckConditions(const DOMDocument *doc,
     */
 
    /*
-    * <OneTimeUse> element is specified to disallow caching. We don't
-    * cache, so it doesn't affect out validation.
-    * However, we need to communicate it to clients so they do not cache.
+    * <OneTimeUse> element is specified to disallow caching, so
+    * SAMLTokenCacheInsert() skips such tokens.
+    * We also need to communicate it to clients so they do not cache.
     */
    name = g_strdup_printf("%sOneTimeUse", token.ns.c_str());
    token.oneTimeUse = (SAMLFindChildByName(conditions, name)
@@ -947,6 +1168,9 @@ SAMLCheckConditions(const DOMDocument *doc,
  * @param[in]  beforeNow    Whether the condition given by the attribute
  *                          requires that the timestamp be before now (true)
  *                          or after (false).
+ * @param[in,out] token     If the check passes, the token's validity range
+ *                          is narrowed to the times at which it would
+ *                          still pass.
  *
  ******************************************************************************
  */
@@ -954,7 +1178,8 @@ SAMLCheckConditions(const DOMDocument *doc,
 static bool
 SAMLCheckTimeAttr(const DOMElement *elem,
                   const char *attrName,
-                  bool beforeNow)
+                  bool beforeNow,
+                  SAMLTokenData &token)
 {
    const XMLCh *timeAttr = elem->getAttribute(MAKE_UNICODE_STRING(attrName));
    if ((NULL == timeAttr) || (0 == *timeAttr)) {
@@ -1003,6 +1228,9 @@ SAMLCheckTimeAttr(const DOMElement *elem,
       return false;
    }
 
+   token.validFrom = MAX(token.validFrom, time.tv_sec - clockSkewAdjustment);
+   token.validUntil = MIN(token.validUntil, time.tv_sec + clockSkewAdjustment);
+
    return true;
 }
 
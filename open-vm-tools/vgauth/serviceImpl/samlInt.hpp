@@ -125,11 +125,25 @@ private:
  * Holds data extracted from a SAML token.
  */
 struct SAMLTokenData {
+   SAMLTokenData() :
+      oneTimeUse(false),
+      isSSOToken(false),
+      validFrom(G_MINLONG),
+      validUntil(G_MAXLONG)
+   {
+   }
+
    string subjectName;
    vector<string> issuerCerts;
    bool oneTimeUse;
    bool isSSOToken;           // set if token came from VMware SSO server
    string ns;
+   /*
+    * The range of seconds (inclusive) over which every time check that
+    * the token passed would still pass; used to age out cached tokens.
+    */
+   glong validFrom;
+   glong validUntil;
 };
 
 
@@ -32,6 +32,7 @@
 
 static ServiceStartListeningForIOFunc startListeningIOFunc = NULL;
 static ServiceStopListeningForIOFunc stopListeningIOFunc = NULL;
+static ServiceResumeIOFunc resumeIOFunc = NULL;
 
 static GHashTable *listenConnectionMap = NULL;
 
@@ -110,6 +111,9 @@ ServiceConnectionGetNextConnectionId(void)
  *                              listening for IO on a connection.
  * @param[in]   stopFunc        The function called when we no longer
  *                              care about IO on a connection.
+ * @param[in]   resumeFunc      The function called to start watching a
+ *                              data connection again once a request
+ *                              handed to a worker has been answered.
  *
  * @return VGAUTH_E_OK on success, VGAuthError on failure
  *
@@ -118,15 +122,41 @@ ServiceConnectionGetNextConnectionId(void)
 
 VGAuthError
 ServiceRegisterIOFunctions(ServiceStartListeningForIOFunc startFunc,
-                           ServiceStopListeningForIOFunc stopFunc)
+                           ServiceStopListeningForIOFunc stopFunc,
+                           ServiceResumeIOFunc resumeFunc)
 {
    startListeningIOFunc = startFunc;
    stopListeningIOFunc = stopFunc;
+   resumeIOFunc = resumeFunc;
 
    return VGAUTH_E_OK;
 }
 
 
+/*
+ ******************************************************************************
+ * ServiceConnectionResumeIO --                                          */ /**
+ *
+ * Starts watching for IO on a data connection again after the request
+ * it was waiting on has been answered.
+ *
+ * @param[in]   conn          The ServiceConnection.
+ *
+ * @return VGAUTH_E_OK on success, VGAuthError on failure
+ *
+ ******************************************************************************
+ */
+
+VGAuthError
+ServiceConnectionResumeIO(ServiceConnection *conn)
+{
+   ASSERT(resumeIOFunc);
+   ASSERT(!conn->requestPending);
+
+   return (* resumeIOFunc) (conn);
+}
+
+
 /*
  ******************************************************************************
  * ServiceCreatePublicConnection --                                     */ /**
@@ -401,6 +431,11 @@ ServiceConnectionShutdown(ServiceConnection *conn)
 
    ASSERT(stopListeningIOFunc);
 
+   /*
+    * A worker still owns curRequest; the connection can't go away yet.
+    */
+   ASSERT(!conn->requestPending);
+
    (* stopListeningIOFunc) (conn);
 
    ServiceNetworkCloseConnection(conn);
@@ -770,6 +805,11 @@ Service_ReloadPrefs(void)
 {
    ServiceInitTicketPrefs();
    ServiceInitListenConnectionPrefs();
+
+   /*
+    * Workers read the SAML state, so let them finish before it's replaced.
+    */
+   ServiceDrainWorkers();
    SAML_Reload();
 }
 
@@ -786,6 +826,7 @@ Service_ReloadPrefs(void)
 void
 Service_Shutdown(void)
 {
+   ServiceShutdownWorkers();
    SAML_Shutdown();
 }
 
@@ -143,6 +143,13 @@ typedef struct _ServiceConnection {
     */
    GTimeVal lastUse;
    gboolean dataConnectionIncremented;
+
+   /*
+    * Set while curRequest has been handed to a worker thread.  No IO is
+    * watched on the connection until the reply has been sent, which keeps
+    * requests on a connection in order.
+    */
+   gboolean requestPending;
 } ServiceConnection;
 
 
@@ -251,9 +258,27 @@ gboolean ServiceNetworkIsConnectionPrivateSuperUser(ServiceConnection *conn);
  */
 typedef VGAuthError (* ServiceStartListeningForIOFunc)(ServiceConnection *conn);
 typedef VGAuthError (* ServiceStopListeningForIOFunc)(ServiceConnection *conn);
+typedef VGAuthError (* ServiceResumeIOFunc)(ServiceConnection *conn);
 
 VGAuthError ServiceRegisterIOFunctions(ServiceStartListeningForIOFunc startFunc,
-                                       ServiceStopListeningForIOFunc stopFunc);
+                                       ServiceStopListeningForIOFunc stopFunc,
+                                       ServiceResumeIOFunc resumeFunc);
+
+VGAuthError ServiceConnectionResumeIO(ServiceConnection *conn);
+
+
+/*
+ * Worker thread functions
+ */
+typedef void (* ServiceWorkFunc)(gpointer data);
+
+VGAuthError ServiceInitWorkers(void);
+gboolean ServiceWorkersActive(void);
+gboolean ServiceSubmitWork(ServiceWorkFunc workFunc,
+                           ServiceWorkFunc doneFunc,
+                           gpointer data);
+void ServiceDrainWorkers(void);
+void ServiceShutdownWorkers(void);
 
 
 /*
@@ -315,6 +340,10 @@ VGAuthError ServiceAliasQueryAliases(const gchar *userName,
 VGAuthError ServiceAliasQueryMappedAliases(int *num,
                                            ServiceMappedAlias **maList);
 
+VGAuthError ServiceAliasQueryMappedAliasesForCert(const gchar *pemCert,
+                                                  int *num,
+                                                  ServiceMappedAlias **maList);
+
 void ServiceAliasFreeAliasList(int num, ServiceAlias *aList);
 
 void ServiceAliasFreeAliasInfo(ServiceAliasInfo *ai);
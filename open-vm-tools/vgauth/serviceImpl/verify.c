@@ -126,52 +126,46 @@ ServiceVerifyAndCheckTrustCertChainForSubject(int numCerts,
     * from the cert chain.
     */
    if (NULL == userName || *userName == '\0') {
-      err = ServiceAliasQueryMappedAliases(&numMapped, &maList);
-
-      if (VGAUTH_E_OK != err) {
-         goto done;
-      }
-      if (0 == numMapped) {
-         /*
-          * No username, no mapped certs, no chance.
-          */
-         Debug("%s: no mapping entries or userName\n", __FUNCTION__);
-         err = VGAUTH_E_AUTHENTICATION_DENIED;
-         goto done;
-      }
-
       /*
-       * Search for a match in the mapped store.
+       * Search for a match in the mapped store.  Each cert in the chain
+       * is looked up on its own, through the mapping file's cert index.
        */
       for (i = 0; i < numCerts; i++) {
+         ServiceAliasFreeMappedAliasList(numMapped, maList);
+         numMapped = 0;
+         maList = NULL;
+
+         err = ServiceAliasQueryMappedAliasesForCert(pemCertChain[i],
+                                                     &numMapped, &maList);
+         if (VGAUTH_E_OK != err) {
+            goto done;
+         }
+
          for (j = 0; j < numMapped; j++) {
-            if (ServiceComparePEMCerts(pemCertChain[i], maList[j].pemCert)) {
-               /*
-                * Make sure we don't have multiple matches with different users.
-                * Two possible scenarios that can trigger this:
-                * - the mapping file could be inconsistent
-                * - the chain coming in could have more than one cert that
-                *   exists in the mapping file, belonging to different users
-                */
-               if ((NULL != queryUserName) &&
-                   g_strcmp0(queryUserName, maList[j].userName) != 0) {
-                  Warning("%s: found more than one user in map file chain\n",
-                          __FUNCTION__);
-                  err = VGAUTH_E_MULTIPLE_MAPPINGS;
-                  goto done;
-               }
+            /*
+             * Make sure we don't have multiple matches with different users.
+             * Two possible scenarios that can trigger this:
+             * - the mapping file could be inconsistent
+             * - the chain coming in could have more than one cert that
+             *   exists in the mapping file, belonging to different users
+             */
+            if ((NULL != queryUserName) &&
+                g_strcmp0(queryUserName, maList[j].userName) != 0) {
+               Warning("%s: found more than one user in map file chain\n",
+                       __FUNCTION__);
+               err = VGAUTH_E_MULTIPLE_MAPPINGS;
+               goto done;
+            }
 
-               for (k = 0; k < maList[j].num; k++) {
-                  if ((maList[j].subjects[k].type == SUBJECT_TYPE_ANY) ||
-                      ServiceAliasIsSubjectEqual(subj->type,
-                                                 maList[j].subjects[k].type,
-                                                 subj->name,
-                                                 maList[j].subjects[k].name)) {
-                     queryUserName = g_strdup(maList[j].userName);
-                     break;
-                  }
+            for (k = 0; k < maList[j].num; k++) {
+               if ((maList[j].subjects[k].type == SUBJECT_TYPE_ANY) ||
+                   ServiceAliasIsSubjectEqual(subj->type,
+                                              maList[j].subjects[k].type,
+                                              subj->name,
+                                              maList[j].subjects[k].name)) {
+                  queryUserName = g_strdup(maList[j].userName);
+                  break;
                }
-
             }
          }
       }
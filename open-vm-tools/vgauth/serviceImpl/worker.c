@@ -0,0 +1,312 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/**
+ * @file worker.c --
+ *
+ *    Worker threads for requests that are too expensive to run on the
+ *    main loop.
+ *
+ *    A work item runs its work function on a pool thread, and then its
+ *    done function back on the main loop, where all the connection and
+ *    protocol state lives.  The work function must only touch the data
+ *    it was handed and code that does its own locking.
+ */
+
+#include "VGAuthLog.h"
+#include "serviceInt.h"
+
+typedef struct ServiceWork {
+   ServiceWorkFunc workFunc;
+   ServiceWorkFunc doneFunc;
+   gpointer data;
+   guint idleId;
+} ServiceWork;
+
+static GThreadPool *workerPool = NULL;
+
+/*
+ * Number of work items pushed to the pool whose work function hasn't
+ * returned yet, so ServiceDrainWorkers() can wait for them.
+ */
+static GMutex *workLock = NULL;
+static GCond *workIdle = NULL;
+static int workInFlight = 0;
+
+/*
+ * Work items whose done function is queued on the main loop but hasn't
+ * run yet, so ServiceShutdownWorkers() can run them itself.  Protected
+ * by workLock.
+ */
+static GSList *workDone = NULL;
+
+
+/*
+ ******************************************************************************
+ * ServiceWorkDone --                                                    */ /**
+ *
+ * Main loop callback that runs the done function of a finished work item.
+ *
+ * @param[in]  userData    The ServiceWork.
+ *
+ * @return FALSE, so the idle source is removed.
+ *
+ ******************************************************************************
+ */
+
+static gboolean
+ServiceWorkDone(gpointer userData)
+{
+   ServiceWork *work = (ServiceWork *) userData;
+
+   g_mutex_lock(workLock);
+   workDone = g_slist_remove(workDone, work);
+   g_mutex_unlock(workLock);
+
+   work->doneFunc(work->data);
+   g_free(work);
+
+   return FALSE;
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceWorkRun --                                                     */ /**
+ *
+ * Thread pool entry point.  Runs the work function, then queues the done
+ * function on the main loop.
+ *
+ * @param[in]  userData    The ServiceWork.
+ * @param[in]  poolData    Unused.
+ *
+ ******************************************************************************
+ */
+
+static void
+ServiceWorkRun(gpointer userData,
+               gpointer poolData)
+{
+   ServiceWork *work = (ServiceWork *) userData;
+
+   work->workFunc(work->data);
+
+   g_mutex_lock(workLock);
+   workDone = g_slist_prepend(workDone, work);
+   work->idleId = g_idle_add(ServiceWorkDone, work);
+   if (--workInFlight == 0) {
+      g_cond_broadcast(workIdle);
+   }
+   g_mutex_unlock(workLock);
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceInitWorkers --                                                 */ /**
+ *
+ * Creates the worker thread pool.  If the pool is disabled in the prefs
+ * or can't be created, every request is handled on the main loop, as
+ * before.
+ *
+ * @return VGAUTH_E_OK
+ *
+ ******************************************************************************
+ */
+
+VGAuthError
+ServiceInitWorkers(void)
+{
+   GError *gErr = NULL;
+   int maxThreads;
+
+   maxThreads = Pref_GetInt(gPrefs,
+                            VGAUTH_PREF_NAME_MAX_WORKER_THREADS,
+                            VGAUTH_PREF_GROUP_NAME_SERVICE,
+                            VGAUTH_PREF_DEFAULT_MAX_WORKER_THREADS);
+   if (maxThreads <= 0) {
+      Log("%s: worker threads disabled; handling all requests inline\n",
+          __FUNCTION__);
+      return VGAUTH_E_OK;
+   }
+
+   if (!g_thread_supported()) {
+      Warning("%s: threads not initialized; handling all requests inline\n",
+              __FUNCTION__);
+      return VGAUTH_E_OK;
+   }
+
+   workLock = g_mutex_new();
+   workIdle = g_cond_new();
+
+   workerPool = g_thread_pool_new(ServiceWorkRun, NULL, maxThreads, FALSE,
+                                  &gErr);
+   if (NULL == workerPool) {
+      Warning("%s: failed to create worker pool (%s); handling all requests "
+              "inline\n", __FUNCTION__, gErr ? gErr->message : "unknown");
+      g_clear_error(&gErr);
+      return VGAUTH_E_OK;
+   }
+
+   Log("%s: using up to %d worker threads\n", __FUNCTION__, maxThreads);
+
+   return VGAUTH_E_OK;
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceWorkersActive --                                               */ /**
+ *
+ * @return TRUE if work can be handed off to the worker pool.
+ *
+ ******************************************************************************
+ */
+
+gboolean
+ServiceWorkersActive(void)
+{
+   return workerPool != NULL;
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceSubmitWork --                                                  */ /**
+ *
+ * Queues a work item.  @a workFunc is run on a pool thread, then
+ * @a doneFunc is run on the main loop.
+ *
+ * @param[in]  workFunc    The function doing the expensive part.
+ * @param[in]  doneFunc    The function that completes the work.
+ * @param[in]  data        Passed to both functions.
+ *
+ * @return TRUE if the work was queued.  On FALSE, neither function has
+ *         been called and the caller should do the work itself.
+ *
+ ******************************************************************************
+ */
+
+gboolean
+ServiceSubmitWork(ServiceWorkFunc workFunc,
+                  ServiceWorkFunc doneFunc,
+                  gpointer data)
+{
+   ServiceWork *work;
+   GError *gErr = NULL;
+
+   if (NULL == workerPool) {
+      return FALSE;
+   }
+
+   work = g_malloc0(sizeof *work);
+   work->workFunc = workFunc;
+   work->doneFunc = doneFunc;
+   work->data = data;
+
+   g_mutex_lock(workLock);
+   workInFlight++;
+   g_mutex_unlock(workLock);
+
+   g_thread_pool_push(workerPool, work, &gErr);
+   if (NULL != gErr) {
+      Warning("%s: failed to queue work: %s\n", __FUNCTION__, gErr->message);
+      g_clear_error(&gErr);
+
+      g_mutex_lock(workLock);
+      if (--workInFlight == 0) {
+         g_cond_broadcast(workIdle);
+      }
+      g_mutex_unlock(workLock);
+
+      g_free(work);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceDrainWorkers --                                                */ /**
+ *
+ * Waits until no work function is queued or running.  Used before
+ * replacing state the work functions read, such as the SAML schemas.
+ * Done functions that are already queued on the main loop still run
+ * afterwards.
+ *
+ ******************************************************************************
+ */
+
+void
+ServiceDrainWorkers(void)
+{
+   if (NULL == workerPool) {
+      return;
+   }
+
+   g_mutex_lock(workLock);
+   while (workInFlight > 0) {
+      g_cond_wait(workIdle, workLock);
+   }
+   g_mutex_unlock(workLock);
+}
+
+
+/*
+ ******************************************************************************
+ * ServiceShutdownWorkers --                                             */ /**
+ *
+ * Stops the worker pool.  Queued and running work functions are allowed
+ * to finish, and since the main loop won't run again, the done functions
+ * still waiting for it are run here, so every client gets its reply and
+ * every work item is freed.
+ *
+ ******************************************************************************
+ */
+
+void
+ServiceShutdownWorkers(void)
+{
+   GSList *pending;
+   GSList *l;
+
+   if (NULL == workerPool) {
+      return;
+   }
+
+   g_thread_pool_free(workerPool, FALSE, TRUE);
+   workerPool = NULL;
+
+   g_mutex_lock(workLock);
+   pending = g_slist_reverse(workDone);
+   workDone = NULL;
+   for (l = pending; l != NULL; l = l->next) {
+      g_source_remove(((ServiceWork *) l->data)->idleId);
+   }
+   g_mutex_unlock(workLock);
+
+   for (l = pending; l != NULL; l = l->next) {
+      ServiceWork *work = (ServiceWork *) l->data;
+
+      work->doneFunc(work->data);
+      g_free(work);
+   }
+   g_slist_free(pending);
+}
@@ -722,7 +722,7 @@ VMBlockRelease(const char *path,                   // IN: Must be control file.
  */
 
 void *
-VMBlockInit(void)
+VMBlockInit(struct fuse_conn_info *conn)    // IN: Not used.
 {
    BlockInit();
    return NULL;
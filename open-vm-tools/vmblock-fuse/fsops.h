@@ -32,12 +32,13 @@
 
 /*
  * FUSE_USE_VERSION sets the version of the FUSE API that will be exported.
- * Version 25 is the newest version supported by the libfuse in our toolchain
- * as of 2008-07.
+ * Version 26 is the first one with the low-level session API used by
+ * fsopsLowLevel.c.
  */
 
-#define FUSE_USE_VERSION 25
+#define FUSE_USE_VERSION 26
 #include <fuse.h>
+#include <fuse_lowlevel.h>
 
 #include "vmblock.h"
 #include "vm_assert.h"
@@ -59,9 +60,12 @@ int VMBlockReadDir(const char *path, void *buf, fuse_fill_dir_t filler,
 int VMBlockOpen(const char *path, struct fuse_file_info *fileInfo);
 int VMBlockWrite(const char *path, const char *buf, size_t size, off_t offset,
                  struct fuse_file_info *fileInfo);
+int VMBlockRead(const char *path, char *buf, size_t size, off_t offset,
+                struct fuse_file_info *fileInfo);
 int VMBlockRelease(const char *path, struct fuse_file_info *fileInfo);
 
 extern struct fuse_operations vmblockOperations;
+extern struct fuse_lowlevel_ops vmblockLowLevelOperations;
 
 /*
  * Internal functions
@@ -0,0 +1,845 @@
+/*********************************************************
+ * Copyright (C) 2016 VMware, Inc. All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation version 2.1 and no later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the Lesser GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA.
+ *
+ *********************************************************/
+
+/*
+ * fsopsLowLevel.c --
+ *
+ *      Vmblock fuse filesystem operations on top of the low-level (inode
+ *      based) fuse API.
+ *
+ *      The path based operations in fsops.c make the kernel come back to us
+ *      for every stat and rebuild full paths on every call. Here every entry
+ *      of the redirect directory gets an inode for as long as the kernel
+ *      remembers it, and lookups and attributes are handed out with timeouts
+ *      so that repeated stats of the same entries (e.g. a file manager
+ *      browsing the DnD staging area) are answered from the kernel caches.
+ *
+ *      readlink() is never cached by the kernel, so blocking semantics are
+ *      unchanged: every resolution of a redirect directory entry still goes
+ *      through VMBlockReadLink() and waits on any block.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "fsops.h"
+#include "block.h"
+#include "vm_basic_types.h"
+#include "vm_basic_defs.h"
+#include "vm_assert.h"
+
+/*
+ * How long the kernel may cache names and attributes. Targets appear and
+ * disappear as DnD operations come and go, so keep this short; negative
+ * lookups are never cached.
+ */
+
+#define VMBLOCK_ENTRY_TIMEOUT   1.0
+#define VMBLOCK_ATTR_TIMEOUT    1.0
+
+/* Fixed inodes. Inodes for redirect directory entries are VMBlockInode *. */
+
+#define VMBLOCK_ROOT_INO        FUSE_ROOT_ID
+#define VMBLOCK_CONTROL_INO     2
+#define VMBLOCK_REDIRECT_INO    3
+
+typedef struct VMBlockInode {
+   uint64 nlookup;           // Kernel references, protected by inodeLock.
+   uint64 generation;
+   char name[1];             // Name within the redirect directory.
+} VMBlockInode;
+
+typedef struct VMBlockDirHandle {
+   DIR *dir;
+} VMBlockDirHandle;
+
+static pthread_mutex_t inodeLock = PTHREAD_MUTEX_INITIALIZER;
+static GHashTable *inodesByName;
+static uint64 nextGeneration = 1;
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * InodeGet --
+ *
+ *      Looks up the inode for a redirect directory entry, creating it if the
+ *      kernel does not know about it yet, and takes one lookup reference.
+ *
+ * Results:
+ *      The inode.
+ *
+ * Side effects:
+ *      May allocate memory.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static VMBlockInode *
+InodeGet(const char *name)    // IN: Name within the redirect directory.
+{
+   VMBlockInode *inode;
+
+   pthread_mutex_lock(&inodeLock);
+
+   inode = g_hash_table_lookup(inodesByName, name);
+   if (inode == NULL) {
+      size_t len = strlen(name);
+
+      inode = g_malloc(sizeof *inode + len);
+      inode->nlookup = 0;
+      inode->generation = nextGeneration++;
+      memcpy(inode->name, name, len + 1);
+      g_hash_table_insert(inodesByName, inode->name, inode);
+   }
+   inode->nlookup++;
+
+   pthread_mutex_unlock(&inodeLock);
+
+   return inode;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * InodePut --
+ *
+ *      Drops lookup references on an inode, freeing it when the kernel has
+ *      forgotten about it.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      May free the inode.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+InodePut(VMBlockInode *inode,    // IN
+         uint64 nlookup)         // IN: References to drop.
+{
+   pthread_mutex_lock(&inodeLock);
+
+   ASSERT(inode->nlookup >= nlookup);
+   inode->nlookup -= nlookup;
+   if (inode->nlookup == 0) {
+      g_hash_table_remove(inodesByName, inode->name);
+      g_free(inode);
+   }
+
+   pthread_mutex_unlock(&inodeLock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * InodeToPath --
+ *
+ *      Builds the path (relative to the mount point, as used by the high
+ *      level operations) of a redirect directory inode.
+ *
+ * Results:
+ *      0 on success, -ENAMETOOLONG if it doesn't fit.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+InodeToPath(fuse_ino_t ino,     // IN
+            char *path,         // OUT
+            size_t pathSize)    // IN
+{
+   VMBlockInode *inode = (VMBlockInode *)(uintptr_t)ino;
+   int len;
+
+   /*
+    * The kernel holds a lookup reference on any inode it passes us, so the
+    * name cannot go away underneath us.
+    */
+
+   len = snprintf(path, pathSize, "%s/%s", REDIRECT_DIR, inode->name);
+   return len < 0 || len >= pathSize ? -ENAMETOOLONG : 0;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * GetFixedAttr --
+ *
+ *      Fills in the attributes of one of the fixed inodes.
+ *
+ * Results:
+ *      TRUE if ino is a fixed inode, FALSE otherwise.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Bool
+GetFixedAttr(fuse_ino_t ino,          // IN
+             struct stat *statBuf)    // OUT
+{
+   const char *path;
+
+   switch (ino) {
+   case VMBLOCK_ROOT_INO:
+      path = "/";
+      break;
+   case VMBLOCK_CONTROL_INO:
+      path = CONTROL_FILE;
+      break;
+   case VMBLOCK_REDIRECT_INO:
+      path = REDIRECT_DIR;
+      break;
+   default:
+      return FALSE;
+   }
+
+   VMBlockGetAttr(path, statBuf);
+   statBuf->st_ino = ino;
+   return TRUE;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMBlockLLLookup --
+ *
+ *      Looks up a name in a directory and hands the kernel a cacheable entry.
+ *
+ * Results:
+ *      Replies with the entry, or an error.
+ *
+ * Side effects:
+ *      Takes a lookup reference on redirect directory inodes.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMBlockLLLookup(fuse_req_t req,       // IN
+                fuse_ino_t parent,    // IN
+                const char *name)     // IN
+{
+   struct fuse_entry_param entry;
+   char path[PATH_MAX + 1];
+   int status;
+
+   LOG(4, "%s: parent: %lu, name: %s\n", __func__, (unsigned long)parent, name);
+
+   memset(&entry, 0, sizeof entry);
+   entry.attr_timeout = VMBLOCK_ATTR_TIMEOUT;
+   entry.entry_timeout = VMBLOCK_ENTRY_TIMEOUT;
+
+   if (parent == VMBLOCK_ROOT_INO) {
+      if (strcmp(name, VMBLOCK_DEVICE_NAME) == 0) {
+         entry.ino = VMBLOCK_CONTROL_INO;
+      } else if (strcmp(name, REDIRECT_DIR_NAME) == 0) {
+         entry.ino = VMBLOCK_REDIRECT_INO;
+      } else {
+         fuse_reply_err(req, ENOENT);
+         return;
+      }
+      GetFixedAttr(entry.ino, &entry.attr);
+      fuse_reply_entry(req, &entry);
+      return;
+   }
+
+   if (parent != VMBLOCK_REDIRECT_INO) {
+      fuse_reply_err(req, parent == VMBLOCK_CONTROL_INO ? ENOTDIR : ENOENT);
+      return;
+   }
+
+   if (snprintf(path, sizeof path, "%s/%s", REDIRECT_DIR, name) >=
+       sizeof path) {
+      fuse_reply_err(req, ENAMETOOLONG);
+      return;
+   }
+
+   status = VMBlockGetAttr(path, &entry.attr);
+   if (status != 0) {
+      fuse_reply_err(req, -status);
+      return;
+   }
+
+   {
+      VMBlockInode *inode = InodeGet(name);
+
+      entry.ino = (uintptr_t)inode;
+      entry.generation = inode->generation;
+      entry.attr.st_ino = entry.ino;
+      if (fuse_reply_entry(req, &entry) != 0) {
+         /* The kernel never saw the reference. */
+         InodePut(inode, 1);
+      }
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMBlockLLForget --
+ *
+ *      The kernel dropped references to an inode.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      May free the inode.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMBlockLLForget(fuse_req_t req,          // IN
+                fuse_ino_t ino,          // IN
+                unsigned long nlookup)   // IN
+{
+   if (ino > VMBLOCK_REDIRECT_INO) {
+      InodePut((VMBlockInode *)(uintptr_t)ino, nlookup);
+   }
+   fuse_reply_none(req);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMBlockLLGetAttr --
+ *
+ *      Gets the attributes of an inode. See VMBlockGetAttr.
+ *
+ * Results:
+ *      Replies with the attributes, or an error.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMBlockLLGetAttr(fuse_req_t req,                // IN
+                 fuse_ino_t ino,                // IN
+                 struct fuse_file_info *fi)     // IN: Ignored.
+{
+   struct stat statBuf;
+   char path[PATH_MAX + 1];
+   int status;
+
+   if (!GetFixedAttr(ino, &statBuf)) {
+      status = InodeToPath(ino, path, sizeof path);
+      if (status == 0) {
+         status = VMBlockGetAttr(path, &statBuf);
+      }
+      if (status != 0) {
+         fuse_reply_err(req, -status);
+         return;
+      }
+      statBuf.st_ino = ino;
+   }
+
+   fuse_reply_attr(req, &statBuf, VMBLOCK_ATTR_TIMEOUT);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMBlockLLReadLink --
+ *
+ *      Resolves a redirect directory entry, blocking while it is blocked.
+ *      See VMBlockReadLink.
+ *
+ * Results:
+ *      Replies with the link target, or an error.
+ *
+ * Side effects:
+ *      May block.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMBlockLLReadLink(fuse_req_t req,     // IN
+                  fuse_ino_t ino)     // IN
+{
+   char path[PATH_MAX + 1];
+   char target[PATH_MAX + 1];
+   int status;
+
+   if (ino <= VMBLOCK_REDIRECT_INO) {
+      fuse_reply_err(req, EINVAL);
+      return;
+   }
+
+   status = InodeToPath(ino, path, sizeof path);
+   if (status == 0) {
+      status = VMBlockReadLink(path, target, sizeof target);
+   }
+   if (status != 0) {
+      fuse_reply_err(req, -status);
+      return;
+   }
+
+   fuse_reply_readlink(req, target);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMBlockLLOpenDir --
+ *
+ *      Opens one of our directories. The redirect directory keeps the target
+ *      directory open for the life of the handle so that reading it does not
+ *      have to reopen and rescan it for every chunk.
+ *
+ * Results:
+ *      Replies with the handle, or an error.
+ *
+ * Side effects:
+ *      May allocate a VMBlockDirHandle.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMBlockLLOpenDir(fuse_req_t req,               // IN
+                 fuse_ino_t ino,               // IN
+                 struct fuse_file_info *fi)    // IN/OUT
+{
+   VMBlockDirHandle *handle;
+
+   if (ino == VMBLOCK_ROOT_INO) {
+      fi->fh = 0;
+      fuse_reply_open(req, fi);
+      return;
+   } else if (ino != VMBLOCK_REDIRECT_INO) {
+      fuse_reply_err(req, ENOTDIR);
+      return;
+   }
+
+   handle = malloc(sizeof *handle);
+   if (handle == NULL) {
+      fuse_reply_err(req, ENOMEM);
+      return;
+   }
+
+   handle->dir = opendir(TARGET_DIR);
+   if (handle->dir == NULL) {
+      int error = errno;
+
+      free(handle);
+      fuse_reply_err(req, error);
+      return;
+   }
+
+   fi->fh = (uintptr_t)handle;
+   if (fuse_reply_open(req, fi) != 0) {
+      closedir(handle->dir);
+      free(handle);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMBlockLLReadDir --
+ *
+ *      Reads a chunk of directory entries starting at offset. Offsets of the
+ *      redirect directory are the target directory's telldir() cookies.
+ *
+ * Results:
+ *      Replies with the entries, or an error.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMBlockLLReadDir(fuse_req_t req,               // IN
+                 fuse_ino_t ino,               // IN
+                 size_t size,                  // IN
+                 off_t offset,                 // IN
+                 struct fuse_file_info *fi)    // IN
+{
+   char *buf;
+   size_t used = 0;
+   struct stat statBuf;
+
+   buf = malloc(size);
+   if (buf == NULL) {
+      fuse_reply_err(req, ENOMEM);
+      return;
+   }
+
+   memset(&statBuf, 0, sizeof statBuf);
+
+   if (ino == VMBLOCK_ROOT_INO) {
+      static const struct {
+         const char *name;
+         fuse_ino_t ino;
+         mode_t mode;
+      } rootEntries[] = {
+         { ".",                 VMBLOCK_ROOT_INO,     S_IFDIR },
+         { "..",                VMBLOCK_ROOT_INO,     S_IFDIR },
+         { VMBLOCK_DEVICE_NAME, VMBLOCK_CONTROL_INO,  S_IFREG },
+         { REDIRECT_DIR_NAME,   VMBLOCK_REDIRECT_INO, S_IFDIR },
+      };
+      off_t i;
+
+      for (i = offset; i < ARRAYSIZE(rootEntries); i++) {
+         size_t len;
+
+         statBuf.st_ino = rootEntries[i].ino;
+         statBuf.st_mode = rootEntries[i].mode;
+         len = fuse_add_direntry(req, buf + used, size - used,
+                                 rootEntries[i].name, &statBuf, i + 1);
+         if (len > size - used) {
+            break;
+         }
+         used += len;
+      }
+   } else {
+      VMBlockDirHandle *handle = (VMBlockDirHandle *)(uintptr_t)fi->fh;
+      struct dirent *dentry;
+
+      ASSERT(ino == VMBLOCK_REDIRECT_INO);
+      ASSERT(handle != NULL);
+
+      if (offset != telldir(handle->dir)) {
+         if (offset == 0) {
+            rewinddir(handle->dir);
+         } else {
+            seekdir(handle->dir, offset);
+         }
+      }
+
+      for (;;) {
+         off_t cur = telldir(handle->dir);
+         size_t len;
+
+         errno = 0;
+         dentry = readdir(handle->dir);
+         if (dentry == NULL) {
+            if (errno != 0 && used == 0) {
+               int error = errno;
+
+               free(buf);
+               fuse_reply_err(req, error);
+               return;
+            }
+            break;
+         }
+
+         /*
+          * Only the type bits of the mode matter here, see ExternalReadDir.
+          */
+
+         statBuf.st_ino = dentry->d_ino;
+         statBuf.st_mode = strcmp(dentry->d_name, ".") == 0 ||
+                           strcmp(dentry->d_name, "..") == 0 ? S_IFDIR
+                                                             : S_IFLNK;
+         len = fuse_add_direntry(req, buf + used, size - used,
+                                 dentry->d_name, &statBuf,
+                                 telldir(handle->dir));
+         if (len > size - used) {
+            /* Doesn't fit; hand it out with the next chunk. */
+            seekdir(handle->dir, cur);
+            break;
+         }
+         used += len;
+      }
+   }
+
+   fuse_reply_buf(req, buf, used);
+   free(buf);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMBlockLLReleaseDir --
+ *
+ *      Closes a directory handle.
+ *
+ * Results:
+ *      Replies with success.
+ *
+ * Side effects:
+ *      Frees the VMBlockDirHandle, if any.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMBlockLLReleaseDir(fuse_req_t req,               // IN
+                    fuse_ino_t ino,               // IN
+                    struct fuse_file_info *fi)    // IN
+{
+   VMBlockDirHandle *handle = (VMBlockDirHandle *)(uintptr_t)fi->fh;
+
+   if (handle != NULL) {
+      closedir(handle->dir);
+      free(handle);
+   }
+   fuse_reply_err(req, 0);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMBlockLLOpen --
+ *
+ *      Opens the control file. See VMBlockOpen.
+ *
+ * Results:
+ *      Replies with the handle, or an error.
+ *
+ * Side effects:
+ *      See VMBlockOpen.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMBlockLLOpen(fuse_req_t req,               // IN
+              fuse_ino_t ino,               // IN
+              struct fuse_file_info *fi)    // IN/OUT
+{
+   int status;
+
+   if (ino != VMBLOCK_CONTROL_INO) {
+      fuse_reply_err(req, ino <= VMBLOCK_REDIRECT_INO ? EISDIR : ENOENT);
+      return;
+   }
+
+   status = VMBlockOpen(CONTROL_FILE, fi);
+   if (status != 0) {
+      fuse_reply_err(req, -status);
+   } else if (fuse_reply_open(req, fi) != 0) {
+      VMBlockRelease(CONTROL_FILE, fi);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMBlockLLRead --
+ *
+ *      Reads the control file. See VMBlockRead.
+ *
+ * Results:
+ *      Replies with the data, or an error.
+ *
+ * Side effects:
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMBlockLLRead(fuse_req_t req,               // IN
+              fuse_ino_t ino,               // IN
+              size_t size,                  // IN
+              off_t offset,                 // IN
+              struct fuse_file_info *fi)    // IN
+{
+   char buf[sizeof VMBLOCK_FUSE_READ_RESPONSE];
+   int status;
+
+   ASSERT(ino == VMBLOCK_CONTROL_INO);
+
+   status = VMBlockRead(CONTROL_FILE, buf, MIN(size, sizeof buf), offset, fi);
+   if (status < 0) {
+      fuse_reply_err(req, -status);
+   } else {
+      fuse_reply_buf(req, buf, status);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMBlockLLWrite --
+ *
+ *      Writes to the control file to perform a blocking operation. See
+ *      VMBlockWrite.
+ *
+ * Results:
+ *      Replies with the count written, or an error.
+ *
+ * Side effects:
+ *      Adds or removes blocks.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMBlockLLWrite(fuse_req_t req,               // IN
+               fuse_ino_t ino,               // IN
+               const char *buf,              // IN
+               size_t size,                  // IN
+               off_t offset,                 // IN
+               struct fuse_file_info *fi)    // IN
+{
+   int status;
+
+   ASSERT(ino == VMBLOCK_CONTROL_INO);
+
+   status = VMBlockWrite(CONTROL_FILE, buf, size, offset, fi);
+   if (status < 0) {
+      fuse_reply_err(req, -status);
+   } else {
+      fuse_reply_write(req, status);
+   }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMBlockLLRelease --
+ *
+ *      Releases the control file. See VMBlockRelease.
+ *
+ * Results:
+ *      Replies with success.
+ *
+ * Side effects:
+ *      Removes any blocks created via this file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMBlockLLRelease(fuse_req_t req,               // IN
+                 fuse_ino_t ino,               // IN
+                 struct fuse_file_info *fi)    // IN/OUT
+{
+   ASSERT(ino == VMBLOCK_CONTROL_INO);
+
+   VMBlockRelease(CONTROL_FILE, fi);
+   fuse_reply_err(req, 0);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMBlockLLInit --
+ *
+ *      Initializes the filesystem.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Calls BlockInit and sets up the inode cache.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMBlockLLInit(void *userData,                 // IN: Not used.
+              struct fuse_conn_info *conn)    // IN: Not used.
+{
+   inodesByName = g_hash_table_new(g_str_hash, g_str_equal);
+   BlockInit();
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMBlockLLDestroy --
+ *
+ *      Cleans up after the filesystem.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Frees any inodes the kernel did not forget and calls BlockCleanup.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+VMBlockLLDestroy(void *userData)    // IN: Not used.
+{
+   GHashTableIter iter;
+   gpointer inode;
+
+   g_hash_table_iter_init(&iter, inodesByName);
+   while (g_hash_table_iter_next(&iter, NULL, &inode)) {
+      g_hash_table_iter_remove(&iter);
+      g_free(inode);
+   }
+   g_hash_table_destroy(inodesByName);
+   inodesByName = NULL;
+
+   BlockCleanup();
+}
+
+
+struct fuse_lowlevel_ops vmblockLowLevelOperations = {
+   .init       = VMBlockLLInit,
+   .destroy    = VMBlockLLDestroy,
+   .lookup     = VMBlockLLLookup,
+   .forget     = VMBlockLLForget,
+   .getattr    = VMBlockLLGetAttr,
+   .readlink   = VMBlockLLReadLink,
+   .opendir    = VMBlockLLOpenDir,
+   .readdir    = VMBlockLLReadDir,
+   .releasedir = VMBlockLLReleaseDir,
+   .open       = VMBlockLLOpen,
+   .read       = VMBlockLLRead,
+   .write      = VMBlockLLWrite,
+   .release    = VMBlockLLRelease,
+};
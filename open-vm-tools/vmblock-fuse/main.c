@@ -24,18 +24,89 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "fsops.h"
 
 int LOGLEVEL_THRESHOLD = 0;
 
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VMBlockMainLowLevel --
+ *
+ *      Mounts the file system and serves it with the low-level operations
+ *      (see fsopsLowLevel.c). Takes the same command line as fuse_main():
+ *      the session is multithreaded unless -s is given and daemonizes unless
+ *      -f or -d is given.
+ *
+ * Results:
+ *      Returns 0 on success and nonzero on failure.
+ *
+ * Side effects:
+ *      None/all.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+VMBlockMainLowLevel(int argc,           // IN
+                    char *argv[])       // IN
+{
+   struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+   struct fuse_session *session;
+   struct fuse_chan *chan;
+   char *mountPoint = NULL;
+   int multithreaded;
+   int foreground;
+   int ret = -1;
+
+   if (fuse_parse_cmdline(&args, &mountPoint, &multithreaded,
+                          &foreground) == -1) {
+      goto out;
+   }
+   if (mountPoint == NULL) {
+      fprintf(stderr, "%s: missing mount point\n", argv[0]);
+      goto out;
+   }
+
+   chan = fuse_mount(mountPoint, &args);
+   if (chan == NULL) {
+      goto out;
+   }
+
+   session = fuse_lowlevel_new(&args, &vmblockLowLevelOperations,
+                               sizeof vmblockLowLevelOperations, NULL);
+   if (session != NULL) {
+      if (fuse_set_signal_handlers(session) != -1) {
+         fuse_session_add_chan(session, chan);
+         if (fuse_daemonize(foreground) != -1) {
+            ret = multithreaded ? fuse_session_loop_mt(session)
+                                : fuse_session_loop(session);
+         }
+         fuse_remove_signal_handlers(session);
+         fuse_session_remove_chan(chan);
+      }
+      fuse_session_destroy(session);
+   }
+   fuse_unmount(mountPoint, chan);
+
+out:
+   free(mountPoint);
+   fuse_opt_free_args(&args);
+   return ret == 0 ? 0 : 1;
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
  * main --
  *
- *      Entry point for the vmblock-fuse file system. Calls fuse_main(). See
+ *      Entry point for the vmblock-fuse file system. By default serves the
+ *      file system through the low-level fuse API; --high-level selects the
+ *      original path based implementation via fuse_main(). See
  *      http://fuse.sourceforge.net/doxygen/fuse_8h.html#3bf31250361d44c2436d76f47f2400ed
  *      for more information.
  *
@@ -60,11 +131,23 @@ int
 main(int argc,           // IN
      char *argv[])       // IN
 {
+   Bool highLevel = FALSE;
    int i;
+
    for (i = 1; i < argc && strcmp(argv[i], "--") != 0; ++i) {
       if (strcmp(argv[i], "-d") == 0) {
          LOGLEVEL_THRESHOLD = 4;
+      } else if (strcmp(argv[i], "--high-level") == 0) {
+         /* Not a fuse option; drop it from the command line. */
+         highLevel = TRUE;
+         memmove(&argv[i], &argv[i + 1], (argc - i) * sizeof argv[0]);
+         --argc;
+         --i;
       }
    }
-   return fuse_main(argc, argv, &vmblockOperations);
+
+   if (highLevel) {
+      return fuse_main(argc, argv, &vmblockOperations, NULL);
+   }
+   return VMBlockMainLowLevel(argc, argv);
 }